@@ -13,6 +13,7 @@
 #include <vector>
 #include <stack>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <string>
 #include <sstream>
@@ -26,9 +26,10 @@ public:
 
     bool    Insert(uint index, T *item);
     T *     Lookup(uint index);
-    
-private:
+    bool    Remove(uint index);
     void    Unload();
+
+private:
     void    UnloadNode(Node<T> *&node);
 private:
     Node<T> *   m_table[Capacity];
@@ -54,6 +55,23 @@ bool LochsEmu::Hashtable<T, Capacity>::Insert( uint index, T *item )
     return true;
 }
 
+template <typename T, uint Capacity>
+bool LochsEmu::Hashtable<T, Capacity>::Remove( uint index )
+{
+    Node<T> **pptr = &m_table[index % Capacity];
+    while (*pptr) {
+        Node<T> *node = *pptr;
+        if (node->Index == index) {
+            *pptr = node->Next;
+            SAFE_DELETE(node->Item);
+            SAFE_DELETE(node);
+            return true;
+        }
+        pptr = &node->Next;
+    }
+    return false;
+}
+
 template <typename T, uint Capacity>
 void LochsEmu::Hashtable<T, Capacity>::UnloadNode( Node<T> *&node )
 {
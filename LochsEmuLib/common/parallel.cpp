@@ -88,6 +88,21 @@ MutexCSLock::~MutexCSLock()
     LeaveCriticalSection(&m_mutex.m_criticalSection);
 }
 
+ConditionVariable::ConditionVariable()
+{
+    InitializeConditionVariable(&m_cond);
+}
+
+bool ConditionVariable::Wait( MutexCS &m, DWORD ms /*= INFINITE*/ )
+{
+    return SleepConditionVariableCS(&m_cond, &m.m_criticalSection, ms) != FALSE;
+}
+
+void ConditionVariable::WakeAll()
+{
+    WakeAllConditionVariable(&m_cond);
+}
+
 MutexLock::MutexLock( Mutex &m )
     : m_mutex(m)
 {
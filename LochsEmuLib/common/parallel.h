@@ -72,6 +72,7 @@ public:
 private:
     
     friend class MutexCSLock;
+    friend class ConditionVariable;
     MutexCS(MutexCS &);
     MutexCS &operator=(const MutexCS &);
 
@@ -88,6 +89,16 @@ private:
     MutexCSLock &operator=(const MutexCSLock &);
 };
 
+class LX_API ConditionVariable {
+public:
+    ConditionVariable();
+    /* m must be held; false on timeout */
+    bool    Wait(MutexCS &m, DWORD ms = INFINITE);
+    void    WakeAll();
+private:
+    CONDITION_VARIABLE  m_cond;
+};
+
 class LX_API Semaphore {
 public:
     Semaphore();
@@ -23,6 +23,8 @@
 #include <vector>
 #include <stack>
 #include <map>
+#include <unordered_map>
+#include <deque>
 #include <set>
 #include <algorithm>
 #include <string>
@@ -0,0 +1,94 @@
+#include "stdafx.h"
+#include "blockcache.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+BlockCache::BlockCache()
+{
+    ZeroMemory(m_codePages, sizeof(m_codePages));
+}
+
+BlockCache::~BlockCache()
+{
+}
+
+void BlockCache::Insert( BasicBlock *block )
+{
+    Assert(block && block->End > block->Start);
+    B( m_blocks.Insert(block->Start, block) );
+
+    for (uint page = PAGE_NUM(block->Start); page <= PAGE_NUM(block->End - 1); page++) {
+        m_pageBlocks[page].push_back(block->Start);
+    }
+}
+
+void BlockCache::AddDecoded( u32 addr, u32 len )
+{
+    for (uint page = PAGE_NUM(addr); page <= PAGE_NUM(addr + max(len, 1u) - 1); page++) {
+        m_pageInsts[page].insert(addr);
+        SetCodePage(page, true);
+    }
+}
+
+void BlockCache::RemoveDecoded( u32 addr, u32 len )
+{
+    for (uint page = PAGE_NUM(addr); page <= PAGE_NUM(addr + max(len, 1u) - 1); page++) {
+        auto iter = m_pageInsts.find(page);
+        if (iter == m_pageInsts.end()) continue;
+        iter->second.erase(addr);
+        if (iter->second.empty()) {
+            m_pageInsts.erase(iter);
+            SetCodePage(page, false);
+        }
+    }
+}
+
+bool BlockCache::IsDirty( u32 addr, u32 size ) const
+{
+    for (uint page = PAGE_NUM(addr); page <= PAGE_NUM(addr + size - 1); page++) {
+        if (m_dirtyPages.find(page) != m_dirtyPages.end()) return true;
+    }
+    return false;
+}
+
+void BlockCache::FlushDirty( std::vector<u32> &stale )
+{
+    std::set<u32> starts;
+    for (auto page : m_dirtyPages) {
+        auto iter = m_pageBlocks.find(page);
+        if (iter == m_pageBlocks.end()) continue;
+        starts.insert(iter->second.begin(), iter->second.end());
+    }
+
+    for (auto start : starts) {
+        BasicBlock *block = m_blocks.Lookup(start);
+        Assert(block);
+        for (uint page = PAGE_NUM(block->Start); page <= PAGE_NUM(block->End - 1); page++) {
+            std::vector<u32> &blocks = m_pageBlocks[page];
+            blocks.erase(std::remove(blocks.begin(), blocks.end(), start), blocks.end());
+            if (blocks.empty()) m_pageBlocks.erase(page);
+        }
+        m_blocks.Remove(start);
+    }
+
+    // including instructions left over from blocks flushed for another page;
+    // any block still using one overlaps this page and is gone by now
+    std::set<u32> insts;
+    for (auto page : m_dirtyPages) {
+        auto iter = m_pageInsts.find(page);
+        if (iter != m_pageInsts.end()) insts.insert(iter->second.begin(), iter->second.end());
+    }
+    stale.insert(stale.end(), insts.begin(), insts.end());
+    m_dirtyPages.clear();
+}
+
+void BlockCache::SetCodePage( uint page, bool isCode )
+{
+    if (isCode) {
+        m_codePages[page >> 5] |= (1 << (page & 31));
+    } else {
+        m_codePages[page >> 5] &= ~(1 << (page & 31));
+    }
+}
+
+END_NAMESPACE_LOCHSEMU()
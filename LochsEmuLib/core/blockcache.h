@@ -0,0 +1,84 @@
+#pragma once
+
+#ifndef __CORE_BLOCKCACHE_H__
+#define __CORE_BLOCKCACHE_H__
+
+#include "lochsemu.h"
+#include "processor.h"
+#include "hashtable.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * A straight-line run of instructions ending at the first branch.
+ * Instructions are owned by the processor's decode cache; handlers
+ * are resolved once when the block is built.
+ */
+struct BasicBlock {
+    struct Entry {
+        const Instruction *         Inst;
+        Processor::InstHandler      Handler;
+    };
+
+    u32                 Start;
+    u32                 End;        // address right after the last instruction
+    Section *           Sec;
+    std::vector<Entry>  Entries;
+
+    BasicBlock(u32 start, Section *sec) : Start(start), End(start), Sec(sec) {}
+};
+
+class BlockCache {
+public:
+    static const uint   MaxBlockInsts = 64;
+
+public:
+    BlockCache();
+    virtual ~BlockCache();
+
+    BasicBlock *    Lookup          (u32 eip) { return m_blocks.Lookup(eip); }
+    void            Insert          (BasicBlock *block);
+
+    /*
+     * Pages stay code pages while the processor's decode cache holds an
+     * instruction on them, whether or not a block still uses it
+     */
+    void            AddDecoded      (u32 addr, u32 len);
+    void            RemoveDecoded   (u32 addr, u32 len);
+
+    /*
+     * Called on every guest write; pages holding cached code are marked
+     * dirty and flushed by the processor at the next instruction boundary
+     */
+    INLINE bool     IsCodePage      (u32 addr) const;
+    void            MarkDirty       (u32 addr) { m_dirtyPages.insert(PAGE_NUM(addr)); }
+    bool            HasDirty        () const { return !m_dirtyPages.empty(); }
+    bool            IsDirty         (u32 addr, u32 size) const;
+
+    /*
+     * Remove every block overlapping a dirty page; 'stale' receives the
+     * addresses of all decoded instructions lying on those pages, which
+     * the processor drops with RemoveDecoded
+     */
+    void            FlushDirty      (std::vector<u32> &stale);
+
+private:
+    void            SetCodePage     (uint page, bool isCode);
+
+private:
+    Hashtable<BasicBlock>               m_blocks;
+    std::map<uint, std::vector<u32> >   m_pageBlocks;   // page number -> block starts
+    std::map<uint, std::set<u32> >      m_pageInsts;    // page number -> decoded instructions
+    std::set<uint>                      m_dirtyPages;
+    u32                                 m_codePages[LX_PAGE_COUNT / 32];
+};
+
+INLINE bool BlockCache::IsCodePage( u32 addr ) const
+{
+    uint page = PAGE_NUM(addr);
+    return (m_codePages[page >> 5] & (1 << (page & 31))) != 0;
+}
+
+END_NAMESPACE_LOCHSEMU()
+
+#endif // __CORE_BLOCKCACHE_H__
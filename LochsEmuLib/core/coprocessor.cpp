@@ -5,6 +5,7 @@
 BEGIN_NAMESPACE_LOCHSEMU()
 
 Coprocessor::Coprocessor()
+: m_preserveContext(true), m_softFloat(false), m_soft(&m_context)
 {
     Reset();
 }
@@ -17,6 +18,10 @@ Coprocessor::~Coprocessor()
 void Coprocessor::Reset()
 {
     ZeroMemory(&m_context,     sizeof(FpuContext));
+    if (m_softFloat) {
+        m_soft.Reset();
+        return;
+    }
     u16 ctrl = 0x27f;
     __asm {
         finit
@@ -28,7 +33,9 @@ void Coprocessor::Reset()
 LochsEmu::LxResult Coprocessor::Initialize( void )
 {
     Assert(sizeof(FpuContext) == 108);
-    m_preserveContext = LxConfig.GetInt("FPU", "PreserveContext", 1) != 0;
+    m_softFloat = LxConfig.GetInt("FPU", "SoftFloat", 0) != 0;
+    // instructions without a soft implementation still need the saved image
+    m_preserveContext = m_softFloat || LxConfig.GetInt("FPU", "PreserveContext", 1) != 0;
     Reset();
     RET_SUCCESS();
 }
@@ -4,6 +4,7 @@
 #define __CORE_COPROCESSOR_H__
 
 #include "lochsemu.h"
+#include "softfpu.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -72,10 +73,18 @@ public:
     void            RestoreContext  (void);
     void            SaveContext     (void);
     FpuContext*     Context         (void) { return &m_context; }
+    /* Context() only holds the guest state between instructions if true */
+    bool            PreservesContext(void) const { return m_preserveContext; }
+
+    /* FPU/SoftFloat: handlers run on SoftFpu instead of the host x87 */
+    bool            IsSoftFloat     (void) const { return m_softFloat; }
+    SoftFpu *       Soft            (void) { return &m_soft; }
 
 private:
     FpuContext      m_context;
     bool            m_preserveContext;
+    bool            m_softFloat;
+    SoftFpu         m_soft;
 };
 
 END_NAMESPACE_LOCHSEMU()
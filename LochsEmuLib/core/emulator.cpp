@@ -7,6 +7,10 @@
 #include "pluginmgr.h"
 #include "config.h"
 #include "refproc.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "winapi.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -14,10 +18,12 @@ BEGIN_NAMESPACE_LOCHSEMU()
 Emulator::Emulator() 
 {
     m_loaded        = false;
+    m_replay        = NULL;
 }
 
 Emulator::~Emulator()
 {
+    SAFE_DELETE(m_replay);
 }
 
 LxResult Emulator::Initialize()
@@ -25,9 +31,16 @@ LxResult Emulator::Initialize()
     LxDebug("Initializing Emulator\n");
     m_loaded                = false;
 
+    InitWinAPIIndex();
     V( m_loader.Initialize(this) );
     V( m_pluginManager.Initialize() );
 
+    if (LxConfig.GetInt("Emulator", "FlatPageMap", 0) != 0) {
+        m_memory.EnablePageMap();
+    }
+
+    V( OpenReplayLog() );
+
     RET_SUCCESS();
 }
 
@@ -52,6 +65,11 @@ LxResult Emulator::LoadModule( int argc, LPSTR argv[] )
         LxFatal("LoadLibraryEx() failed\n");
     }
 
+    std::string snapshot = LxConfig.GetString("Emulator", "RestoreSnapshot", "");
+    if (!snapshot.empty()) {
+        V( RestoreSnapshot(snapshot.c_str()) );
+    }
+
     m_loaded = true;
 
     V(m_pluginManager.OnProcessPostLoad(&m_loader));
@@ -62,9 +80,51 @@ LxResult Emulator::LoadModule( int argc, LPSTR argv[] )
 void Emulator::Run()
 {
     V( m_process.Run() );
+    if (m_replay) m_replay->Close();
     m_pluginManager.OnExit();
 }
 
+LxResult Emulator::OpenReplayLog()
+{
+    std::string replayLog = LxConfig.GetString("Emulator", "ReplayLog", "");
+    std::string recordLog = LxConfig.GetString("Emulator", "RecordLog", "");
+    if (replayLog.empty() && recordLog.empty()) RET_SUCCESS();
+
+    m_replay = new ReplayLog(this);
+    if (!replayLog.empty()) {
+        LxResult lr = m_replay->OpenReplay(replayLog.c_str());
+        if (LX_FAILED(lr)) {
+            LxError("Cannot load replay log %s\n", replayLog.c_str());
+            SAFE_DELETE(m_replay);
+        }
+        return lr;
+    }
+    // sections must be reserved with write tracking from the start
+    Section::EnableWriteWatch();
+    LxResult lr = m_replay->OpenRecord(recordLog.c_str());
+    if (LX_FAILED(lr)) SAFE_DELETE(m_replay);
+    return lr;
+}
+
+LxResult Emulator::SaveSnapshot( LPCSTR lpFileName )
+{
+    Snapshot snapshot;
+    LxResult lr = snapshot.Capture(this);
+    if (LX_FAILED(lr)) return lr;
+    return snapshot.Save(lpFileName);
+}
+
+LxResult Emulator::RestoreSnapshot( LPCSTR lpFileName )
+{
+    Snapshot snapshot;
+    LxResult lr = snapshot.Load(lpFileName);
+    if (LX_FAILED(lr)) {
+        LxError("Cannot load snapshot %s\n", lpFileName);
+        return lr;
+    }
+    return snapshot.Restore(this);
+}
+
 void Emulator::Reset()
 {
     ZeroMemory(m_path, MAX_PATH);
@@ -75,6 +135,10 @@ void Emulator::Reset()
 Processor * Emulator::GetProcessorByThreadID( ThreadID id )
 {
     Thread *th = m_process.GetThreadRealID(id);
+    if (th == NULL) {
+        // a scheduler worker runs guest threads under its own host id
+        th = Scheduler::Current();
+    }
     Assert(th);
     if (th == NULL) return NULL;
     return th->CPU();
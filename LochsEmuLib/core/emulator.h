@@ -34,6 +34,7 @@ public:
     RefProcess *    RefProc() { return &m_refProcess; }
     PluginManager * Plugins() { return &m_pluginManager; }
     PeLoader *      Loader() { return &m_loader; }
+    ReplayLog *     Replay() { return m_replay; }
 
     const Memory *  Mem() const { return &m_memory; }
     const Process * Proc() const { return &m_process; }
@@ -45,6 +46,22 @@ public:
     LPCSTR          CmdLine() const { return m_cmdline; }
     bool            IsLoaded() const { return m_loaded; }
     void            Terminate();
+
+    /*
+     * Save the process between two instructions of the main thread, or
+     * restore such a file right after LoadModule so Run() continues from it.
+     * Emulator/SnapshotAt=<eip> with Emulator/SaveSnapshot=<file> saves one
+     * the first time the main thread reaches that EIP, and
+     * Emulator/RestoreSnapshot=<file> restores one on load
+     */
+    LxResult        SaveSnapshot(LPCSTR lpFileName);
+    LxResult        RestoreSnapshot(LPCSTR lpFileName);
+
+    /*
+     * Emulator/RecordLog logs what WinAPI calls return, Emulator/ReplayLog
+     * plays such a log back instead of calling the host
+     */
+    LxResult        OpenReplayLog();
 public:
     u32             InquireStackBase(void);
     u32             InquireStackLimit(void);
@@ -66,6 +83,7 @@ protected:
     char            m_cmdline[LX_CMDLINE_SIZE];
     bool            m_loaded;
     HMODULE         m_hModule;
+    ReplayLog *     m_replay;
 
 
 };
@@ -1,9 +1,15 @@
 #include "stdafx.h"
 #include "heap.h"
 #include "memory.h"
+#include "snapshot.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
+static const u32 SizeClassTable[Heap::NumSizeClasses] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+};
+
+static const u32 FreeSlot = (u32) -1;
 
 Heap::Heap( u32 base, u32 reserve, u32 commit, uint nModule )
 : Section(SectionDesc("heap", nModule), base, reserve)
@@ -12,70 +18,69 @@ Heap::Heap( u32 base, u32 reserve, u32 commit, uint nModule )
     Assert(PAGE_LOW(reserve) == 0);
     Assert(PAGE_LOW(commit) == 0);
 
-    m_map = new uint[m_pages];
-    ZeroMemory(m_map, sizeof(uint) * m_pages);
+    m_pageSlab.assign(m_pages, NULL);
+    m_freeRuns[0] = m_pages;
 }
 
 Heap::~Heap()
 {
-    SAFE_DELETE_ARRAY(m_map);
+    for (uint i = 0; i < m_pages; i++) {
+        SAFE_DELETE(m_pageSlab[i]);
+    }
 }
 
 u32 Heap::HeapAlloc( u32 size, uint flags, Processor *cpu )
 {
-    u32 actualSize = RoundUp(size);
-    if (actualSize == 0) return 0;
-    u32 pageSize = PAGE_NUM(actualSize);
-    uint startPage = FindSpace(pageSize);
-    if (startPage > m_pages) {
+    u32 addr = size <= MaxSmallSize ? AllocSmall(size) : AllocLarge(size);
+    if (addr == 0) {
         // TODO: cpu exception
         return 0;
     }
-    u32 startAddr = PAGE_ADDR(startPage) + m_base;
-    V( Commit(startAddr, actualSize, PAGE_READWRITE) ); // TODO: may change the page flag
-
-    for (uint i = startPage; i < startPage + pageSize; i++) {
-        Assert(m_map[i] == 0);
-        m_map[i] = pageSize;
+    if (flags & HEAP_ZERO_MEMORY) {
+        ZeroMemory(m_dataPtr + (addr - m_base), size);
     }
-    m_memBlockSize[startAddr] = size;
-    return startAddr;
+    return addr;
 }
 
 bool Heap::HeapFree( u32 addr, uint flags, Processor *cpu )
 {
-    // addr must be the start of a page
-    if (PAGE_LOW(addr) != 0) return false;
-
     if (!Contains(addr)) return false;
 
-    uint startPage = PAGE_NUM(addr - m_base);
-    uint size = m_map[startPage];
-    if (size == 0) return false;
-
-    for (uint i = startPage; i < size+startPage; i++) {
-        Assert(m_map[i] == size);
-        m_map[i] = 0;
-    }
-    if (LX_FAILED(Decommit(addr, PAGE_ADDR(size))))
-        return false;
-    return true;
+    Slab *slab = FindSlab(addr);
+    return slab ? FreeSmall(slab, addr) : FreeLarge(addr);
 }
 
 u32 Heap::HeapRealloc( u32 addr, u32 size, uint flags, Processor *cpu )
 {
-    if (PAGE_LOW(addr) != 0) return 0;
-    const u32 actualSize = RoundUp(size);
-
     if (!Contains(addr)) return 0;
-    if (actualSize == 0) return 0;
-    
-    u32 newAddr = HeapAlloc(actualSize, flags, cpu);
-    if (newAddr == 0) return 0;
 
-    const u32 origSize = PAGE_ADDR(m_map[PAGE_NUM(addr-m_base)]);
+    const u32 origSize = HeapSize(addr, 0, cpu);
+    if (origSize == FreeSlot) return 0;
+
+    bool inPlace = false;
+    Slab *slab = FindSlab(addr);
+    if (slab) {
+        const u32 cs = ClassSize(slab->Class);
+        if (size <= cs) {
+            slab->Sizes[(addr - slab->Base) / cs] = size;
+            inPlace = true;
+        }
+    } else if (size > MaxSmallSize) {
+        inPlace = GrowLarge(addr, origSize, size);
+    }
+
+    if (inPlace) {
+        if ((flags & HEAP_ZERO_MEMORY) && size > origSize) {
+            ZeroMemory(m_dataPtr + (addr - m_base) + origSize, size - origSize);
+        }
+        return addr;
+    }
+    if (flags & HEAP_REALLOC_IN_PLACE_ONLY) return 0;
 
-    memcpy(m_dataPtr + (newAddr - m_base), m_dataPtr + (addr - m_base), min(origSize, actualSize));
+    u32 newAddr = HeapAlloc(size, flags, cpu);
+    if (newAddr == 0) return 0;
+
+    memcpy(m_dataPtr + (newAddr - m_base), m_dataPtr + (addr - m_base), min(origSize, size));
 
     if (!HeapFree(addr, 0, cpu)) return 0;
     return newAddr;
@@ -83,11 +88,16 @@ u32 Heap::HeapRealloc( u32 addr, u32 size, uint flags, Processor *cpu )
 
 u32 Heap::HeapSize( u32 addr, uint flags, Processor *cpu )
 {
-    Assert(m_memBlockSize.find(addr) != m_memBlockSize.end());
-    return m_memBlockSize[addr];
-//     if (PAGE_LOW(addr) != 0) return 0;
-//     uint page = PAGE_NUM(addr - m_base);
-//     return m_map[page];
+    if (!Contains(addr)) return FreeSlot;
+
+    Slab *slab = FindSlab(addr);
+    if (slab) {
+        const u32 cs = ClassSize(slab->Class);
+        if ((addr - slab->Base) % cs != 0) return FreeSlot;
+        return slab->Sizes[(addr - slab->Base) / cs];
+    }
+    auto iter = m_memBlockSize.find(addr);
+    return iter == m_memBlockSize.end() ? FreeSlot : iter->second;
 }
 
 bool Heap::HeapValidate( u32 addr, uint flags, Processor *cpu )
@@ -96,21 +106,306 @@ bool Heap::HeapValidate( u32 addr, uint flags, Processor *cpu )
     return true;
 }
 
-uint Heap::FindSpace( uint nPages )
+bool Heap::HeapWalk( u32 prev, u32 *addr, u32 *size ) const
+{
+    Assert(addr && size);
+
+    uint page = (prev == 0) ? 0 : PAGE_NUM(prev - m_base);
+    while (page < m_pages) {
+        const Slab *slab = m_pageSlab[page];
+        if (slab) {
+            const u32 cs = ClassSize(slab->Class);
+            for (uint i = 0; i < slab->Sizes.size(); i++) {
+                u32 a = slab->Base + i * cs;
+                if (a > prev && slab->Sizes[i] != FreeSlot) {
+                    *addr = a;
+                    *size = slab->Sizes[i];
+                    return true;
+                }
+            }
+            page++;
+            continue;
+        }
+        auto iter = m_memBlockSize.find(m_base + PAGE_ADDR(page));
+        if (iter == m_memBlockSize.end()) {
+            page++;
+            continue;
+        }
+        if (iter->first > prev) {
+            *addr = iter->first;
+            *size = iter->second;
+            return true;
+        }
+        page += PAGE_NUM(RoundUp(iter->second));
+    }
+    return false;
+}
+
+void Heap::SaveState( SnapshotWriter &w ) const
+{
+    w.Put((u32) m_freeRuns.size());
+    for (auto &run : m_freeRuns) {
+        w.Put((u32) run.first);
+        w.Put((u32) run.second);
+    }
+    w.Put((u32) m_memBlockSize.size());
+    for (auto &block : m_memBlockSize) {
+        w.Put(block.first);
+        w.Put(block.second);
+    }
+
+    u32 nSlabs = 0;
+    for (uint i = 0; i < m_pages; i++) {
+        if (m_pageSlab[i]) nSlabs++;
+    }
+    w.Put(nSlabs);
+    for (uint i = 0; i < m_pages; i++) {
+        const Slab *slab = m_pageSlab[i];
+        if (slab == NULL) continue;
+        w.Put((u32) i);
+        w.Put((u32) slab->Class);
+        w.Put((u32) slab->Used);
+        w.PutVector(slab->FreeSlots);
+        w.PutVector(slab->Sizes);
+    }
+    // partial lists in order, so the restored heap hands out the same addresses
+    for (uint c = 0; c < NumSizeClasses; c++) {
+        w.Put((u32) m_partial[c].size());
+        for (uint i = 0; i < m_partial[c].size(); i++) {
+            w.Put((u32) PAGE_NUM(m_partial[c][i]->Base - m_base));
+        }
+    }
+}
+
+bool Heap::LoadState( SnapshotReader &r )
+{
+    for (uint i = 0; i < m_pages; i++) {
+        SAFE_DELETE(m_pageSlab[i]);
+    }
+    m_freeRuns.clear();
+    m_memBlockSize.clear();
+    for (uint c = 0; c < NumSizeClasses; c++) {
+        m_partial[c].clear();
+    }
+
+    u32 n = r.Get<u32>();
+    for (u32 i = 0; i < n && !r.Failed(); i++) {
+        u32 first = r.Get<u32>();
+        m_freeRuns[first] = r.Get<u32>();
+    }
+    n = r.Get<u32>();
+    for (u32 i = 0; i < n && !r.Failed(); i++) {
+        u32 addr = r.Get<u32>();
+        m_memBlockSize[addr] = r.Get<u32>();
+    }
+    n = r.Get<u32>();
+    for (u32 i = 0; i < n && !r.Failed(); i++) {
+        u32 page = r.Get<u32>();
+        Slab *slab = new Slab;
+        slab->Class         = r.Get<u32>();
+        slab->Used          = r.Get<u32>();
+        slab->PartialIndex  = -1;
+        r.GetVector(slab->FreeSlots);
+        r.GetVector(slab->Sizes);
+        if (page >= m_pages || m_pageSlab[page] || slab->Class >= NumSizeClasses) {
+            delete slab;
+            return false;
+        }
+        slab->Base = m_base + PAGE_ADDR(page);
+        m_pageSlab[page] = slab;
+    }
+    for (uint c = 0; c < NumSizeClasses && !r.Failed(); c++) {
+        n = r.Get<u32>();
+        for (u32 i = 0; i < n && !r.Failed(); i++) {
+            u32 page = r.Get<u32>();
+            Slab *slab = page < m_pages ? m_pageSlab[page] : NULL;
+            if (slab == NULL || slab->Class != c || slab->PartialIndex >= 0) return false;
+            AddPartial(slab);
+        }
+    }
+    return !r.Failed();
+}
+
+uint Heap::SizeClass( u32 size )
+{
+    Assert(size <= MaxSmallSize);
+    uint i = 0;
+    while (SizeClassTable[i] < size) i++;
+    return i;
+}
+
+u32 Heap::ClassSize( uint sizeClass )
+{
+    Assert(sizeClass < NumSizeClasses);
+    return SizeClassTable[sizeClass];
+}
+
+u32 Heap::AllocSmall( u32 size )
+{
+    const uint cls = SizeClass(size);
+    const u32 cs = ClassSize(cls);
+
+    if (m_partial[cls].empty()) {
+        uint page = AllocPages(1);
+        if (page > m_pages) return 0;
+
+        Slab *slab          = new Slab;
+        slab->Base          = m_base + PAGE_ADDR(page);
+        slab->Class         = cls;
+        slab->Used          = 0;
+        slab->PartialIndex  = -1;
+        const uint slots    = LX_PAGE_SIZE / cs;
+        slab->Sizes.assign(slots, FreeSlot);
+        slab->FreeSlots.reserve(slots);
+        for (uint i = slots; i > 0; i--) {
+            slab->FreeSlots.push_back((u16) (i - 1));
+        }
+        m_pageSlab[page] = slab;
+        AddPartial(slab);
+    }
+
+    Slab *slab = m_partial[cls].back();
+    u16 slot = slab->FreeSlots.back();
+    slab->FreeSlots.pop_back();
+    slab->Sizes[slot] = size;
+    slab->Used++;
+    if (slab->FreeSlots.empty()) {
+        RemovePartial(slab);
+    }
+    return slab->Base + slot * cs;
+}
+
+u32 Heap::AllocLarge( u32 size )
+{
+    uint startPage = AllocPages(PAGE_NUM(RoundUp(size)));
+    if (startPage > m_pages) return 0;
+
+    u32 startAddr = m_base + PAGE_ADDR(startPage);
+    m_memBlockSize[startAddr] = size;
+    return startAddr;
+}
+
+bool Heap::FreeSmall( Slab *slab, u32 addr )
+{
+    const u32 cs = ClassSize(slab->Class);
+    if ((addr - slab->Base) % cs != 0) return false;
+    const uint slot = (addr - slab->Base) / cs;
+    if (slab->Sizes[slot] == FreeSlot) return false;
+
+    slab->Sizes[slot] = FreeSlot;
+    slab->FreeSlots.push_back((u16) slot);
+    slab->Used--;
+    if (slab->PartialIndex < 0) {
+        AddPartial(slab);
+    }
+
+    // keep one empty slab per class so alloc/free pairs don't commit and decommit
+    if (slab->Used == 0 && m_partial[slab->Class].size() > 1) {
+        RemovePartial(slab);
+        uint page = PAGE_NUM(slab->Base - m_base);
+        m_pageSlab[page] = NULL;
+        SAFE_DELETE(slab);
+        FreePages(page, 1);
+    }
+    return true;
+}
+
+bool Heap::FreeLarge( u32 addr )
 {
-    uint ptr = 0;
-    uint contBlocks = 0;
-    while (ptr < m_pages) {
-        if (m_map[ptr] == 0) {
-            contBlocks++;
-            ptr++;
-            if (contBlocks == nPages) return ptr - nPages;
-        } else {
-            contBlocks = 0;
-            ptr += m_map[ptr];
+    auto iter = m_memBlockSize.find(addr);
+    if (iter == m_memBlockSize.end()) return false;
+
+    FreePages(PAGE_NUM(addr - m_base), PAGE_NUM(RoundUp(iter->second)));
+    m_memBlockSize.erase(iter);
+    return true;
+}
+
+bool Heap::GrowLarge( u32 addr, u32 oldSize, u32 newSize )
+{
+    const uint startPage = PAGE_NUM(addr - m_base);
+    const uint oldPages = PAGE_NUM(RoundUp(oldSize));
+    const uint newPages = PAGE_NUM(RoundUp(newSize));
+
+    if (newPages < oldPages) {
+        FreePages(startPage + newPages, oldPages - newPages);
+    } else if (newPages > oldPages) {
+        // only grow into the free run right behind the block
+        auto iter = m_freeRuns.find(startPage + oldPages);
+        if (iter == m_freeRuns.end() || iter->second < newPages - oldPages)
+            return false;
+        const uint runPages = iter->second;
+        m_freeRuns.erase(iter);
+        if (runPages > newPages - oldPages) {
+            m_freeRuns[startPage + newPages] = runPages - (newPages - oldPages);
         }
+        V( Commit(addr + PAGE_ADDR(oldPages), PAGE_ADDR(newPages - oldPages), PAGE_READWRITE) );
+    }
+    m_memBlockSize[addr] = newSize;
+    return true;
+}
+
+Heap::Slab * Heap::FindSlab( u32 addr ) const
+{
+    Assert(Contains(addr));
+    return m_pageSlab[PAGE_NUM(addr - m_base)];
+}
+
+void Heap::AddPartial( Slab *slab )
+{
+    Assert(slab->PartialIndex < 0);
+    slab->PartialIndex = (int) m_partial[slab->Class].size();
+    m_partial[slab->Class].push_back(slab);
+}
+
+void Heap::RemovePartial( Slab *slab )
+{
+    std::vector<Slab *> &partial = m_partial[slab->Class];
+    Assert(slab->PartialIndex >= 0 && partial[slab->PartialIndex] == slab);
+
+    Slab *last = partial.back();
+    partial[slab->PartialIndex] = last;
+    last->PartialIndex = slab->PartialIndex;
+    partial.pop_back();
+    slab->PartialIndex = -1;
+}
+
+uint Heap::AllocPages( uint nPages )
+{
+    // first fit over the free runs
+    for (auto iter = m_freeRuns.begin(); iter != m_freeRuns.end(); ++iter) {
+        if (iter->second < nPages) continue;
+
+        const uint startPage = iter->first;
+        const uint runPages = iter->second;
+        m_freeRuns.erase(iter);
+        if (runPages > nPages) {
+            m_freeRuns[startPage + nPages] = runPages - nPages;
+        }
+        V( Commit(m_base + PAGE_ADDR(startPage), PAGE_ADDR(nPages), PAGE_READWRITE) ); // TODO: may change the page flag
+        return startPage;
     }
     return m_pages + 1;
 }
 
-END_NAMESPACE_LOCHSEMU()
\ No newline at end of file
+void Heap::FreePages( uint startPage, uint nPages )
+{
+    V( Decommit(m_base + PAGE_ADDR(startPage), PAGE_ADDR(nPages)) );
+
+    // merge with the runs right after and right before
+    auto next = m_freeRuns.lower_bound(startPage);
+    if (next != m_freeRuns.end() && next->first == startPage + nPages) {
+        nPages += next->second;
+        next = m_freeRuns.erase(next);
+    }
+    if (next != m_freeRuns.begin()) {
+        auto prev = next;
+        --prev;
+        if (prev->first + prev->second == startPage) {
+            prev->second += nPages;
+            return;
+        }
+    }
+    m_freeRuns[startPage] = nPages;
+}
+
+END_NAMESPACE_LOCHSEMU()
@@ -8,7 +8,17 @@
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
+/*
+ * Blocks up to MaxSmallSize bytes are carved from one-page slabs of a
+ * single size class; larger blocks take whole pages from a coalescing
+ * list of free page runs. All bookkeeping lives on the host side so the
+ * guest only ever sees its own data.
+ */
 class LX_API Heap : public Section {
+public:
+    static const uint   NumSizeClasses  = 14;
+    static const u32    MaxSmallSize    = 2048;
+
 public:
     Heap(u32 base, u32 reserve, u32 commit, uint nModule);
     virtual ~Heap();
@@ -18,16 +28,51 @@ public:
     u32     HeapRealloc(u32 addr, u32 size, uint flags, Processor *cpu);
     u32     HeapSize(u32 addr, uint flags, Processor *cpu);
     bool    HeapValidate(u32 addr, uint flags, Processor *cpu);
+
+    /*
+     * Enumerate busy blocks in address order, as HeapWalk does;
+     * start with prev = 0. Returns false when no block follows 'prev'
+     */
+    bool    HeapWalk(u32 prev, u32 *addr, u32 *size) const;
+
+    /* allocator bookkeeping for snapshots; page contents are saved separately */
+    void    SaveState(SnapshotWriter &w) const;
+    bool    LoadState(SnapshotReader &r);
+
 private:
+    struct Slab {
+        u32                 Base;
+        uint                Class;
+        uint                Used;
+        int                 PartialIndex;   // position in m_partial[Class], -1 if full
+        std::vector<u16>    FreeSlots;
+        std::vector<u32>    Sizes;          // requested size of each slot, (u32) -1 if free
+    };
+
+    static uint     SizeClass(u32 size);
+    static u32      ClassSize(uint sizeClass);
+
+    u32     AllocSmall(u32 size);
+    u32     AllocLarge(u32 size);
+    bool    FreeSmall(Slab *slab, u32 addr);
+    bool    FreeLarge(u32 addr);
+    bool    GrowLarge(u32 addr, u32 oldSize, u32 newSize);
+    Slab *  FindSlab(u32 addr) const;
+    void    AddPartial(Slab *slab);
+    void    RemovePartial(Slab *slab);
+
     /*
-     * Find next continuous pages available;
-     * if found, retval = page starting number;
-     * if not found, retval = n > m_pages
+     * Take nPages contiguous pages from the free runs and commit them;
+     * returns the first page number, or m_pages + 1 if out of space
      */
-    uint FindSpace(uint nPages);
+    uint    AllocPages(uint nPages);
+    void    FreePages(uint startPage, uint nPages);
+
 private:
-    uint *m_map;
-    std::map<u32, u32>  m_memBlockSize; // Preserve the size of each memory block
+    std::vector<Slab *>     m_pageSlab;     // slab owning each page, NULL otherwise
+    std::map<uint, uint>    m_freeRuns;     // first page -> page count, always coalesced
+    std::map<u32, u32>      m_memBlockSize; // large block address -> requested size
+    std::vector<Slab *>     m_partial[NumSizeClasses];  // slabs with free slots
 };
 
 END_NAMESPACE_LOCHSEMU()
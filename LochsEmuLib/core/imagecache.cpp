@@ -0,0 +1,219 @@
+#include "stdafx.h"
+#include "imagecache.h"
+#include "memory.h"
+#include "section.h"
+#include "snapshot.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+static const u32 ImageCacheMagic    = 0x4943584c;   // "LXCI"
+static const u32 ImageCacheVersion  = 1;
+
+ImageCache::ImageCache()
+{
+    m_view  = NULL;
+}
+
+ImageCache::~ImageCache()
+{
+    Release();
+}
+
+void ImageCache::Initialize( LPCSTR lpDirectory )
+{
+    m_dir = lpDirectory ? lpDirectory : "";
+    if (m_dir.empty()) return;
+    if (m_dir[m_dir.size() - 1] != '\\' && m_dir[m_dir.size() - 1] != '/') m_dir += '\\';
+    CreateDirectoryA(m_dir.c_str(), NULL);
+    LxInfo("Using image cache in %s\n", m_dir.c_str());
+}
+
+bool ImageCache::GetKey( LPCSTR lpFileName, std::string &fullPath, u64 &size, u64 &writeTime ) const
+{
+    char buf[MAX_PATH];
+    if (GetFullPathNameA(lpFileName, MAX_PATH, buf, NULL) == 0) return false;
+    fullPath = buf;
+    std::transform(fullPath.begin(), fullPath.end(), fullPath.begin(), ::tolower);
+
+    WIN32_FILE_ATTRIBUTE_DATA attrs;
+    if (!GetFileAttributesExA(buf, GetFileExInfoStandard, &attrs)) return false;
+    size        = ((u64) attrs.nFileSizeHigh << 32) | attrs.nFileSizeLow;
+    writeTime   = ((u64) attrs.ftLastWriteTime.dwHighDateTime << 32) | attrs.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+std::string ImageCache::EntryPath( const std::string &fullPath, LPCSTR moduleName ) const
+{
+    // FNV-1a of the path, so equally named modules from different folders do not collide
+    u32 hash = 2166136261u;
+    for (uint i = 0; i < fullPath.size(); i++) {
+        hash = (hash ^ (byte) fullPath[i]) * 16777619u;
+    }
+    char buf[16];
+    sprintf(buf, ".%08x.lxi", hash);
+    return m_dir + moduleName + buf;
+}
+
+bool ImageCache::Lookup( LPCSTR lpFileName, CachedImage &image )
+{
+    Release();
+
+    std::string fullPath;
+    u64 size, writeTime;
+    if (!GetKey(lpFileName, fullPath, size, writeTime)) return false;
+
+    HANDLE hFile = CreateFileA(EntryPath(fullPath, LxFileName(lpFileName).c_str()).c_str(),
+        GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+    DWORD fileSize = GetFileSize(hFile, NULL);
+    HANDLE hMapping = fileSize == 0 ? NULL : CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(hFile);
+    if (hMapping == NULL) return false;
+    m_view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+    if (m_view == NULL) return false;
+
+    SnapshotReader r((cpbyte) m_view, fileSize);
+    if (r.Get<u32>() != ImageCacheMagic || r.Get<u32>() != ImageCacheVersion ||
+        r.GetString() != fullPath || r.Get<u64>() != size || r.Get<u64>() != writeTime) {
+        Release();
+        return false;
+    }
+
+    ModuleInfo &info = image.Info;
+    info.LinearAddressIAT   = r.Get<u32>();
+    info.LinearSizeIAT      = r.Get<u32>();
+    info.ImageBase          = r.Get<u32>();
+    info.OriginalImageBase  = r.Get<u32>();
+    info.EntryPoint         = r.Get<u32>();
+    info.StackReserve       = r.Get<u32>();
+    info.StackCommit        = r.Get<u32>();
+    info.HeapReserve        = r.Get<u32>();
+    info.HeapCommit         = r.Get<u32>();
+    strncpy(info.Name, r.GetString().c_str(), MAX_PATH - 1);
+    r.Read(info.DataDirectory, sizeof(info.DataDirectory));
+
+    u32 nDlls = r.Get<u32>();
+    for (u32 i = 0; i < nDlls && !r.Failed(); i++) {
+        std::vector<ImportEntry> &funcs = info.Imports[r.GetString()];
+        u32 nFuncs = r.Get<u32>();
+        for (u32 j = 0; j < nFuncs && !r.Failed(); j++) {
+            std::string name = r.GetString();
+            u32 iatOffset = r.Get<u32>();
+            ImportEntry entry(name, iatOffset);
+            entry.Ordinal = r.Get<u32>();
+            funcs.push_back(entry);
+        }
+    }
+    u32 nExports = r.Get<u32>();
+    for (u32 i = 0; i < nExports && !r.Failed(); i++) {
+        std::string name = r.GetString();
+        u32 address = r.Get<u32>();
+        info.Exports.push_back(ExportEntry(name, address, r.Get<u16>()));
+    }
+    u32 nRelocs = r.Get<u32>();
+    for (u32 i = 0; i < nRelocs && !r.Failed(); i++) {
+        u32 type = r.Get<u32>();
+        info.Relocations.push_back(RelocationEntry(type, r.Get<u32>()));
+    }
+
+    u32 nSections = r.Get<u32>();
+    for (u32 i = 0; i < nSections && !r.Failed(); i++) {
+        CachedImage::Section sec;
+        sec.Desc.Desc   = r.GetString();
+        sec.Address     = r.Get<u32>();
+        sec.Size        = r.Get<u32>();
+        sec.Protect     = r.Get<u32>();
+        sec.Data        = r.Skip(sec.Size);
+        image.Sections.push_back(sec);
+    }
+    if (r.Failed()) {
+        LxWarning("Image cache entry of %s is corrupt\n", lpFileName);
+        Release();
+        return false;
+    }
+    return true;
+}
+
+void ImageCache::Release()
+{
+    if (m_view) {
+        UnmapViewOfFile(m_view);
+        m_view = NULL;
+    }
+}
+
+LxResult ImageCache::Store( LPCSTR lpFileName, const ModuleInfo &info, const Memory *mem, const std::vector<u32> &sections )
+{
+    std::string fullPath;
+    u64 size, writeTime;
+    if (!GetKey(lpFileName, fullPath, size, writeTime)) return LX_RESULT_FILE_NOT_EXIST;
+
+    std::vector<byte> buf;
+    SnapshotWriter w(buf);
+    w.Put(ImageCacheMagic);
+    w.Put(ImageCacheVersion);
+    w.PutString(fullPath);
+    w.Put(size);
+    w.Put(writeTime);
+
+    w.Put(info.LinearAddressIAT);
+    w.Put(info.LinearSizeIAT);
+    w.Put(info.ImageBase);
+    w.Put(info.OriginalImageBase);
+    w.Put(info.EntryPoint);
+    w.Put(info.StackReserve);
+    w.Put(info.StackCommit);
+    w.Put(info.HeapReserve);
+    w.Put(info.HeapCommit);
+    w.PutString(info.Name);
+    w.Write(info.DataDirectory, sizeof(info.DataDirectory));
+
+    w.Put((u32) info.Imports.size());
+    for (auto iter = info.Imports.begin(); iter != info.Imports.end(); ++iter) {
+        w.PutString(iter->first);
+        w.Put((u32) iter->second.size());
+        for (uint i = 0; i < iter->second.size(); i++) {
+            w.PutString(iter->second[i].Name);
+            w.Put(iter->second[i].IATOffset);
+            w.Put(iter->second[i].Ordinal);
+        }
+    }
+    w.Put((u32) info.Exports.size());
+    for (uint i = 0; i < info.Exports.size(); i++) {
+        w.PutString(info.Exports[i].Name);
+        w.Put(info.Exports[i].Address);
+        w.Put(info.Exports[i].Ordinal);
+    }
+    w.Put((u32) info.Relocations.size());
+    for (uint i = 0; i < info.Relocations.size(); i++) {
+        w.Put(info.Relocations[i].Type);
+        w.Put(info.Relocations[i].Address);
+    }
+
+    w.Put((u32) sections.size());
+    for (uint i = 0; i < sections.size(); i++) {
+        const Section *sec = mem->GetSection(sections[i]);
+        Assert(sec && sec->Base() == sections[i]);
+        w.PutString(sec->Description());
+        w.Put(sec->Base());
+        w.Put(sec->Size());
+        w.Put((u32) sec->GetSectionInfo()[0].Protect);
+        w.Write(sec->GetRawData(sec->Base()), sec->Size());
+    }
+
+    // written aside and renamed, so a concurrent Lookup never sees half an entry
+    std::string path = EntryPath(fullPath, info.Name);
+    std::string temp = path + ".tmp";
+    FILE *fp = fopen(temp.c_str(), "wb");
+    if (fp == NULL) return LX_RESULT_ERROR_OPEN_FILE;
+    size_t written = fwrite(&buf[0], 1, buf.size(), fp);
+    fclose(fp);
+    if (written != buf.size() || !MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(temp.c_str());
+        return LX_RESULT_ERROR_WRITE_FILE;
+    }
+    RET_SUCCESS();
+}
+
+END_NAMESPACE_LOCHSEMU()
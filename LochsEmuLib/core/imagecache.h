@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef __CORE_IMAGECACHE_H__
+#define __CORE_IMAGECACHE_H__
+
+#include "lochsemu.h"
+#include "memdesc.h"
+#include "pemodule.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * A module as PeLoader left it in guest memory: its sections laid out
+ * and relocated for ImageBase, and its parsed import, export and
+ * relocation tables. Section data points into the mapped cache file.
+ */
+struct CachedImage {
+    struct Section {
+        SectionDesc     Desc;
+        u32             Address;
+        u32             Size;
+        uint            Protect;
+        cpbyte          Data;
+    };
+
+    ModuleInfo              Info;
+    std::vector<Section>    Sections;
+};
+
+/*
+ * Persistent cache of loaded PE images (Emulator/ImageCache=<directory>).
+ * An entry is keyed by the module's full path, file size and write time;
+ * it is only used when PeLoader picks the same image base again, so the
+ * stored relocations are still right. IATs are not cached and are always
+ * resolved again, because they depend on the other modules.
+ */
+class LX_API ImageCache {
+public:
+    ImageCache();
+    ~ImageCache();
+
+    void            Initialize  (LPCSTR lpDirectory);
+    bool            IsEnabled   (void) const { return !m_dir.empty(); }
+
+    /* maps the entry of a module file; its data stays valid until Release */
+    bool            Lookup      (LPCSTR lpFileName, CachedImage &image);
+    void            Release     (void);
+
+    /* saves a loaded module, its sections given by base address */
+    LxResult        Store       (LPCSTR lpFileName, const ModuleInfo &info,
+                                 const Memory *mem, const std::vector<u32> &sections);
+
+private:
+    bool            GetKey      (LPCSTR lpFileName, std::string &fullPath, u64 &size, u64 &writeTime) const;
+    std::string     EntryPath   (const std::string &fullPath, LPCSTR moduleName) const;
+
+private:
+    std::string     m_dir;
+    LPVOID          m_view;
+};
+
+END_NAMESPACE_LOCHSEMU()
+
+#endif // __CORE_IMAGECACHE_H__
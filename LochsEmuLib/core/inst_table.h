@@ -118,6 +118,7 @@ DECLARE_INST_HANDLER(Xlat_D7);			 //	XLAT m8
 DECLARE_INST_HANDLER(Test_84);           // TEST r/m8, r8
 DECLARE_INST_HANDLER(Test_85);           // TEST r/m16/32, r16/32
 
+DECLARE_INST_HANDLER(Xchg_86);          // XCHG r/m8, r8; XCHG r8, r/m8
 DECLARE_INST_HANDLER(Xchg_87);          // XCHG r/m32, r32; XCHG r32, r/m32
 
 DECLARE_INST_HANDLER(Mov_88);
@@ -374,7 +375,10 @@ DECLARE_INST_HANDLER(Bsr_0FBD);         // BSR r16/32, r/m16/32
 DECLARE_INST_HANDLER(Movsx_0FBE);       // MOVSX  r32, r/m8
 DECLARE_INST_HANDLER(Movsx_0FBF);       // MOVSX  r32, r/m16
 
+DECLARE_INST_HANDLER(Xadd_0FC0);		//XADD r/m8, r8
 DECLARE_INST_HANDLER(Xadd_0FC1);		//XADD r/m16/32, r16/32
+DECLARE_INST_HANDLER(Ext_0FC7);
+DECLARE_INST_HANDLER(Cmpxchg8b_0FC7_ext1);  // CMPXCHG8B m64
 DECLARE_INST_HANDLER(Bswap_0FC8);		//BSWAP r32;
 
 DECLARE_INST_HANDLER(Movq_0FD6);        // MOVQ xmm2/m64, xmm1
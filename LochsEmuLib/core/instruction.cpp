@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "instruction.h"
+#include "parallel.h"
+#include "config.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -61,4 +63,303 @@ bool Instruction::IsJmp( const Instruction *inst )
     return m[0] == 'j' && m[1] == 'm' && m[2] == 'p';
 }
 
+/*
+ * Opcodes followed by a ModRM byte
+ */
+static const bool HasModrmOneByte[0x100] = {
+    /*       0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f */
+    /* 0 */  1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0,
+    /* 1 */  1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0,
+    /* 2 */  1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0,
+    /* 3 */  1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0,
+    /* 4 */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 5 */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 6 */  0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0,
+    /* 7 */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 8 */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 9 */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* a */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* b */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* c */  1, 1, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* d */  1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* e */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* f */  0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 1, 1,
+};
+
+static const bool HasModrmTwoBytes[0x100] = {
+    /*       0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f */
+    /* 0 */  1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1,
+    /* 1 */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 2 */  1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 3 */  0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0,
+    /* 4 */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 5 */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 6 */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 7 */  1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 8 */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 9 */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* a */  0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1,
+    /* b */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* c */  1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* d */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* e */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* f */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+void Instruction::DecodeAux( cpbyte data, int length, INSTRUCTION *aux )
+{
+    ZeroMemory(aux, sizeof(INSTRUCTION));
+    aux->length = length;
+    aux->mode   = MODE_32;
+
+    int  i = 0;
+    bool opsize16 = false;
+    for (; i < length; i++) {
+        byte b = data[i];
+        if (b == 0x66) {
+            opsize16 = true;
+        } else if (b != 0x67 && b != 0xf0 && b != 0xf2 && b != 0xf3 && b != 0x2e &&
+            b != 0x36 && b != 0x3e && b != 0x26 && b != 0x64 && b != 0x65) {
+            break;
+        }
+    }
+    if (i >= length) return;
+
+    const byte op = data[i++];
+    if (op == 0x0f) {
+        if (i >= length) return;
+        const byte op2 = data[i++];
+        aux->opcode = op2;
+        if (op2 == 0x38 || op2 == 0x3a) {
+            // 3-byte opcodes all take a ModRM
+            i++;
+            if (i < length) aux->modrm = data[i];
+        } else if (HasModrmTwoBytes[op2]) {
+            if (i < length) aux->modrm = data[i];
+        } else if (op2 >= 0x80 && op2 <= 0x8f) {
+            // Jcc rel16/32
+            aux->op1.type       = OPERAND_TYPE_IMMEDIATE;
+            aux->op1.immediate  = opsize16 ? *(const u16 *) &data[i] : *(const u32 *) &data[i];
+        }
+        return;
+    }
+
+    aux->opcode = op;
+    if (HasModrmOneByte[op]) {
+        if (i < length) aux->modrm = data[i];
+        // x87 handlers index on the byte after the escape
+        if (op >= 0xd8 && op <= 0xdf) aux->opcode = aux->modrm;
+        return;
+    }
+
+    if ((op >= 0x70 && op <= 0x7f) || (op >= 0xe0 && op <= 0xe3) || op == 0xeb) {
+        // rel8, always sign-extended
+        aux->op1.type       = OPERAND_TYPE_IMMEDIATE;
+        aux->op1.immediate  = (u32) (i32) (i8) data[i];
+    } else if (op == 0xe8 || op == 0xe9) {
+        aux->op1.type       = OPERAND_TYPE_IMMEDIATE;
+        aux->op1.immediate  = opsize16 ? *(const u16 *) &data[i] : *(const u32 *) &data[i];
+    } else if (op == 0xc8) {
+        // ENTER imm16, imm8
+        aux->op1.type       = OPERAND_TYPE_IMMEDIATE;
+        aux->op1.immediate  = *(const u16 *) &data[i];
+        aux->op2.type       = OPERAND_TYPE_IMMEDIATE;
+        aux->op2.immediate  = data[i + 2];
+    }
+}
+
+bool Instruction::VerifyAux( byte data[], const INSTRUCTION *aux )
+{
+    INSTRUCTION ref;
+    if (get_instruction(&ref, data, MODE_32) == 0) {
+        // libdasm does not know this one either
+        return true;
+    }
+
+    bool ok = ref.opcode == aux->opcode;
+    if (ref.modrm != 0) ok = ok && ref.modrm == aux->modrm;
+    if (aux->op1.type == OPERAND_TYPE_IMMEDIATE) ok = ok && ref.op1.immediate == aux->op1.immediate;
+    if (aux->op2.type == OPERAND_TYPE_IMMEDIATE) ok = ok && ref.op2.immediate == aux->op2.immediate;
+
+    if (!ok) {
+        LxWarning("Decoder mismatch: %02x %02x %02x %02x, opcode %02x/%02x, modrm %02x/%02x, imm %08x/%08x\n",
+            data[0], data[1], data[2], data[3], aux->opcode, ref.opcode, aux->modrm, ref.modrm,
+            aux->op1.immediate, ref.op1.immediate);
+    }
+    return ok;
+}
+
+/* GP_Regs index of a BeaEngine REG0..REG7, -1 for anything else */
+static int GpRegIndex( u32 num )
+{
+    switch (num) {
+    case REG0: return 0;
+    case REG1: return 1;
+    case REG2: return 2;
+    case REG3: return 3;
+    case REG4: return 4;
+    case REG5: return 5;
+    case REG6: return 6;
+    case REG7: return 7;
+    default:   return -1;
+    }
+}
+
+static void PredecodeOperand( const Instruction *inst, const ARGTYPE &arg, Instruction::Operand *op )
+{
+    ZeroMemory(op, sizeof(Instruction::Operand));
+
+    if (IsRegArg(arg)) {
+        if (REG_TYPE(arg.ArgType) != (REGISTER_TYPE | GENERAL_REG)) return;
+        int r = GpRegIndex(REG_NUM(arg.ArgType));
+        if (r < 0) return;
+        if (arg.ArgSize == 8) {
+            if (r >= 4) return;
+            op->Kind    = Instruction::Operand::KindReg8;
+            op->Reg     = (u8) (r + (arg.ArgPosition ? 4 : 0));
+        } else if (arg.ArgSize == 16) {
+            op->Kind    = Instruction::Operand::KindReg16;
+            op->Reg     = (u8) r;
+        } else if (arg.ArgSize == 32) {
+            op->Kind    = Instruction::Operand::KindReg32;
+            op->Reg     = (u8) r;
+        }
+    } else if (IsConstantArg(arg)) {
+        op->Kind    = Instruction::Operand::KindImm;
+        op->Disp    = (u32) inst->Main.Inst.Immediat;
+    } else if (IsMemoryArg(arg)) {
+        int base = 8, index = 8;
+        if (arg.Memory.BaseRegister) {
+            base = GpRegIndex(REG_NUM(arg.Memory.BaseRegister));
+            if (base < 0) return;
+        }
+        if (arg.Memory.IndexRegister) {
+            index = GpRegIndex(REG_NUM(arg.Memory.IndexRegister));
+            if (index < 0) return;
+        }
+        op->Reg     = (u8) base;
+        op->Index   = (u8) index;
+        op->Scale   = (u8) arg.Memory.Scale;
+        op->Disp    = (u32) arg.Memory.Displacement;
+        if (index != 8) {
+            op->Kind = Instruction::Operand::KindMemSib;
+        } else if (base != 8) {
+            op->Kind = Instruction::Operand::KindMemBase;
+        } else {
+            op->Kind = Instruction::Operand::KindMemDisp;
+        }
+    }
+}
+
+void Instruction::Predecode( Instruction *inst )
+{
+    PredecodeOperand(inst, inst->Main.Argument1, &inst->Operands[0]);
+    PredecodeOperand(inst, inst->Main.Argument2, &inst->Operands[1]);
+    PredecodeOperand(inst, inst->Main.Argument3, &inst->Operands[2]);
+}
+
+#pragma push_macro("new")
+#undef new
+
+/*
+ * Fixed-size free-list pool for Instruction objects. Chunks are never
+ * returned to the heap; the decode cache recycles freed slots.
+ */
+class InstructionPool {
+public:
+    static const int ChunkSize = 1024;
+
+    InstructionPool() : m_free(NULL) {}
+    ~InstructionPool()
+    {
+        for (auto &chunk : m_chunks) {
+            ::operator delete(chunk);
+        }
+        m_chunks.clear();
+    }
+
+    void *  Alloc()
+    {
+        MutexCSLock lock(m_mutex);
+        if (NULL == m_free) Expand();
+        FreeSlot *slot = m_free;
+        m_free = slot->Next;
+        return slot;
+    }
+
+    void    Free(void *p)
+    {
+        MutexCSLock lock(m_mutex);
+        FreeSlot *slot = (FreeSlot *) p;
+        slot->Next = m_free;
+        m_free = slot;
+    }
+
+    bool    Owns(const void *p)
+    {
+        MutexCSLock lock(m_mutex);
+        for (auto &chunk : m_chunks) {
+            if (p >= chunk && p < chunk + ChunkSize * sizeof(Instruction)) return true;
+        }
+        return false;
+    }
+
+private:
+    struct FreeSlot {
+        FreeSlot *  Next;
+    };
+
+    void    Expand()
+    {
+        pbyte chunk = (pbyte) ::operator new(ChunkSize * sizeof(Instruction));
+        m_chunks.push_back(chunk);
+        for (int i = ChunkSize - 1; i >= 0; i--) {
+            FreeSlot *slot = (FreeSlot *) (chunk + i * sizeof(Instruction));
+            slot->Next = m_free;
+            m_free = slot;
+        }
+    }
+
+private:
+    MutexCS                 m_mutex;
+    FreeSlot *              m_free;
+    std::vector<pbyte>      m_chunks;
+};
+
+static InstructionPool &GetInstructionPool()
+{
+    static InstructionPool pool;
+    return pool;
+}
+
+void * Instruction::operator new( size_t size )
+{
+    // classes derived from Instruction go to the regular heap
+    if (size != sizeof(Instruction)) return ::operator new(size);
+    return GetInstructionPool().Alloc();
+}
+
+void Instruction::operator delete( void *p, size_t size )
+{
+    if (NULL == p) return;
+    if (size != sizeof(Instruction)) {
+        ::operator delete(p);
+    } else {
+        GetInstructionPool().Free(p);
+    }
+}
+
+void Instruction::operator delete( void *p, int, const char *, int )
+{
+    // only reached when a constructor throws under the debug 'new'
+    if (NULL == p) return;
+    if (GetInstructionPool().Owns(p)) {
+        GetInstructionPool().Free(p);
+    } else {
+        ::operator delete(p);
+    }
+}
+
+#pragma pop_macro("new")
+
 END_NAMESPACE_LOCHSEMU()
\ No newline at end of file
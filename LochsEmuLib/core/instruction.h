@@ -14,10 +14,35 @@
 BEGIN_NAMESPACE_LOCHSEMU()
 
 class LX_API Instruction {
+public:
+    /*
+     * Location of Argument1..3 resolved once by Predecode, so that
+     * Processor::ReadOperand/WriteOperand need not inspect ARGTYPE on
+     * every execution. KindGeneric operands take the ARGTYPE path
+     */
+    struct Operand {
+        enum Kind {
+            KindGeneric = 0,
+            KindReg8,           // Reg indexes Processor::GP_Regs8
+            KindReg16,          // Reg indexes Processor::GP_Regs
+            KindReg32,
+            KindImm,            // value in Disp
+            KindMemDisp,        // [disp]
+            KindMemBase,        // [base+disp]
+            KindMemSib,         // [base+index*scale+disp], a missing base is GP_Regs[8]
+        };
+        u8      Kind;
+        u8      Reg;
+        u8      Index;
+        u8      Scale;
+        u32     Disp;
+    };
+
 public:
     Instruction() {
         ZeroMemory(&Main, sizeof(DISASM));
         ZeroMemory(&Aux, sizeof(INSTRUCTION));
+        ZeroMemory(Operands, sizeof(Operands));
         Length = 0;
     }
 
@@ -31,12 +56,57 @@ public:
     static bool IsXchg(const Instruction *inst);
     static bool IsJmp(const Instruction *inst);
 
+    /*
+     * Fill the libdasm fields used by the emulator (opcode, modrm, branch
+     * and ENTER immediates) straight from the instruction bytes, so that
+     * only BeaEngine has to run on each new instruction.
+     * BeaEngine itself is kept: every instruction handler and plugin reads
+     * its DISASM operands, so a decoder of our own would have to reproduce
+     * them exactly before it could replace it.
+     */
+    static void DecodeAux(cpbyte data, int length, INSTRUCTION *aux);
+
+    /*
+     * Compare DecodeAux against a full libdasm decode; used when
+     * Emulator/VerifyDecoder is set
+     */
+    static bool VerifyAux(byte data[], const INSTRUCTION *aux);
+
+    /*
+     * Fill Operands from the BeaEngine arguments; called by LxDecode
+     */
+    static void Predecode(Instruction *inst);
+
+    /*
+     * Predecoded form of 'oper', or NULL if it is not one of Main's arguments
+     */
+    const Operand * OperandOf(const ARGTYPE &oper) const {
+        if (&oper == &Main.Argument1) return &Operands[0];
+        if (&oper == &Main.Argument2) return &Operands[1];
+        if (&oper == &Main.Argument3) return &Operands[2];
+        return NULL;
+    }
+
+    /*
+     * Instructions are allocated from a shared free-list pool rather than
+     * one heap block each
+     */
+#pragma push_macro("new")
+#undef new
+    static void *   operator new    (size_t size);
+    static void *   operator new    (size_t size, int, const char *, int) { return operator new(size); }
+    static void     operator delete (void *p, size_t size);
+    static void     operator delete (void *p, int, const char *, int);
+#pragma pop_macro("new")
+
     DISASM          Main;  /* BeaEngine */
 
     INSTRUCTION     Aux;   /* Libdasm */
 
     int             Length;
 
+    Operand         Operands[3];
+
 }; // class Instruction
 
 
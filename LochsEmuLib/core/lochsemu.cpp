@@ -224,13 +224,21 @@ LX_API bool LxByteToWide( LPCSTR b, LPWSTR w, int len)
     return true;
 }
 
+static bool IsVerifyDecoder()
+{
+    static const bool verify = LxConfig.GetInt("Emulator", "VerifyDecoder", 0) != 0;
+    return verify;
+}
+
 INLINE LX_API bool LxDecode( byte data[], Instruction *inst, u32 eip )
 {
     __try {
-        get_instruction(&inst->Aux, data, MODE_32);
         inst->Main.EIP = (UIntPtr) data;
         inst->Main.VirtualAddr = eip;
         inst->Length = Disasm((LPDISASM) &inst->Main);
+        Instruction::DecodeAux(data, inst->Length, &inst->Aux);
+        if (IsVerifyDecoder()) Instruction::VerifyAux(data, &inst->Aux);
+        Instruction::Predecode(inst);
     }
     __except(EXCEPTION_EXECUTE_HANDLER) {
         return false;
@@ -160,6 +160,15 @@ class   Coprocessor;
 struct  X86SIMD;
 class   Memory;
 class   Instruction;
+class   BlockCache;
+struct  BasicBlock;
+class   SoftTlb;
+class   Scheduler;
+class   SyncManager;
+class   Snapshot;
+class   SnapshotWriter;
+class   SnapshotReader;
+class   ReplayLog;
 class   PeModule;
 struct  ModuleInfo;
 struct  PageDesc;
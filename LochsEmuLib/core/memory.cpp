@@ -9,6 +9,8 @@ BEGIN_NAMESPACE_LOCHSEMU()
 LX_API Memory::Memory()
 {
     ZeroMemory(m_sectionTable, sizeof(m_sectionTable));
+    m_readMap = NULL;
+    m_writeMap = NULL;
 }
 
 
@@ -19,6 +21,8 @@ LX_API Memory::~Memory()
         SAFE_DELETE(m_sections[i]);
     }
     m_sections.clear();
+    SAFE_DELETE_ARRAY(m_readMap);
+    SAFE_DELETE_ARRAY(m_writeMap);
 }
 
 LX_API LxResult Memory::Alloc( const SectionDesc &desc, u32 address, u32 size, uint protect )
@@ -85,6 +89,7 @@ LX_API LxResult Memory::Free( u32 address )
         return LX_RESULT_INVALID_OPERATION;
     // cannot free a heap or stack
     if (IsHeap(sec) || IsStack(sec)) return LX_RESULT_INVALID_OPERATION;
+    UnmapSection(sec);
     sec->Free();
     RemoveSection(sec);
     RET_SUCCESS();
@@ -196,6 +201,8 @@ void Memory::InsertSection( Section *sec )
         m_sectionTable[i] = sec;
     }
     m_sections.push_back(sec);
+    sec->m_owner = this;
+    UpdatePageMap(sec, sec->Base(), sec->Size());
 }
 
 
@@ -208,6 +215,7 @@ void Memory::RemoveSection( Section *sec )
     uint pageCnt = PAGE_NUM((*iter)->Size());
     for (uint i = 0; i < pageCnt; i++)
         m_sectionTable[i+pageIdx] = NULL;
+    UnmapSection(sec);
     SAFE_DELETE(*iter);
     m_sections.erase(iter);
 }
@@ -221,12 +229,49 @@ LX_API void Memory::Erase()
 LX_API void Memory::Clear()
 {
     ZeroMemory(m_sectionTable, sizeof(Section *) * LX_PAGE_COUNT);
+    if (m_readMap) {
+        ZeroMemory(m_readMap, sizeof(pbyte) * LX_PAGE_COUNT);
+        ZeroMemory(m_writeMap, sizeof(pbyte) * LX_PAGE_COUNT);
+    }
     for (uint i = 0; i < m_sections.size(); i++) {
         SAFE_DELETE(m_sections[i]);
     }
     m_sections.clear();
 }
 
+LX_API void Memory::EnablePageMap()
+{
+    if (m_readMap) return;
+    m_readMap = new pbyte[LX_PAGE_COUNT];
+    m_writeMap = new pbyte[LX_PAGE_COUNT];
+    ZeroMemory(m_readMap, sizeof(pbyte) * LX_PAGE_COUNT);
+    ZeroMemory(m_writeMap, sizeof(pbyte) * LX_PAGE_COUNT);
+    for (auto &sec : m_sections) {
+        UpdatePageMap(sec, sec->Base(), sec->Size());
+    }
+    LxInfo("Flat page map enabled, %d KB\n", 2 * sizeof(pbyte) * LX_PAGE_COUNT / 1024);
+}
+
+LX_API void Memory::UpdatePageMap( const Section *sec, u32 address, u32 size )
+{
+    if (m_readMap == NULL) return;
+    Assert(sec->Contains(address) && address + size <= sec->Base() + sec->Size());
+    uint first = PAGE_NUM(address), last = PAGE_NUM(address + size - 1);
+    for (uint n = first; n <= last; n++) {
+        u32 addr = PAGE_ADDR(n);
+        pbyte host = sec->m_dataPtr ? sec->GetRawData(addr) : NULL;
+        m_readMap[PAGE_NUM(addr)] = host && sec->IsReadable(addr) ? host : NULL;
+        m_writeMap[PAGE_NUM(addr)] = host && sec->IsWritable(addr) ? host : NULL;
+    }
+}
+
+void Memory::UnmapSection( const Section *sec )
+{
+    if (m_readMap == NULL) return;
+    ZeroMemory(m_readMap + PAGE_NUM(sec->Base()), sizeof(pbyte) * PAGE_NUM(sec->Size()));
+    ZeroMemory(m_writeMap + PAGE_NUM(sec->Base()), sizeof(pbyte) * PAGE_NUM(sec->Size()));
+}
+
 LX_API u32 Memory::FindFreePages( u32 base, u32 size )
 {
     u32 actualSize = RoundUp(size);
@@ -283,6 +328,15 @@ std::vector<SectionInfo> Memory::GetMemoryInfo() const
     return r;
 }
 
+void Memory::CollectWrites( std::vector<u32> &pages )
+{
+    SyncObjectLock lock(*this);
+    std::vector<PVOID> scratch;
+    for (uint i = 0; i < m_sections.size(); i++) {
+        m_sections[i]->CollectWrites(pages, scratch);
+    }
+}
+
 std::vector<PageInfo> Memory::GetSectionInfo(u32 address) const
 {
     return GetSection(address)->GetSectionInfo();
@@ -116,18 +116,64 @@ public:
     std::vector<PageInfo>       GetSectionInfo(u32 address) const;
     SectionDesc     GetSectionDesc(u32 address) const;
     Section *       GetSection(u32 address) const { return m_sectionTable[PAGE_NUM(address)]; }
+    const std::vector<Section *> &  GetSections() const { return m_sections; }
+    bool            IsHeap(Section *sec) const { return m_heaps.find(sec) != m_heaps.end(); }
+    bool            IsStack(Section *sec) const { return m_stacks.find(sec) != m_stacks.end(); }
+
+    /*
+     * Flat page map (Emulator/FlatPageMap): host address of every readable
+     * and every writable guest page, NULL otherwise, so an access is one
+     * table index and an add with no section or page flag lookup.
+     * MapRead/MapWrite return NULL when the map is off, the page is not
+     * accessible or the access crosses a page; callers then use Read/Write
+     */
+    void            EnablePageMap   (void);
+    bool            HasPageMap      (void) const { return m_readMap != NULL; }
+    INLINE pbyte    MapRead         (u32 address, u32 size) const;
+    INLINE pbyte    MapWrite        (u32 address, u32 size) const;
+    void            UpdatePageMap   (const Section *sec, u32 address, u32 size);
+
+    /*
+     * Guest pages written since the last call, by the guest or by the host
+     * on its behalf; needs Section::EnableWriteWatch before loading
+     */
+    void            CollectWrites   (std::vector<u32> &pages);
+
+    /*
+     * Striped locks for LOCK-prefixed instructions that cannot be mapped
+     * onto a host atomic; each lock covers one 64-byte line
+     */
+    static const uint AddressLockCount = 64;
+    MutexCS &       AddressLock     (u32 address) { return m_addressLocks[(address >> 6) & (AddressLockCount - 1)]; }
+
 protected:
     void            InsertSection(Section *sec);
     void            RemoveSection(Section *sec);
-    bool            IsHeap(Section *sec) const { return m_heaps.find(sec) != m_heaps.end(); }
-    bool            IsStack(Section *sec) const { return m_stacks.find(sec) != m_stacks.end(); }
+    void            UnmapSection(const Section *sec);
 private:
     Section *       m_sectionTable[LX_PAGE_COUNT];
     std::vector<Section *>   m_sections;
     std::set<Section *>  m_heaps;
     std::set<Section *>  m_stacks;
+    pbyte *         m_readMap;
+    pbyte *         m_writeMap;
+    MutexCS         m_addressLocks[AddressLockCount];
 }; // class Memory
 
+INLINE pbyte Memory::MapRead(u32 address, u32 size) const
+{
+    if (m_readMap == NULL || PAGE_LOW(address) > LX_PAGE_SIZE - size) return NULL;
+    pbyte page = m_readMap[PAGE_NUM(address)];
+    return page ? page + PAGE_LOW(address) : NULL;
+}
+
+INLINE pbyte Memory::MapWrite(u32 address, u32 size) const
+{
+    if (m_writeMap == NULL || PAGE_LOW(address) > LX_PAGE_SIZE - size) return NULL;
+    pbyte page = m_writeMap[PAGE_NUM(address)];
+    return page ? page + PAGE_LOW(address) : NULL;
+}
+
 INLINE uint Memory::GetPageState(uint addr) const 
 {
     Section *s = GetSection(addr);
@@ -6,6 +6,7 @@
 #include "process.h"
 #include "winapi.h"
 #include "refproc.h"
+#include "config.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -42,6 +43,8 @@ LochsEmu::LxResult PeLoader::Initialize( Emulator *emu )
     Assert(m_memory);
     Assert(m_process);
 
+    m_cache.Initialize(LxConfig.GetString("Emulator", "ImageCache", "").c_str());
+
     RET_SUCCESS();
 }
 
@@ -61,6 +64,8 @@ LochsEmu::LxResult PeLoader::Load( LPCSTR lpFileName )
 LochsEmu::LxResult PeLoader::LoadModule( LPCSTR lpFileName )
 {
     LxInfo("Loading module: %s\n", lpFileName);
+    if (m_cache.IsEnabled() && LoadCachedModule(lpFileName)) RET_SUCCESS();
+
     PeModule module;
     V( module.Load(lpFileName) );
 
@@ -69,8 +74,10 @@ LochsEmu::LxResult PeLoader::LoadModule( LPCSTR lpFileName )
     /*
      * First load each section to memory
      */
-    u32 imageBase = DetermineImageBase(&module);
+    u32 imageBase = DetermineImageBase(module.GetName(), module.GetOptionalHeader()->ImageBase);
     uint nSections = module.GetNumOfSections();
+    std::vector<u32> sections;
+    sections.push_back(imageBase);
     LxInfo("Loading module [%s, %d sections] at base 0x%08x\n", lpFileName, nSections, imageBase);
 
     /* PE header to section 0 */
@@ -82,6 +89,7 @@ LochsEmu::LxResult PeLoader::LoadModule( LPCSTR lpFileName )
 
     for (uint i = 0; i < nSections; i++) {
         V( LoadSectionToMem(&module, module.GetSectionHeader(i), imageBase, m_infos.size()) );
+        sections.push_back(imageBase + module.GetSectionHeader(i)->VirtualAddress);
     }
 
     /*
@@ -89,6 +97,9 @@ LochsEmu::LxResult PeLoader::LoadModule( LPCSTR lpFileName )
      */
     ModuleInfo info = module.GetModuleInfo(m_memory, imageBase);
     m_infos.push_back(info);
+    m_paths.push_back(lpFileName);
+    m_sections.push_back(sections);
+    m_cached.push_back(false);
 
     LxDebug("\n");
     
@@ -104,9 +115,10 @@ uint PeLoader::RuntimeLoad( LPCSTR lpFileName )
     V( LoadLibraries(nModule) );
 
     V( LoadIAT(nModule) );
-    if (m_infos[nModule].OriginalImageBase != m_infos[nModule].ImageBase) {
+    if (!m_cached[nModule] && m_infos[nModule].OriginalImageBase != m_infos[nModule].ImageBase) {
         V( Relocate(nModule) );
     }
+    StoreCachedModule(nModule);
     return nModule;
 }
 
@@ -177,13 +189,54 @@ LochsEmu::LxResult PeLoader::LoadSectionToMem( PeModule *module, PIMAGE_SECTION_
     return lr;
 }
 
-u32 PeLoader::DetermineImageBase( PeModule *module )
+bool PeLoader::LoadCachedModule( LPCSTR lpFileName )
+{
+    CachedImage image;
+    if (!m_cache.Lookup(lpFileName, image)) return false;
+
+    SyncObjectLock lock(*m_memory);
+
+    // the stored relocations only hold at the same base
+    if (DetermineImageBase(image.Info.Name, image.Info.OriginalImageBase) != image.Info.ImageBase) {
+        m_cache.Release();
+        return false;
+    }
+    LxInfo("Loading module [%s, %d sections] at base 0x%08x from image cache\n", 
+        lpFileName, image.Sections.size() - 1, image.Info.ImageBase);
+
+    const uint nModule = m_infos.size();
+    std::vector<u32> sections;
+    for (uint i = 0; i < image.Sections.size(); i++) {
+        const CachedImage::Section &sec = image.Sections[i];
+        V( m_memory->AllocCopy(SectionDesc(sec.Desc.Desc, nModule), sec.Address, sec.Size, 
+            sec.Protect, (pbyte) sec.Data, sec.Size) );
+        sections.push_back(sec.Address);
+    }
+    m_cache.Release();
+
+    m_infos.push_back(image.Info);
+    m_paths.push_back(lpFileName);
+    m_sections.push_back(sections);
+    m_cached.push_back(true);
+    return true;
+}
+
+void PeLoader::StoreCachedModule( uint nModule )
+{
+    if (!m_cache.IsEnabled() || m_cached[nModule]) return;
+    if (LX_FAILED(m_cache.Store(m_paths[nModule].c_str(), m_infos[nModule], m_memory, m_sections[nModule]))) {
+        LxWarning("Cannot save %s to the image cache\n", m_paths[nModule].c_str());
+        return;
+    }
+    m_cached[nModule] = true;
+}
+
+u32 PeLoader::DetermineImageBase( LPCSTR name, u32 preferredBase )
 {
-    LPCSTR name = module->GetName();
     RefProcess::ModuleLoadInfo *info = m_refProcess->GetModuleLoadInfo(name);
     if (info) return info->ImageBase;
 
-    u32 base = module->GetOptionalHeader()->ImageBase;
+    u32 base = preferredBase;
     if (base == 0) 
         base = 0x10000000;
     // TODO: determine total number of pages to use
@@ -199,11 +252,15 @@ LochsEmu::LxResult PeLoader::PostProcess()
     }
 
     for (uint i = 0; i < m_infos.size(); i++) {
-        if ( m_infos[i].OriginalImageBase != m_infos[i].ImageBase ) {
+        if ( !m_cached[i] && m_infos[i].OriginalImageBase != m_infos[i].ImageBase ) {
             V( Relocate(i) );
         }
     }
 
+    for (uint i = 0; i < m_infos.size(); i++) {
+        StoreCachedModule(i);
+    }
+
     RET_SUCCESS();
 }
 
@@ -5,6 +5,7 @@
 
 #include "lochsemu.h"
 #include "pemodule.h"
+#include "imagecache.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -22,6 +23,7 @@ public:
     const Emulator *    Emu() const { Assert(m_emu); return m_emu; }
     LPCSTR              Path() const;
     uint                RuntimeLoad(LPCSTR lpFileName);
+    LPCSTR              GetModulePath(uint n) const { Assert(n < m_paths.size()); return m_paths[n].c_str(); }
     ModuleInfo *        GetModuleInfo(uint n) { Assert(n < m_infos.size()); return &m_infos[n]; }
     const ModuleInfo *  GetModuleInfo(uint n) const { Assert(n < m_infos.size()); return &m_infos[n]; }
     const uint          GetNumOfModules() const { return m_infos.size(); }
@@ -33,6 +35,16 @@ protected:
      */
     LxResult            LoadModule(LPCSTR lpFileName);
 
+    /*
+     * Loads a module from the image cache, already relocated
+     */
+    bool                LoadCachedModule(LPCSTR lpFileName);
+
+    /*
+     * Saves a freshly loaded and relocated module to the image cache
+     */
+    void                StoreCachedModule(uint nModule);
+
     /*
      * Loads dependent DLLs for the nth module
      */
@@ -57,7 +69,7 @@ protected:
      * A module may not be loaded at its ImageBase
      * Its image base is determined by PeLoader
      */
-    u32                 DetermineImageBase(PeModule *module);
+    u32                 DetermineImageBase(LPCSTR name, u32 preferredBase);
     LxResult            LoadSectionToMem(PeModule *module, PIMAGE_SECTION_HEADER pSec, u32 base, uint nModule);
     uint                GetModuleExportIndexByName(uint nModule, const char *funcName);
     uint                GetModuleExportIndexByOrdinal(uint nModule, uint ordinal);
@@ -68,6 +80,10 @@ protected:
     RefProcess *        m_refProcess;
     std::string         m_fileName;
     std::vector<ModuleInfo> m_infos;
+    ImageCache          m_cache;
+    std::vector<std::string>        m_paths;        // file of each module
+    std::vector<std::vector<u32> >  m_sections;     // base of each section of each module
+    std::vector<bool>   m_cached;                   // module is in m_cache, relocated
 };
 
 END_NAMESPACE_LOCHSEMU()
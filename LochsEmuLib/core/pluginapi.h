@@ -24,12 +24,26 @@ struct PluginInfo {
     }
 };
 
+/*
+ * One guest memory access in a batch; wider accesses are split into
+ * 8-byte records
+ */
+struct MemAccessRecord {
+    u32             Eip;        /* instruction that made the access */
+    u32             Address;
+    u8              Size;       /* 1, 2, 4 or 8 */
+    u8              Write;      /* 0 = read, 1 = write */
+    u16             Reserved;
+    u32             Data[2];    /* the value, little-endian, Size bytes valid */
+};
+
 typedef bool (* LochsEmu_Plugin_Initialize)     (const LochsEmuInterface *lochsemu, PluginInfo *info);
 typedef bool (* LochsEmu_Plugin_Cleanup)        (void);
 typedef void (* LochsEmu_Processor_PreExecute)  (Processor *cpu, const Instruction *inst);
 typedef void (* LochsEmu_Processor_PostExecute) (Processor *cpu, const Instruction *inst);
 typedef void (* LochsEmu_Processor_MemRead)     (const Processor *cpu, u32 address, u32 nBytes, cpbyte data);
 typedef void (* LochsEmu_Processor_MemWrite)    (const Processor *cpu, u32 address, u32 nBytes, cpbyte data);
+typedef void (* LochsEmu_Processor_MemBatch)    (const Processor *cpu, const MemAccessRecord *records, uint count);
 typedef void (* LochsEmu_Process_PreRun)        (const Process *proc, Processor *cpu);
 typedef void (* LochsEmu_Process_PostRun)       (const Process *proc);
 typedef void (* LochsEmu_Process_PreLoad)       (PeLoader *loader);
@@ -39,6 +53,70 @@ typedef void (* LochsEmu_Winapi_PostCall)       (Processor *cpu, uint apiIndex);
 typedef void (* LochsEmu_Thread_Create)         (Thread *thrd);
 typedef void (* LochsEmu_Thread_Exit)           (Thread *thrd);
 
+/*
+ * Event subscriptions
+ *
+ * A plugin exporting LochsEmu_Plugin_Subscribe only receives the
+ * processor and winapi events it subscribes to; plugins without it get
+ * every event they have a callback for. Subscribe is called once after
+ * a successful Initialize with the host's LX_PLUGIN_SUBSCRIBE_VERSION
+ * and returns the number of entries filled in.
+ */
+#define LX_PLUGIN_SUBSCRIBE_VERSION     1
+#define LX_PLUGIN_MAX_SUBSCRIPTIONS     32
+
+enum PluginEvent {
+    LX_EVENT_PRE_EXECUTE = 0,
+    LX_EVENT_POST_EXECUTE,
+    LX_EVENT_MEM_READ,
+    LX_EVENT_MEM_WRITE,
+    LX_EVENT_WINAPI_PRECALL,
+    LX_EVENT_WINAPI_POSTCALL,
+    LX_EVENT_MEM_BATCH,
+    LX_EVENT_MEM_BATCH_ASYNC,
+    LX_EVENT_COUNT,
+};
+
+#define LX_EVENT_MASK(e)    (1u << (e))
+#define LX_ANY_MODULE       ((uint) -1)
+#define LX_ANY_API          ((uint) -1)
+
+struct PluginSubscription {
+    u32             Events;     /* LX_EVENT_MASK() of the events this entry covers */
+    u32             EipStart;   /* [EipStart, EipEnd) of the executed instruction, 0/0 = any */
+    u32             EipEnd;
+    u32             MemStart;   /* [MemStart, MemEnd) for memory events, 0/0 = any */
+    u32             MemEnd;
+    uint            Module;     /* module index of the executed instruction */
+    uint            ApiIndex;   /* winapi index for winapi events */
+
+    PluginSubscription() {
+        Events      = 0;
+        EipStart    = EipEnd = 0;
+        MemStart    = MemEnd = 0;
+        Module      = LX_ANY_MODULE;
+        ApiIndex    = LX_ANY_API;
+    }
+};
+
+typedef uint (* LochsEmu_Plugin_Subscribe)      (uint version, PluginSubscription *subs, uint maxCount);
+
+/*
+ * Batched memory events
+ *
+ * Instead of a MemRead/MemWrite call per access, a plugin may export
+ * LochsEmu_Processor_MemBatch: each processor then collects the accesses
+ * inside the subscribed ranges and hands them over in order at the end of
+ * every block (every instruction without the block cache) or when
+ * Emulator/MemBatchSize records have piled up. A plugin only gets the
+ * records inside its own ranges, and no call when there are none.
+ *
+ * LochsEmu_Processor_MemBatchAsync receives the same batches on a single
+ * worker thread while the guest keeps running. It is meant for analyses
+ * that only need the records; 'cpu' then only tells threads apart and
+ * must not be dereferenced.
+ */
+
 
 END_NAMESPACE_LOCHSEMU()
 
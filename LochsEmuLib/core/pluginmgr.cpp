@@ -2,17 +2,22 @@
 #include "pluginmgr.h"
 #include "diriter.h"
 #include "config.h"
+#include "processor.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
 
 PluginManager::PluginManager()
 {
-
+    m_enablePlugins     = false;
+    m_batchAnyAddress   = false;
+    m_batchWorker       = NULL;
+    m_batchStop         = false;
 }
 
 PluginManager::~PluginManager()
 {
+    StopMemBatchWorker();
     for (uint i = 0; i < m_plugins.size(); i++) {
         FreeLibrary(m_plugins[i].Handle);
     }
@@ -85,14 +90,88 @@ LxResult PluginManager::LoadPlugins()
     }
     LxInfo("%d plugins loaded\n", m_plugins.size());
     m_numPlugins = m_plugins.size();
+    BuildDispatchLists();
+
+    if (HasHandlers(LX_EVENT_MEM_BATCH_ASYNC)) {
+        m_batchWorker = CreateThread(NULL, 0, &PluginManager::MemBatchRoutine, this, 0, NULL);
+        if (m_batchWorker == NULL) {
+            LxError("Cannot create the memory event worker\n");
+            RET_FAIL(LX_RESULT_THREAD_FAILED);
+        }
+    }
     RET_SUCCESS();
 }
 
+void PluginManager::BuildDispatchLists()
+{
+    // m_plugins is not modified after loading, so the lists may point into it
+    for (auto &plugin : m_plugins) {
+        PluginSubscription subs[LX_PLUGIN_MAX_SUBSCRIPTIONS];
+        uint nSubs;
+        if (plugin.Subscribe) {
+            nSubs = plugin.Subscribe(LX_PLUGIN_SUBSCRIBE_VERSION, subs, LX_PLUGIN_MAX_SUBSCRIPTIONS);
+            if (nSubs > LX_PLUGIN_MAX_SUBSCRIPTIONS) {
+                LxWarning("Plugin %s: too many subscriptions\n", plugin.Info.Name);
+                nSubs = LX_PLUGIN_MAX_SUBSCRIPTIONS;
+            }
+        } else {
+            subs[0].Events = LX_EVENT_MASK(LX_EVENT_COUNT) - 1;
+            nSubs = 1;
+        }
+
+        for (uint i = 0; i < nSubs; i++) {
+            for (int e = 0; e < LX_EVENT_COUNT; e++) {
+                if (subs[i].Events & LX_EVENT_MASK(e)) {
+                    AddHandler((PluginEvent) e, &plugin, subs[i]);
+                }
+            }
+        }
+    }
+}
+
+void PluginManager::AddHandler( PluginEvent e, LoadedPluginInfo *plugin, const PluginSubscription &sub )
+{
+    bool hasCallback = false;
+    switch (e) {
+    case LX_EVENT_PRE_EXECUTE:      hasCallback = plugin->ProcessorPreExecute != NULL; break;
+    case LX_EVENT_POST_EXECUTE:     hasCallback = plugin->ProcessorPostExecute != NULL; break;
+    case LX_EVENT_MEM_READ:         hasCallback = plugin->ProcessorMemRead != NULL; break;
+    case LX_EVENT_MEM_WRITE:        hasCallback = plugin->ProcessorMemWrite != NULL; break;
+    case LX_EVENT_WINAPI_PRECALL:   hasCallback = plugin->WinapiPreCall != NULL; break;
+    case LX_EVENT_WINAPI_POSTCALL:  hasCallback = plugin->WinapiPostCall != NULL; break;
+    case LX_EVENT_MEM_BATCH:        hasCallback = plugin->ProcessorMemBatch != NULL; break;
+    case LX_EVENT_MEM_BATCH_ASYNC:  hasCallback = plugin->ProcessorMemBatchAsync != NULL; break;
+    default: Assert(0);
+    }
+    if (!hasCallback) {
+        if (plugin->Subscribe) {
+            LxWarning("Plugin %s subscribes to event %d without a callback\n", plugin->Info.Name, e);
+        }
+        return;
+    }
+
+    PluginFilter filter;
+    filter.Plugin   = plugin;
+    filter.EipStart = sub.EipStart;
+    filter.EipEnd   = sub.EipEnd;
+    filter.MemStart = sub.MemStart;
+    filter.MemEnd   = sub.MemEnd;
+    filter.Module   = sub.Module;
+    filter.ApiIndex = sub.ApiIndex;
+    m_handlers[e].push_back(filter);
+
+    if ((e == LX_EVENT_MEM_BATCH || e == LX_EVENT_MEM_BATCH_ASYNC) && sub.MemStart == sub.MemEnd) {
+        m_batchAnyAddress = true;
+    }
+}
+
 
 void PluginManager::LoadAPIAddrs( LoadedPluginInfo *plugin )
 {
     plugin->Cleanup = (LochsEmu_Plugin_Cleanup)
         GetProcAddress(plugin->Handle, "LochsEmu_Plugin_Cleanup");
+    plugin->Subscribe = (LochsEmu_Plugin_Subscribe)
+        GetProcAddress(plugin->Handle, "LochsEmu_Plugin_Subscribe");
     plugin->ProcessorPreExecute = (LochsEmu_Processor_PreExecute) 
         GetProcAddress(plugin->Handle, "LochsEmu_Processor_PreExecute");
     plugin->ProcessorPostExecute = (LochsEmu_Processor_PostExecute)
@@ -101,6 +180,10 @@ void PluginManager::LoadAPIAddrs( LoadedPluginInfo *plugin )
         GetProcAddress(plugin->Handle, "LochsEmu_Processor_MemRead");
     plugin->ProcessorMemWrite = (LochsEmu_Processor_MemWrite)
         GetProcAddress(plugin->Handle, "LochsEmu_Processor_MemWrite");
+    plugin->ProcessorMemBatch = (LochsEmu_Processor_MemBatch)
+        GetProcAddress(plugin->Handle, "LochsEmu_Processor_MemBatch");
+    plugin->ProcessorMemBatchAsync = (LochsEmu_Processor_MemBatch)
+        GetProcAddress(plugin->Handle, "LochsEmu_Processor_MemBatchAsync");
     plugin->ProcessPreRun = (LochsEmu_Process_PreRun)
         GetProcAddress(plugin->Handle, "LochsEmu_Process_PreRun");
     plugin->ProcessPostRun = (LochsEmu_Process_PostRun)
@@ -137,50 +220,190 @@ bool PluginManager::CheckPlugin( const LoadedPluginInfo &plugin )
 }
 
 
-LxResult PluginManager::OnProcessorPreExecute( Processor *cpu, const Instruction *inst )
+/*
+ * Matches the executed instruction, not EIP: by PostExecute EIP already
+ * points to the next one
+ */
+static INLINE bool MatchExecute( const PluginFilter &f, const Processor *cpu, const Instruction *inst )
 {
-    if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
-        if (plugin.ProcessorPreExecute)
-            plugin.ProcessorPreExecute(cpu, inst);
+    const u32 eip = (u32) inst->Main.VirtualAddr;
+    if (f.EipStart != f.EipEnd && (eip < f.EipStart || eip >= f.EipEnd))
+        return false;
+    return f.Module == LX_ANY_MODULE || cpu->GetCurrentModule() == f.Module;
+}
+
+static INLINE bool MatchMemory( const PluginFilter &f, u32 addr, u32 nBytes )
+{
+    return f.MemStart == f.MemEnd || (addr < f.MemEnd && addr + nBytes > f.MemStart);
+}
+
+static INLINE bool MatchWinapi( const PluginFilter &f, uint apiIndex )
+{
+    return f.ApiIndex == LX_ANY_API || f.ApiIndex == apiIndex;
+}
+
+/*
+ * A plugin with several matching entries is still called only once;
+ * its entries are adjacent in each list
+ */
+#define DISPATCH_EVENT(e, match, call)                              \
+    {                                                               \
+        const LoadedPluginInfo *last = NULL;                        \
+        for (auto &f : m_handlers[e]) {                             \
+            if (f.Plugin == last || !(match)) continue;             \
+            last = f.Plugin;                                        \
+            f.Plugin->call;                                         \
+        }                                                           \
     }
+
+LxResult PluginManager::OnProcessorPreExecute( Processor *cpu, const Instruction *inst )
+{
+    DISPATCH_EVENT(LX_EVENT_PRE_EXECUTE, MatchExecute(f, cpu, inst), ProcessorPreExecute(cpu, inst));
     RET_SUCCESS();
 }
 
 LxResult PluginManager::OnProcessorPostExecute( Processor *cpu, const Instruction *inst )
 {
-    if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
-        if (plugin.ProcessorPostExecute)
-            plugin.ProcessorPostExecute(cpu, inst);
-    }
+    DISPATCH_EVENT(LX_EVENT_POST_EXECUTE, MatchExecute(f, cpu, inst), ProcessorPostExecute(cpu, inst));
     RET_SUCCESS();
 }
 
 LxResult PluginManager::OnProcessorMemRead( const Processor *cpu, u32 addr, u32 nBytes, cpbyte data )
 {
-    if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
-        if (plugin.ProcessorMemRead)
-            plugin.ProcessorMemRead(cpu, addr, nBytes, data);
-    }
+    DISPATCH_EVENT(LX_EVENT_MEM_READ, MatchMemory(f, addr, nBytes), ProcessorMemRead(cpu, addr, nBytes, data));
     RET_SUCCESS();
 }
 
 LxResult PluginManager::OnProcessorMemWrite( const Processor *cpu, u32 addr, u32 nBytes, cpbyte data)
 {
-    if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
-        if (plugin.ProcessorMemWrite)
-            plugin.ProcessorMemWrite(cpu, addr, nBytes, data);
+    DISPATCH_EVENT(LX_EVENT_MEM_WRITE, MatchMemory(f, addr, nBytes), ProcessorMemWrite(cpu, addr, nBytes, data));
+    RET_SUCCESS();
+}
+
+LxResult PluginManager::OnProcessorMemBatch( const Processor *cpu, const MemAccessRecord *records, uint count )
+{
+    DispatchMemBatch(LX_EVENT_MEM_BATCH, cpu, records, count);
+    if (HasHandlers(LX_EVENT_MEM_BATCH_ASYNC)) {
+        PostMemBatch(cpu, records, count);
     }
     RET_SUCCESS();
 }
 
+/*
+ * The processor collects the union of all batch subscribers' ranges;
+ * each plugin only gets the records inside its own
+ */
+void PluginManager::DispatchMemBatch( PluginEvent e, const Processor *cpu, const MemAccessRecord *records, uint count )
+{
+    const std::vector<PluginFilter> &handlers = m_handlers[e];
+    std::vector<MemAccessRecord> matched;
+    uint i = 0;
+    while (i < handlers.size()) {
+        LoadedPluginInfo *plugin = handlers[i].Plugin;
+        uint end = i;
+        bool anyAddress = false;
+        for (; end < handlers.size() && handlers[end].Plugin == plugin; end++) {
+            if (handlers[end].MemStart == handlers[end].MemEnd) anyAddress = true;
+        }
+
+        const MemAccessRecord *batch = records;
+        uint n = count;
+        if (!anyAddress) {
+            matched.clear();
+            for (uint j = 0; j < count; j++) {
+                for (uint k = i; k < end; k++) {
+                    if (MatchMemory(handlers[k], records[j].Address, records[j].Size)) {
+                        matched.push_back(records[j]);
+                        break;
+                    }
+                }
+            }
+            batch = matched.empty() ? NULL : &matched[0];
+            n = (uint) matched.size();
+        }
+        if (n > 0) {
+            if (e == LX_EVENT_MEM_BATCH) {
+                plugin->ProcessorMemBatch(cpu, batch, n);
+            } else {
+                plugin->ProcessorMemBatchAsync(cpu, batch, n);
+            }
+        }
+        i = end;
+    }
+}
+
+bool PluginManager::MatchMemBatch( u32 addr, u32 nBytes ) const
+{
+    for (auto &f : m_handlers[LX_EVENT_MEM_BATCH]) {
+        if (MatchMemory(f, addr, nBytes)) return true;
+    }
+    for (auto &f : m_handlers[LX_EVENT_MEM_BATCH_ASYNC]) {
+        if (MatchMemory(f, addr, nBytes)) return true;
+    }
+    return false;
+}
+
+void PluginManager::PostMemBatch( const Processor *cpu, const MemAccessRecord *records, uint count )
+{
+    MutexCSLock lock(m_batchLock);
+    // a slow consumer holds the guest back rather than piling up batches
+    while (m_batchQueue.size() >= MaxPendingBatches && !m_batchStop) {
+        m_batchChanged.Wait(m_batchLock);
+    }
+    if (m_batchStop) return;
+
+    PendingMemBatch *batch = new PendingMemBatch;
+    batch->Cpu = cpu;
+    batch->Records.assign(records, records + count);
+    m_batchQueue.push_back(batch);
+    m_batchChanged.WakeAll();
+}
+
+DWORD WINAPI PluginManager::MemBatchRoutine( LPVOID lpParams )
+{
+    PluginManager *mgr = (PluginManager *) lpParams;
+    mgr->MemBatchLoop();
+    return 0;
+}
+
+void PluginManager::MemBatchLoop()
+{
+    while (true) {
+        PendingMemBatch *batch = NULL;
+        {
+            MutexCSLock lock(m_batchLock);
+            while (m_batchQueue.empty() && !m_batchStop) {
+                m_batchChanged.Wait(m_batchLock);
+            }
+            // queued batches are still delivered after a stop
+            if (m_batchQueue.empty()) break;
+            batch = m_batchQueue.front();
+            m_batchQueue.pop_front();
+            m_batchChanged.WakeAll();
+        }
+        DispatchMemBatch(LX_EVENT_MEM_BATCH_ASYNC, batch->Cpu, &batch->Records[0], (uint) batch->Records.size());
+        delete batch;
+    }
+}
+
+void PluginManager::StopMemBatchWorker()
+{
+    if (m_batchWorker == NULL) return;
+    {
+        MutexCSLock lock(m_batchLock);
+        m_batchStop = true;
+        m_batchChanged.WakeAll();
+    }
+    WaitForSingleObject(m_batchWorker, INFINITE);
+    CloseHandle(m_batchWorker);
+    m_batchWorker = NULL;
+}
+
 LxResult PluginManager::OnExit( void )
 {
     if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
+    StopMemBatchWorker();
+    for (auto &plugin : m_plugins) {
         if (plugin.Cleanup)
             plugin.Cleanup();
     }
@@ -190,7 +413,7 @@ LxResult PluginManager::OnExit( void )
 LxResult PluginManager::OnProcessPreRun( const Process *proc, Processor *cpu )
 {
     if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
+    for (auto &plugin : m_plugins) {
         if (plugin.ProcessPreRun)
             plugin.ProcessPreRun(proc, cpu);
     }
@@ -200,7 +423,7 @@ LxResult PluginManager::OnProcessPreRun( const Process *proc, Processor *cpu )
 LxResult PluginManager::OnProcessPostRun( const Process *proc )
 {
     if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
+    for (auto &plugin : m_plugins) {
         if (plugin.ProcessPostRun)
             plugin.ProcessPostRun(proc);
     }
@@ -210,7 +433,7 @@ LxResult PluginManager::OnProcessPostRun( const Process *proc )
 LxResult PluginManager::OnProcessPreLoad( PeLoader *loader )
 {
     if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
+    for (auto &plugin : m_plugins) {
         if (plugin.ProcessPreLoad)
             plugin.ProcessPreLoad(loader);
     }
@@ -220,7 +443,7 @@ LxResult PluginManager::OnProcessPreLoad( PeLoader *loader )
 LxResult PluginManager::OnProcessPostLoad( PeLoader *loader )
 {
     if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
+    for (auto &plugin : m_plugins) {
         if (plugin.ProcessPostLoad)
             plugin.ProcessPostLoad(loader);
     }
@@ -229,28 +452,20 @@ LxResult PluginManager::OnProcessPostLoad( PeLoader *loader )
 
 LxResult PluginManager::OnWinapiPreCall( Processor *cpu, uint apiIndex )
 {
-    if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
-        if (plugin.WinapiPreCall)
-            plugin.WinapiPreCall(cpu, apiIndex);
-    }
+    DISPATCH_EVENT(LX_EVENT_WINAPI_PRECALL, MatchWinapi(f, apiIndex), WinapiPreCall(cpu, apiIndex));
     RET_SUCCESS();
 }
 
 LxResult PluginManager::OnWinapiPostCall( Processor *cpu, uint apiIndex )
 {
-    if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
-        if (plugin.WinapiPostCall)
-            plugin.WinapiPostCall(cpu, apiIndex);
-    }
+    DISPATCH_EVENT(LX_EVENT_WINAPI_POSTCALL, MatchWinapi(f, apiIndex), WinapiPostCall(cpu, apiIndex));
     RET_SUCCESS();
 }
 
 LochsEmu::LxResult PluginManager::OnThreadCreate( Thread *thrd )
 {
     if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
+    for (auto &plugin : m_plugins) {
         if (plugin.ThreadCreate)
             plugin.ThreadCreate(thrd);
     }
@@ -260,7 +475,7 @@ LochsEmu::LxResult PluginManager::OnThreadCreate( Thread *thrd )
 LochsEmu::LxResult PluginManager::OnThreadExit( Thread *thrd )
 {
     if (!m_enablePlugins) RET_SUCCESS();
-    for (auto plugin : m_plugins) {
+    for (auto &plugin : m_plugins) {
         if (plugin.ThreadExit)
             plugin.ThreadExit(thrd);
     }
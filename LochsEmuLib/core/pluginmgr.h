@@ -5,6 +5,7 @@
 
 #include "lochsemu.h"
 #include "pluginapi.h"
+#include "parallel.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -16,10 +17,13 @@ struct LoadedPluginInfo {
      */
     LochsEmu_Plugin_Initialize      Init;
     LochsEmu_Plugin_Cleanup         Cleanup;
+    LochsEmu_Plugin_Subscribe       Subscribe;
     LochsEmu_Processor_PreExecute   ProcessorPreExecute;
     LochsEmu_Processor_PostExecute  ProcessorPostExecute;
     LochsEmu_Processor_MemRead      ProcessorMemRead;
     LochsEmu_Processor_MemWrite     ProcessorMemWrite;
+    LochsEmu_Processor_MemBatch     ProcessorMemBatch;
+    LochsEmu_Processor_MemBatch     ProcessorMemBatchAsync;
     LochsEmu_Process_PreRun         ProcessPreRun;
     LochsEmu_Process_PostRun        ProcessPostRun;
     LochsEmu_Process_PreLoad        ProcessPreLoad;
@@ -33,10 +37,13 @@ struct LoadedPluginInfo {
         Handle                      = (HMODULE) 0;
         Init                        = NULL;
         Cleanup                     = NULL;
+        Subscribe                   = NULL;
         ProcessorPreExecute         = NULL;
         ProcessorPostExecute        = NULL;
         ProcessorMemRead            = NULL;
         ProcessorMemWrite           = NULL;
+        ProcessorMemBatch           = NULL;
+        ProcessorMemBatchAsync      = NULL;
         ProcessPreRun               = NULL;
         ProcessPostRun              = NULL;
         ProcessPreLoad              = NULL;
@@ -48,6 +55,29 @@ struct LoadedPluginInfo {
     }
 };
 
+/*
+ * One entry of a per-event dispatch list
+ */
+struct PluginFilter {
+    LoadedPluginInfo *  Plugin;
+    u32                 EipStart;
+    u32                 EipEnd;
+    u32                 MemStart;
+    u32                 MemEnd;
+    uint                Module;
+    uint                ApiIndex;
+};
+
+/*
+ * Batched memory events of one processor, not delivered yet
+ */
+struct MemEventBatch {
+    std::vector<MemAccessRecord>    Records;
+    uint                            Count;
+
+    MemEventBatch(uint capacity) : Records(capacity), Count(0) {}
+};
+
 class PluginManager {
 public:
     PluginManager();
@@ -59,6 +89,7 @@ public:
     LxResult OnProcessorPostExecute (Processor *cpu, const Instruction *inst);
     LxResult OnProcessorMemRead     (const Processor *cpu, u32 addr, u32 nBytes, cpbyte data);
     LxResult OnProcessorMemWrite    (const Processor *cpu, u32 addr, u32 nBytes, cpbyte data);
+    LxResult OnProcessorMemBatch    (const Processor *cpu, const MemAccessRecord *records, uint count);
     LxResult OnProcessPreRun        (const Process *proc, Processor *cpu);
     LxResult OnProcessPostRun       (const Process *proc);
     LxResult OnProcessPreLoad       (PeLoader *loader);
@@ -68,11 +99,50 @@ public:
     LxResult OnThreadCreate         (Thread *thrd);
     LxResult OnThreadExit           (Thread *thrd);
 
+    /*
+     * True if any loaded plugin hooks PreExecute or PostExecute
+     */
+    bool     WantsInstructionEvents (void) const { return HasHandlers(LX_EVENT_PRE_EXECUTE) || HasHandlers(LX_EVENT_POST_EXECUTE); }
+
+    /*
+     * True if any loaded plugin hooks MemRead or MemWrite
+     */
+    bool     WantsMemoryEvents      (void) const { return HasHandlers(LX_EVENT_MEM_READ) || HasHandlers(LX_EVENT_MEM_WRITE) || WantsMemoryBatches(); }
+
+    /*
+     * True if any loaded plugin takes batched memory events
+     */
+    bool     WantsMemoryBatches     (void) const { return HasHandlers(LX_EVENT_MEM_BATCH) || HasHandlers(LX_EVENT_MEM_BATCH_ASYNC); }
+
+    /*
+     * True if an access falls in the range of any batch subscription
+     */
+    bool     InMemBatchRange        (u32 addr, u32 nBytes) const { return m_batchAnyAddress || MatchMemBatch(addr, nBytes); }
+
+    bool     HasHandlers            (PluginEvent e) const { return !m_handlers[e].empty(); }
+
 private:
     bool            FindPluginDirectory();
     LxResult        LoadPlugins();
     void            LoadAPIAddrs(LoadedPluginInfo *plugin);
     bool            CheckPlugin(const LoadedPluginInfo &plugin);
+    void            BuildDispatchLists();
+    void            AddHandler(PluginEvent e, LoadedPluginInfo *plugin, const PluginSubscription &sub);
+    bool            MatchMemBatch(u32 addr, u32 nBytes) const;
+    void            DispatchMemBatch(PluginEvent e, const Processor *cpu, const MemAccessRecord *records, uint count);
+
+    /*
+     * Worker thread for LX_EVENT_MEM_BATCH_ASYNC
+     */
+    struct PendingMemBatch {
+        const Processor *               Cpu;
+        std::vector<MemAccessRecord>    Records;
+    };
+    static const uint   MaxPendingBatches = 64;
+    static DWORD WINAPI MemBatchRoutine(LPVOID lpParams);
+    void            MemBatchLoop();
+    void            PostMemBatch(const Processor *cpu, const MemAccessRecord *records, uint count);
+    void            StopMemBatchWorker();
 
 private:
     std::string         m_pluginDirectory;
@@ -82,6 +152,14 @@ private:
     PluginTable         m_plugins;
     uint                m_numPlugins;
     bool                m_enablePlugins;
+    std::vector<PluginFilter>   m_handlers[LX_EVENT_COUNT];
+    bool                m_batchAnyAddress;  // a batch subscription without a range
+
+    HANDLE              m_batchWorker;
+    MutexCS             m_batchLock;
+    ConditionVariable   m_batchChanged;
+    std::deque<PendingMemBatch *>   m_batchQueue;
+    bool                m_batchStop;
 
 };
 
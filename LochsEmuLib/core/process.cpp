@@ -9,6 +9,8 @@
 #include "win32.h"
 #include "processor.h"
 #include "config.h"
+#include "scheduler.h"
+#include "syncmgr.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -19,17 +21,27 @@ Process::Process()
     m_loader        = NULL;
     m_PebAddress    = 0;
     m_plugins       = NULL;
+    m_scheduler     = NULL;
+    m_sync          = NULL;
+    m_resumed       = false;
+    m_threadSerial  = 0;
 
     ZeroMemory(m_threads, sizeof(m_threads));
+    // hand out low indexes first; 0 is the main thread
+    m_freeThreadIds.reserve(MaximumThreads);
+    for (int i = MaximumThreads - 1; i >= 1; i--)
+        m_freeThreadIds.push_back(i);
 }
 
 Process::~Process()
 {
+    SAFE_DELETE(m_scheduler);
     for (int i = 0; i < MaximumThreads; i++)
         SAFE_DELETE(m_threads[i]);
+    SAFE_DELETE(m_sync);
 
     for (uint i = 0; i < m_heaps.size(); i++) {
-        Mem()->DestroyHeap(m_heaps[i]);
+        if (m_heaps[i]) Mem()->DestroyHeap(m_heaps[i]);
     }
     m_heaps.clear();
 
@@ -58,7 +70,9 @@ LochsEmu::LxResult Process::Initialize(Emulator *emu)
     V_RETURN( InitHeap() );
     V_RETURN( InitPEB() );
 
+    m_sync = new SyncManager(this);
     V_RETURN( InitMainThread() );
+    V_RETURN( InitScheduler() );
 
     LoadApiInfo();
     
@@ -124,6 +138,29 @@ HeapID Process::CreateHeap( u32 reserve, u32 commit, uint flags )
 }
 
 
+std::vector<u32> Process::GetHeapBases() const
+{
+    std::vector<u32> bases;
+    for (uint i = 0; i < m_heaps.size(); i++) {
+        bases.push_back(m_heaps[i] ? m_heaps[i]->Base() : 0);
+    }
+    return bases;
+}
+
+bool Process::SetHeapBases( const std::vector<u32> &bases )
+{
+    SyncObjectLock lock(*m_memory);
+    std::vector<Heap *> heaps;
+    for (uint i = 0; i < bases.size(); i++) {
+        Section *sec = bases[i] ? Mem()->GetSection(bases[i]) : NULL;
+        if (bases[i] && (sec == NULL || sec->Base() != bases[i] || !Mem()->IsHeap(sec)))
+            return false;
+        heaps.push_back((Heap *) sec);
+    }
+    m_heaps = heaps;
+    return true;
+}
+
 bool Process::DestroyHeap( HeapID id )
 {
     Assert(id < m_heaps.size());
@@ -141,6 +178,8 @@ LochsEmu::LxResult Process::InitMainThread()
     ThreadID realId = GetCurrentThreadId();
     HANDLE hThread = OpenThread(THREAD_ALL_ACCESS, FALSE, realId);
     m_threads[ID]   = new Thread(this, ID, ID, realId, hThread);
+    m_threadsByExtID[realId] = m_threads[ID];
+    m_sync->ThreadStarted();
 
     ThreadInfo info;
     info.EntryPoint = GetModuleInfo(0)->EntryPoint;
@@ -158,24 +197,42 @@ LochsEmu::LxResult Process::InitMainThread()
     RET_SUCCESS();
 }
 
+LochsEmu::LxResult Process::InitScheduler()
+{
+    int workers = LxConfig.GetInt("Emulator", "ThreadPool", 0);
+    if (workers <= 0) RET_SUCCESS();
+
+    u32 timeSlice = (u32) LxConfig.GetInt("Emulator", "TimeSlice", 10000);
+    m_scheduler = new Scheduler(this, workers, max(timeSlice, 1u));
+    return m_scheduler->Start();
+}
+
 LochsEmu::LxResult Process::Run()
 {
     std::vector<uint>   moduleLoad;
 
-    /* Run each DllMain */
-    for (uint i = m_loader->GetNumOfModules() - 1; i >= 1; i--) {
-        V( m_threads[0]->RunModuleEntry(i, LX_LOAD_PROCESS_ATTACH, LX_LOAD_STATIC) );
+    /* Run each DllMain; a restored snapshot is already past them */
+    if (!m_resumed) {
+        for (uint i = m_loader->GetNumOfModules() - 1; i >= 1; i--) {
+            V( m_threads[0]->RunModuleEntry(i, LX_LOAD_PROCESS_ATTACH, LX_LOAD_STATIC) );
+        }
     }
     moduleLoad = m_threads[0]->GetModuleLoadOrder();
     Assert(moduleLoad.size() == m_loader->GetNumOfModules() - 1);
 
     /* Prolog */
-    ProcessProlog();
+    if (!m_resumed) ProcessProlog();
 
     V( Plugins()->OnProcessPreRun(this, m_threads[0]->CPU()) );
     
     /* Run main thread */
-    V( m_threads[0]->Run() );
+    if (m_resumed) {
+        V( m_threads[0]->Resume() );
+    } else {
+        V( m_threads[0]->Run() );
+    }
+
+    if (m_scheduler) m_scheduler->Stop();
 
     /* Epilog */
     ProcessEpilog();
@@ -198,14 +255,29 @@ Thread * Process::ThreadCreate( const ThreadInfo &ti )
 
     ThreadID id = FindNextThreadId();
     m_threads[id] = new Thread(this, ti.ParentId, id);
+    m_threads[id]->Serial = ++m_threadSerial;
 
     V( m_threads[id]->Initialize(ti) );
 
+    m_sync->ThreadStarted();
+    if (m_scheduler) {
+        // the guest waits on, queries and closes it like a thread handle
+        m_threads[id]->Handle   = m_sync->NewThread();
+        m_sync->Retain(m_threads[id]->Handle);      // released by Scheduler::Finish
+        m_threads[id]->ExtID    = m_scheduler->NextThreadId();
+        m_threadsByExtID[m_threads[id]->ExtID] = m_threads[id];
+
+        m_plugins->OnThreadCreate(m_threads[id]);
+        m_scheduler->Add(m_threads[id], (ti.Flags & CREATE_SUSPENDED) != 0);
+        return m_threads[id];
+    }
+
     HANDLE hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) &LxThreadRoutine, 
         m_threads[id], ti.Flags, NULL);
 
     m_threads[id]->Handle   = hThread;
     m_threads[id]->ExtID = GetThreadId(hThread);
+    m_threadsByExtID[m_threads[id]->ExtID] = m_threads[id];
 
     m_plugins->OnThreadCreate(m_threads[id]);
 
@@ -218,13 +290,11 @@ void Process::ThreadExit( ThreadID id, u32 code )
     SyncObjectLock lock(*this);
 
     LxInfo("Exiting thread [%x] with exit code %d\n", id, code);
-    int i = 1;
-    for (; i < MaximumThreads; i++)
-        if (m_threads[i] != NULL && m_threads[i]->ExtID == id) break;
-    if (i == MaximumThreads) {
+    auto iter = m_threadsByExtID.find(id);
+    if (iter == m_threadsByExtID.end() || iter->second->IntID == 0) {
         LxFatal("No thread has ID [%x]\n", id);
     }
-    m_threads[i]->Exit(code);
+    iter->second->Exit(code);
 }
 
 
@@ -376,31 +446,43 @@ void Process::Terminate()
     m_threads[0]->CPU()->Terminate(0);
 }
 
-ThreadID Process::FindNextThreadId() const
+ThreadID Process::FindNextThreadId()
 {
-    for (int i = 1; i < MaximumThreads; i++)
-        if (m_threads[i] == NULL) return i;
-    LxFatal("Cannot find valid thread ID\n");
-    return -1;
+    if (m_freeThreadIds.empty()) {
+        LxFatal("Cannot find valid thread ID\n");
+        return -1;
+    }
+    ThreadID id = m_freeThreadIds.back();
+    m_freeThreadIds.pop_back();
+    return id;
 }
 
 Thread * Process::GetThreadRealID( ThreadID id ) const
 {
-    for (int i = 0; i < MaximumThreads; i++)
-        if (m_threads[i] != NULL && m_threads[i]->ExtID == id)
-            return m_threads[i];
-    return NULL;
+    SyncObjectLock lock(*this);
+
+    auto iter = m_threadsByExtID.find(id);
+    return iter == m_threadsByExtID.end() ? NULL : iter->second;
+}
+
+bool Process::ThreadResume( HANDLE hThread )
+{
+    return m_scheduler != NULL && m_scheduler->Resume(hThread);
 }
 
 void Process::ThreadDelete( ThreadID id )
-      {
+{
+    SyncObjectLock lock(*this);
 
-    for (int i = 0; i < MaximumThreads; i++) {
-        if (m_threads[i] != NULL && m_threads[i]->ExtID == id) {
-            LxDebug("Deleting thread [%x]\n", id);
-            SAFE_DELETE(m_threads[i]);
-        }
-    }
+    auto iter = m_threadsByExtID.find(id);
+    if (iter == m_threadsByExtID.end()) return;
+
+    LxDebug("Deleting thread [%x]\n", id);
+    const int intId = iter->second->IntID;
+    m_threadsByExtID.erase(iter);
+    m_sync->ThreadExited(m_threads[intId]);
+    SAFE_DELETE(m_threads[intId]);
+    m_freeThreadIds.push_back(intId);
 }
 
 
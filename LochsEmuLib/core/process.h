@@ -18,7 +18,7 @@ struct ApiInfo {
 class LX_API Process : public MutexSyncObject {
 public:
     static const uint   ProcessHeapStart = 0x1000;
-    static const int    MaximumThreads = 8;
+    static const int    MaximumThreads = 1024;
 
 public:
     Process();
@@ -31,17 +31,26 @@ public:
 
     LxResult        Initialize(Emulator *emu);
     LxResult        Run();
+    /* Run() continues the main thread instead of starting it, see Snapshot */
+    void            SetResumed() { m_resumed = true; }
     void            Terminate();
 
     Thread *        ThreadCreate(const ThreadInfo &ti);
     void            ThreadExit(ThreadID id, u32 code);
     void            ThreadDelete(ThreadID id);
+    bool            ThreadResume(HANDLE hThread);
 
     HeapID          CreateHeap(u32 reserve, u32 commit, uint flags);
     bool            DestroyHeap(HeapID id);
     Thread *        GetThread(ThreadID id) const { Assert(id < MaximumThreads); return m_threads[id]; }
     Thread *        GetThreadRealID(ThreadID id) const;
+    Scheduler *     GetScheduler() const { return m_scheduler; }
+    SyncManager *   Sync() const { Assert(m_sync); return m_sync; }
     Heap *          GetHeap(uint id) const { return m_heaps[id - ProcessHeapStart]; }
+    /* base of each heap by HeapID, 0 for destroyed ones */
+    std::vector<u32>    GetHeapBases() const;
+    bool            SetHeapBases(const std::vector<u32> &bases);
+    uint            GetThreadCount() const { return (uint) m_threadsByExtID.size(); }
     u32             GetPEBAddress() const { return m_PebAddress; }
     HMODULE         GetModule(LPCSTR lpName);
     HMODULE         GetModule(LPCWSTR lpName);
@@ -58,11 +67,12 @@ protected:
     LxResult        InitHeap();
     LxResult        InitPEB();
     LxResult        InitMainThread();
+    LxResult        InitScheduler();
     u32             DetermineHeapBase(u32 base, u32 reserve);
     void            ProcessProlog();
     void            ProcessEpilog();
     void            LoadApiInfo();
-    ThreadID        FindNextThreadId() const;
+    ThreadID        FindNextThreadId();
 
 protected:
     Emulator *      m_emu;
@@ -71,8 +81,14 @@ protected:
     PluginManager * m_plugins;
 
     Thread *        m_threads[MaximumThreads];  // main thread is always m_threads[0]
+    std::vector<ThreadID>   m_freeThreadIds;    // unused indexes of m_threads
+    std::unordered_map<ThreadID, Thread *>  m_threadsByExtID;
+    Scheduler *     m_scheduler;    // NULL unless guest threads run on a pool
+    SyncManager *   m_sync;
     std::vector<Heap *>     m_heaps; /* [0] is process main heap */
     u32             m_PebAddress;
+    bool            m_resumed;
+    u32             m_threadSerial;     // Serial of the last thread created
 
     /*
      * ģ鵼ַģƺͺƵӳ
@@ -8,6 +8,10 @@
 #include "coprocessor.h"
 #include "winapi.h"
 #include "process.h"
+#include "blockcache.h"
+#include "softtlb.h"
+#include "config.h"
+#include "snapshot.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -15,10 +19,26 @@ Processor::Processor(int id, Thread *thread) : IntID(id)
 {
     Assert(thread);
     m_thread = thread;
+    m_blocks = NULL;
+    m_tlb = NULL;
+    m_memBatch = NULL;
+    m_lazyFlags = false;
+    m_bulkStrings = false;
+    m_deferFlags = false;
+    m_instCount = 0;
+    m_yield = false;
+    m_snapshotAt = 0;
 }
 
 Processor::~Processor()
 {
+    SAFE_DELETE(m_blocks);
+    if (m_tlb) {
+        LxDebug("Processor %d soft TLB: %I64u hits, %I64u misses\n", IntID,
+            m_tlb->Hits(), m_tlb->Misses());
+        SAFE_DELETE(m_tlb);
+    }
+    SAFE_DELETE(m_memBatch);
     Mem = NULL;
     m_emulator = NULL;
 }
@@ -36,6 +56,37 @@ LxResult Processor::Initialize()
     V( m_fpu.Initialize() );
     SIMD.Initialize();
     Exception.Initialize(this);
+
+    // Blocks skip the per-instruction plugin fan-out, so only use them
+    // when no plugin has asked for PreExecute/PostExecute events
+    SAFE_DELETE(m_blocks);
+    if (LxConfig.GetInt("Emulator", "EnableBlockCache", 1) != 0 &&
+        !m_plugins->WantsInstructionEvents())
+    {
+        m_blocks = new BlockCache();
+    }
+    m_lazyFlags = LxConfig.GetInt("Emulator", "LazyFlags", 0) != 0;
+
+    // Bulk string loops skip the per-iteration events plugins may rely on
+    m_bulkStrings = LxConfig.GetInt("Emulator", "BulkStrings", 1) != 0 &&
+        !m_plugins->WantsInstructionEvents() && !m_plugins->WantsMemoryEvents();
+
+    // the flat page map already resolves every page without a miss path
+    SAFE_DELETE(m_tlb);
+    if (LxConfig.GetInt("Emulator", "EnableSoftTlb", 1) != 0 && !Mem->HasPageMap()) {
+        m_tlb = new SoftTlb(Mem);
+    }
+
+    SAFE_DELETE(m_memBatch);
+    if (m_plugins->WantsMemoryBatches()) {
+        m_memBatch = new MemEventBatch(max(LxConfig.GetInt("Emulator", "MemBatchSize", 4096), 2));
+    }
+
+    // Emulator/SnapshotAt=<eip>: the main thread saves Emulator/SaveSnapshot the first time it gets there
+    m_snapshotAt = 0;
+    if (m_thread->IntID == 0 && !LxConfig.GetString("Emulator", "SaveSnapshot", "").empty()) {
+        m_snapshotAt = LxConfig.GetUint("Emulator", "SnapshotAt", 0);
+    }
     RET_SUCCESS();
 }
 
@@ -61,21 +112,31 @@ void Processor::Reset()
     m_fpu.Reset();
     m_currSection = NULL;
     m_lastEip = 0;
+    m_pendingFlags = LazyFlags();
+    m_deferFlags = false;
+    m_yield = false;
     ClearExecFlags();
 }
 
-LxResult Processor::Step()
+const Instruction * Processor::FetchInstruction( u32 eip )
 {
     // look up the inst decode cache
-    m_inst = m_instCache.Lookup(EIP);
-
-    if (NULL == m_inst) {
-        // fetch at current EIP
-        pbyte codePtr = GetCodePtr();
-        m_inst = new Instruction();
-        LxDecode(codePtr, m_inst, EIP);
-        m_instCache.Insert(EIP, m_inst);
+    Instruction *inst = m_instCache.Lookup(eip);
+
+    if (NULL == inst) {
+        // fetch at eip
+        pbyte codePtr = GetCodePtr(eip);
+        inst = new Instruction();
+        LxDecode(codePtr, inst, eip);
+        m_instCache.Insert(eip, inst);
+        if (m_blocks) m_blocks->AddDecoded(eip, inst->Length > 0 ? inst->Length : 1);
     }
+    return inst;
+}
+
+LxResult Processor::Step()
+{
+    m_inst = (Instruction *) FetchInstruction(EIP);
 
     m_currSection = Mem->GetSection(EIP);
 
@@ -85,7 +146,11 @@ LxResult Processor::Step()
     m_plugins->OnProcessorPreExecute(this, m_inst);
 
     V( Execute(m_inst) );
+    m_instCount++;
+
+    MaterializeFlags();
 
+    FlushMemBatch();
     m_plugins->OnProcessorPostExecute(this, m_inst);
 
     Assert(EIP == TERMINATE_EIP || Mem->Contains(EIP));
@@ -96,27 +161,144 @@ LxResult Processor::Step()
     RET_SUCCESS();
 }
 
-LxResult Processor::Run(u32 entry)
+BasicBlock * Processor::BuildBlock( u32 eip )
 {
-    EIP = entry; 
+    Section *sec = Mem->GetSection(eip);
+    Assert(sec);
+    BasicBlock *block = new BasicBlock(eip, sec);
+
+    u32 addr = eip;
+    while (block->Entries.size() < BlockCache::MaxBlockInsts && sec->Contains(addr)) {
+        // the snapshot EIP has to be reached between two blocks
+        if (addr == m_snapshotAt && addr != eip) break;
+        const Instruction *inst = FetchInstruction(addr);
+        BasicBlock::Entry entry = { inst, ResolveHandler(inst) };
+        bool invalid = inst->Length <= 0 || entry.Handler == NULL;
+        // leave bad instructions to be reported when actually reached
+        if (invalid && !block->Entries.empty()) break;
+        block->Entries.push_back(entry);
+        if (invalid) break;
+        addr += inst->Length;
+        if (inst->Main.Inst.BranchType != 0) break;
+    }
+    block->End = max(addr, eip + 1);
+    m_blocks->Insert(block);
+    return block;
+}
 
-    LxInfo("Running Thread[%x] at EIP[0x%08x] ESP[0x%08X]\n", m_thread->ExtID, EIP, ESP);
+void Processor::FlushCodePages()
+{
+    std::vector<u32> stale;
+    m_blocks->FlushDirty(stale);
+    for (auto addr : stale) {
+        const Instruction *inst = m_instCache.Lookup(addr);
+        if (inst == NULL) continue;
+        m_blocks->RemoveDecoded(addr, inst->Length > 0 ? inst->Length : 1);
+        m_instCache.Remove(addr);
+    }
+}
 
+LxResult Processor::StepBlock()
+{
+    Assert(m_blocks);
+
+    BasicBlock *block = m_blocks->Lookup(EIP);
+    if (NULL == block) {
+        block = BuildBlock(EIP);
+    }
+
+    m_currSection = block->Sec;
+
+    /*
+     * Leave the block as soon as control goes anywhere other than the next
+     * instruction: taken branches, REP iterations, WinAPI calls, exceptions,
+     * or a write to a page holding cached code
+     */
+    const u32 execFlags = m_execFlags;
+    for (uint i = 0; i < block->Entries.size(); i++) {
+        const BasicBlock::Entry &entry = block->Entries[i];
+        const u32 nextEip = EIP + entry.Inst->Length;
+        m_inst = (Instruction *) entry.Inst;
+
+        V( Execute(entry.Inst, entry.Handler) );
+        m_instCount++;
+
+        m_execFlags = execFlags;
+        if (EIP != nextEip || m_terminated || m_blocks->HasDirty()) break;
+    }
+
+    if (m_blocks->HasDirty()) {
+        m_inst = NULL;
+        FlushCodePages();
+    }
+
+    MaterializeFlags();
+
+    FlushMemBatch();
+
+    Assert(EIP == TERMINATE_EIP || Mem->Contains(EIP));
+
+    ClearExecFlags();
+
+    RET_SUCCESS();
+}
+
+LxResult Processor::Run(u32 entry)
+{
+    BeginRun(entry);
+    return Resume();
+}
+
+LxResult Processor::Resume()
+{
     m_terminated = false;
     while (true) {
-        LxResult lr = Step();
+        LxResult lr = m_blocks ? StepBlock() : Step();
         if (LX_FAILED(lr)) { RET_FAIL(lr); }
         if (m_terminated) { break; }
         if (EIP == TERMINATE_EIP) {
             m_thread->ExitCode = EAX;
             break;
         }
+        if (EIP == m_snapshotAt) SaveSnapshotHere();
     }
 
     LxDebug("Thread [%x] terminated\n", m_thread->ExtID);
     RET_SUCCESS();
 }
 
+void Processor::BeginRun( u32 entry )
+{
+    EIP = entry; 
+
+    LxInfo("Running Thread[%x] at EIP[0x%08x] ESP[0x%08X]\n", m_thread->ExtID, EIP, ESP);
+
+    m_terminated = false;
+}
+
+LxResult Processor::RunSlice( u32 budget, bool *finished )
+{
+    // a block may overrun the budget by a few instructions
+    const u64 start = m_instCount;
+    *finished = false;
+    while (m_instCount - start < budget) {
+        LxResult lr = m_blocks ? StepBlock() : Step();
+        if (LX_FAILED(lr)) { RET_FAIL(lr); }
+        if (m_terminated) { *finished = true; break; }
+        if (EIP == TERMINATE_EIP) {
+            m_thread->ExitCode = EAX;
+            *finished = true;
+            break;
+        }
+        if (m_yield) { break; }
+    }
+    m_yield = false;
+    if (*finished) {
+        LxDebug("Thread [%x] terminated\n", m_thread->ExtID);
+    }
+    RET_SUCCESS();
+}
+
 LxResult Processor::RunCallback(uint id)
 {
     //LxDebug("Running callback #%d\n", id);
@@ -135,7 +317,7 @@ LxResult Processor::RunConditional( u32 entry )
     m_terminated = false;
     while (true) {
         SetExecFlag(LX_EXEC_CALLBACK);
-        LxResult lr = Step();
+        LxResult lr = m_blocks ? StepBlock() : Step();
         if (LX_FAILED(lr)) { RET_FAIL(lr); }
         if (m_terminated || EIP == TERMINATE_EIP) break;
     }
@@ -146,10 +328,12 @@ LxResult Processor::RunConditional( u32 entry )
 
 LxResult Processor::Execute( const Instruction *inst )
 {
-    m_lastEip = EIP;
-    EIP += inst->Length;
+    return Execute(inst, ResolveHandler(inst));
+}
 
-    InstHandler h;
+Processor::InstHandler Processor::ResolveHandler( const Instruction *inst ) const
+{
+    InstHandler h = NULL;
 
     if (INST_ONEBYTE(inst->Main.Inst.Opcode)) {
         h = InstTableOneByte[inst->Main.Inst.Opcode];
@@ -160,10 +344,30 @@ LxResult Processor::Execute( const Instruction *inst )
     } else if (inst->Main.Inst.Opcode == 0x0f3a63) {
         h = &Processor::Pcmpistri_660F3A63;
     }
-    else {
+    return h;
+}
+
+LxResult Processor::Execute( const Instruction *inst, InstHandler h )
+{
+    if (h == NULL) {
         LxFatal("Unsupported instruction: %s\n", inst->Main.CompleteInstr);
     }
 
+    // pick up pages freed or reprotected since the last instruction
+    if (m_tlb) m_tlb->Sync();
+
+    /*
+     * Only instructions which neither read flags nor set them one by one
+     * may leave their flags pending; everything else runs with eager flags
+     */
+    if (m_lazyFlags) {
+        m_deferFlags = IsLazyFlagsSafe(inst);
+        if (!m_deferFlags) MaterializeFlags();
+    }
+
+    m_lastEip = EIP;
+    EIP += inst->Length;
+
     // check for AddressSizeOverride prefix(67h)
     if (inst->Main.Prefix.AddressSize) {
         LxWarning("AddressSize prefix(67h) found at [%08x] %s\n",
@@ -173,13 +377,24 @@ LxResult Processor::Execute( const Instruction *inst )
     // quick hack for 'rep ret' instructions; thanks to damn AMD
     bool isRet = inst->Main.Inst.BranchType == RetType;
 
-    if (inst->Main.Prefix.LockPrefix) {
-        Mem->Lock();
+    if (IsLocked(inst)) {
+        ExecuteLocked(inst, h);
+        m_deferFlags = false;
+        RET_SUCCESS();
     }
 
     const u32 opcode = inst->Main.Inst.Opcode;
+    // a REP with ECX already 0 takes the regular path below, as it always did
+    bool bulk = ECX != 0 && IsBulkString(inst);
+    if (bulk) {
+        RepStringBulk(inst);
+    }
+
     // Thanks to shitty MOVQ_F30F7E
-    if (inst->Main.Prefix.RepPrefix && !isRet && opcode != 0x0f7e && opcode != 0x0f6f) {
+    if (bulk && ECX == 0) {
+        // all iterations done in bulk; EIP already points past the instruction
+        SetExecFlag(inst->Main.Prefix.RepPrefix ? LX_EXEC_PREFIX_REP : LX_EXEC_PREFIX_REPNE);
+    } else if (inst->Main.Prefix.RepPrefix && !isRet && opcode != 0x0f7e && opcode != 0x0f6f) {
         (this->*h)(inst);
         ECX--;
         bool isRepe = opcode == 0xa6 || opcode == 0xa7 || opcode == 0xae || opcode == 0xaf;
@@ -200,9 +415,7 @@ LxResult Processor::Execute( const Instruction *inst )
         (this->*h)(inst);
     }
 
-    if (inst->Main.Prefix.LockPrefix) {
-        Mem->Unlock();
-    }
+    m_deferFlags = false;
 
     RET_SUCCESS();
 }
@@ -260,6 +473,7 @@ void Processor::Push( u32 nBytes, cpbyte content )
 
     ESP -= nBytes;
     memcpy(Mem->GetRawData(ESP), content, nBytes);
+    CheckCodeWrite(ESP, nBytes);
 }
 
 void Processor::Pop( u32 nBytes, pbyte content )
@@ -279,8 +493,13 @@ INLINE u8 Processor::MemRead8( u32 address, RegSeg seg ) const
 {
     u8 val = INIT_8;
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Read8(address, &val); 
-    m_plugins->OnProcessorMemRead(this, address, 1, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupRead(address, 1) : Mem->MapRead(address, 1);
+    if (p) {
+        val = *((u8p) p);
+    } else {
+        Mem->Read8(address, &val);
+    }
+    NotifyMemRead(address, 1, (cpbyte) &val);
     return val;
 }
 
@@ -288,8 +507,13 @@ INLINE u16 Processor::MemRead16( u32 address, RegSeg seg ) const
 {
     u16 val = INIT_16;
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Read16(address, &val);
-    m_plugins->OnProcessorMemRead(this, address, 2, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupRead(address, 2) : Mem->MapRead(address, 2);
+    if (p) {
+        val = *((u16p) p);
+    } else {
+        Mem->Read16(address, &val);
+    }
+    NotifyMemRead(address, 2, (cpbyte) &val);
     return val;
 }
 
@@ -297,8 +521,13 @@ INLINE u32 Processor::MemRead32( u32 address, RegSeg seg ) const
 {
     u32 val = INIT_32;
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Read32(address, &val);
-    m_plugins->OnProcessorMemRead(this, address, 4, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupRead(address, 4) : Mem->MapRead(address, 4);
+    if (p) {
+        val = *((u32p) p);
+    } else {
+        Mem->Read32(address, &val);
+    }
+    NotifyMemRead(address, 4, (cpbyte) &val);
     return val;
 }
 
@@ -306,8 +535,13 @@ INLINE u64 Processor::MemRead64( u32 address, RegSeg seg ) const
 {
     u64 val = INIT_64;
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Read64(address, &val);
-    m_plugins->OnProcessorMemRead(this, address, 8, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupRead(address, 8) : Mem->MapRead(address, 8);
+    if (p) {
+        val = *((u64p) p);
+    } else {
+        Mem->Read64(address, &val);
+    }
+    NotifyMemRead(address, 8, (cpbyte) &val);
     return val;
 }
 
@@ -315,44 +549,125 @@ INLINE u128 Processor::MemRead128( u32 address, RegSeg seg ) const
 {
     u128 val;
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Read128(address, &val);
-    m_plugins->OnProcessorMemRead(this, address, 16, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupRead(address, 16) : Mem->MapRead(address, 16);
+    if (p) {
+        memcpy(&val, p, sizeof(u128));
+    } else {
+        Mem->Read128(address, &val);
+    }
+    NotifyMemRead(address, 16, (cpbyte) &val);
     return val;
 }
 
 INLINE void Processor::MemWrite8( u32 address, u8 val, RegSeg seg )
 {
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Write8(address, val);
-    m_plugins->OnProcessorMemWrite(this, address, 1, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupWrite(address, 1) : Mem->MapWrite(address, 1);
+    if (p) {
+        *((u8p) p) = val;
+    } else {
+        Mem->Write8(address, val);
+    }
+    CheckCodeWrite(address, 1);
+    NotifyMemWrite(address, 1, (cpbyte) &val);
 }
 
 INLINE void Processor::MemWrite16( u32 address, u16 val, RegSeg seg )
 {
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Write16(address, val);
-    m_plugins->OnProcessorMemWrite(this, address, 2, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupWrite(address, 2) : Mem->MapWrite(address, 2);
+    if (p) {
+        *((u16p) p) = val;
+    } else {
+        Mem->Write16(address, val);
+    }
+    CheckCodeWrite(address, 2);
+    NotifyMemWrite(address, 2, (cpbyte) &val);
 }
 
 INLINE void Processor::MemWrite32( u32 address, u32 val, RegSeg seg )
 {
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Write32(address, val);
-    m_plugins->OnProcessorMemWrite(this, address, 4, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupWrite(address, 4) : Mem->MapWrite(address, 4);
+    if (p) {
+        *((u32p) p) = val;
+    } else {
+        Mem->Write32(address, val);
+    }
+    CheckCodeWrite(address, 4);
+    NotifyMemWrite(address, 4, (cpbyte) &val);
 }
 
 INLINE void Processor::MemWrite64( u32 address, u64 val, RegSeg seg )
 {
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Write64(address, val);
-    m_plugins->OnProcessorMemWrite(this, address, 8, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupWrite(address, 8) : Mem->MapWrite(address, 8);
+    if (p) {
+        *((u64p) p) = val;
+    } else {
+        Mem->Write64(address, val);
+    }
+    CheckCodeWrite(address, 8);
+    NotifyMemWrite(address, 8, (cpbyte) &val);
 }
 
 INLINE void Processor::MemWrite128( u32 address, const u128 &val, RegSeg seg )
 {
     if (seg == LX_REG_FS) { address = GetFSOffset(address); }
-    Mem->Write128(address, val);
-    m_plugins->OnProcessorMemWrite(this, address, 16, (cpbyte) &val);
+    pbyte p = m_tlb ? m_tlb->LookupWrite(address, 16) : Mem->MapWrite(address, 16);
+    if (p) {
+        memcpy(p, &val, sizeof(u128));
+    } else {
+        Mem->Write128(address, val);
+    }
+    CheckCodeWrite(address, 16);
+    NotifyMemWrite(address, 16, (cpbyte) &val);
+}
+
+void Processor::BatchMemAccess( u32 address, u32 nBytes, cpbyte data, bool write ) const
+{
+    if (!m_plugins->InMemBatchRange(address, nBytes)) return;
+    for (u32 offset = 0; offset < nBytes; offset += 8) {
+        MemAccessRecord &r = m_memBatch->Records[m_memBatch->Count++];
+        r.Eip       = m_lastEip;
+        r.Address   = address + offset;
+        r.Size      = (u8) min(nBytes - offset, 8);
+        r.Write     = write ? 1 : 0;
+        r.Reserved  = 0;
+        r.Data[0]   = r.Data[1] = 0;
+        memcpy(r.Data, data + offset, r.Size);
+        if (m_memBatch->Count == m_memBatch->Records.size()) FlushMemBatch();
+    }
+}
+
+void Processor::SaveSnapshotHere()
+{
+    m_snapshotAt = 0;
+    std::string fileName = LxConfig.GetString("Emulator", "SaveSnapshot", "");
+    LxResult lr = m_emulator->SaveSnapshot(fileName.c_str());
+    if (LX_FAILED(lr)) {
+        LxError("Cannot save snapshot %s at EIP[%08x]\n", fileName.c_str(), EIP);
+    } else {
+        LxInfo("Snapshot saved to %s at EIP[%08x]\n", fileName.c_str(), EIP);
+    }
+}
+
+void Processor::FlushMemBatch() const
+{
+    if (m_memBatch == NULL || m_memBatch->Count == 0) return;
+    m_plugins->OnProcessorMemBatch(this, &m_memBatch->Records[0], m_memBatch->Count);
+    m_memBatch->Count = 0;
+}
+
+INLINE void Processor::CheckCodeWrite( u32 address, u32 nBytes )
+{
+    if (m_blocks == NULL) return;
+    if (m_blocks->IsCodePage(address)) {
+        m_blocks->MarkDirty(address);
+    }
+    if (m_blocks->IsCodePage(address + nBytes - 1)) {
+        m_blocks->MarkDirty(address + nBytes - 1);
+    }
 }
 
 u32 Processor::GetFSOffset(u32 addr) const {
@@ -361,16 +676,21 @@ u32 Processor::GetFSOffset(u32 addr) const {
 
 u32 Processor::GetEflags() const
 {
+    u32 cf = CF, pf = PF, zf = ZF, sf = SF, of = OF;
+    if (m_pendingFlags.Size != 0) {
+        EvalLazyFlags(m_pendingFlags, &cf, &pf, &zf, &sf, &of);
+    }
+
     u32 r = 0;
-    r |= CF;
-    r |= (PF << 2);
+    r |= cf;
+    r |= (pf << 2);
     r |= (AF << 4);
-    r |= (ZF << 6);
-    r |= (SF << 7);
+    r |= (zf << 6);
+    r |= (sf << 7);
     r |= (TF << 8);
     r |= (IF << 9);
     r |= (DF << 10);
-    r |= (OF << 11);
+    r |= (of << 11);
     r |= (IOPL << 12);
     r |= (NT << 14);
     r |= (RF << 16);
@@ -384,6 +704,7 @@ u32 Processor::GetEflags() const
 
 void Processor::SetEflags( u32 eflags )
 {
+    m_pendingFlags.Size = 0;
     CF =     eflags & 1;
     PF =    (eflags >> 2) & 1;
     AF =    (eflags >> 4) & 1;
@@ -403,6 +724,60 @@ void Processor::SetEflags( u32 eflags )
     ID =    (eflags >> 21) & 1;
 }
 
+void Processor::SaveState( SnapshotWriter &w ) const
+{
+    if (!m_fpu.PreservesContext()) {
+        LxWarning("FPU/PreserveContext is off, FPU state is not saved reliably\n");
+    }
+    for (int i = 0; i < 8; i++) {
+        w.Put(GP_Regs[i].X32);
+    }
+    w.Write(Seg_Regs, sizeof(Seg_Regs));
+    w.Put(GetEflags());
+    w.Put(EIP);
+    w.Put(m_lastEip);
+    w.Write(m_callbackTable, sizeof(m_callbackTable));
+    w.Write(SIMD.MM, sizeof(SIMD.MM));
+    w.Write(SIMD.XMM, sizeof(SIMD.XMM));
+    w.Put(SIMD.MXCSR);
+    w.Write(const_cast<Coprocessor &>(m_fpu).Context(), sizeof(FpuContext));
+}
+
+bool Processor::LoadState( SnapshotReader &r )
+{
+    for (int i = 0; i < 8; i++) {
+        GP_Regs[i].X32 = r.Get<u32>();
+    }
+    r.Read(Seg_Regs, sizeof(Seg_Regs));
+    SetEflags(r.Get<u32>());
+    EIP         = r.Get<u32>();
+    m_lastEip   = r.Get<u32>();
+    r.Read(m_callbackTable, sizeof(m_callbackTable));
+    r.Read(SIMD.MM, sizeof(SIMD.MM));
+    r.Read(SIMD.XMM, sizeof(SIMD.XMM));
+    SIMD.MXCSR  = r.Get<u32>();
+    r.Read(m_fpu.Context(), sizeof(FpuContext));
+    m_fpu.RestoreContext();
+
+    m_inst          = NULL;
+    m_currSection   = NULL;
+    m_deferFlags    = false;
+    m_yield         = false;
+    ClearExecFlags();
+    FlushCaches();
+    return !r.Failed();
+}
+
+void Processor::FlushCaches()
+{
+    m_instCache.Unload();
+    if (m_blocks) {
+        SAFE_DELETE(m_blocks);
+        m_blocks = new BlockCache();
+    }
+    if (m_tlb) m_tlb->Flush();
+}
+
 void Processor::ToContext( CONTEXT *context )
 {
     Assert(context);
@@ -473,6 +848,15 @@ uint Processor::GetModule( u32 eip ) const
 
 u8 Processor::ReadOperand8( const Instruction *inst, const ARGTYPE &oper, u32 *offset ) const
 {
+    const Instruction::Operand *op = inst->OperandOf(oper);
+    if (op && op->Kind >= Instruction::Operand::KindMemDisp) {
+        RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
+        u32 o = Offset32(*op);
+        if (offset) *offset = o;
+        return MemRead8(o, seg);
+    }
+    if (op && op->Kind == Instruction::Operand::KindReg8) return *GP_Regs8[op->Reg];
+    if (op && op->Kind == Instruction::Operand::KindImm) return (u8) op->Disp;
     if (IsRegArg(oper)) {
         return GP_Reg8(REG_NUM(oper.ArgType), oper.ArgPosition);
     } else if (IsMemoryArg(oper)) {
@@ -490,6 +874,15 @@ u8 Processor::ReadOperand8( const Instruction *inst, const ARGTYPE &oper, u32 *o
 
 u16 Processor::ReadOperand16( const Instruction *inst, const ARGTYPE &oper, u32 *offset ) const
 {
+    const Instruction::Operand *op = inst->OperandOf(oper);
+    if (op && op->Kind >= Instruction::Operand::KindMemDisp) {
+        RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
+        u32 o = Offset32(*op);
+        if (offset) *offset = o;
+        return MemRead16(o, seg);
+    }
+    if (op && op->Kind == Instruction::Operand::KindReg16) return GP_Regs[op->Reg].X16;
+    if (op && op->Kind == Instruction::Operand::KindImm) return (u16) op->Disp;
     if (IsRegArg(oper)) {
         return GP_Reg16(REG_NUM(oper.ArgType));
     } else if (IsMemoryArg(oper)) {
@@ -507,6 +900,15 @@ u16 Processor::ReadOperand16( const Instruction *inst, const ARGTYPE &oper, u32
 
 u32 Processor::ReadOperand32( const Instruction *inst, const ARGTYPE &oper, u32 *offset ) const
 {
+    const Instruction::Operand *op = inst->OperandOf(oper);
+    if (op && op->Kind >= Instruction::Operand::KindMemDisp) {
+        RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
+        u32 o = Offset32(*op);
+        if (offset) *offset = o;
+        return MemRead32(o, seg);
+    }
+    if (op && op->Kind == Instruction::Operand::KindReg32) return GP_Regs[op->Reg].X32;
+    if (op && op->Kind == Instruction::Operand::KindImm) return (u32) op->Disp;
     if (IsRegArg(oper)) {
         return GP_Reg32(REG_NUM(oper.ArgType));
     } else if (IsMemoryArg(oper)) {
@@ -524,6 +926,13 @@ u32 Processor::ReadOperand32( const Instruction *inst, const ARGTYPE &oper, u32
 
 u64 Processor::ReadOperand64(const Instruction *inst, const ARGTYPE &oper, u32 *offset) const
 {
+    const Instruction::Operand *op = inst->OperandOf(oper);
+    if (op && op->Kind >= Instruction::Operand::KindMemDisp) {
+        RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
+        u32 o = Offset32(*op);
+        if (offset) *offset = o;
+        return MemRead64(o, seg);
+    }
     if (IsMemoryArg(oper)) {
         RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
         u32 o = Offset32(oper);
@@ -541,6 +950,13 @@ u64 Processor::ReadOperand64(const Instruction *inst, const ARGTYPE &oper, u32 *
 
 u128 Processor::ReadOperand128(const Instruction *inst, const ARGTYPE &oper, u32 *offset) const
 {
+    const Instruction::Operand *op = inst->OperandOf(oper);
+    if (op && op->Kind >= Instruction::Operand::KindMemDisp) {
+        RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
+        u32 o = Offset32(*op);
+        if (offset) *offset = o;
+        return MemRead128(o, seg);
+    }
     if (IsMemoryArg(oper)) {
         RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
         u32 o = Offset32(oper);
@@ -558,6 +974,11 @@ u128 Processor::ReadOperand128(const Instruction *inst, const ARGTYPE &oper, u32
 
 void Processor::WriteOperand8( const Instruction *inst, const ARGTYPE &oper, u32 offset, u8 val )
 {
+    const Instruction::Operand *op = inst->OperandOf(oper);
+    if (op && op->Kind == Instruction::Operand::KindReg8) {
+        *GP_Regs8[op->Reg] = val;
+        return;
+    }
     if (IsMemoryArg(oper)) {
         RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
         MemWrite8(offset, val, seg);
@@ -572,6 +993,11 @@ void Processor::WriteOperand8( const Instruction *inst, const ARGTYPE &oper, u32
 
 void Processor::WriteOperand16( const Instruction *inst, const ARGTYPE &oper, u32 offset, u16 val )
 {
+    const Instruction::Operand *op = inst->OperandOf(oper);
+    if (op && op->Kind == Instruction::Operand::KindReg16) {
+        GP_Regs[op->Reg].X16 = val;
+        return;
+    }
     if (IsMemoryArg(oper)) {
         RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
         MemWrite16(offset, val, seg);
@@ -586,6 +1012,11 @@ void Processor::WriteOperand16( const Instruction *inst, const ARGTYPE &oper, u3
 
 void Processor::WriteOperand32( const Instruction *inst, const ARGTYPE &oper, u32 offset, u32 val )
 {
+    const Instruction::Operand *op = inst->OperandOf(oper);
+    if (op && op->Kind == Instruction::Operand::KindReg32) {
+        GP_Regs[op->Reg].X32 = val;
+        return;
+    }
     if (IsMemoryArg(oper)) {
         RegSeg seg = inst->Main.Prefix.FSPrefix ? LX_REG_FS : LX_REG_DS;
         MemWrite32(offset, val, seg);
@@ -128,6 +128,18 @@ enum RegXMM {
 #define LX_EXEC_TERMINATE_EIP   0x32
 
 
+/*
+ * Last flag-producing operation, recorded instead of computing
+ * CF/PF/ZF/SF/OF when lazy flags are enabled
+ */
+struct LazyFlags {
+    uint    Size;       // operand size in bits; 0 if nothing is pending
+    u32     Result;
+    u64     UResult;    // result promoted to unsigned, gives CF
+    i64     IResult;    // result promoted to signed, gives OF
+
+    LazyFlags() : Size(0), Result(0), UResult(0), IResult(0) {}
+};
 
 class LX_API Processor {
     // Simulation for x86 CPU
@@ -221,13 +233,22 @@ public:
     uint            GetModule           (u32 eip) const;
 
     u32             GetPrevEip          (void) const { return m_lastEip; }
+    u64             InstCount           (void) const { return m_instCount; }
     u32             GetValidEip         (void) const;
 
     LxResult        Initialize          (void);
     LxResult        Run                 (u32 entry);
+    void            BeginRun            (u32 entry);
+    /* keep running from the current EIP, e.g. after a snapshot was restored */
+    LxResult        Resume              (void);
+    /* run about 'budget' instructions; 'finished' is set once the thread is done */
+    LxResult        RunSlice            (u32 budget, bool *finished);
+    /* end the current slice after this instruction, e.g. for a blocked wait */
+    void            YieldSlice          (void) { m_yield = true; }
     LxResult        RunCallback         (uint id);
     LxResult        RunConditional      (u32 entry);
     LxResult        Step                (void);
+    LxResult        StepBlock           (void);
     LxResult        Execute             (const Instruction *inst);
     void            Reset               (void);
     void            Terminate           (uint nCode);
@@ -235,6 +256,12 @@ public:
     void            PopContext          (void);
     u32             GetEflags           (void) const;
     void            SetEflags           (u32 eflags);
+
+    /* register file for snapshots; only valid between two instructions */
+    void            SaveState           (SnapshotWriter &w) const;
+    bool            LoadState           (SnapshotReader &r);
+    /* drop decoded instructions and blocks, e.g. after guest code was replaced */
+    void            FlushCaches         (void);
     INLINE u32  &   Reg_32              (const ARGTYPE &oper);
     INLINE u16  &   Reg_16              (const ARGTYPE &oper);
     INLINE u8   &   Reg_8               (const ARGTYPE &oper);
@@ -291,6 +318,7 @@ public:
     void            Pop                 (u32 nBytes, pbyte content);
 
     INLINE u32      Offset32            (const ARGTYPE &oper) const;
+    INLINE u32      Offset32            (const Instruction::Operand &op) const;
 
     // Set ZF according to result 'val'
     INLINE void     SetFlagZF8          (u8 val)    { ZF = (val == 0); }
@@ -369,6 +397,10 @@ public:
     bool            IsJumpTaken_Loop() const  { return ECX != 0; }
     bool            IsJumpTaken     (const Instruction *inst) const;
 
+    // Lazy flags evaluation
+    bool            IsLazyFlags         () const { return m_lazyFlags; }
+    INLINE void     MaterializeFlags    (void);
+
 public:
         typedef void    (Processor::*InstHandler)(const Instruction *inst);
 private:
@@ -408,6 +440,28 @@ private:
     void        SetByte(const Instruction *inst, bool cond);
     void        JumpRel8(const Instruction *inst);
     void        JumpRel32(const Instruction *inst);
+    bool        IsBulkString(const Instruction *inst) const;
+    void        RepStringBulk(const Instruction *inst);
+    pbyte       BulkStringPtr(u32 address, bool write) const;
+
+    InstHandler         ResolveHandler      (const Instruction *inst) const;
+    LxResult            Execute             (const Instruction *inst, InstHandler h);
+    static bool         IsLocked            (const Instruction *inst);
+    void                ExecuteLocked       (const Instruction *inst, InstHandler h);
+    bool                ExecuteAtomic       (const Instruction *inst, u32 address);
+    pbyte               AtomicHostPtr       (u32 address, u32 size) const;
+    const Instruction * FetchInstruction    (u32 eip);
+    BasicBlock *        BuildBlock          (u32 eip);
+    void                FlushCodePages      (void);
+    static bool         IsLazyFlagsSafe     (const Instruction *inst);
+    static void         EvalLazyFlags       (const LazyFlags &lf, u32 *cf, u32 *pf, 
+                                             u32 *zf, u32 *sf, u32 *of);
+    INLINE void         CheckCodeWrite      (u32 address, u32 nBytes);
+    INLINE void         NotifyMemRead       (u32 address, u32 nBytes, cpbyte data) const;
+    INLINE void         NotifyMemWrite      (u32 address, u32 nBytes, cpbyte data) const;
+    void                BatchMemAccess      (u32 address, u32 nBytes, cpbyte data, bool write) const;
+    void                FlushMemBatch       (void) const;
+    void                SaveSnapshotHere    (void);
 
 protected:
     Thread *        m_thread;
@@ -420,9 +474,19 @@ protected:
     bool            m_terminated;
     u32             m_callbackTable[LX_CALLBACKS];
     Hashtable<Instruction>  m_instCache;
+    BlockCache *    m_blocks;       // NULL when running instruction by instruction
+    SoftTlb *       m_tlb;          // NULL when every access goes through Memory
+    MemEventBatch * m_memBatch;     // NULL unless a plugin takes batched memory events
     u32             m_execFlags;    // Used to represent status after execution of each instruciton 
     Section *       m_currSection;
     u32             m_lastEip;
+    bool            m_lazyFlags;
+    bool            m_bulkStrings;  // REP MOVS/STOS/CMPS/SCAS may run page by page
+    bool            m_deferFlags;   // current instruction may leave its flags pending
+    LazyFlags       m_pendingFlags;
+    u64             m_instCount;    // instructions executed by Step/StepBlock
+    bool            m_yield;        // set by YieldSlice, cleared by RunSlice
+    u32             m_snapshotAt;   // main thread: EIP to save a snapshot at, 0 if none
 }; // class CPU
 
 
@@ -603,6 +667,19 @@ INLINE u32 Processor::Offset32( const ARGTYPE &oper ) const
     return offset;
 }
 
+INLINE u32 Processor::Offset32( const Instruction::Operand &op ) const
+{
+    switch (op.Kind) {
+    case Instruction::Operand::KindMemDisp:
+        return op.Disp;
+    case Instruction::Operand::KindMemBase:
+        return GP_Regs[op.Reg].X32 + op.Disp;
+    default:
+        Assert(op.Kind == Instruction::Operand::KindMemSib);
+        return GP_Regs[op.Reg].X32 + GP_Regs[op.Index].X32 * op.Scale + op.Disp;
+    }
+}
+
 INLINE void Processor::SetFlagPF8( u8 val )
 {
     int num = 0;
@@ -661,6 +738,11 @@ INLINE void Processor::SetFlagOF32( u32 val, const i64 &val64 )
 
 INLINE void Processor::SetFlagsArith8( u8 val, u16 uv16, i16 iv16 )
 {
+    if (m_deferFlags) {
+        m_pendingFlags.Size = 8;
+        m_pendingFlags.Result = val; m_pendingFlags.UResult = uv16; m_pendingFlags.IResult = iv16;
+        return;
+    }
     SetFlagCF8(val, uv16);
     SetFlagOF8(val, iv16);
     SetFlagZF8(val);
@@ -670,6 +752,11 @@ INLINE void Processor::SetFlagsArith8( u8 val, u16 uv16, i16 iv16 )
 
 INLINE void Processor::SetFlagsArith16( u16 val, u32 uv32, i32 iv32 )
 {
+    if (m_deferFlags) {
+        m_pendingFlags.Size = 16;
+        m_pendingFlags.Result = val; m_pendingFlags.UResult = uv32; m_pendingFlags.IResult = iv32;
+        return;
+    }
     SetFlagCF16(val, uv32);
     SetFlagOF16(val, iv32);
     SetFlagZF16(val);
@@ -679,6 +766,11 @@ INLINE void Processor::SetFlagsArith16( u16 val, u32 uv32, i32 iv32 )
 
 INLINE void Processor::SetFlagsArith32( u32 val, const u64 &uv64, const i64 &iv64 )
 {
+    if (m_deferFlags) {
+        m_pendingFlags.Size = 32;
+        m_pendingFlags.Result = val; m_pendingFlags.UResult = uv64; m_pendingFlags.IResult = iv64;
+        return;
+    }
     SetFlagCF32(val, uv64);
     SetFlagOF32(val, iv64);
     SetFlagZF32(val);
@@ -688,18 +780,31 @@ INLINE void Processor::SetFlagsArith32( u32 val, const u64 &uv64, const i64 &iv6
 
 INLINE void Processor::SetFlagsLogic8( u8 val )
 {
+    if (m_deferFlags) {
+        // promoted results equal to the result itself give CF = OF = 0
+        SetFlagsArith8(val, PROMOTE_U16(val), PROMOTE_I16(val));
+        return;
+    }
     SetFlagsShift8(val);
     OF = CF = 0;
 }
 
 INLINE void Processor::SetFlagsLogic16( u16 val )
 {
+    if (m_deferFlags) {
+        SetFlagsArith16(val, PROMOTE_U32(val), PROMOTE_I32(val));
+        return;
+    }
     SetFlagsShift16(val);
     OF = CF = 0;
 }
 
 INLINE void Processor::SetFlagsLogic32( u32 val )
 {
+    if (m_deferFlags) {
+        SetFlagsArith32(val, PROMOTE_U64(val), PROMOTE_I64(val));
+        return;
+    }
     SetFlagsShift32(val);
     OF = CF = 0;
 }
@@ -725,6 +830,25 @@ INLINE void Processor::SetFlagsShift32( u32 val )
     SetFlagSF32(val);
 }
 
+INLINE void Processor::MaterializeFlags()
+{
+    if (m_pendingFlags.Size == 0) return;
+    EvalLazyFlags(m_pendingFlags, &CF, &PF, &ZF, &SF, &OF);
+    m_pendingFlags.Size = 0;
+}
+
+
+INLINE void Processor::NotifyMemRead( u32 address, u32 nBytes, cpbyte data ) const
+{
+    m_plugins->OnProcessorMemRead(this, address, nBytes, data);
+    if (m_memBatch) BatchMemAccess(address, nBytes, data, false);
+}
+
+INLINE void Processor::NotifyMemWrite( u32 address, u32 nBytes, cpbyte data ) const
+{
+    m_plugins->OnProcessorMemWrite(this, address, nBytes, data);
+    if (m_memBatch) BatchMemAccess(address, nBytes, data, true);
+}
 
 INLINE u32 Processor::GetStackParam32( uint num ) const
 {
@@ -0,0 +1,510 @@
+#include "stdafx.h"
+#include "replay.h"
+#include "emulator.h"
+#include "processor.h"
+#include "process.h"
+#include "thread.h"
+#include "memory.h"
+#include "section.h"
+#include "scheduler.h"
+#include "snapshot.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+static const u32    ReplayMagic     = 0x5052584c;   // "LXRP"
+static const u32    ReplayVersion   = 1;
+static const uint   FlushSize       = 1024 * 1024;
+static const uint   MergeGap        = 8;            // unchanged bytes allowed inside one run
+
+ReplayLog::ReplayLog( Emulator *emu )
+{
+    Assert(emu);
+    m_emu           = emu;
+    m_replaying     = false;
+    m_fp            = NULL;
+    m_cursor        = 0;
+    m_inFlight      = 0;
+    m_live          = false;
+}
+
+ReplayLog::~ReplayLog()
+{
+    Close();
+    for (auto iter = m_shadow.begin(); iter != m_shadow.end(); ++iter) {
+        SAFE_DELETE_ARRAY(iter->second.Data);
+    }
+}
+
+LxResult ReplayLog::OpenRecord( LPCSTR lpFileName )
+{
+    m_fp = fopen(lpFileName, "wb");
+    if (m_fp == NULL) {
+        LxError("Cannot create replay log %s\n", lpFileName);
+        return LX_RESULT_ERROR_OPEN_FILE;
+    }
+    SnapshotWriter w(m_buf);
+    w.Put(ReplayMagic);
+    w.Put(ReplayVersion);
+    LxInfo("Recording WinAPI results to %s\n", lpFileName);
+    RET_SUCCESS();
+}
+
+LxResult ReplayLog::OpenReplay( LPCSTR lpFileName )
+{
+    FILE *fp = fopen(lpFileName, "rb");
+    if (fp == NULL) return LX_RESULT_ERROR_OPEN_FILE;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    m_data.resize(size > 0 ? size : 0);
+    size_t nRead = m_data.empty() ? 0 : fread(&m_data[0], 1, m_data.size(), fp);
+    fclose(fp);
+    if (nRead != m_data.size()) return LX_RESULT_ERROR_READ_FILE;
+
+    if (!Parse()) {
+        LxError("%s is not a replay log of this version\n", lpFileName);
+        return LX_RESULT_INVALID_FORMAT;
+    }
+    m_replaying = true;
+    LxInfo("Replaying %d WinAPI events from %s\n", m_events.size(), lpFileName);
+    RET_SUCCESS();
+}
+
+void ReplayLog::Close()
+{
+    MutexCSLock lock(m_lock);
+    if (m_fp == NULL) return;
+    Flush();
+    fclose(m_fp);
+    m_fp = NULL;
+}
+
+uint ReplayLog::Call( Processor *cpu, uint apiIndex, WinAPIHandler handler )
+{
+    if (m_replaying) return Replay(cpu, apiIndex, handler);
+    if (m_fp) return Record(cpu, apiIndex, handler);
+    return handler(cpu);
+}
+
+/************************************************************************/
+/* Recording                                                            */
+/************************************************************************/
+
+uint ReplayLog::Record( Processor *cpu, uint apiIndex, WinAPIHandler handler )
+{
+    const uint flags = WinAPIInfoTable[apiIndex].Flags;
+
+    // the enter event is the call's place in the log; the handler runs unlocked,
+    // so whatever guest code it runs may log calls of its own before the exit
+    std::vector<u32> sections;
+    {
+        MutexCSLock lock(m_lock);
+        if (flags & LX_WINAPI_ALLOCATES) GetSectionBases(sections);
+        WriteEnter(cpu->Thr(), apiIndex);
+    }
+    uint r = handler(cpu);
+    DWORD lastError = GetLastError();
+    {
+        MutexCSLock lock(m_lock);
+        WriteExit(cpu, r, lastError, (flags & LX_WINAPI_ALLOCATES) ? &sections : NULL);
+    }
+    SetLastError(lastError);
+    return r;
+}
+
+void ReplayLog::WriteEnter( Thread *t, uint apiIndex )
+{
+    if (m_inFlight++ == 0) {
+        // whatever the guest wrote itself since the last call is not logged;
+        // with other calls still running it may be theirs, so it waits for their exit
+        std::vector<u32> pages;
+        m_emu->Mem()->CollectWrites(pages);
+        SyncObjectLock lock(*m_emu->Mem());
+        for (uint i = 0; i < pages.size(); i++) {
+            cpbyte data = GetCommittedPage(pages[i]);
+            if (data == NULL) continue;
+            ShadowPage &shadow = m_shadow[pages[i]];
+            if (shadow.Data == NULL) shadow.Data = new byte[LX_PAGE_SIZE];
+            memcpy(shadow.Data, data, LX_PAGE_SIZE);
+            shadow.Generation = Section::MappingGeneration();
+        }
+    }
+
+    SnapshotWriter w(m_buf);
+    w.Put((u8) EventEnter);
+    w.Put(t->Serial);
+    w.Put((u32) apiIndex);
+}
+
+void ReplayLog::WriteExit( Processor *cpu, uint result, DWORD lastError, const std::vector<u32> *oldSections )
+{
+    Assert(m_inFlight > 0);
+    m_inFlight--;
+
+    SnapshotWriter w(m_buf);
+    w.Put((u8) EventExit);
+    w.Put(cpu->Thr()->Serial);
+    w.Put((u32) result);
+    w.Put(cpu->EAX);
+    w.Put(cpu->ECX);
+    w.Put(cpu->EDX);
+    w.Put((u32) lastError);
+
+    Memory *mem = m_emu->Mem();
+    std::vector<u32> pages;
+    mem->CollectWrites(pages);
+    SyncObjectLock lock(*mem);
+
+    // sections the handler created
+    std::vector<Section *> created;
+    if (oldSections) {
+        const std::vector<Section *> &sections = mem->GetSections();
+        for (uint i = 0; i < sections.size(); i++) {
+            if (!std::binary_search(oldSections->begin(), oldSections->end(), sections[i]->Base()))
+                created.push_back(sections[i]);
+        }
+    }
+    w.Put((u32) created.size());
+    for (uint i = 0; i < created.size(); i++) {
+        Section *sec = created[i];
+        w.Put(sec->Base());
+        w.Put(sec->Size());
+        w.Put((u32) sec->GetSectionInfo()[0].Protect);
+        w.Put((u32) sec->Module());
+        w.PutString(sec->Description());
+    }
+
+    std::vector<byte> runs;
+    u32 nPages = 0;
+    for (uint i = 0; i < pages.size(); i++) {
+        cpbyte data = GetCommittedPage(pages[i]);
+        if (data && WritePage(runs, pages[i], data)) nPages++;
+    }
+    w.Put(nPages);
+    if (!runs.empty()) w.Write(&runs[0], (uint) runs.size());
+
+    if (m_buf.size() >= FlushSize) Flush();
+}
+
+bool ReplayLog::WritePage( std::vector<byte> &buf, u32 addr, cpbyte data )
+{
+    ShadowPage &shadow = m_shadow[addr];
+    bool full = shadow.Data == NULL || shadow.Generation != Section::MappingGeneration();
+    if (shadow.Data == NULL) shadow.Data = new byte[LX_PAGE_SIZE];
+
+    std::vector<std::pair<u16, u16> > runs;
+    if (full) {
+        runs.push_back(std::make_pair((u16) 0, (u16) LX_PAGE_SIZE));
+    } else {
+        uint i = 0;
+        while (i < LX_PAGE_SIZE) {
+            if (data[i] == shadow.Data[i]) { i++; continue; }
+            uint start = i, end = i + 1, same = 0;
+            for (i = end; i < LX_PAGE_SIZE && same < MergeGap; i++) {
+                if (data[i] == shadow.Data[i]) {
+                    same++;
+                } else {
+                    same = 0;
+                    end = i + 1;
+                }
+            }
+            runs.push_back(std::make_pair((u16) start, (u16) (end - start)));
+            i = end;
+        }
+    }
+    memcpy(shadow.Data, data, LX_PAGE_SIZE);
+    shadow.Generation = Section::MappingGeneration();
+    if (runs.empty()) return false;
+
+    SnapshotWriter w(buf);
+    w.Put(addr);
+    w.Put((u16) runs.size());
+    for (uint i = 0; i < runs.size(); i++) {
+        w.Put(runs[i].first);
+        w.Put(runs[i].second);
+        w.Write(data + runs[i].first, runs[i].second);
+    }
+    return true;
+}
+
+void ReplayLog::Flush()
+{
+    if (m_fp == NULL || m_buf.empty()) return;
+    if (fwrite(&m_buf[0], 1, m_buf.size(), m_fp) != m_buf.size()) {
+        LxError("Cannot write replay log\n");
+    }
+    m_buf.clear();
+}
+
+cpbyte ReplayLog::GetCommittedPage( u32 addr ) const
+{
+    Section *sec = m_emu->Mem()->GetSection(addr);
+    if (sec == NULL || !sec->IsCommitted(PAGE_NUM(addr - sec->Base()))) return NULL;
+    return sec->GetRawData(addr);
+}
+
+void ReplayLog::GetSectionBases( std::vector<u32> &bases ) const
+{
+    SyncObjectLock lock(*m_emu->Mem());
+    const std::vector<Section *> &sections = m_emu->Mem()->GetSections();
+    for (uint i = 0; i < sections.size(); i++) {
+        bases.push_back(sections[i]->Base());
+    }
+    std::sort(bases.begin(), bases.end());
+}
+
+/************************************************************************/
+/* Replaying                                                            */
+/************************************************************************/
+
+bool ReplayLog::Parse()
+{
+    SnapshotReader r(m_data.empty() ? NULL : &m_data[0], (uint) m_data.size());
+    if (r.Get<u32>() != ReplayMagic || r.Get<u32>() != ReplayVersion) return false;
+
+    while (r.Position() < m_data.size()) {
+        Event e;
+        ZeroMemory(&e, sizeof(e));
+        e.Kind      = (EventKind) r.Get<u8>();
+        e.Serial    = r.Get<u32>();
+        e.Value     = r.Get<u32>();
+        if (e.Kind == EventEnter) {
+            if (e.Value >= LxGetTotalWinAPIs()) return false;
+        } else if (e.Kind == EventExit) {
+            e.Eax       = r.Get<u32>();
+            e.Ecx       = r.Get<u32>();
+            e.Edx       = r.Get<u32>();
+            e.LastError = r.Get<u32>();
+            e.Offset    = r.Position();
+
+            // sections and pages are read again by ApplyExit
+            u32 nSections = r.Get<u32>();
+            for (u32 i = 0; i < nSections && !r.Failed(); i++) {
+                r.Skip(4 * sizeof(u32));
+                r.GetString();
+            }
+            u32 nPages = r.Get<u32>();
+            for (u32 i = 0; i < nPages && !r.Failed(); i++) {
+                r.Skip(sizeof(u32));
+                u16 nRuns = r.Get<u16>();
+                for (u16 j = 0; j < nRuns && !r.Failed(); j++) {
+                    r.Skip(sizeof(u16));
+                    r.Skip(r.Get<u16>());
+                }
+            }
+        } else {
+            return false;
+        }
+        if (r.Failed()) {
+            // the recording was cut short; keep what is complete
+            LxWarning("Replay log truncated after %d events\n", m_events.size());
+            break;
+        }
+        m_events.push_back(e);
+    }
+    return true;
+}
+
+uint ReplayLog::Replay( Processor *cpu, uint apiIndex, WinAPIHandler handler )
+{
+    Thread *t = cpu->Thr();
+    const uint flags = WinAPIInfoTable[apiIndex].Flags;
+
+    // enter event, unless this is a retry of a call already entered
+    bool live = false, run = false;
+    {
+        MutexCSLock lock(m_lock);
+        std::vector<PendingCall> &calls = m_pending[t];
+        if (calls.empty() || calls.back().Running) {
+            Turn turn = WaitTurn(t);
+            if (turn == TurnRetry) return WinAPIRetry;
+            if (turn == TurnMine) {
+                const Event &e = m_events[m_cursor];
+                if (e.Kind != EventEnter || e.Value != apiIndex) Diverged(t, apiIndex);
+                PendingCall call;
+                call.Running = (flags & LX_WINAPI_EXECUTE) != 0;
+                calls.push_back(call);
+                run = call.Running;
+                Advance();
+            } else {
+                live = true;
+            }
+        }
+    }
+    if (live) return handler(cpu);
+
+    if (run) RunHandler(cpu, apiIndex, handler);
+
+    // exit event
+    {
+        MutexCSLock lock(m_lock);
+        std::vector<PendingCall> &calls = m_pending[t];
+        Assert(!calls.empty() && !calls.back().Running);
+        const PendingCall call = calls.back();
+        Turn turn = WaitTurn(t);
+        if (turn == TurnRetry) {
+            if (call.Ran) {
+                // the handler has run; the call only waits for its exit from now on
+                cpu->EAX = call.Saved[0];
+                cpu->ECX = call.Saved[1];
+                cpu->EDX = call.Saved[2];
+            }
+            return WinAPIRetry;
+        }
+        calls.pop_back();
+
+        if (turn == TurnMine) {
+            const Event &e = m_events[m_cursor];
+            if (e.Kind != EventExit) Diverged(t, apiIndex);
+            if (call.Ran && e.Value != WinAPIRetry) {
+                if (call.Result != e.Value) Diverged(t, apiIndex);
+                if (flags & LX_WINAPI_NEW_HANDLE) {
+                    m_handles[e.Eax] = call.Eax;
+                } else if (call.Eax != e.Eax) {
+                    LxWarning("Replay: %s returned %08x, recorded %08x\n",
+                        WinAPIInfoTable[apiIndex].FuncName, call.Eax, e.Eax);
+                }
+            }
+            Advance();
+            ApplyExit(cpu, e);
+            return e.Value;
+        }
+
+        // log exhausted
+        if (call.Ran) {
+            cpu->EAX = call.Eax;
+            cpu->ECX = call.Ecx;
+            cpu->EDX = call.Edx;
+            return call.Result;
+        }
+    }
+    return handler(cpu);
+}
+
+void ReplayLog::RunHandler( Processor *cpu, uint apiIndex, WinAPIHandler handler )
+{
+    const uint flags = WinAPIInfoTable[apiIndex].Flags;
+    u32 saved[3] = { cpu->EAX, cpu->ECX, cpu->EDX };
+
+    // unlocked: guest code the handler runs (DllMain, exception handlers)
+    // replays its own calls, which the log has between this enter and exit
+    u32 param = 0;
+    if (flags & LX_WINAPI_HANDLE_ARG) {
+        param = cpu->GetStackParam32(0);
+        u32 actual;
+        {
+            MutexCSLock lock(m_lock);
+            actual = MapHandle(param);
+        }
+        cpu->MemWrite32(cpu->ESP + 4, actual, LX_REG_SS);
+    }
+    uint r = handler(cpu);
+    if (flags & LX_WINAPI_HANDLE_ARG) {
+        cpu->MemWrite32(cpu->ESP + 4, param, LX_REG_SS);
+    }
+
+    MutexCSLock lock(m_lock);
+    PendingCall &call = m_pending[cpu->Thr()].back();
+    Assert(call.Running);
+    call.Running    = false;
+    call.Ran        = true;
+    call.Result     = r;
+    call.Eax        = cpu->EAX;
+    call.Ecx        = cpu->ECX;
+    call.Edx        = cpu->EDX;
+    memcpy(call.Saved, saved, sizeof(saved));
+}
+
+ReplayLog::Turn ReplayLog::WaitTurn( Thread *t )
+{
+    DWORD waited = 0;
+    while (true) {
+        if (m_live) return TurnLive;
+        if (m_cursor >= m_events.size()) {
+            LxWarning("Replay log exhausted, WinAPI calls run on the host from now on\n");
+            m_live = true;
+            return TurnLive;
+        }
+        if (m_events[m_cursor].Serial == t->Serial) return TurnMine;
+
+        // a pooled thread must not block its worker; it tries again next slice
+        if (Scheduler::Current() == t) return TurnRetry;
+        if (!m_turn.Wait(m_lock, 50)) {
+            waited += 50;
+            if (waited == 10000) {
+                LxWarning("Replay: thread #%d still waiting for thread #%d\n",
+                    t->Serial, m_events[m_cursor].Serial);
+            }
+        }
+    }
+}
+
+void ReplayLog::Advance()
+{
+    m_cursor++;
+    m_turn.WakeAll();
+}
+
+void ReplayLog::ApplyExit( Processor *cpu, const Event &e )
+{
+    if (e.Value != WinAPIRetry) {
+        // a retried call runs again from its CALL, which may still need the registers
+        cpu->EAX = e.Eax;
+        cpu->ECX = e.Ecx;
+        cpu->EDX = e.Edx;
+        SetLastError(e.LastError);
+    }
+
+    Memory *mem = m_emu->Mem();
+    SyncObjectLock lock(*mem);
+    SnapshotReader r(&m_data[e.Offset], (uint) m_data.size() - e.Offset);
+
+    u32 nSections = r.Get<u32>();
+    for (u32 i = 0; i < nSections; i++) {
+        u32 base    = r.Get<u32>();
+        u32 size    = r.Get<u32>();
+        u32 protect = r.Get<u32>();
+        u32 module  = r.Get<u32>();
+        std::string desc = r.GetString();
+        if (mem->GetSection(base) != NULL) continue;
+        if (mem->Overlaps(base, size) || LX_FAILED(mem->Alloc(SectionDesc(desc, module), base, size, protect))) {
+            LxWarning("Replay: cannot recreate section %s at %08x\n", desc.c_str(), base);
+        }
+    }
+
+    u32 nPages = r.Get<u32>();
+    for (u32 i = 0; i < nPages; i++) {
+        u32 addr    = r.Get<u32>();
+        u16 nRuns   = r.Get<u16>();
+        pbyte page  = (pbyte) GetCommittedPage(addr);
+        if (page == NULL) {
+            LxWarning("Replay: page %08x is not committed\n", addr);
+        }
+        for (u16 j = 0; j < nRuns; j++) {
+            u16 off     = r.Get<u16>();
+            u16 len     = r.Get<u16>();
+            cpbyte data = r.Skip(len);
+            if (page && data && off + len <= LX_PAGE_SIZE) memcpy(page + off, data, len);
+        }
+    }
+}
+
+void ReplayLog::Diverged( Thread *t, uint apiIndex )
+{
+    const Event &e = m_events[m_cursor];
+    if (e.Kind == EventEnter) {
+        LxFatal("Replay diverged at event %d: thread #%d called %s, log has %s\n",
+            m_cursor, t->Serial, WinAPIInfoTable[apiIndex].FuncName, WinAPIInfoTable[e.Value].FuncName);
+    } else {
+        LxFatal("Replay diverged at event %d: %s of thread #%d does not match the log\n",
+            m_cursor, WinAPIInfoTable[apiIndex].FuncName, t->Serial);
+    }
+}
+
+u32 ReplayLog::MapHandle( u32 recorded ) const
+{
+    auto iter = m_handles.find(recorded);
+    return iter == m_handles.end() ? recorded : iter->second;
+}
+
+END_NAMESPACE_LOCHSEMU()
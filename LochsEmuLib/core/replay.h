@@ -0,0 +1,122 @@
+#pragma once
+
+#ifndef __CORE_REPLAY_H__
+#define __CORE_REPLAY_H__
+
+#include "lochsemu.h"
+#include "parallel.h"
+#include "winapi.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * Record and replay of everything a guest learns from the host through
+ * WinAPI calls (Emulator/RecordLog, Emulator/ReplayLog).
+ *
+ * Recording logs, for every call, an enter event and an exit event in one
+ * global order. Exit events carry EAX/ECX/EDX, the last error and the guest
+ * bytes the handler changed, found with host write tracking and stored as
+ * runs of changes against a copy of each page taken at the enter event.
+ *
+ * Replay hands the logged results back without calling the handler, and
+ * holds each thread at its next API call until the log says it is its
+ * turn, so threads interleave at API calls exactly as they did when
+ * recorded. Handlers flagged LX_WINAPI_EXECUTE still run for their effect
+ * on emulator state (heaps, threads, modules), between the enter and exit
+ * events as when recorded, so calls made by guest code they run (DllMain)
+ * replay in between; the guest sees the logged results. Once the log runs
+ * out, calls go to the host again.
+ */
+class LX_API ReplayLog {
+public:
+    ReplayLog(Emulator *emu);
+    ~ReplayLog();
+
+    LxResult        OpenRecord  (LPCSTR lpFileName);
+    LxResult        OpenReplay  (LPCSTR lpFileName);
+    void            Close       (void);
+
+    bool            IsReplaying (void) const { return m_replaying; }
+
+    /* runs or replays one API call; same return value as the handler */
+    uint            Call        (Processor *cpu, uint apiIndex, WinAPIHandler handler);
+
+private:
+    enum EventKind {
+        EventEnter  = 1,
+        EventExit   = 2,
+    };
+
+    enum Turn {
+        TurnMine, TurnRetry, TurnLive,
+    };
+
+    struct Event {
+        EventKind   Kind;
+        u32         Serial;     // Thread::Serial
+        u32         Value;      // API index for enter, handler result for exit
+        u32         Eax;
+        u32         Ecx;
+        u32         Edx;
+        u32         LastError;
+        u32         Offset;     // exit: its sections and pages in m_data
+    };
+
+    struct PendingCall {
+        bool        Running;    // LX_WINAPI_EXECUTE handler still running
+        bool        Ran;        // handler done, waiting for the exit event
+        u32         Result;
+        u32         Eax;
+        u32         Ecx;
+        u32         Edx;
+        u32         Saved[3];   // EAX/ECX/EDX before the handler, for a retry
+        PendingCall() : Running(false), Ran(false), Result(0), Eax(0), Ecx(0), Edx(0) {}
+    };
+
+    struct ShadowPage {
+        pbyte       Data;
+        u32         Generation; // Section::MappingGeneration when copied
+        ShadowPage() : Data(NULL), Generation(0) {}
+    };
+
+    uint            Record          (Processor *cpu, uint apiIndex, WinAPIHandler handler);
+    void            WriteEnter      (Thread *t, uint apiIndex);
+    void            WriteExit       (Processor *cpu, uint result, DWORD lastError, const std::vector<u32> *oldSections);
+    bool            WritePage       (std::vector<byte> &buf, u32 addr, cpbyte data);
+    void            Flush           (void);
+    cpbyte          GetCommittedPage(u32 addr) const;
+    void            GetSectionBases (std::vector<u32> &bases) const;
+
+    uint            Replay          (Processor *cpu, uint apiIndex, WinAPIHandler handler);
+    bool            Parse           (void);
+    Turn            WaitTurn        (Thread *t);
+    void            Advance         (void);
+    void            RunHandler      (Processor *cpu, uint apiIndex, WinAPIHandler handler);
+    void            ApplyExit       (Processor *cpu, const Event &e);
+    void            Diverged        (Thread *t, uint apiIndex);
+    u32             MapHandle       (u32 recorded) const;
+
+private:
+    Emulator *                  m_emu;
+    bool                        m_replaying;
+    MutexCS                     m_lock;
+
+    /* recording */
+    FILE *                      m_fp;
+    std::vector<byte>           m_buf;          // events not written to m_fp yet
+    std::unordered_map<u32, ShadowPage> m_shadow;   // guest page -> contents as last seen
+    uint                        m_inFlight;     // calls entered but not exited
+
+    /* replaying */
+    std::vector<byte>           m_data;         // the whole log
+    std::vector<Event>          m_events;
+    uint                        m_cursor;       // next event
+    ConditionVariable           m_turn;
+    std::map<Thread *, std::vector<PendingCall> > m_pending;   // entered, exit not replayed yet; innermost last
+    std::map<u32, u32>          m_handles;      // recorded -> actual handle values
+    bool                        m_live;         // log exhausted
+};
+
+END_NAMESPACE_LOCHSEMU()
+
+#endif // __CORE_REPLAY_H__
@@ -0,0 +1,163 @@
+#include "stdafx.h"
+#include "scheduler.h"
+#include "process.h"
+#include "thread.h"
+#include "pluginmgr.h"
+#include "syncmgr.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+static __declspec(thread) Thread *  CurrentThread = NULL;
+
+Scheduler::Scheduler( Process *proc, int workers, u32 timeSlice )
+{
+    Assert(proc);
+    Assert(workers > 0 && timeSlice > 0);
+    m_process       = proc;
+    m_workerCount   = workers;
+    m_timeSlice     = timeSlice;
+    m_stopping      = false;
+    m_nextId        = 1;
+}
+
+Scheduler::~Scheduler()
+{
+    Stop();
+}
+
+LxResult Scheduler::Start()
+{
+    LxInfo("Starting %d scheduler workers, time slice %d instructions\n",
+        m_workerCount, m_timeSlice);
+    for (int i = 0; i < m_workerCount; i++) {
+        HANDLE h = CreateThread(NULL, 0, &Scheduler::WorkerRoutine, this, 0, NULL);
+        if (h == NULL) {
+            LxError("Cannot create scheduler worker %d\n", i);
+            RET_FAIL(LX_RESULT_THREAD_FAILED);
+        }
+        m_workers.push_back(h);
+    }
+    RET_SUCCESS();
+}
+
+void Scheduler::Stop()
+{
+    if (m_workers.empty()) return;
+
+    // like ExitProcess, threads still queued are simply never run again;
+    // a worker finishes its current slice first, and the Process deletes
+    // the threads it runs once we return, so there is no giving up on it
+    m_stopping = true;
+    m_readyCount.Post((int) m_workers.size());
+    DWORD r = WaitForMultipleObjects((DWORD) m_workers.size(), &m_workers[0], TRUE, 5000);
+    if (r == WAIT_TIMEOUT) {
+        LxWarning("Waiting for scheduler workers still blocked in guest code\n");
+        WaitForMultipleObjects((DWORD) m_workers.size(), &m_workers[0], TRUE, INFINITE);
+    }
+    for (uint i = 0; i < m_workers.size(); i++) {
+        CloseHandle(m_workers[i]);
+    }
+    m_workers.clear();
+}
+
+void Scheduler::Add( Thread *t, bool suspended )
+{
+    Assert(t);
+    if (suspended) {
+        MutexCSLock lock(m_lock);
+        m_suspended.push_back(t);
+    } else {
+        Push(t);
+    }
+}
+
+bool Scheduler::Resume( HANDLE hThread )
+{
+    Thread *t = NULL;
+    {
+        MutexCSLock lock(m_lock);
+        for (uint i = 0; i < m_suspended.size(); i++) {
+            if (m_suspended[i]->Handle == hThread) {
+                t = m_suspended[i];
+                m_suspended.erase(m_suspended.begin() + i);
+                break;
+            }
+        }
+    }
+    if (t == NULL) return false;
+    Push(t);
+    return true;
+}
+
+ThreadID Scheduler::NextThreadId()
+{
+    MutexCSLock lock(m_lock);
+    ThreadID id = m_nextId;
+    m_nextId += 2;
+    return id;
+}
+
+Thread * Scheduler::Current()
+{
+    return CurrentThread;
+}
+
+DWORD WINAPI Scheduler::WorkerRoutine( LPVOID lpParams )
+{
+    Scheduler *s = (Scheduler *) lpParams;
+    s->WorkerLoop();
+    return 0;
+}
+
+void Scheduler::WorkerLoop()
+{
+    while (true) {
+        Thread *t = Pop();
+        if (t == NULL) break;
+
+        CurrentThread = t;
+        bool finished = false;
+        LxResult lr = t->RunSlice(m_timeSlice, &finished);
+        CurrentThread = NULL;
+
+        if (LX_FAILED(lr)) {
+            LxError("Thread [%x] failed, error code %x\n", t->ExtID, lr);
+            finished = true;
+        }
+        if (finished) {
+            Finish(t);
+        } else {
+            Push(t);
+        }
+    }
+}
+
+Thread * Scheduler::Pop()
+{
+    m_readyCount.Wait();
+    MutexCSLock lock(m_lock);
+    if (m_stopping || m_ready.empty()) return NULL;
+    Thread *t = m_ready.front();
+    m_ready.pop_front();
+    return t;
+}
+
+void Scheduler::Push( Thread *t )
+{
+    {
+        MutexCSLock lock(m_lock);
+        m_ready.push_back(t);
+    }
+    m_readyCount.Post();
+}
+
+void Scheduler::Finish( Thread *t )
+{
+    m_process->Plugins()->OnThreadExit(t);
+    // the guest holds its own reference to the handle and closes it with CloseHandle
+    m_process->Sync()->ExitThread(t->Handle, t->ExitCode);
+    m_process->Sync()->Close(t->Handle);
+    m_process->ThreadDelete(t->ExtID);
+}
+
+END_NAMESPACE_LOCHSEMU()
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef __CORE_SCHEDULER_H__
+#define __CORE_SCHEDULER_H__
+
+#include "lochsemu.h"
+#include "parallel.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * M:N scheduler (Emulator/ThreadPool > 0): threads created by the guest
+ * run cooperatively on a fixed pool of host threads. A worker takes the
+ * thread at the head of the ready queue, runs it for Emulator/TimeSlice
+ * instructions and puts it back at the tail. The main thread keeps its
+ * own host thread. A guest blocked on an emulated object gives its worker
+ * up until the next slice; one blocked in a host wait holds on to it.
+ */
+class LX_API Scheduler {
+public:
+    Scheduler(Process *proc, int workers, u32 timeSlice);
+    ~Scheduler();
+
+    LxResult        Start();
+    void            Stop();
+
+    /* queue a new thread; suspended ones wait for Resume */
+    void            Add(Thread *t, bool suspended);
+    /* false if hThread is not a suspended pooled thread */
+    bool            Resume(HANDLE hThread);
+
+    /* ids of pooled threads are odd, so they never clash with host ones */
+    ThreadID        NextThreadId();
+
+    /* guest thread running on the calling worker, NULL elsewhere */
+    static Thread * Current();
+
+private:
+    static DWORD WINAPI WorkerRoutine(LPVOID lpParams);
+    void            WorkerLoop();
+    Thread *        Pop();
+    void            Push(Thread *t);
+    void            Finish(Thread *t);
+
+private:
+    Process *               m_process;
+    int                     m_workerCount;
+    u32                     m_timeSlice;
+    std::vector<HANDLE>     m_workers;
+    std::deque<Thread *>    m_ready;
+    std::vector<Thread *>   m_suspended;
+    MutexCS                 m_lock;
+    Semaphore               m_readyCount;
+    volatile bool           m_stopping;
+    ThreadID                m_nextId;
+};
+
+END_NAMESPACE_LOCHSEMU()
+
+#endif // __CORE_SCHEDULER_H__
@@ -4,10 +4,12 @@
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
+volatile long Section::s_mappingGeneration = 0;
+bool Section::s_writeWatch = false;
 
 Section::Section( const SectionDesc &desc, u32 base, u32 size )
 : m_desc(desc), m_base(base), m_size(size), m_pages(PAGE_NUM(size)), 
-PhysAddress((u32) this)
+PhysAddress((u32) this), m_owner(NULL)
 {
     Assert(PAGE_LOW(base) == 0);
     Assert(PAGE_LOW(size) == 0);
@@ -18,7 +20,8 @@ PhysAddress((u32) this)
         m_pageDescTable[i] = PageDesc();
 
     // Allocate a block of memory, even reserved
-    m_dataPtr = (pbyte) VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+    m_dataPtr = (pbyte) VirtualAlloc(NULL, size, 
+        MEM_RESERVE | (s_writeWatch ? MEM_WRITE_WATCH : 0), PAGE_NOACCESS);
 }
 
 Section::~Section()
@@ -26,6 +29,7 @@ Section::~Section()
     SAFE_DELETE_ARRAY(m_pageDescTable);
     if (m_dataPtr)
         Free();
+    InvalidateMappings();
 }
 
 LxResult Section::Commit( u32 addr, u32 size, uint protect )
@@ -35,11 +39,15 @@ LxResult Section::Commit( u32 addr, u32 size, uint protect )
 
     u32 head = addr - m_base;
     u32 tail = addr - m_base + size - 1;
+    bool downgrade = false;
     for (uint n = PAGE_NUM(head); n <= PAGE_NUM(tail); n++) {
+        if (IsCommitted(n) && m_pageDescTable[n].Protect != protect) downgrade = true;
         SetPageDesc(n, protect, LX_CHR_COMMITTED);
     }
+    if (downgrade) InvalidateMappings();
     LPVOID lpAddr = VirtualAlloc(m_dataPtr + (addr - m_base), size, MEM_COMMIT, PAGE_READWRITE);
     Assert(lpAddr == m_dataPtr + (addr - m_base));
+    UpdatePageMap(addr, size);
     RET_SUCCESS();
     
 }
@@ -54,6 +62,8 @@ LxResult Section::Decommit( u32 addr, u32 size )
     for (uint n = PAGE_NUM(head); n <= PAGE_NUM(tail); n++) {
         SetPageDesc(n, PAGE_NOACCESS, LX_CHR_RESERVED);
     }
+    InvalidateMappings();
+    UpdatePageMap(addr, size);
     B( VirtualFree(m_dataPtr + (addr - m_base), size, MEM_DECOMMIT) );
     RET_SUCCESS();
 }
@@ -67,6 +77,7 @@ LxResult Section::Release()
     }
     B( VirtualFree(m_dataPtr, 0, MEM_RELEASE) );
     m_dataPtr = NULL;
+    InvalidateMappings();
     RET_SUCCESS();
 }
 
@@ -75,6 +86,7 @@ void Section::Free()
     B( VirtualFree(m_dataPtr, m_size, MEM_DECOMMIT) );
     B( VirtualFree(m_dataPtr, 0, MEM_RELEASE) );
     m_dataPtr = NULL;
+    InvalidateMappings();
 }
 
 void Section::Copy( u32 addr, u32 size, pbyte data )
@@ -90,6 +102,30 @@ void Section::Copy( u32 addr, u32 size, pbyte data )
     memcpy(m_dataPtr + (addr - m_base), data, min(size, m_size));
 }
 
+void Section::CollectWrites( std::vector<u32> &pages, std::vector<PVOID> &scratch )
+{
+    if (!s_writeWatch || m_dataPtr == NULL) return;
+    if (scratch.size() < m_pages) scratch.resize(m_pages);
+
+    ULONG_PTR count = m_pages;
+    DWORD granularity;
+    if (GetWriteWatch(WRITE_WATCH_FLAG_RESET, m_dataPtr, m_size, &scratch[0], &count, &granularity) != 0)
+        return;     // reserved before write tracking was enabled
+    for (ULONG_PTR i = 0; i < count; i++) {
+        pages.push_back(m_base + (u32) ((pbyte) scratch[i] - m_dataPtr));
+    }
+}
+
+void Section::InvalidateMappings()
+{
+    InterlockedIncrement(&s_mappingGeneration);
+}
+
+void Section::UpdatePageMap( u32 addr, u32 size )
+{
+    if (m_owner) m_owner->UpdatePageMap(this, addr, size);
+}
+
 std::vector<PageInfo> Section::GetSectionInfo() const
 {
     std::vector<PageInfo> r;
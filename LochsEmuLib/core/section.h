@@ -17,6 +17,7 @@ BEGIN_NAMESPACE_LOCHSEMU()
  */
 
 class LX_API Section {
+    friend class Memory;
 public:
     Section(const SectionDesc &desc, u32 base, u32 size);
     virtual ~Section();
@@ -58,6 +59,8 @@ public:
     INLINE pbyte    GetRawData(u32 addr) const;
     INLINE void     Erase();
     INLINE uint     GetPageState(u32 addr) const;
+    INLINE bool     IsReadable(u32 addr) const;
+    INLINE bool     IsWritable(u32 addr) const;
     std::vector<PageInfo>    GetSectionInfo() const;
 
     INLINE LxResult Read8(u32 address, u8p val) const;
@@ -71,7 +74,24 @@ public:
     INLINE LxResult Write64(u32 address, const u64 &value);
     INLINE LxResult Write128(u32 address, const u128 &value);
 
+    /*
+     * Bumped whenever a page of any section is decommitted, released or
+     * recommitted with a new protection
+     */
+    static u32      MappingGeneration() { return (u32) s_mappingGeneration; }
+
+    /*
+     * Reserve sections created from now on with host write tracking, so
+     * CollectWrites can tell which pages were written (ReplayLog recording)
+     */
+    static void     EnableWriteWatch() { s_writeWatch = true; }
+    /* append the guest address of every page written since the last call */
+    void            CollectWrites(std::vector<u32> &pages, std::vector<PVOID> &scratch);
+
 protected:
+    static void     InvalidateMappings();
+    void            UpdatePageMap(u32 addr, u32 size);
+
     INLINE void     SetPageDesc(uint pageNum, uint protect, uint chr);
     INLINE bool     CanRead(uint pageNum) const;
     INLINE bool     CanWrite(uint pageNum) const;
@@ -87,6 +107,10 @@ protected:
     u32             m_pages;
     PageDesc *      m_pageDescTable;
     pbyte           m_dataPtr;
+    Memory *        m_owner;        // set once the section is inserted into a Memory
+
+    static volatile long    s_mappingGeneration;
+    static bool             s_writeWatch;
 };
 
 
@@ -105,6 +129,17 @@ INLINE uint Section::GetPageState(u32 addr) const {
     Assert(Contains(addr)); return m_pageDescTable[PAGE_NUM(addr-m_base)].Characristics; 
 }
 
+INLINE bool Section::IsReadable(u32 addr) const {
+    Assert(Contains(addr));
+    uint pageNum = PAGE_NUM(addr-m_base);
+    return IsCommitted(pageNum) && CanRead(pageNum);
+}
+INLINE bool Section::IsWritable(u32 addr) const {
+    Assert(Contains(addr));
+    uint pageNum = PAGE_NUM(addr-m_base);
+    return IsCommitted(pageNum) && CanWrite(pageNum);
+}
+
 INLINE bool Section::IsAllCommitted() const
 {
     for (uint i = 0; i < m_pages; i++) {
@@ -0,0 +1,386 @@
+#include "stdafx.h"
+#include "snapshot.h"
+#include "emulator.h"
+#include "process.h"
+#include "thread.h"
+#include "memory.h"
+#include "section.h"
+#include "heap.h"
+#include "stack.h"
+#include "pemodule.h"
+#include "peloader.h"
+#include "syncmgr.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+static const u32 SnapshotMagic      = 0x4e53584c;   // "LXSN"
+static const u32 SnapshotVersion    = 3;
+
+static bool IsZeroPage( cpbyte p )
+{
+    const u32 *w = (const u32 *) p;
+    for (uint i = 0; i < LX_PAGE_SIZE / sizeof(u32); i++) {
+        if (w[i] != 0) return false;
+    }
+    return true;
+}
+
+Snapshot::Snapshot()
+{
+    m_tebAddress = 0;
+}
+
+Snapshot::~Snapshot()
+{
+}
+
+LxResult Snapshot::Capture( Emulator *emu )
+{
+    Assert(emu);
+    Process *proc = emu->Proc();
+    Thread *main = proc->GetThread(0);
+    if (proc->GetThreadCount() != 1) {
+        LxError("Snapshot: %d threads alive, only the main thread may be\n", proc->GetThreadCount());
+        return LX_RESULT_INVALID_OPERATION;
+    }
+    const uint nModules = emu->Loader()->GetNumOfModules();
+    if (main->GetModuleLoadOrder().size() != nModules - 1) {
+        LxError("Snapshot: modules are still being initialized\n");
+        return LX_RESULT_INVALID_OPERATION;
+    }
+
+    SyncObjectLock lock(*emu->Mem());
+
+    m_image         = emu->Path();
+    m_moduleOrder   = main->GetModuleLoadOrder();
+    m_tebAddress    = main->GetTEBAddress();
+    m_moduleBases.clear();
+    m_modulePaths.clear();
+    m_moduleInit.clear();
+    for (uint i = 0; i < nModules; i++) {
+        const ModuleInfo *info = emu->Loader()->GetModuleInfo(i);
+        m_moduleBases.push_back(info->ImageBase);
+        m_modulePaths.push_back(emu->Loader()->GetModulePath(i));
+        m_moduleInit.push_back(info->Initialized ? 1 : 0);
+    }
+
+    CaptureMemory(emu->Mem());
+    m_heaps = proc->GetHeapBases();
+
+    m_cpu.clear();
+    SnapshotWriter cpu(m_cpu);
+    main->CPU()->SaveState(cpu);
+    cpu.Put(main->ExitCode);
+    cpu.Put(main->LastError);
+
+    m_sync.clear();
+    SnapshotWriter sync(m_sync);
+    proc->Sync()->SaveState(sync, main);
+
+    LxInfo("Snapshot captured at EIP[%08x]: %d sections, %d KB of page data\n",
+        main->CPU()->EIP, m_sections.size(), m_pageData.size() / 1024);
+    RET_SUCCESS();
+}
+
+void Snapshot::CaptureMemory( const Memory *mem )
+{
+    m_sections.clear();
+    m_pageData.clear();
+
+    const std::vector<Section *> &sections = mem->GetSections();
+    m_sections.resize(sections.size());
+    for (uint n = 0; n < sections.size(); n++) {
+        Section *sec = sections[n];
+        SectionImage &img = m_sections[n];
+        img.Kind    = mem->IsHeap(sec) ? KindHeap : mem->IsStack(sec) ? KindStack : KindPlain;
+        img.Desc    = sec->GetDesc();
+        img.Base    = sec->Base();
+        img.Size    = sec->Size();
+
+        std::vector<PageInfo> pages = sec->GetSectionInfo();
+        img.Pages.assign(pages.begin(), pages.end());
+        img.PageData.assign(pages.size(), NoPageData);
+        for (uint i = 0; i < pages.size(); i++) {
+            if (!sec->IsCommitted(i)) continue;
+            // committed pages that are still zero carry no data
+            cpbyte p = sec->GetRawData(img.Base + PAGE_ADDR(i));
+            if (IsZeroPage(p)) continue;
+            img.PageData[i] = (u32) m_pageData.size();
+            m_pageData.insert(m_pageData.end(), p, p + LX_PAGE_SIZE);
+        }
+        if (img.Kind == KindHeap) {
+            SnapshotWriter w(img.State);
+            ((const Heap *) sec)->SaveState(w);
+        }
+    }
+}
+
+LxResult Snapshot::Restore( Emulator *emu ) const
+{
+    Assert(emu);
+    if (IsEmpty()) return LX_RESULT_NOT_INITIALIZED;
+
+    Process *proc = emu->Proc();
+    Thread *main = proc->GetThread(0);
+    if (proc->GetThreadCount() != 1) {
+        LxError("Snapshot: restore into a process that is already running\n");
+        return LX_RESULT_INVALID_OPERATION;
+    }
+    if (_stricmp(m_image.c_str(), emu->Path()) != 0) {
+        LxWarning("Snapshot was taken from %s\n", m_image.c_str());
+    }
+
+    // modules loaded by the guest after start-up; each also brings back the
+    // dependencies it loaded, which were recorded right after it
+    PeLoader *loader = emu->Loader();
+    while (loader->GetNumOfModules() < m_modulePaths.size()) {
+        const uint n = loader->GetNumOfModules();
+        LxInfo("Snapshot: loading %s\n", m_modulePaths[n].c_str());
+        proc->LoadModule(m_modulePaths[n].c_str());
+        if (loader->GetNumOfModules() == n) {
+            LxError("Snapshot: cannot load %s\n", m_modulePaths[n].c_str());
+            return LX_RESULT_INVALID_OPERATION;
+        }
+    }
+
+    // the image must have been loaded exactly as when the snapshot was taken
+    bool matches = loader->GetNumOfModules() == m_moduleBases.size() &&
+        main->GetTEBAddress() == m_tebAddress;
+    for (uint i = 0; matches && i < m_moduleBases.size(); i++) {
+        matches = loader->GetModuleInfo(i)->ImageBase == m_moduleBases[i];
+    }
+    if (!matches) {
+        LxError("Snapshot: modules or main thread are laid out differently\n");
+        return LX_RESULT_INVALID_OPERATION;
+    }
+
+    LxResult lr = RestoreMemory(emu);
+    if (LX_FAILED(lr)) return lr;
+
+    for (uint i = 0; i < m_moduleInit.size(); i++) {
+        loader->GetModuleInfo(i)->Initialized = m_moduleInit[i] != 0;
+    }
+    main->SetModuleLoadOrder(m_moduleOrder);
+    if (!proc->SetHeapBases(m_heaps)) {
+        LxError("Snapshot: process heaps are missing\n");
+        return LX_RESULT_INVALID_FORMAT;
+    }
+
+    SnapshotReader cpu(m_cpu.empty() ? NULL : &m_cpu[0], (uint) m_cpu.size());
+    if (!main->CPU()->LoadState(cpu)) return LX_RESULT_INVALID_FORMAT;
+    main->ExitCode = cpu.Get<u32>();
+    main->LastError = cpu.Get<u32>();
+
+    SnapshotReader sync(m_sync.empty() ? NULL : &m_sync[0], (uint) m_sync.size());
+    if (!proc->Sync()->LoadState(sync, main)) return LX_RESULT_INVALID_FORMAT;
+
+    proc->SetResumed();
+    LxInfo("Snapshot restored at EIP[%08x]\n", main->CPU()->EIP);
+    RET_SUCCESS();
+}
+
+LxResult Snapshot::RestoreMemory( Emulator *emu ) const
+{
+    Memory *mem = emu->Mem();
+    SyncObjectLock lock(*mem);
+
+    std::map<u32, const SectionImage *> images;
+    for (uint i = 0; i < m_sections.size(); i++) {
+        images[m_sections[i].Base] = &m_sections[i];
+    }
+
+    // drop sections the snapshot does not have in the same place and shape
+    const Section *mainStack = emu->Proc()->GetThread(0)->GetStack();
+    std::vector<Section *> stale;
+    const std::vector<Section *> &sections = mem->GetSections();
+    for (uint i = 0; i < sections.size(); i++) {
+        Section *sec = sections[i];
+        SectionKind kind = mem->IsHeap(sec) ? KindHeap : mem->IsStack(sec) ? KindStack : KindPlain;
+        auto iter = images.find(sec->Base());
+        if (iter != images.end() && iter->second->Size == sec->Size() && iter->second->Kind == kind)
+            continue;
+        if (sec == mainStack) {
+            LxError("Snapshot: main thread stack at %08x does not match\n", sec->Base());
+            return LX_RESULT_INVALID_OPERATION;
+        }
+        stale.push_back(sec);
+    }
+    for (uint i = 0; i < stale.size(); i++) {
+        Section *sec = stale[i];
+        if (mem->IsHeap(sec)) {
+            mem->DestroyHeap((Heap *) sec);
+        } else if (mem->IsStack(sec)) {
+            mem->DestroyStack((Stack *) sec);
+        } else {
+            LxResult lr = mem->Free(sec->Base());
+            if (LX_FAILED(lr)) return lr;
+        }
+    }
+
+    for (uint i = 0; i < m_sections.size(); i++) {
+        const SectionImage &img = m_sections[i];
+        Section *sec = mem->GetSection(img.Base);
+        if (sec == NULL) {
+            switch (img.Kind) {
+            case KindHeap:
+                sec = mem->CreateHeap(img.Base, img.Size, 0, img.Desc.Module);
+                break;
+            case KindStack:
+                sec = mem->CreateStack(img.Base, img.Size, 0, img.Desc.Module);
+                break;
+            default:
+                if (!LX_FAILED(mem->Reserve(img.Desc, img.Base, img.Size, PAGE_NOACCESS)))
+                    sec = mem->GetSection(img.Base);
+                break;
+            }
+            if (sec == NULL) {
+                LxError("Snapshot: cannot recreate section %08x\n", img.Base);
+                return LX_RESULT_NO_MEMORY;
+            }
+        }
+        LxResult lr = RestoreSection(sec, img);
+        if (LX_FAILED(lr)) return lr;
+    }
+    RET_SUCCESS();
+}
+
+LxResult Snapshot::RestoreSection( Section *sec, const SectionImage &img ) const
+{
+    static const byte ZeroPage[LX_PAGE_SIZE] = { 0 };
+
+    // only pages that differ are touched, so restoring the same snapshot again is cheap
+    std::vector<PageInfo> current = sec->GetSectionInfo();
+    for (uint i = 0; i < img.Pages.size(); i++) {
+        const u32 addr = img.Base + PAGE_ADDR(i);
+        const PageDesc &page = img.Pages[i];
+        if ((page.Characristics & LX_CHR_COMMITTED) == 0) {
+            if (sec->IsCommitted(i)) sec->Decommit(addr, LX_PAGE_SIZE);
+            continue;
+        }
+        if (!sec->IsCommitted(i) || current[i].Protect != page.Protect) {
+            sec->Commit(addr, LX_PAGE_SIZE, page.Protect);
+        }
+        pbyte dst = sec->GetRawData(addr);
+        cpbyte src = img.PageData[i] == NoPageData ? ZeroPage : &m_pageData[img.PageData[i]];
+        if (memcmp(dst, src, LX_PAGE_SIZE) != 0) {
+            memcpy(dst, src, LX_PAGE_SIZE);
+        }
+    }
+
+    if (img.Kind == KindHeap) {
+        SnapshotReader r(img.State.empty() ? NULL : &img.State[0], (uint) img.State.size());
+        if (!((Heap *) sec)->LoadState(r)) {
+            LxError("Snapshot: corrupted heap state at %08x\n", img.Base);
+            return LX_RESULT_INVALID_FORMAT;
+        }
+    }
+    RET_SUCCESS();
+}
+
+LxResult Snapshot::Save( LPCSTR lpFileName ) const
+{
+    std::vector<byte> buf;
+    SnapshotWriter w(buf);
+    w.Put(SnapshotMagic);
+    w.Put(SnapshotVersion);
+    w.PutString(m_image);
+    w.PutVector(m_moduleBases);
+    w.Put((u32) m_modulePaths.size());
+    for (uint i = 0; i < m_modulePaths.size(); i++) {
+        w.PutString(m_modulePaths[i]);
+    }
+    w.PutVector(m_moduleInit);
+    w.PutVector(m_moduleOrder);
+    w.Put(m_tebAddress);
+    w.Put((u32) m_sections.size());
+    for (uint i = 0; i < m_sections.size(); i++) {
+        const SectionImage &img = m_sections[i];
+        w.Put((u32) img.Kind);
+        w.PutString(img.Desc.Desc);
+        w.Put((u32) img.Desc.Module);
+        w.Put(img.Base);
+        w.Put(img.Size);
+        w.PutVector(img.Pages);
+        w.PutVector(img.PageData);
+        w.PutVector(img.State);
+    }
+    w.PutVector(m_pageData);
+    w.PutVector(m_heaps);
+    w.PutVector(m_cpu);
+    w.PutVector(m_sync);
+
+    FILE *fp = fopen(lpFileName, "wb");
+    if (fp == NULL) return LX_RESULT_ERROR_OPEN_FILE;
+    size_t written = fwrite(&buf[0], 1, buf.size(), fp);
+    fclose(fp);
+    if (written != buf.size()) return LX_RESULT_ERROR_WRITE_FILE;
+    LxInfo("Snapshot saved to %s, %d KB\n", lpFileName, buf.size() / 1024);
+    RET_SUCCESS();
+}
+
+LxResult Snapshot::Load( LPCSTR lpFileName )
+{
+    FILE *fp = fopen(lpFileName, "rb");
+    if (fp == NULL) return LX_RESULT_ERROR_OPEN_FILE;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    std::vector<byte> buf(size > 0 ? size : 0);
+    size_t nRead = buf.empty() ? 0 : fread(&buf[0], 1, buf.size(), fp);
+    fclose(fp);
+    if (nRead != buf.size()) return LX_RESULT_ERROR_READ_FILE;
+
+    SnapshotReader r(buf.empty() ? NULL : &buf[0], (uint) buf.size());
+    if (r.Get<u32>() != SnapshotMagic || r.Get<u32>() != SnapshotVersion) {
+        LxError("%s is not a snapshot of this version\n", lpFileName);
+        return LX_RESULT_INVALID_FORMAT;
+    }
+    m_image = r.GetString();
+    r.GetVector(m_moduleBases);
+    u32 nPaths = r.Get<u32>();
+    m_modulePaths.clear();
+    for (u32 i = 0; i < nPaths && !r.Failed(); i++) {
+        m_modulePaths.push_back(r.GetString());
+    }
+    r.GetVector(m_moduleInit);
+    r.GetVector(m_moduleOrder);
+    m_tebAddress = r.Get<u32>();
+    u32 nSections = r.Get<u32>();
+    m_sections.clear();
+    for (u32 i = 0; i < nSections && !r.Failed(); i++) {
+        SectionImage img;
+        img.Kind        = (SectionKind) r.Get<u32>();
+        img.Desc.Desc   = r.GetString();
+        img.Desc.Module = r.Get<u32>();
+        img.Base        = r.Get<u32>();
+        img.Size        = r.Get<u32>();
+        r.GetVector(img.Pages);
+        r.GetVector(img.PageData);
+        r.GetVector(img.State);
+        if (img.Kind > KindStack || img.Pages.size() != PAGE_NUM(img.Size) ||
+            img.PageData.size() != img.Pages.size())
+        {
+            return LX_RESULT_INVALID_FORMAT;
+        }
+        m_sections.push_back(img);
+    }
+    r.GetVector(m_pageData);
+    r.GetVector(m_heaps);
+    r.GetVector(m_cpu);
+    r.GetVector(m_sync);
+    if (r.Failed()) return LX_RESULT_INVALID_FORMAT;
+
+    for (uint i = 0; i < m_sections.size(); i++) {
+        const std::vector<u32> &offsets = m_sections[i].PageData;
+        for (uint j = 0; j < offsets.size(); j++) {
+            if (offsets[j] != NoPageData && (offsets[j] > m_pageData.size() ||
+                m_pageData.size() - offsets[j] < LX_PAGE_SIZE))
+            {
+                return LX_RESULT_INVALID_FORMAT;
+            }
+        }
+    }
+    RET_SUCCESS();
+}
+
+END_NAMESPACE_LOCHSEMU()
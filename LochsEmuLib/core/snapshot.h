@@ -0,0 +1,160 @@
+#pragma once
+
+#ifndef __CORE_SNAPSHOT_H__
+#define __CORE_SNAPSHOT_H__
+
+#include "lochsemu.h"
+#include "memdesc.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * Flat little-endian stream used by the snapshot file and by the
+ * components that save their own state into it
+ */
+class LX_API SnapshotWriter {
+public:
+    SnapshotWriter(std::vector<byte> &buf) : m_buf(buf) {}
+
+    void        Write(const void *data, uint size)
+    {
+        m_buf.insert(m_buf.end(), (cpbyte) data, (cpbyte) data + size);
+    }
+    template <typename T>
+    void        Put(const T &val) { Write(&val, sizeof(T)); }
+    void        PutString(const std::string &s)
+    {
+        Put((u32) s.size());
+        Write(s.data(), (uint) s.size());
+    }
+    template <typename T>
+    void        PutVector(const std::vector<T> &v)
+    {
+        Put((u32) v.size());
+        if (!v.empty()) Write(&v[0], (uint) (v.size() * sizeof(T)));
+    }
+
+private:
+    std::vector<byte> &     m_buf;
+    SnapshotWriter &operator=(const SnapshotWriter &);
+};
+
+class LX_API SnapshotReader {
+public:
+    SnapshotReader(cpbyte data, uint size) : m_data(data), m_size(size), m_pos(0), m_failed(false) {}
+
+    /* reads past the end fail and leave the stream failed */
+    bool        Read(void *data, uint size)
+    {
+        if (m_failed || size > m_size - m_pos) {
+            m_failed = true;
+            ZeroMemory(data, size);
+            return false;
+        }
+        memcpy(data, m_data + m_pos, size);
+        m_pos += size;
+        return true;
+    }
+    template <typename T>
+    T           Get() { T val; Read(&val, sizeof(T)); return val; }
+    std::string GetString()
+    {
+        u32 len = Get<u32>();
+        if (m_failed || len > m_size - m_pos) { m_failed = true; return std::string(); }
+        std::string s((const char *) m_data + m_pos, len);
+        m_pos += len;
+        return s;
+    }
+    template <typename T>
+    void        GetVector(std::vector<T> &v)
+    {
+        u32 n = Get<u32>();
+        if (m_failed || n > (m_size - m_pos) / sizeof(T)) { m_failed = true; v.clear(); return; }
+        v.resize(n);
+        if (n) Read(&v[0], n * sizeof(T));
+    }
+    /* pointer to the next 'size' bytes without copying them */
+    cpbyte      Skip(uint size)
+    {
+        if (m_failed || size > m_size - m_pos) { m_failed = true; return NULL; }
+        cpbyte p = m_data + m_pos;
+        m_pos += size;
+        return p;
+    }
+    bool        Failed() const { return m_failed; }
+    uint        Position() const { return m_pos; }
+
+private:
+    cpbyte      m_data;
+    uint        m_size;
+    uint        m_pos;
+    bool        m_failed;
+};
+
+/*
+ * Saved state of an emulated process: every memory section with its page
+ * protections and committed pages, heap bookkeeping, the main thread's
+ * registers, the process heap table and the emulated synchronization
+ * objects and clock.
+ *
+ * A snapshot is restored into an emulator that has loaded the same image
+ * but not run it yet; Process::Run then resumes the main thread where it
+ * was captured. Modules the guest loaded at run time are loaded again,
+ * in the same order and without running DllMain, and must land at the
+ * same bases. Capture only works while the main thread is the only
+ * guest thread, and host handles (files, sockets, ...) are not saved.
+ * Restoring the same Snapshot again only writes back pages that differ,
+ * so repeated runs from one warm state are cheap.
+ */
+class LX_API Snapshot {
+public:
+    Snapshot();
+    ~Snapshot();
+
+    /* call between two instructions of the main thread */
+    LxResult        Capture(Emulator *emu);
+    LxResult        Restore(Emulator *emu) const;
+
+    LxResult        Save(LPCSTR lpFileName) const;
+    LxResult        Load(LPCSTR lpFileName);
+
+    bool            IsEmpty() const { return m_sections.empty(); }
+
+private:
+    enum SectionKind {
+        KindPlain, KindHeap, KindStack,
+    };
+
+    struct SectionImage {
+        SectionKind             Kind;
+        SectionDesc             Desc;
+        u32                     Base;
+        u32                     Size;
+        std::vector<PageDesc>   Pages;
+        std::vector<u32>        PageData;   // offset into m_pageData per page, NoPageData if zero or uncommitted
+        std::vector<byte>       State;      // heap bookkeeping
+    };
+
+    static const u32    NoPageData  = (u32) -1;
+
+    void            CaptureMemory(const Memory *mem);
+    LxResult        RestoreMemory(Emulator *emu) const;
+    LxResult        RestoreSection(Section *sec, const SectionImage &img) const;
+
+private:
+    std::string                 m_image;        // path of the main module
+    std::vector<u32>            m_moduleBases;
+    std::vector<std::string>    m_modulePaths;
+    std::vector<byte>           m_moduleInit;   // ModuleInfo::Initialized of each module
+    std::vector<uint>           m_moduleOrder;  // main thread's DllMain order
+    std::vector<SectionImage>   m_sections;
+    std::vector<byte>           m_pageData;
+    std::vector<u32>            m_heaps;        // base of each process heap, 0 if destroyed
+    std::vector<byte>           m_cpu;
+    std::vector<byte>           m_sync;
+    u32                         m_tebAddress;
+};
+
+END_NAMESPACE_LOCHSEMU()
+
+#endif // __CORE_SNAPSHOT_H__
@@ -0,0 +1,1040 @@
+#include "stdafx.h"
+#include "softfpu.h"
+#include "coprocessor.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+static const u16    SW_IE       = 0x0001;
+static const u16    SW_DE       = 0x0002;
+static const u16    SW_ZE       = 0x0004;
+static const u16    SW_OE       = 0x0008;
+static const u16    SW_UE       = 0x0010;
+static const u16    SW_PE       = 0x0020;
+static const u16    SW_SF       = 0x0040;
+static const u16    SW_ES       = 0x0080;
+static const u16    SW_C0       = 0x0100;
+static const u16    SW_C1       = 0x0200;
+static const u16    SW_C2       = 0x0400;
+static const u16    SW_C3       = 0x4000;
+static const u16    SW_B        = 0x8000;
+static const u16    SW_EXCEPT   = 0x003f;
+
+static const u16    TagValid    = 0;
+static const u16    TagZero     = 1;
+static const u16    TagSpecial  = 2;
+static const u16    TagEmpty    = 3;
+
+static const int    ExpBias     = 16383;
+static const u64    TopBit      = 0x8000000000000000ULL;
+static const u64    QuietBit    = 0x4000000000000000ULL;
+
+static const Float80 ConstantTable[] = {
+    { 0x8000000000000000ULL, 0x3fff },  /* 1 */
+    { 0xd49a784bcd1b8afeULL, 0x4000 },  /* log2(10) */
+    { 0xb8aa3b295c17f0bcULL, 0x3fff },  /* log2(e) */
+    { 0xc90fdaa22168c235ULL, 0x4000 },  /* pi */
+    { 0x9a209a84fbcff799ULL, 0x3ffd },  /* log10(2) */
+    { 0xb17217f7d1cf79acULL, 0x3ffe },  /* ln(2) */
+    { 0x0000000000000000ULL, 0x0000 },  /* 0 */
+};
+
+static int Clz64( u64 x )
+{
+    Assert(x != 0);
+    int n = 0;
+    if ((x >> 32) == 0) { n += 32; x <<= 32; }
+    if ((x >> 48) == 0) { n += 16; x <<= 16; }
+    if ((x >> 56) == 0) { n +=  8; x <<=  8; }
+    if ((x >> 60) == 0) { n +=  4; x <<=  4; }
+    if ((x >> 62) == 0) { n +=  2; x <<=  2; }
+    if ((x >> 63) == 0) { n +=  1; }
+    return n;
+}
+
+/* shift hi:lo right by n, or-ing every bit shifted out into the lowest bit */
+static void Shift128RightJam( u64 *hi, u64 *lo, int n )
+{
+    if (n <= 0) return;
+    if (n < 64) {
+        u64 sticky = (*lo << (64 - n)) != 0;
+        *lo = (*hi << (64 - n)) | (*lo >> n) | sticky;
+        *hi >>= n;
+    } else if (n == 64) {
+        *lo = *hi | (*lo != 0);
+        *hi = 0;
+    } else if (n < 128) {
+        *lo = (*hi >> (n - 64)) | (((*hi << (128 - n)) | *lo) != 0);
+        *hi = 0;
+    } else {
+        *lo = (*hi | *lo) != 0;
+        *hi = 0;
+    }
+}
+
+static void Mul64To128( u64 a, u64 b, u64 *hi, u64 *lo )
+{
+    u64 aLo = (u32) a, aHi = a >> 32;
+    u64 bLo = (u32) b, bHi = b >> 32;
+    u64 p0 = aLo * bLo, p1 = aLo * bHi, p2 = aHi * bLo, p3 = aHi * bHi;
+    u64 mid = (p0 >> 32) + (u32) p1 + (u32) p2;
+    *lo = (mid << 32) | (u32) p0;
+    *hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+}
+
+static Float80 FromMagnitude( bool sign, u64 mag )
+{
+    Float80 f;
+    if (mag == 0) {
+        f.Mantissa  = 0;
+        f.SignExp   = sign ? 0x8000 : 0;
+        return f;
+    }
+    int s = Clz64(mag);
+    f.Mantissa  = mag << s;
+    f.SignExp   = (sign ? 0x8000 : 0) | (u16) (63 - s + ExpBias);
+    return f;
+}
+
+static Float80 ReadReg( const FPUReg &reg )
+{
+    Float80 f;
+    memcpy(&f.Mantissa, reg, 8);
+    memcpy(&f.SignExp, reg + 8, 2);
+    return f;
+}
+
+static void WriteReg( FPUReg &reg, const Float80 &f )
+{
+    memcpy(reg, &f.Mantissa, 8);
+    memcpy(reg + 8, &f.SignExp, 2);
+}
+
+SoftFpu::SoftFpu( FpuContext *context )
+: m_context(context)
+{
+}
+
+void SoftFpu::Reset( void )
+{
+    m_context->ControlWord  = 0x27f;
+    m_context->StatusWord   = 0;
+    m_context->TagWord      = 0xffff;
+}
+
+/*
+ * Register stack
+ */
+
+int SoftFpu::Top( void ) const
+{
+    return (m_context->StatusWord >> 11) & 7;
+}
+
+void SoftFpu::SetTop( int top )
+{
+    m_context->StatusWord = (m_context->StatusWord & ~0x3800) | ((top & 7) << 11);
+}
+
+u16 SoftFpu::Tag( int i ) const
+{
+    int phys = (Top() + i) & 7;
+    return (m_context->TagWord >> (phys * 2)) & 3;
+}
+
+void SoftFpu::SetTag( int i, u16 tag )
+{
+    int phys = (Top() + i) & 7;
+    m_context->TagWord = (m_context->TagWord & ~(3 << (phys * 2))) | (tag << (phys * 2));
+}
+
+Float80 SoftFpu::Get( int i )
+{
+    Assert(i >= 0 && i < LX_X87_REGS);
+    if (Tag(i) == TagEmpty) {
+        // stack underflow
+        m_context->StatusWord &= ~SW_C1;
+        Raise(SW_IE | SW_SF);
+        return Indefinite();
+    }
+    return ReadReg(m_context->ST[i]);
+}
+
+void SoftFpu::Set( int i, const Float80 &f )
+{
+    Assert(i >= 0 && i < LX_X87_REGS);
+    WriteReg(m_context->ST[i], f);
+    SetTag(i, TagOf(f));
+}
+
+void SoftFpu::Push( const Float80 &f )
+{
+    Float80 val = f;
+    if (Tag(7) != TagEmpty) {
+        // stack overflow
+        m_context->StatusWord |= SW_C1;
+        Raise(SW_IE | SW_SF);
+        val = Indefinite();
+    }
+    // the fsave image is ordered by stack position, not by physical register
+    memmove(m_context->ST[1], m_context->ST[0], sizeof(FPUReg) * (LX_X87_REGS - 1));
+    SetTop(Top() - 1);
+    Set(0, val);
+}
+
+void SoftFpu::Pop( void )
+{
+    SetTag(0, TagEmpty);
+    FPUReg old;
+    memcpy(old, m_context->ST[0], sizeof(FPUReg));
+    memmove(m_context->ST[0], m_context->ST[1], sizeof(FPUReg) * (LX_X87_REGS - 1));
+    memcpy(m_context->ST[LX_X87_REGS - 1], old, sizeof(FPUReg));
+    SetTop(Top() + 1);
+}
+
+void SoftFpu::Raise( u16 flags )
+{
+    m_context->StatusWord |= flags;
+    if (m_context->StatusWord & ~m_context->ControlWord & SW_EXCEPT) {
+        m_context->StatusWord |= SW_ES | SW_B;
+    }
+}
+
+void SoftFpu::SetConditions( int c3, int c2, int c0 )
+{
+    u16 sw = m_context->StatusWord & ~(SW_C3 | SW_C2 | SW_C1 | SW_C0);
+    if (c3) sw |= SW_C3;
+    if (c2) sw |= SW_C2;
+    if (c0) sw |= SW_C0;
+    m_context->StatusWord = sw;
+}
+
+u16 SoftFpu::ControlWord( void ) const
+{
+    return m_context->ControlWord;
+}
+
+void SoftFpu::SetControlWord( u16 cw )
+{
+    m_context->ControlWord = cw;
+    if (m_context->StatusWord & ~cw & SW_EXCEPT) {
+        m_context->StatusWord |= SW_ES | SW_B;
+    } else {
+        m_context->StatusWord &= ~(SW_ES | SW_B);
+    }
+}
+
+u16 SoftFpu::StatusWord( void ) const
+{
+    return m_context->StatusWord;
+}
+
+/*
+ * Classification
+ */
+
+SoftFpu::Class SoftFpu::Classify( const Float80 &f )
+{
+    int exp = f.SignExp & 0x7fff;
+    if (exp == 0) {
+        return f.Mantissa == 0 ? ClassZero : ClassDenormal;
+    }
+    if (exp == 0x7fff) {
+        if ((f.Mantissa << 1) == 0) {
+            return (f.Mantissa & TopBit) ? ClassInf : ClassUnsupported;
+        }
+        return (f.Mantissa & TopBit) ? ClassNaN : ClassUnsupported;
+    }
+    return (f.Mantissa & TopBit) ? ClassNormal : ClassUnsupported;
+}
+
+bool SoftFpu::IsSignaling( const Float80 &f )
+{
+    return Classify(f) == ClassNaN && (f.Mantissa & QuietBit) == 0;
+}
+
+Float80 SoftFpu::Quiet( const Float80 &f )
+{
+    Float80 r = f;
+    r.Mantissa |= QuietBit;
+    return r;
+}
+
+Float80 SoftFpu::Indefinite( void )
+{
+    Float80 f = { 0xc000000000000000ULL, 0xffff };
+    return f;
+}
+
+Float80 SoftFpu::Infinity( bool sign )
+{
+    Float80 f = { TopBit, (u16) ((sign ? 0x8000 : 0) | 0x7fff) };
+    return f;
+}
+
+Float80 SoftFpu::Zero( bool sign )
+{
+    Float80 f = { 0, (u16) (sign ? 0x8000 : 0) };
+    return f;
+}
+
+u16 SoftFpu::TagOf( const Float80 &f )
+{
+    switch (Classify(f)) {
+    case ClassZero:     return TagZero;
+    case ClassNormal:   return TagValid;
+    default:            return TagSpecial;
+    }
+}
+
+void SoftFpu::Unpack( const Float80 &f, Unpacked *u )
+{
+    Assert(f.Mantissa != 0);
+    int exp = f.SignExp & 0x7fff;
+    u->Sign = (f.SignExp & 0x8000) != 0;
+    if (exp == 0) {
+        int s = Clz64(f.Mantissa);
+        u->Mant = f.Mantissa << s;
+        u->Exp  = 1 - ExpBias - s;
+    } else {
+        u->Mant = f.Mantissa;
+        u->Exp  = exp - ExpBias;
+    }
+}
+
+bool SoftFpu::CheckOperands( const Float80 &a, const Float80 &b, Float80 *result )
+{
+    Class ca = Classify(a), cb = Classify(b);
+    if (ca == ClassUnsupported || cb == ClassUnsupported) {
+        Raise(SW_IE);
+        *result = Indefinite();
+        return true;
+    }
+    if (ca == ClassNaN || cb == ClassNaN) {
+        if (IsSignaling(a) || IsSignaling(b)) Raise(SW_IE);
+        if (ca == ClassNaN && cb == ClassNaN) {
+            *result = Quiet((a.Mantissa << 1) >= (b.Mantissa << 1) ? a : b);
+        } else {
+            *result = Quiet(ca == ClassNaN ? a : b);
+        }
+        return true;
+    }
+    if (ca == ClassDenormal || cb == ClassDenormal) Raise(SW_DE);
+    return false;
+}
+
+/*
+ * Rounding
+ */
+
+int SoftFpu::PrecisionBits( void ) const
+{
+    switch ((m_context->ControlWord >> 8) & 3) {
+    case 0:     return 24;
+    case 2:     return 53;
+    default:    return 64;
+    }
+}
+
+int SoftFpu::RoundingMode( void ) const
+{
+    return (m_context->ControlWord >> 10) & 3;
+}
+
+bool SoftFpu::Round( bool sign, int *exp, u64 *hi, u64 lo, int bits, int minExp, int maxExp )
+{
+    bool tiny = false;
+    if (*exp < minExp) {
+        Shift128RightJam(hi, &lo, min(minExp - *exp, 128));
+        *exp = minExp;
+        tiny = true;
+    }
+
+    const int drop = 64 - bits;
+    u64 rem, half;
+    bool sticky;
+    if (drop == 0) {
+        rem     = lo;
+        half    = TopBit;
+        sticky  = false;
+    } else {
+        const u64 mask = (1ULL << drop) - 1;
+        rem     = *hi & mask;
+        half    = 1ULL << (drop - 1);
+        sticky  = lo != 0;
+        *hi    &= ~mask;
+    }
+
+    const bool inexact = rem != 0 || sticky;
+    bool up = false;
+    switch (RoundingMode()) {
+    case 0: up = rem > half || (rem == half && (sticky || ((*hi >> drop) & 1))); break;
+    case 1: up = sign && inexact; break;
+    case 2: up = !sign && inexact; break;
+    default: break;
+    }
+    if (up) {
+        *hi += 1ULL << drop;
+        if (*hi == 0) {
+            *hi = TopBit;
+            (*exp)++;
+        }
+    }
+    if (inexact) {
+        Raise(SW_PE);
+        if (up) m_context->StatusWord |= SW_C1;
+        if (tiny) Raise(SW_UE);
+    }
+    return *exp <= maxExp;
+}
+
+Float80 SoftFpu::RoundPack( bool sign, int exp, u64 hi, u64 lo )
+{
+    if (hi == 0 && lo == 0) return Zero(sign);
+    if (hi == 0) {
+        hi = lo;
+        lo = 0;
+        exp -= 64;
+    }
+    int s = Clz64(hi);
+    if (s) {
+        hi = (hi << s) | (lo >> (64 - s));
+        lo <<= s;
+        exp -= s;
+    }
+
+    const int bits = PrecisionBits();
+    if (!Round(sign, &exp, &hi, lo, bits, 1 - ExpBias, ExpBias)) {
+        Raise(SW_OE | SW_PE);
+        const int rc = RoundingMode();
+        if (rc == 0 || (rc == 1 && sign) || (rc == 2 && !sign)) {
+            return Infinity(sign);
+        }
+        Float80 f = { ~0ULL << (64 - bits), (u16) ((sign ? 0x8000 : 0) | 0x7ffe) };
+        return f;
+    }
+
+    Float80 f;
+    f.Mantissa  = hi;
+    f.SignExp   = (sign ? 0x8000 : 0) | (u16) ((hi & TopBit) ? exp + ExpBias : 0);
+    return f;
+}
+
+u64 SoftFpu::RoundToInteger( const Float80 &f, bool *overflow )
+{
+    *overflow = false;
+    if (Classify(f) == ClassZero) return 0;
+
+    Unpacked u;
+    Unpack(f, &u);
+    if (u.Exp >= 64) {
+        *overflow = true;
+        return 0;
+    }
+    if (u.Exp == 63) return u.Mant;
+
+    u64 intPart, rem, half;
+    if (u.Exp >= 0) {
+        const int shift = 63 - u.Exp;
+        intPart = u.Mant >> shift;
+        rem     = u.Mant & ((1ULL << shift) - 1);
+        half    = 1ULL << (shift - 1);
+    } else if (u.Exp == -1) {
+        intPart = 0;
+        rem     = u.Mant;
+        half    = TopBit;
+    } else {
+        // below one half
+        intPart = 0;
+        rem     = 1;
+        half    = TopBit;
+    }
+
+    const bool inexact = rem != 0;
+    bool up = false;
+    switch (RoundingMode()) {
+    case 0: up = rem > half || (rem == half && (intPart & 1)); break;
+    case 1: up = u.Sign && inexact; break;
+    case 2: up = !u.Sign && inexact; break;
+    default: break;
+    }
+    if (inexact) {
+        Raise(SW_PE);
+        if (up) m_context->StatusWord |= SW_C1;
+    }
+    if (up && ++intPart == 0) {
+        *overflow = true;
+    }
+    return intPart;
+}
+
+/*
+ * Arithmetic
+ */
+
+Float80 SoftFpu::Add( const Float80 &a, const Float80 &b, bool negateB )
+{
+    Float80 r;
+    if (CheckOperands(a, b, &r)) return r;
+
+    Class ca = Classify(a), cb = Classify(b);
+    bool sa = (a.SignExp & 0x8000) != 0;
+    bool sb = ((b.SignExp & 0x8000) != 0) ^ negateB;
+
+    if (ca == ClassInf || cb == ClassInf) {
+        if (ca == ClassInf && cb == ClassInf && sa != sb) {
+            Raise(SW_IE);
+            return Indefinite();
+        }
+        return Infinity(ca == ClassInf ? sa : sb);
+    }
+    if (ca == ClassZero && cb == ClassZero) {
+        return Zero(sa == sb ? sa : RoundingMode() == 1);
+    }
+
+    Unpacked ua, ub;
+    if (ca == ClassZero) {
+        Unpack(b, &ub);
+        return RoundPack(sb, ub.Exp, ub.Mant, 0);
+    }
+    if (cb == ClassZero) {
+        Unpack(a, &ua);
+        return RoundPack(sa, ua.Exp, ua.Mant, 0);
+    }
+
+    Unpack(a, &ua);
+    Unpack(b, &ub);
+    ub.Sign = sb;
+    if (ua.Exp < ub.Exp || (ua.Exp == ub.Exp && ua.Mant < ub.Mant)) {
+        std::swap(ua, ub);
+    }
+
+    u64 bhi = ub.Mant, blo = 0;
+    Shift128RightJam(&bhi, &blo, min(ua.Exp - ub.Exp, 128));
+    int exp = ua.Exp;
+
+    if (ua.Sign == ub.Sign) {
+        u64 lo = blo;
+        u64 hi = ua.Mant + bhi;
+        if (hi < ua.Mant) {
+            lo = (lo >> 1) | (hi << 63) | (lo & 1);
+            hi = (hi >> 1) | TopBit;
+            exp++;
+        }
+        return RoundPack(ua.Sign, exp, hi, lo);
+    }
+
+    u64 lo = 0 - blo;
+    u64 hi = ua.Mant - bhi - (blo != 0);
+    if (hi == 0 && lo == 0) return Zero(RoundingMode() == 1);
+    return RoundPack(ua.Sign, exp, hi, lo);
+}
+
+Float80 SoftFpu::Mul( const Float80 &a, const Float80 &b )
+{
+    Float80 r;
+    if (CheckOperands(a, b, &r)) return r;
+
+    Class ca = Classify(a), cb = Classify(b);
+    bool sign = ((a.SignExp ^ b.SignExp) & 0x8000) != 0;
+
+    if (ca == ClassInf || cb == ClassInf) {
+        if (ca == ClassZero || cb == ClassZero) {
+            Raise(SW_IE);
+            return Indefinite();
+        }
+        return Infinity(sign);
+    }
+    if (ca == ClassZero || cb == ClassZero) return Zero(sign);
+
+    Unpacked ua, ub;
+    Unpack(a, &ua);
+    Unpack(b, &ub);
+    u64 hi, lo;
+    Mul64To128(ua.Mant, ub.Mant, &hi, &lo);
+    return RoundPack(sign, ua.Exp + ub.Exp + 1, hi, lo);
+}
+
+Float80 SoftFpu::Div( const Float80 &a, const Float80 &b )
+{
+    Float80 r;
+    if (CheckOperands(a, b, &r)) return r;
+
+    Class ca = Classify(a), cb = Classify(b);
+    bool sign = ((a.SignExp ^ b.SignExp) & 0x8000) != 0;
+
+    if (ca == ClassInf) {
+        if (cb == ClassInf) {
+            Raise(SW_IE);
+            return Indefinite();
+        }
+        return Infinity(sign);
+    }
+    if (cb == ClassInf) return Zero(sign);
+    if (cb == ClassZero) {
+        if (ca == ClassZero) {
+            Raise(SW_IE);
+            return Indefinite();
+        }
+        Raise(SW_ZE);
+        return Infinity(sign);
+    }
+    if (ca == ClassZero) return Zero(sign);
+
+    Unpacked ua, ub;
+    Unpack(a, &ua);
+    Unpack(b, &ub);
+
+    // restoring division; 'carry' is bit 64 of the partial remainder
+    int exp = ua.Exp - ub.Exp;
+    u64 rem = ua.Mant;
+    bool carry = false;
+    if (rem < ub.Mant) {
+        carry = (rem & TopBit) != 0;
+        rem <<= 1;
+        exp--;
+    }
+    u64 q = 0;
+    for (int i = 0; i < 64; i++) {
+        q <<= 1;
+        if (carry || rem >= ub.Mant) {
+            rem -= ub.Mant;
+            q |= 1;
+        }
+        carry = (rem & TopBit) != 0;
+        rem <<= 1;
+    }
+    u64 lo = 0;
+    if (carry || rem >= ub.Mant) {
+        rem -= ub.Mant;
+        lo = TopBit;
+    }
+    if (rem != 0) lo |= 1;
+    return RoundPack(sign, exp, q, lo);
+}
+
+Float80 SoftFpu::Arith( ArithOp op, const Float80 &a, const Float80 &b )
+{
+    switch (op) {
+    case OpAdd:     return Add(a, b, false);
+    case OpSub:     return Add(a, b, true);
+    case OpSubR:    return Add(b, a, true);
+    case OpMul:     return Mul(a, b);
+    case OpDiv:     return Div(a, b);
+    case OpDivR:    return Div(b, a);
+    default:        Assert(0); return Indefinite();
+    }
+}
+
+/* returns -1, 0, 1 for a < b, a == b, a > b and 2 for unordered */
+int SoftFpu::Compare( const Float80 &a, const Float80 &b, bool unordered )
+{
+    Class ca = Classify(a), cb = Classify(b);
+    if (ca == ClassNaN || cb == ClassNaN || ca == ClassUnsupported || cb == ClassUnsupported) {
+        if (!unordered || IsSignaling(a) || IsSignaling(b) ||
+            ca == ClassUnsupported || cb == ClassUnsupported) {
+            Raise(SW_IE);
+        }
+        return 2;
+    }
+    if (ca == ClassDenormal || cb == ClassDenormal) Raise(SW_DE);
+    if (ca == ClassZero && cb == ClassZero) return 0;
+
+    bool sa = ca != ClassZero && (a.SignExp & 0x8000) != 0;
+    bool sb = cb != ClassZero && (b.SignExp & 0x8000) != 0;
+    if (sa != sb) return sa ? -1 : 1;
+
+    int ea = a.SignExp & 0x7fff, eb = b.SignExp & 0x7fff;
+    int mag = 0;
+    if (ea != eb) {
+        mag = ea < eb ? -1 : 1;
+    } else if (a.Mantissa != b.Mantissa) {
+        mag = a.Mantissa < b.Mantissa ? -1 : 1;
+    }
+    return sa ? -mag : mag;
+}
+
+/*
+ * Conversions
+ */
+
+Float80 SoftFpu::FromFloat32( u32 val )
+{
+    const bool sign = (val >> 31) != 0;
+    const int exp = (val >> 23) & 0xff;
+    const u32 frac = val & 0x7fffff;
+
+    Float80 f;
+    if (exp == 0xff) {
+        if (frac == 0) return Infinity(sign);
+        f.Mantissa  = TopBit | ((u64) frac << 40);
+        f.SignExp   = (sign ? 0x8000 : 0) | 0x7fff;
+        if ((frac & 0x400000) == 0) {
+            Raise(SW_IE);
+            f = Quiet(f);
+        }
+        return f;
+    }
+    if (exp == 0) {
+        if (frac == 0) return Zero(sign);
+        Raise(SW_DE);
+        int s = Clz64(frac);
+        f.Mantissa  = (u64) frac << s;
+        f.SignExp   = (sign ? 0x8000 : 0) | (u16) (-86 - s + ExpBias);
+        return f;
+    }
+    f.Mantissa  = TopBit | ((u64) frac << 40);
+    f.SignExp   = (sign ? 0x8000 : 0) | (u16) (exp - 127 + ExpBias);
+    return f;
+}
+
+Float80 SoftFpu::FromFloat64( u64 val )
+{
+    const bool sign = (val >> 63) != 0;
+    const int exp = (int) (val >> 52) & 0x7ff;
+    const u64 frac = val & 0xfffffffffffffULL;
+
+    Float80 f;
+    if (exp == 0x7ff) {
+        if (frac == 0) return Infinity(sign);
+        f.Mantissa  = TopBit | (frac << 11);
+        f.SignExp   = (sign ? 0x8000 : 0) | 0x7fff;
+        if ((frac & 0x8000000000000ULL) == 0) {
+            Raise(SW_IE);
+            f = Quiet(f);
+        }
+        return f;
+    }
+    if (exp == 0) {
+        if (frac == 0) return Zero(sign);
+        Raise(SW_DE);
+        int s = Clz64(frac);
+        f.Mantissa  = frac << s;
+        f.SignExp   = (sign ? 0x8000 : 0) | (u16) (-1011 - s + ExpBias);
+        return f;
+    }
+    f.Mantissa  = TopBit | (frac << 11);
+    f.SignExp   = (sign ? 0x8000 : 0) | (u16) (exp - 1023 + ExpBias);
+    return f;
+}
+
+Float80 SoftFpu::FromInt64( i64 val )
+{
+    const bool sign = val < 0;
+    return FromMagnitude(sign, sign ? 0 - (u64) val : (u64) val);
+}
+
+/*
+ * Instructions
+ */
+
+void SoftFpu::LoadFloat80( cpbyte data )
+{
+    Float80 f;
+    memcpy(&f.Mantissa, data, 8);
+    memcpy(&f.SignExp, data + 8, 2);
+    Push(f);
+}
+
+void SoftFpu::LoadReg( int i )
+{
+    Push(Get(i));
+}
+
+void SoftFpu::LoadConst( Constant c )
+{
+    Assert(c >= ConstOne && c <= ConstZero);
+    Push(ConstantTable[c]);
+}
+
+u64 SoftFpu::StoreFloat64( bool pop )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 f = Get(0);
+    const u64 sign = (u64) (f.SignExp >> 15) << 63;
+
+    u64 r;
+    switch (Classify(f)) {
+    case ClassZero:
+        r = sign;
+        break;
+    case ClassInf:
+        r = sign | 0x7ff0000000000000ULL;
+        break;
+    case ClassNaN:
+        if (IsSignaling(f)) Raise(SW_IE);
+        r = sign | 0x7ff8000000000000ULL | ((f.Mantissa << 1) >> 12);
+        break;
+    case ClassUnsupported:
+        Raise(SW_IE);
+        r = 0xfff8000000000000ULL;
+        break;
+    default:
+        {
+            if (Classify(f) == ClassDenormal) Raise(SW_DE);
+            Unpacked u;
+            Unpack(f, &u);
+            int exp = u.Exp;
+            u64 hi = u.Mant;
+            if (!Round(u.Sign, &exp, &hi, 0, 53, -1022, 1023)) {
+                Raise(SW_OE | SW_PE);
+                const int rc = RoundingMode();
+                bool toInf = rc == 0 || (rc == 1 && u.Sign) || (rc == 2 && !u.Sign);
+                r = sign | (toInf ? 0x7ff0000000000000ULL : 0x7fefffffffffffffULL);
+            } else if (hi & TopBit) {
+                r = sign | ((u64) (exp + 1023) << 52) | ((hi >> 11) & 0xfffffffffffffULL);
+            } else {
+                r = sign | (hi >> 11);
+            }
+        }
+        break;
+    }
+    if (pop) Pop();
+    return r;
+}
+
+u32 SoftFpu::StoreInt32( bool pop )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 f = Get(0);
+    u32 r = 0x80000000;
+    Class c = Classify(f);
+    if (c == ClassNaN || c == ClassInf || c == ClassUnsupported) {
+        Raise(SW_IE);
+    } else {
+        bool overflow;
+        const bool sign = (f.SignExp & 0x8000) != 0;
+        u64 mag = RoundToInteger(f, &overflow);
+        if (overflow || mag > (sign ? 0x80000000ULL : 0x7fffffffULL)) {
+            Raise(SW_IE);
+        } else {
+            r = sign ? (u32) (0 - mag) : (u32) mag;
+        }
+    }
+    if (pop) Pop();
+    return r;
+}
+
+u64 SoftFpu::StoreInt64( bool pop )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 f = Get(0);
+    u64 r = TopBit;
+    Class c = Classify(f);
+    if (c == ClassNaN || c == ClassInf || c == ClassUnsupported) {
+        Raise(SW_IE);
+    } else {
+        bool overflow;
+        const bool sign = (f.SignExp & 0x8000) != 0;
+        u64 mag = RoundToInteger(f, &overflow);
+        if (overflow || mag > (sign ? TopBit : TopBit - 1)) {
+            Raise(SW_IE);
+        } else {
+            r = sign ? 0 - mag : mag;
+        }
+    }
+    if (pop) Pop();
+    return r;
+}
+
+void SoftFpu::StoreReg( int i, bool pop )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Set(i, Get(0));
+    if (pop) Pop();
+}
+
+void SoftFpu::ArithReg( ArithOp op, int dst, int src, bool pop )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 a = Get(dst);
+    Float80 b = Get(src);
+    Set(dst, Arith(op, a, b));
+    if (pop) Pop();
+}
+
+void SoftFpu::ArithMem( ArithOp op, const Float80 &val )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 a = Get(0);
+    Set(0, Arith(op, a, val));
+}
+
+void SoftFpu::CompareReg( int i, bool unordered, int pops )
+{
+    CompareMem(Get(i), unordered, 0);
+    while (pops-- > 0) Pop();
+}
+
+void SoftFpu::CompareMem( const Float80 &val, bool unordered, int pops )
+{
+    switch (Compare(Get(0), val, unordered)) {
+    case -1:    SetConditions(0, 0, 1); break;
+    case 0:     SetConditions(1, 0, 0); break;
+    case 1:     SetConditions(0, 0, 0); break;
+    default:    SetConditions(1, 1, 1); break;
+    }
+    while (pops-- > 0) Pop();
+}
+
+void SoftFpu::CompareFlags( int i, u32 *zf, u32 *pf, u32 *cf )
+{
+    m_context->StatusWord &= ~SW_C1;
+    switch (Compare(Get(0), Get(i), true)) {
+    case -1:    *zf = 0; *pf = 0; *cf = 1; break;
+    case 0:     *zf = 1; *pf = 0; *cf = 0; break;
+    case 1:     *zf = 0; *pf = 0; *cf = 0; break;
+    default:    *zf = 1; *pf = 1; *cf = 1; break;
+    }
+}
+
+void SoftFpu::Chs( void )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 f = Get(0);
+    f.SignExp ^= 0x8000;
+    Set(0, f);
+}
+
+void SoftFpu::Abs( void )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 f = Get(0);
+    f.SignExp &= 0x7fff;
+    Set(0, f);
+}
+
+void SoftFpu::Sqrt( void )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 f = Get(0);
+    const bool sign = (f.SignExp & 0x8000) != 0;
+
+    switch (Classify(f)) {
+    case ClassUnsupported:
+        Raise(SW_IE);
+        Set(0, Indefinite());
+        return;
+    case ClassNaN:
+        if (IsSignaling(f)) Raise(SW_IE);
+        Set(0, Quiet(f));
+        return;
+    case ClassZero:
+        return;
+    case ClassInf:
+        if (sign) {
+            Raise(SW_IE);
+            Set(0, Indefinite());
+        }
+        return;
+    case ClassDenormal:
+        Raise(SW_DE);
+        break;
+    default:
+        break;
+    }
+    if (sign) {
+        Raise(SW_IE);
+        Set(0, Indefinite());
+        return;
+    }
+
+    Unpacked u;
+    Unpack(f, &u);
+    // radicand = mant * 2^63 (even exponent) or mant * 2^64 (odd exponent)
+    u64 rhi, rlo;
+    int exp;
+    if (u.Exp & 1) {
+        rhi = u.Mant;
+        rlo = 0;
+        exp = (u.Exp - 1) / 2;
+    } else {
+        rhi = u.Mant >> 1;
+        rlo = u.Mant << 63;
+        exp = u.Exp / 2;
+    }
+
+    // digit-by-digit square root of the 128-bit radicand
+    u64 root = 0, remHi = 0, remLo = 0;
+    for (int i = 63; i >= 0; i--) {
+        u64 digits = i >= 32 ? (rhi >> ((i - 32) * 2)) & 3 : (rlo >> (i * 2)) & 3;
+        remHi = (remHi << 2) | (remLo >> 62);
+        remLo = (remLo << 2) | digits;
+        u64 trialHi = root >> 62, trialLo = (root << 2) | 1;
+        if (remHi > trialHi || (remHi == trialHi && remLo >= trialLo)) {
+            u64 borrow = remLo < trialLo;
+            remLo -= trialLo;
+            remHi -= trialHi + borrow;
+            root = (root << 1) | 1;
+        } else {
+            root <<= 1;
+        }
+    }
+
+    // remainder > root means the dropped fraction is above one half
+    u64 lo = 0;
+    if (remHi != 0 || remLo > root) {
+        lo = TopBit | 1;
+    } else if (remLo != 0) {
+        lo = 1;
+    }
+    Set(0, RoundPack(false, exp, root, lo));
+}
+
+void SoftFpu::RoundInt( void )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 f = Get(0);
+    switch (Classify(f)) {
+    case ClassUnsupported:
+        Raise(SW_IE);
+        Set(0, Indefinite());
+        return;
+    case ClassNaN:
+        if (IsSignaling(f)) Raise(SW_IE);
+        Set(0, Quiet(f));
+        return;
+    case ClassZero:
+    case ClassInf:
+        return;
+    case ClassDenormal:
+        Raise(SW_DE);
+        break;
+    default:
+        break;
+    }
+    if ((f.SignExp & 0x7fff) - ExpBias >= 63) return;
+
+    bool overflow;
+    u64 mag = RoundToInteger(f, &overflow);
+    Assert(!overflow);
+    Set(0, FromMagnitude((f.SignExp & 0x8000) != 0, mag));
+}
+
+void SoftFpu::Xch( int i )
+{
+    m_context->StatusWord &= ~SW_C1;
+    Float80 a = Get(0);
+    Float80 b = Get(i);
+    Set(0, b);
+    Set(i, a);
+}
+
+void SoftFpu::Xam( void )
+{
+    Float80 f = ReadReg(m_context->ST[0]);
+    if (Tag(0) == TagEmpty) {
+        SetConditions(1, 0, 1);
+    } else {
+        switch (Classify(f)) {
+        case ClassUnsupported:  SetConditions(0, 0, 0); break;
+        case ClassNaN:          SetConditions(0, 0, 1); break;
+        case ClassNormal:       SetConditions(0, 1, 0); break;
+        case ClassInf:          SetConditions(0, 1, 1); break;
+        case ClassZero:         SetConditions(1, 0, 0); break;
+        case ClassDenormal:     SetConditions(1, 1, 0); break;
+        }
+    }
+    if (f.SignExp & 0x8000) m_context->StatusWord |= SW_C1;
+}
+
+END_NAMESPACE_LOCHSEMU()
@@ -0,0 +1,136 @@
+#pragma once
+
+#ifndef __CORE_SOFTFPU_H__
+#define __CORE_SOFTFPU_H__
+
+#include "lochsemu.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+struct FpuContext;
+
+struct Float80 {
+    u64     Mantissa;   /* explicit integer bit at bit 63 */
+    u16     SignExp;    /* sign at bit 15, biased exponent below */
+};
+
+/*
+ * Software x87 working directly on the fsave image kept by Coprocessor,
+ * so instructions it does not implement can still go through the host
+ * FPU with RestoreContext/SaveContext.
+ *
+ * Honors precision and rounding control and raises the status word
+ * exception flags; exceptions are always given their masked response.
+ */
+class LX_API SoftFpu {
+public:
+    enum ArithOp {
+        OpAdd, OpSub, OpSubR, OpMul, OpDiv, OpDivR,
+    };
+
+    enum Constant {
+        ConstOne, ConstL2T, ConstL2E, ConstPi, ConstLG2, ConstLN2, ConstZero,
+    };
+
+public:
+    SoftFpu(FpuContext *context);
+
+    void        Reset           (void);
+
+    /* loads push onto the register stack */
+    void        LoadFloat32     (u32 val)   { Push(FromFloat32(val)); }
+    void        LoadFloat64     (u64 val)   { Push(FromFloat64(val)); }
+    void        LoadFloat80     (cpbyte data);
+    void        LoadInt16       (i16 val)   { Push(FromInt64(val)); }
+    void        LoadInt32       (i32 val)   { Push(FromInt64(val)); }
+    void        LoadInt64       (i64 val)   { Push(FromInt64(val)); }
+    void        LoadReg         (int i);
+    void        LoadConst       (Constant c);
+
+    u64         StoreFloat64    (bool pop);
+    u32         StoreInt32      (bool pop);
+    u64         StoreInt64      (bool pop);
+    void        StoreReg        (int i, bool pop);
+
+    /* ST(dst) = ST(dst) op ST(src), popping afterwards if requested */
+    void        ArithReg        (ArithOp op, int dst, int src, bool pop);
+    /* ST(0) = ST(0) op val */
+    void        ArithMem        (ArithOp op, const Float80 &val);
+
+    /* compare ST(0) with ST(i) or val, setting C0/C2/C3 and popping 'pops' times */
+    void        CompareReg      (int i, bool unordered, int pops);
+    void        CompareMem      (const Float80 &val, bool unordered, int pops);
+    /* FUCOMI: returns the ZF/PF/CF triple instead of touching C0/C2/C3 */
+    void        CompareFlags    (int i, u32 *zf, u32 *pf, u32 *cf);
+
+    void        Chs             (void);
+    void        Abs             (void);
+    void        Sqrt            (void);
+    void        RoundInt        (void);
+    void        Xch             (int i);
+    void        Xam             (void);
+
+    u16         ControlWord     (void) const;
+    void        SetControlWord  (u16 cw);
+    u16         StatusWord      (void) const;
+
+    Float80     FromFloat32     (u32 val);
+    Float80     FromFloat64     (u64 val);
+    Float80     FromInt64       (i64 val);
+
+private:
+    struct Unpacked {
+        bool    Sign;
+        int     Exp;            /* unbiased; value = Mant / 2^63 * 2^Exp */
+        u64     Mant;
+    };
+
+    enum Class {
+        ClassZero, ClassNormal, ClassDenormal, ClassInf, ClassNaN, ClassUnsupported,
+    };
+
+    static Class    Classify        (const Float80 &f);
+    static bool     IsSignaling     (const Float80 &f);
+    static Float80  Quiet           (const Float80 &f);
+    static Float80  Indefinite      (void);
+    static Float80  Infinity        (bool sign);
+    static Float80  Zero            (bool sign);
+    static u16      TagOf           (const Float80 &f);
+
+    int         Top             (void) const;
+    void        SetTop          (int top);
+    u16         Tag             (int i) const;
+    void        SetTag          (int i, u16 tag);
+    Float80     Get             (int i);
+    void        Set             (int i, const Float80 &f);
+    void        Push            (const Float80 &f);
+    void        Pop             (void);
+    void        Raise           (u16 flags);
+    void        SetConditions   (int c3, int c2, int c0);
+
+    /* NaN and denormal checks shared by the arithmetic operations */
+    bool        CheckOperands   (const Float80 &a, const Float80 &b, Float80 *result);
+    void        Unpack          (const Float80 &f, Unpacked *u);
+    /*
+     * Round hi:lo (normalized, value = hi / 2^63 * 2^exp) to 'bits' bits
+     * within [minExp, maxExp]. Returns false on overflow
+     */
+    bool        Round           (bool sign, int *exp, u64 *hi, u64 lo, int bits, int minExp, int maxExp);
+    Float80     RoundPack       (bool sign, int exp, u64 hi, u64 lo);
+    int         PrecisionBits   (void) const;
+    int         RoundingMode    (void) const;
+    u64         RoundToInteger  (const Float80 &f, bool *overflow);
+
+    Float80     Add             (const Float80 &a, const Float80 &b, bool negateB);
+    Float80     Mul             (const Float80 &a, const Float80 &b);
+    Float80     Div             (const Float80 &a, const Float80 &b);
+    Float80     Arith           (ArithOp op, const Float80 &a, const Float80 &b);
+    int         Compare         (const Float80 &a, const Float80 &b, bool unordered);
+
+private:
+    FpuContext *    m_context;
+};
+
+END_NAMESPACE_LOCHSEMU()
+
+#endif // __CORE_SOFTFPU_H__
@@ -0,0 +1,57 @@
+#include "stdafx.h"
+#include "softtlb.h"
+#include "memory.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+SoftTlb::SoftTlb( const Memory *mem )
+{
+    Assert(mem);
+    m_mem       = mem;
+    m_hits      = 0;
+    m_misses    = 0;
+    Flush();
+}
+
+SoftTlb::~SoftTlb()
+{
+}
+
+void SoftTlb::Flush()
+{
+    m_generation = Section::MappingGeneration();
+    for (uint i = 0; i < EntryCount; i++) {
+        m_entries[i].ReadTag    = InvalidTag;
+        m_entries[i].WriteTag   = InvalidTag;
+        m_entries[i].Host       = NULL;
+    }
+}
+
+pbyte SoftTlb::Refill( u32 addr, u32 size, bool write )
+{
+    m_misses++;
+
+    // accesses crossing a page go through Memory every time
+    if (PAGE_LOW(addr) > LX_PAGE_SIZE - size) return NULL;
+
+    const Section *sec = m_mem->GetSection(addr);
+    if (sec == NULL) return NULL;
+    if (write ? !sec->IsWritable(addr) : !sec->IsReadable(addr)) return NULL;
+
+    Entry &e = m_entries[PAGE_NUM(addr) & (EntryCount - 1)];
+    pbyte host = sec->GetRawData(PAGE_HIGH(addr));
+    if (e.Host != host) {
+        // the slot held another page; drop both permissions for it
+        e.ReadTag   = InvalidTag;
+        e.WriteTag  = InvalidTag;
+        e.Host      = host;
+    }
+    if (write) {
+        e.WriteTag  = PAGE_HIGH(addr);
+    } else {
+        e.ReadTag   = PAGE_HIGH(addr);
+    }
+    return host + PAGE_LOW(addr);
+}
+
+END_NAMESPACE_LOCHSEMU()
@@ -0,0 +1,86 @@
+#pragma once
+
+#ifndef __CORE_SOFTTLB_H__
+#define __CORE_SOFTTLB_H__
+
+#include "lochsemu.h"
+#include "section.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * Direct-mapped cache of guest page -> host pointer, kept separately for
+ * reads and writes. Only accessible pages are ever cached, so granting
+ * access never needs a flush; anything that takes access away bumps
+ * Section::MappingGeneration() and the owner calls Sync() to catch up.
+ */
+class SoftTlb {
+public:
+    static const uint   EntryCount  = 256;
+    static const u32    InvalidTag  = 1;        // never page aligned
+
+public:
+    SoftTlb(const Memory *mem);
+    virtual ~SoftTlb();
+
+    /*
+     * Host pointer for 'size' bytes at 'addr', or NULL if the access
+     * must take the slow path (miss on an inaccessible page, or crossing
+     * a page boundary)
+     */
+    INLINE pbyte    LookupRead      (u32 addr, u32 size);
+    INLINE pbyte    LookupWrite     (u32 addr, u32 size);
+
+    INLINE void     Sync            ();
+    void            Flush           ();
+
+    u64             Hits() const { return m_hits; }
+    u64             Misses() const { return m_misses; }
+
+private:
+    pbyte           Refill          (u32 addr, u32 size, bool write);
+
+private:
+    struct Entry {
+        u32     ReadTag;
+        u32     WriteTag;
+        pbyte   Host;           // host address of the page start
+    };
+
+    const Memory *  m_mem;
+    Entry           m_entries[EntryCount];
+    u32             m_generation;
+    u64             m_hits;
+    u64             m_misses;
+};
+
+INLINE pbyte SoftTlb::LookupRead( u32 addr, u32 size )
+{
+    Entry &e = m_entries[PAGE_NUM(addr) & (EntryCount - 1)];
+    if (e.ReadTag == PAGE_HIGH(addr) && PAGE_LOW(addr) <= LX_PAGE_SIZE - size) {
+        m_hits++;
+        return e.Host + PAGE_LOW(addr);
+    }
+    return Refill(addr, size, false);
+}
+
+INLINE pbyte SoftTlb::LookupWrite( u32 addr, u32 size )
+{
+    Entry &e = m_entries[PAGE_NUM(addr) & (EntryCount - 1)];
+    if (e.WriteTag == PAGE_HIGH(addr) && PAGE_LOW(addr) <= LX_PAGE_SIZE - size) {
+        m_hits++;
+        return e.Host + PAGE_LOW(addr);
+    }
+    return Refill(addr, size, true);
+}
+
+INLINE void SoftTlb::Sync()
+{
+    if (m_generation != Section::MappingGeneration()) {
+        Flush();
+    }
+}
+
+END_NAMESPACE_LOCHSEMU()
+
+#endif // __CORE_SOFTTLB_H__
@@ -0,0 +1,702 @@
+#include "stdafx.h"
+#include "syncmgr.h"
+#include "process.h"
+#include "thread.h"
+#include "memory.h"
+#include "scheduler.h"
+#include "snapshot.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/* longest a host thread sleeps before it looks at the virtual clock again */
+static const DWORD MaxHostWait = 50;
+
+SyncManager::SyncManager( Process *proc )
+{
+    Assert(proc);
+    m_process   = proc;
+    m_alive     = 0;
+    m_skew      = 0;
+}
+
+SyncManager::~SyncManager()
+{
+    Clear();
+}
+
+void SyncManager::Clear()
+{
+    for (uint i = 0; i < m_objects.size(); i++) {
+        SAFE_DELETE(m_objects[i]);
+    }
+    for (auto &cs : m_critSecs) {
+        delete cs.second;
+    }
+    m_objects.clear();
+    m_freeSlots.clear();
+    m_names.clear();
+    m_critSecs.clear();
+    m_timers.clear();
+}
+
+bool SyncManager::IsEmulatedHandle( HANDLE h )
+{
+    const u32 v = (u32) h;
+    return v >= HandleBase && v <= HandleLimit && (v & 3) == 0;
+}
+
+u64 SyncManager::Now()
+{
+    MutexCSLock lock(m_lock);
+    return GetTickCount64() + m_skew;
+}
+
+u64 SyncManager::Skew()
+{
+    MutexCSLock lock(m_lock);
+    return m_skew;
+}
+
+HANDLE SyncManager::Insert( SyncObject *obj, LPCSTR name )
+{
+    obj->Refs = 1;
+    if (name != NULL) {
+        auto iter = m_names.find(name);
+        if (iter != m_names.end()) {
+            SyncObject *existing = m_objects[iter->second];
+            const bool sameType = existing->Type == obj->Type;
+            delete obj;
+            if (!sameType) {
+                SetLastError(ERROR_INVALID_HANDLE);
+                return NULL;
+            }
+            existing->Refs++;
+            SetLastError(ERROR_ALREADY_EXISTS);
+            return (HANDLE) (HandleBase + iter->second * 4);
+        }
+        obj->Name = name;
+    }
+
+    u32 index;
+    if (m_freeSlots.empty()) {
+        index = (u32) m_objects.size();
+        if (HandleBase + index * 4 > HandleLimit) {
+            delete obj;
+            SetLastError(ERROR_NO_SYSTEM_RESOURCES);
+            return NULL;
+        }
+        m_objects.push_back(obj);
+    } else {
+        index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_objects[index] = obj;
+    }
+    if (name != NULL) m_names[name] = index;
+    SetLastError(ERROR_SUCCESS);
+    return (HANDLE) (HandleBase + index * 4);
+}
+
+SyncManager::SyncObject::SyncObject( ObjectType type )
+{
+    Type        = type;
+    ManualReset = false;
+    Signaled    = false;
+    Abandoned   = false;
+    Owner       = NULL;
+    Recursion   = 0;
+    Count       = 0;
+    Maximum     = 0;
+    DueTime     = NoDeadline;
+    Period      = 0;
+    GuestAddr   = 0;
+    Refs        = 0;
+}
+
+SyncManager::SyncObject * SyncManager::Lookup( HANDLE h )
+{
+    if (!IsEmulatedHandle(h)) return NULL;
+    const u32 index = ((u32) h - HandleBase) / 4;
+    if (index >= m_objects.size()) return NULL;
+    return m_objects[index];
+}
+
+SyncManager::SyncObject * SyncManager::Lookup( HANDLE h, ObjectType type )
+{
+    SyncObject *obj = Lookup(h);
+    return obj != NULL && obj->Type == type ? obj : NULL;
+}
+
+HANDLE SyncManager::NewEvent( bool manualReset, bool initialState, LPCSTR name )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj     = new SyncObject(TypeEvent);
+    obj->ManualReset    = manualReset;
+    obj->Signaled       = initialState;
+    return Insert(obj, name);
+}
+
+HANDLE SyncManager::NewMutex( Thread *t, bool initialOwner, LPCSTR name )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj     = new SyncObject(TypeMutex);
+    if (initialOwner) {
+        obj->Owner      = t;
+        obj->Recursion  = 1;
+    }
+    // an existing mutex is opened, not acquired
+    return Insert(obj, name);
+}
+
+HANDLE SyncManager::NewSemaphore( i32 initialCount, i32 maximumCount, LPCSTR name )
+{
+    if (maximumCount <= 0 || initialCount < 0 || initialCount > maximumCount) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+    MutexCSLock lock(m_lock);
+    SyncObject *obj     = new SyncObject(TypeSemaphore);
+    obj->Count          = initialCount;
+    obj->Maximum        = maximumCount;
+    return Insert(obj, name);
+}
+
+HANDLE SyncManager::NewTimer( bool manualReset, LPCSTR name )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj     = new SyncObject(TypeTimer);
+    obj->ManualReset    = manualReset;
+    return Insert(obj, name);
+}
+
+HANDLE SyncManager::NewThread()
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj     = new SyncObject(TypeThread);
+    obj->ManualReset    = true;
+    obj->Count          = STILL_ACTIVE;
+    return Insert(obj, NULL);
+}
+
+bool SyncManager::ExitThread( HANDLE h, u32 exitCode )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h, TypeThread);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    obj->Signaled   = true;
+    obj->Count      = (i32) exitCode;
+    m_changed.WakeAll();
+    return true;
+}
+
+bool SyncManager::GetExitCode( HANDLE h, u32 *exitCode )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h, TypeThread);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    *exitCode = (u32) obj->Count;
+    return true;
+}
+
+bool SyncManager::SetEvent( HANDLE h )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h, TypeEvent);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    obj->Signaled = true;
+    m_changed.WakeAll();
+    return true;
+}
+
+bool SyncManager::ResetEvent( HANDLE h )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h, TypeEvent);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    obj->Signaled = false;
+    return true;
+}
+
+bool SyncManager::ReleaseMutex( Thread *t, HANDLE h )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h, TypeMutex);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    if (obj->Owner != t) {
+        SetLastError(ERROR_NOT_OWNER);
+        return false;
+    }
+    if (--obj->Recursion == 0) {
+        obj->Owner = NULL;
+        m_changed.WakeAll();
+    }
+    return true;
+}
+
+bool SyncManager::ReleaseSemaphore( HANDLE h, i32 count, i32 *prevCount )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h, TypeSemaphore);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    if (count <= 0 || count > obj->Maximum - obj->Count) {
+        SetLastError(ERROR_TOO_MANY_POSTS);
+        return false;
+    }
+    if (prevCount) *prevCount = obj->Count;
+    obj->Count += count;
+    m_changed.WakeAll();
+    return true;
+}
+
+bool SyncManager::SetTimer( HANDLE h, i64 dueTime, u32 period )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h, TypeTimer);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+
+    u64 delay;
+    if (dueTime < 0) {
+        delay = (u64) -dueTime / 10000;
+    } else {
+        // absolute UTC time, measured against the virtual system time
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft);
+        i64 now = (i64) (((u64) ft.dwHighDateTime << 32) | ft.dwLowDateTime) + (i64) m_skew * 10000;
+        delay = dueTime > now ? (u64) (dueTime - now) / 10000 : 0;
+    }
+    obj->Signaled   = false;
+    obj->DueTime    = Now() + delay;
+    obj->Period     = period;
+    m_timers.insert(obj);
+    m_changed.WakeAll();
+    return true;
+}
+
+bool SyncManager::CancelTimer( HANDLE h )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h, TypeTimer);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    obj->DueTime = NoDeadline;
+    m_timers.erase(obj);
+    return true;
+}
+
+bool SyncManager::Retain( HANDLE h )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h);
+    if (obj == NULL) return false;
+    obj->Refs++;
+    return true;
+}
+
+bool SyncManager::Close( HANDLE h )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = Lookup(h);
+    if (obj == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    if (--obj->Refs > 0) return true;
+
+    const u32 index = ((u32) h - HandleBase) / 4;
+    if (!obj->Name.empty()) m_names.erase(obj->Name);
+    m_objects[index] = NULL;
+    m_freeSlots.push_back(index);
+    Destroy(obj);
+    return true;
+}
+
+void SyncManager::Destroy( SyncObject *obj )
+{
+    m_timers.erase(obj);
+    delete obj;
+}
+
+SyncManager::SyncObject * SyncManager::LookupCritSec( u32 addr )
+{
+    auto iter = m_critSecs.find(addr);
+    if (iter != m_critSecs.end()) return iter->second;
+
+    // statically initialized or never initialized; treat as a fresh one
+    SyncObject *obj = new SyncObject(TypeCritSec);
+    obj->GuestAddr  = addr;
+    m_critSecs[addr] = obj;
+    return obj;
+}
+
+void SyncManager::SyncGuestCritSec( SyncObject *obj )
+{
+    // keep the fields guest code peeks at (e.g. OwningThread) meaningful
+    RTL_CRITICAL_SECTION *cs = (RTL_CRITICAL_SECTION *) m_process->Mem()->GetRawData(obj->GuestAddr);
+    if (cs == NULL) return;
+    cs->LockCount       = obj->Owner ? 0 : -1;
+    cs->RecursionCount  = obj->Recursion;
+    cs->OwningThread    = obj->Owner ? (HANDLE) obj->Owner->ExtID : NULL;
+}
+
+void SyncManager::InitCriticalSection( u32 addr, u32 spinCount )
+{
+    MutexCSLock lock(m_lock);
+    RTL_CRITICAL_SECTION *cs = (RTL_CRITICAL_SECTION *) m_process->Mem()->GetRawData(addr);
+    if (cs) {
+        ZeroMemory(cs, sizeof(RTL_CRITICAL_SECTION));
+        cs->LockCount   = -1;
+        cs->SpinCount   = spinCount;
+    }
+    SyncObject *obj = LookupCritSec(addr);
+    obj->Owner      = NULL;
+    obj->Recursion  = 0;
+}
+
+void SyncManager::DeleteCriticalSection( u32 addr )
+{
+    MutexCSLock lock(m_lock);
+    auto iter = m_critSecs.find(addr);
+    if (iter == m_critSecs.end()) return;
+    delete iter->second;
+    m_critSecs.erase(iter);
+}
+
+bool SyncManager::TryEnterCriticalSection( Thread *t, u32 addr )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = LookupCritSec(addr);
+    if (!IsSignaled(obj, t)) return false;
+    Acquire(obj, t);
+    return true;
+}
+
+u32 SyncManager::EnterCriticalSection( Thread *t, u32 addr )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = LookupCritSec(addr);
+    return WaitObjects(t, &obj, 1, false, INFINITE);
+}
+
+void SyncManager::LeaveCriticalSection( Thread *t, u32 addr )
+{
+    MutexCSLock lock(m_lock);
+    SyncObject *obj = LookupCritSec(addr);
+    if (obj->Owner != t || obj->Recursion == 0) {
+        LxWarning("Thread [%x] leaves critical section %08x it does not own\n", t->ExtID, addr);
+        return;
+    }
+    if (--obj->Recursion == 0) {
+        obj->Owner = NULL;
+        m_changed.WakeAll();
+    }
+    SyncGuestCritSec(obj);
+}
+
+bool SyncManager::IsSignaled( SyncObject *obj, Thread *t )
+{
+    switch (obj->Type) {
+    case TypeEvent:
+    case TypeTimer:
+    case TypeThread:    return obj->Signaled;
+    case TypeMutex:
+    case TypeCritSec:   return obj->Owner == NULL || obj->Owner == t;
+    case TypeSemaphore: return obj->Count > 0;
+    default:            return false;
+    }
+}
+
+void SyncManager::Acquire( SyncObject *obj, Thread *t )
+{
+    switch (obj->Type) {
+    case TypeEvent:
+    case TypeTimer:
+    case TypeThread:
+        if (!obj->ManualReset) obj->Signaled = false;
+        break;
+    case TypeMutex:
+    case TypeCritSec:
+        obj->Owner = t;
+        obj->Recursion++;
+        obj->Abandoned = false;
+        if (obj->Type == TypeCritSec) SyncGuestCritSec(obj);
+        break;
+    case TypeSemaphore:
+        obj->Count--;
+        break;
+    }
+}
+
+u32 SyncManager::TryWait( SyncObject **objs, u32 count, bool waitAll, Thread *t )
+{
+    if (waitAll && count > 0) {
+        bool abandoned = false;
+        for (u32 i = 0; i < count; i++) {
+            if (!IsSignaled(objs[i], t)) return WAIT_TIMEOUT;
+        }
+        for (u32 i = 0; i < count; i++) {
+            abandoned |= objs[i]->Abandoned;
+            Acquire(objs[i], t);
+        }
+        return abandoned ? WAIT_ABANDONED_0 : WAIT_OBJECT_0;
+    }
+    for (u32 i = 0; i < count; i++) {
+        if (IsSignaled(objs[i], t)) {
+            bool abandoned = objs[i]->Abandoned;
+            Acquire(objs[i], t);
+            return (abandoned ? WAIT_ABANDONED_0 : WAIT_OBJECT_0) + i;
+        }
+    }
+    return WAIT_TIMEOUT;
+}
+
+void SyncManager::UpdateTimers()
+{
+    if (m_timers.empty()) return;
+    const u64 now = Now();
+    for (auto iter = m_timers.begin(); iter != m_timers.end(); ) {
+        SyncObject *obj = *iter;
+        if (obj->DueTime > now) { ++iter; continue; }
+        obj->Signaled = true;
+        if (obj->Period != 0) {
+            obj->DueTime = now + obj->Period;
+            ++iter;
+        } else {
+            obj->DueTime = NoDeadline;
+            iter = m_timers.erase(iter);
+        }
+    }
+}
+
+bool SyncManager::AdvanceIfIdle()
+{
+    if ((int) m_waiters.size() < m_alive) return false;
+
+    // every thread is blocked: nothing can happen before the next deadline
+    u64 earliest = NoDeadline;
+    for (auto &w : m_waiters) {
+        earliest = min(earliest, w.second);
+    }
+    for (auto obj : m_timers) {
+        earliest = min(earliest, obj->DueTime);
+    }
+    if (earliest == NoDeadline) return false;
+
+    const u64 now = Now();
+    if (earliest <= now) return false;
+    m_skew += earliest - now;
+    m_changed.WakeAll();
+    return true;
+}
+
+void SyncManager::EndWait( Thread *t )
+{
+    m_waiters.erase(t);
+}
+
+bool SyncManager::IsPooled( Thread *t ) const
+{
+    return t != NULL && Scheduler::Current() == t;
+}
+
+u32 SyncManager::WaitObjects( Thread *t, SyncObject **objs, u32 count, bool waitAll, u32 timeout )
+{
+    u64 deadline = timeout == INFINITE ? NoDeadline : Now() + timeout;
+    const bool pooled = IsPooled(t);
+    if (pooled) {
+        // a retried call keeps the deadline of its first attempt
+        auto iter = m_waiters.find(t);
+        if (iter != m_waiters.end()) deadline = iter->second;
+    }
+
+    while (true) {
+        UpdateTimers();
+        u32 r = TryWait(objs, count, waitAll, t);
+        if (r != WAIT_TIMEOUT) {
+            EndWait(t);
+            m_changed.WakeAll();
+            return r;
+        }
+        const u64 now = Now();
+        if (now >= deadline) {
+            EndWait(t);
+            return WAIT_TIMEOUT;
+        }
+        m_waiters[t] = deadline;
+        if (AdvanceIfIdle()) continue;
+        if (pooled) return WaitPending;
+
+        DWORD ms = MaxHostWait;
+        if (deadline != NoDeadline) ms = (DWORD) min((u64) ms, deadline - now);
+        m_changed.Wait(m_lock, max(ms, (DWORD) 1));
+    }
+}
+
+u32 SyncManager::Wait( Thread *t, const HANDLE *handles, u32 count, bool waitAll, u32 timeout )
+{
+    if (count > MAXIMUM_WAIT_OBJECTS) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return WAIT_FAILED;
+    }
+
+    MutexCSLock lock(m_lock);
+    SyncObject *objs[MAXIMUM_WAIT_OBJECTS];
+    for (u32 i = 0; i < count; i++) {
+        objs[i] = Lookup(handles[i]);
+        if (objs[i] == NULL) {
+            SetLastError(ERROR_INVALID_HANDLE);
+            return WAIT_FAILED;
+        }
+    }
+    return WaitObjects(t, objs, count, waitAll, timeout);
+}
+
+u32 SyncManager::Sleep( Thread *t, u32 ms )
+{
+    MutexCSLock lock(m_lock);
+    return WaitObjects(t, NULL, 0, false, ms);
+}
+
+void SyncManager::ThreadStarted()
+{
+    MutexCSLock lock(m_lock);
+    m_alive++;
+}
+
+void SyncManager::ThreadExited( Thread *t )
+{
+    MutexCSLock lock(m_lock);
+    m_alive--;
+    EndWait(t);
+
+    // mutexes are abandoned, critical sections simply released
+    for (uint i = 0; i < m_objects.size(); i++) {
+        SyncObject *obj = m_objects[i];
+        if (obj && obj->Type == TypeMutex && obj->Owner == t) {
+            obj->Owner      = NULL;
+            obj->Recursion  = 0;
+            obj->Abandoned  = true;
+        }
+    }
+    for (auto &cs : m_critSecs) {
+        SyncObject *obj = cs.second;
+        if (obj->Owner == t) {
+            LxWarning("Thread [%x] exits inside critical section %08x\n", t->ExtID, obj->GuestAddr);
+            obj->Owner      = NULL;
+            obj->Recursion  = 0;
+            SyncGuestCritSec(obj);
+        }
+    }
+    // the remaining threads may all be waiting now
+    AdvanceIfIdle();
+    m_changed.WakeAll();
+}
+
+void SyncManager::SaveObject( SnapshotWriter &w, const SyncObject *obj )
+{
+    w.Put((u32) obj->Type);
+    w.Put((u8) obj->ManualReset);
+    w.Put((u8) obj->Signaled);
+    w.Put((u8) obj->Abandoned);
+    w.Put((u8) (obj->Owner != NULL));
+    w.Put(obj->Recursion);
+    w.Put(obj->Count);
+    w.Put(obj->Maximum);
+    w.Put(obj->DueTime);
+    w.Put(obj->Period);
+    w.Put(obj->GuestAddr);
+    w.Put(obj->Refs);
+    w.PutString(obj->Name);
+}
+
+SyncManager::SyncObject * SyncManager::LoadObject( SnapshotReader &r, Thread *main )
+{
+    u32 type = r.Get<u32>();
+    if (type > TypeThread) return NULL;
+    SyncObject *obj     = new SyncObject((ObjectType) type);
+    obj->ManualReset    = r.Get<u8>() != 0;
+    obj->Signaled       = r.Get<u8>() != 0;
+    obj->Abandoned      = r.Get<u8>() != 0;
+    obj->Owner          = r.Get<u8>() ? main : NULL;
+    obj->Recursion      = r.Get<u32>();
+    obj->Count          = r.Get<i32>();
+    obj->Maximum        = r.Get<i32>();
+    obj->DueTime        = r.Get<u64>();
+    obj->Period         = r.Get<u32>();
+    obj->GuestAddr      = r.Get<u32>();
+    obj->Refs           = r.Get<u32>();
+    obj->Name           = r.GetString();
+    return obj;
+}
+
+void SyncManager::SaveState( SnapshotWriter &w, Thread *main )
+{
+    MutexCSLock lock(m_lock);
+    Assert(m_alive == 1 && m_waiters.empty());
+
+    w.Put(GetTickCount64() + m_skew);
+    w.Put((u32) m_objects.size());
+    for (uint i = 0; i < m_objects.size(); i++) {
+        const SyncObject *obj = m_objects[i];
+        Assert(obj == NULL || obj->Owner == NULL || obj->Owner == main);
+        w.Put((u8) (obj != NULL));
+        if (obj) SaveObject(w, obj);
+    }
+    w.PutVector(m_freeSlots);
+    w.Put((u32) m_critSecs.size());
+    for (auto &cs : m_critSecs) {
+        SaveObject(w, cs.second);
+    }
+}
+
+bool SyncManager::LoadState( SnapshotReader &r, Thread *main )
+{
+    MutexCSLock lock(m_lock);
+    Clear();
+
+    // virtual time carries on from the captured instant
+    m_skew = r.Get<u64>() - GetTickCount64();
+    u32 n = r.Get<u32>();
+    for (u32 i = 0; i < n && !r.Failed(); i++) {
+        SyncObject *obj = NULL;
+        if (r.Get<u8>()) {
+            obj = LoadObject(r, main);
+            if (obj == NULL) return false;
+            if (!obj->Name.empty()) m_names[obj->Name] = i;
+            if (obj->DueTime != NoDeadline) m_timers.insert(obj);
+        }
+        m_objects.push_back(obj);
+    }
+    r.GetVector(m_freeSlots);
+    n = r.Get<u32>();
+    for (u32 i = 0; i < n && !r.Failed(); i++) {
+        SyncObject *obj = LoadObject(r, main);
+        if (obj == NULL) return false;
+        delete m_critSecs[obj->GuestAddr];
+        m_critSecs[obj->GuestAddr] = obj;
+    }
+    return !r.Failed();
+}
+
+END_NAMESPACE_LOCHSEMU()
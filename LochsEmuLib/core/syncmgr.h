@@ -0,0 +1,142 @@
+#pragma once
+
+#ifndef __CORE_SYNCMGR_H__
+#define __CORE_SYNCMGR_H__
+
+#include "lochsemu.h"
+#include "parallel.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * Emulated kernel synchronization objects and virtual time.
+ *
+ * Events, mutexes, semaphores, waitable timers and critical sections live
+ * here instead of in the host kernel; their handles are values no host
+ * handle takes. A wait that cannot be satisfied parks a host thread on a
+ * condition variable, while a thread run by the Scheduler gets WaitPending
+ * back so the API call is retried on its next slice and the worker is free.
+ *
+ * Virtual time is host time plus a skew. Whenever every guest thread is
+ * waiting, the clock jumps to the nearest deadline, so Sleep and timed
+ * waits cost no wall-clock time.
+ */
+class LX_API SyncManager {
+public:
+    static const u32    HandleBase      = 0x7f000000;
+    static const u32    HandleLimit     = 0x7fffffff;
+    static const u32    WaitPending     = (u32) -2;
+    static const u64    NoDeadline      = (u64) -1;
+
+public:
+    SyncManager(Process *proc);
+    ~SyncManager();
+
+    static bool     IsEmulatedHandle    (HANDLE h);
+
+    /* names may be NULL; an existing name returns its object */
+    HANDLE          NewEvent            (bool manualReset, bool initialState, LPCSTR name);
+    HANDLE          NewMutex            (Thread *t, bool initialOwner, LPCSTR name);
+    HANDLE          NewSemaphore        (i32 initialCount, i32 maximumCount, LPCSTR name);
+    HANDLE          NewTimer            (bool manualReset, LPCSTR name);
+    /* handle of a thread run by the Scheduler, signaled by ExitThread */
+    HANDLE          NewThread           (void);
+    bool            ExitThread          (HANDLE h, u32 exitCode);
+    /* STILL_ACTIVE until the thread exits; false if h is no thread */
+    bool            GetExitCode         (HANDLE h, u32 *exitCode);
+    bool            SetEvent            (HANDLE h);
+    bool            ResetEvent          (HANDLE h);
+    bool            ReleaseMutex        (Thread *t, HANDLE h);
+    bool            ReleaseSemaphore    (HANDLE h, i32 count, i32 *prevCount);
+    /* dueTime as in SetWaitableTimer: negative is relative, in 100ns units */
+    bool            SetTimer            (HANDLE h, i64 dueTime, u32 period);
+    bool            CancelTimer         (HANDLE h);
+    /* one more reference to the object, dropped again by Close */
+    bool            Retain              (HANDLE h);
+    bool            Close               (HANDLE h);
+
+    /* critical sections, keyed by the guest address of the CRITICAL_SECTION */
+    void            InitCriticalSection (u32 addr, u32 spinCount);
+    void            DeleteCriticalSection(u32 addr);
+    bool            TryEnterCriticalSection(Thread *t, u32 addr);
+    u32             EnterCriticalSection(Thread *t, u32 addr);
+    void            LeaveCriticalSection(Thread *t, u32 addr);
+
+    /*
+     * WAIT_OBJECT_0 + i, WAIT_ABANDONED_0 + i, WAIT_TIMEOUT or WAIT_FAILED;
+     * WaitPending when a pooled thread has to retry the call
+     */
+    u32             Wait                (Thread *t, const HANDLE *handles, u32 count, bool waitAll, u32 timeout);
+    u32             Sleep               (Thread *t, u32 ms);
+
+    u64             Now                 (void);             // virtual milliseconds
+    u64             Skew                (void);             // virtual minus host, in milliseconds
+
+    void            ThreadStarted       (void);
+    void            ThreadExited        (Thread *t);
+
+    /*
+     * objects, critical sections and the virtual clock for snapshots;
+     * only valid while 'main' is the only thread, which owns whatever is owned
+     */
+    void            SaveState           (SnapshotWriter &w, Thread *main);
+    bool            LoadState           (SnapshotReader &r, Thread *main);
+
+private:
+    enum ObjectType {
+        TypeEvent, TypeMutex, TypeSemaphore, TypeTimer, TypeCritSec, TypeThread,
+    };
+
+    struct SyncObject {
+        SyncObject(ObjectType type);
+
+        ObjectType  Type;
+        bool        ManualReset;
+        bool        Signaled;       // events, timers and threads
+        bool        Abandoned;      // mutexes
+        Thread *    Owner;          // mutexes and critical sections
+        u32         Recursion;
+        i32         Count;          // semaphores; exit code of threads
+        i32         Maximum;
+        u64         DueTime;        // timers, virtual ms; NoDeadline if not set
+        u32         Period;
+        u32         GuestAddr;      // critical sections
+        u32         Refs;           // handles referring to a named object
+        std::string Name;
+    };
+
+    HANDLE          Insert              (SyncObject *obj, LPCSTR name);
+    SyncObject *    Lookup              (HANDLE h);
+    SyncObject *    Lookup              (HANDLE h, ObjectType type);
+    SyncObject *    LookupCritSec       (u32 addr);
+    bool            IsSignaled          (SyncObject *obj, Thread *t);
+    void            Acquire             (SyncObject *obj, Thread *t);
+    u32             TryWait             (SyncObject **objs, u32 count, bool waitAll, Thread *t);
+    u32             WaitObjects         (Thread *t, SyncObject **objs, u32 count, bool waitAll, u32 timeout);
+    void            UpdateTimers        (void);
+    void            Destroy             (SyncObject *obj);
+    void            Clear               (void);
+    static void     SaveObject          (SnapshotWriter &w, const SyncObject *obj);
+    static SyncObject * LoadObject      (SnapshotReader &r, Thread *main);
+    void            SyncGuestCritSec    (SyncObject *obj);
+    bool            AdvanceIfIdle       (void);
+    void            EndWait             (Thread *t);
+    bool            IsPooled            (Thread *t) const;
+
+private:
+    Process *                   m_process;
+    MutexCS                     m_lock;
+    ConditionVariable           m_changed;
+    std::vector<SyncObject *>   m_objects;          // handle index -> object, NULL when free
+    std::vector<u32>            m_freeSlots;
+    std::map<std::string, u32>  m_names;
+    std::unordered_map<u32, SyncObject *>   m_critSecs;
+    std::set<SyncObject *>      m_timers;           // armed waitable timers
+    std::map<Thread *, u64>     m_waiters;          // threads in a wait and their deadlines
+    int                         m_alive;
+    u64                         m_skew;
+};
+
+END_NAMESPACE_LOCHSEMU()
+
+#endif // __CORE_SYNCMGR_H__
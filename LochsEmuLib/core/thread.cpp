@@ -19,6 +19,10 @@ Thread::Thread( Process *proc, int parentId, int intId, ThreadID extId, HANDLE h
     m_stack         = NULL; 
     m_TebAddress    = 0;
     ExitCode        = 0;
+    Serial          = 0;
+    LastError       = 0;
+    RetryingApi     = NoRetry;
+    m_started       = false;
 }
 
 Thread::~Thread()
@@ -89,6 +93,24 @@ LochsEmu::LxResult Thread::Run()
     RET_SUCCESS();
 }
 
+LochsEmu::LxResult Thread::Resume()
+{
+    V( m_cpu.Resume() );
+    RET_SUCCESS();
+}
+
+LochsEmu::LxResult Thread::RunSlice( u32 budget, bool *finished )
+{
+    if (!m_started) {
+        // same frame as LxThreadRoutine sets up
+        m_cpu.Push32(m_initInfo.ParamPtr);
+        m_cpu.Push32((u32) TERMINATE_EIP);
+        m_cpu.BeginRun(m_initInfo.EntryPoint);
+        m_started = true;
+    }
+    return m_cpu.RunSlice(budget, finished);
+}
+
 LochsEmu::LxResult Thread::RunAt( u32 entry )
 {
     RET_NOT_IMPLEMENTED();
@@ -37,12 +37,18 @@ enum LoadReason {
 
 class LX_API Thread {
 public:
+    static const uint NoRetry = (uint) -1;
+
     Thread(Process *proc, int parentId, int intId, ThreadID extId = 0, HANDLE hThread = INVALID_HANDLE_VALUE);
     virtual ~Thread();
 
     LxResult        Initialize(const ThreadInfo &info);
     LxResult        Run();
     LxResult        RunAt(u32 entry);
+    /* continue from the current EIP, for a restored snapshot */
+    LxResult        Resume();
+    /* pooled threads: run one time slice, starting the thread on the first */
+    LxResult        RunSlice(u32 budget, bool *finished);
     void            Exit(u32 code);
     HMODULE         LoadModule(LPCSTR lpFileName);
     LxResult        UnloadModule(HMODULE hModule);
@@ -56,6 +62,7 @@ public:
     PluginManager * Plugins() const { Assert(m_plugins); return m_plugins; }
     u32             GetTEBAddress() const { return m_TebAddress; }
     std::vector<uint>   GetModuleLoadOrder() const { return m_moduleLoadOrder; }
+    void            SetModuleLoadOrder(const std::vector<uint> &order) { m_moduleLoadOrder = order; }
     const ThreadInfo *  GetThreadInfo() const { return &m_initInfo; }
 public:
     int             ParentId;
@@ -63,6 +70,9 @@ public:
     ThreadID        ExtID;
     HANDLE          Handle;
     u32             ExitCode;
+    u32             Serial;     // creation order, 0 for the main thread; stable across runs
+    u32             LastError;  // loaded into the host thread around each WinAPI call
+    uint            RetryingApi;    // API whose call returned WinAPIRetry, NoRetry if none
 protected:
     void            InitStack();
     void            InitTEB();
@@ -75,6 +85,7 @@ protected:
     Stack *         m_stack;
     u32             m_TebAddress;
     std::vector<uint>   m_moduleLoadOrder;  /* Record module load order for module unloading */
+    bool            m_started;
 };
 
 DWORD LxThreadRoutine(LPVOID lpParams);
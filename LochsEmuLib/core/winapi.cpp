@@ -3,6 +3,9 @@
 #include "processor.h"
 #include "debug.h"
 #include "process.h"
+#include "emulator.h"
+#include "replay.h"
+#include "parallel.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
@@ -38,6 +41,7 @@ WinAPIInfo WinAPIInfoTable[] = {
     /* kernel32.dll */
 	{ 01, 0, "AddAtomA", Kernel32_AddAtomA },
     { 01, 0, "AreFileApisANSI", Kernel32_AreFileApisANSI },
+    { 01, 0, "CancelWaitableTimer", Kernel32_CancelWaitableTimer },
     { 01, 0, "CloseHandle", Kernel32_CloseHandle },
     //{ 01, 0, "CloseToolhelp32Snapshot", Kernel32_CloseToolhelp32Snapshot },
 	{ 01, 0, "CompareStringW", Kernel32_CompareStringW },
@@ -46,17 +50,22 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 01, 0, "CreateFileA", Kernel32_CreateFileA },
     { 01, 0, "CreateFileW", Kernel32_CreateFileW },
 	{ 01, 0, "CreateProcessA", kernel32_CreateProcessA },
+    { 01, 0, "CreateMutexA", Kernel32_CreateMutexA },
+    { 01, 0, "CreateMutexW", Kernel32_CreateMutexW },
 	{ 01, 0, "CreateSemaphoreA", Kernel32_CreateSemaphoreA },
+    { 01, 0, "CreateSemaphoreW", Kernel32_CreateSemaphoreW },
     { 01, 0, "CreateToolhelp32Snapshot", Kernel32_CreateToolhelp32Snapshot },
-    { 01, 0, "CreateThread", Kernel32_CreateThread },
+    { 01, 0, "CreateThread", Kernel32_CreateThread, LX_WINAPI_EXECUTE | LX_WINAPI_NEW_HANDLE },
+    { 01, 0, "CreateWaitableTimerA", Kernel32_CreateWaitableTimerA },
+    { 01, 0, "CreateWaitableTimerW", Kernel32_CreateWaitableTimerW },
     { 01, 0, "DecodePointer", Kernel32_DecodePointer },
     { 01, 0, "DeleteCriticalSection", Kernel32_DeleteCriticalSection },
     { 01, 0, "DeleteFileA", Kernel32_DeleteFileA },
 	{ 01, 0, "DisableThreadLibraryCalls", Kernel32_DisableThreadLibraryCalls },
     { 01, 0, "EncodePointer", Kernel32_EncodePointer },
     { 01, 0, "EnterCriticalSection", Kernel32_EnterCriticalSection },
-    { 01, 0, "ExitProcess", Kernel32_ExitProcess },
-    { 01, 0, "ExitThread", Kernel32_ExitThread },
+    { 01, 0, "ExitProcess", Kernel32_ExitProcess, LX_WINAPI_EXECUTE },
+    { 01, 0, "ExitThread", Kernel32_ExitThread, LX_WINAPI_EXECUTE },
     { 01, 0, "FileTimeToLocalFileTime", Kernel32_FileTimeToLocalFileTime },
     { 01, 0, "FindActCtxSectionStringW", Kernel32_FindActCtxSectionStringW },
 	{ 01, 0, "FindAtomA", Kernel32_FindAtomA },
@@ -69,14 +78,14 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 01, 0, "FlsSetValue", Kernel32_FlsSetValue },
     { 01, 0, "FlushConsoleInputBuffer", Kernel32_FlushConsoleInputBuffer },
     { 01, 0, "FreeEnvironmentStringsW", Kernel32_FreeEnvironmentStringsW },
-    { 01, 0, "FreeLibrary", Kernel32_FreeLibrary },
+    { 01, 0, "FreeLibrary", Kernel32_FreeLibrary, LX_WINAPI_EXECUTE },
     { 01, 0, "GetACP", Kernel32_GetACP },
 	{ 01, 0, "GetAtomNameA", Kernel32_GetAtomNameA },
     { 01, 0, "GetCPInfo", Kernel32_GetCPInfo },
     { 01, 0, "GetConsoleCP", Kernel32_GetConsoleCP },
     { 01, 0, "GetConsoleMode", Kernel32_GetConsoleMode },
-    { 01, 0, "GetCommandLineA", Kernel32_GetCommandLineA },
-    { 01, 0, "GetCommandLineW", Kernel32_GetCommandLineW },
+    { 01, 0, "GetCommandLineA", Kernel32_GetCommandLineA, LX_WINAPI_ALLOCATES },
+    { 01, 0, "GetCommandLineW", Kernel32_GetCommandLineW, LX_WINAPI_ALLOCATES },
     { 01, 0, "GetComputerNameA", Kernel32_GetComputerNameA },
 	{ 01, 0, "GetCurrentDirectoryW", Kernel32_GetCurrentDirectoryW },
     //{ 01, 0, "GetCurrentPackageId", Kernel32_GetCurrentPackageId },
@@ -85,10 +94,11 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 01, 0, "GetCurrentThreadId", Kernel32_GetCurrentThreadId },
     { 01, 0, "GetCurrentThread", Kernel32_GetCurrentThread },
     { 01, 0, "GetDriveTypeA", Kernel32_GetDriveTypeA },
-    { 01, 0, "GetEnvironmentStrings", Kernel32_GetEnvironmentStrings },
-    { 01, 0, "GetEnvironmentStringsW", Kernel32_GetEnvironmentStringsW },
+    { 01, 0, "GetEnvironmentStrings", Kernel32_GetEnvironmentStrings, LX_WINAPI_ALLOCATES },
+    { 01, 0, "GetEnvironmentStringsW", Kernel32_GetEnvironmentStringsW, LX_WINAPI_ALLOCATES },
     { 01, 0, "GetEnvironmentVariableA", Kernel32_GetEnvironmentVariableA },
 	{ 01, 0, "GetExitCodeProcess", Kernel32_GetExitCodeProcess },
+    { 01, 0, "GetExitCodeThread", Kernel32_GetExitCodeThread },
 	{ 01, 0, "GetFileAttributesA", Kernel32_GetFileAttributesA },
     { 01, 0, "GetFileType", Kernel32_GetFileType },
     { 01, 0, "GetLastError", Kernel32_GetLastError },
@@ -122,21 +132,22 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 01, 0, "GetVersionExA", Kernel32_GetVersionExA },
     { 01, 0, "GetVersionExW", Kernel32_GetVersionExW },
     { 01, 0, "GetVolumeInformationA", Kernel32_GetVolumeInformationA },
-	{ 01, 0, "GlobalAlloc", Kernel32_GlobalAlloc },
-	{ 01, 0, "GlobalFree", Kernel32_GlobalFree },
+	{ 01, 0, "GlobalAlloc", Kernel32_GlobalAlloc, LX_WINAPI_EXECUTE },
+	{ 01, 0, "GlobalFree", Kernel32_GlobalFree, LX_WINAPI_EXECUTE },
     { 01, 0, "GlobalMemoryStatus", Kernel32_GlobalMemoryStatus },
     { 01, 0, "Heap32First", Kernel32_Heap32First },
     { 01, 0, "Heap32Next", Kernel32_Heap32Next },
     { 01, 0, "Heap32ListFirst", Kernel32_Heap32ListFirst },
     { 01, 0, "Heap32ListNext", Kernel32_Heap32ListNext },
-    { 01, 0, "HeapAlloc", Kernel32_HeapAlloc },
-    { 01, 0, "HeapCreate", Kernel32_HeapCreate },
-    { 01, 0, "HeapDestroy", Kernel32_HeapDestroy },
-    { 01, 0, "HeapFree", Kernel32_HeapFree },
-    { 01, 0, "HeapReAlloc", Kernel32_HeapReAlloc },
+    { 01, 0, "HeapAlloc", Kernel32_HeapAlloc, LX_WINAPI_EXECUTE },
+    { 01, 0, "HeapCreate", Kernel32_HeapCreate, LX_WINAPI_EXECUTE },
+    { 01, 0, "HeapDestroy", Kernel32_HeapDestroy, LX_WINAPI_EXECUTE },
+    { 01, 0, "HeapFree", Kernel32_HeapFree, LX_WINAPI_EXECUTE },
+    { 01, 0, "HeapReAlloc", Kernel32_HeapReAlloc, LX_WINAPI_EXECUTE },
 	{ 01, 0, "HeapValidate", Kernel32_HeapValidate }, 
 	{ 01, 0, "HeapSetInformation", Kernel32_HeapSetInformation },
     { 01, 0, "HeapSize", Kernel32_HeapSize },
+    { 01, 0, "HeapWalk", Kernel32_HeapWalk },
 	{ 01, 0, "InitializeCriticalSection", Kernel32_InitializeCriticalSection },
     { 01, 0, "InitializeCriticalSectionAndSpinCount", Kernel32_InitializeCriticalSectionAndSpinCount },
     { 01, 0, "InitializeCriticalSectionEx", Kernel32_InitializeCriticalSectionEx },
@@ -157,9 +168,9 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 01, 0, "LCMapStringEx", Kernel32_LCMapStringEx },
     { 01, 0, "LCMapStringW", Kernel32_LCMapStringW },
     { 01, 0, "LeaveCriticalSection", Kernel32_LeaveCriticalSection },
-    { 01, 0, "LoadLibraryA", Kernel32_LoadLibraryA },
-	{ 01, 0, "LoadLibraryW", Kernel32_LoadLibraryW },
-    { 01, 0, "LoadLibraryExW", Kernel32_LoadLibraryExW },
+    { 01, 0, "LoadLibraryA", Kernel32_LoadLibraryA, LX_WINAPI_EXECUTE },
+	{ 01, 0, "LoadLibraryW", Kernel32_LoadLibraryW, LX_WINAPI_EXECUTE },
+    { 01, 0, "LoadLibraryExW", Kernel32_LoadLibraryExW, LX_WINAPI_EXECUTE },
     { 01, 0, "lstrcpy", Kernel32_lstrcpy },
     { 01, 0, "lstrcmpiA", Kernel32_lstrcmpiA },
     { 01, 0, "lstrlenA", Kernel32_lstrlenA },
@@ -170,11 +181,15 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 01, 0, "Process32First", Kernel32_Process32First },
     { 01, 0, "Process32Next", Kernel32_Process32Next },
     { 01, 0, "QueryPerformanceCounter", Kernel32_QueryPerformanceCounter },
-    { 01, 0, "RaiseException", Kernel32_RaiseException },
+    { 01, 0, "QueryPerformanceFrequency", Kernel32_QueryPerformanceFrequency },
+    { 01, 0, "RaiseException", Kernel32_RaiseException, LX_WINAPI_EXECUTE },
     { 01, 0, "ReadConsoleInputA", Kernel32_ReadConsoleInputA },
     { 01, 0, "ReadFile", Kernel32_ReadFile },
-    { 01, 0, "ResumeThread", Kernel32_ResumeThread },
-    { 01, 0, "RtlUnwind", Kernel32_RtlUnwind },
+    { 01, 0, "ReleaseMutex", Kernel32_ReleaseMutex },
+    { 01, 0, "ReleaseSemaphore", Kernel32_ReleaseSemaphore },
+    { 01, 0, "ResetEvent", Kernel32_ResetEvent },
+    { 01, 0, "ResumeThread", Kernel32_ResumeThread, LX_WINAPI_EXECUTE | LX_WINAPI_HANDLE_ARG },
+    { 01, 0, "RtlUnwind", Kernel32_RtlUnwind, LX_WINAPI_EXECUTE },
     { 01, 0, "SearchPathA", Kernel32_SearchPathA },
     { 01, 0, "SetFileAttributesA", Kernel32_SetFileAttributesA },
     { 01, 0, "SetConsoleCtrlHandler", Kernel32_SetConsoleCtrlHandler },
@@ -187,19 +202,24 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 01, 0, "SetHandleCount", Kernel32_SetHandleCount },
     { 01, 0, "SetLastError", Kernel32_SetLastError },
     { 01, 0, "SetUnhandledExceptionFilter", Kernel32_SetUnhandledExceptionFilter },
+    { 01, 0, "SetWaitableTimer", Kernel32_SetWaitableTimer },
     { 01, 0, "Sleep", Kernel32_Sleep },
     { 01, 0, "SleepEx", Kernel32_SleepEx },
-    { 01, 0, "TerminateProcess", Kernel32_TerminateProcess },
+    { 01, 0, "SwitchToThread", Kernel32_SwitchToThread },
+    { 01, 0, "TerminateProcess", Kernel32_TerminateProcess, LX_WINAPI_EXECUTE },
     { 01, 0, "Thread32First", Kernel32_Thread32First },
     { 01, 0, "Thread32Next", Kernel32_Thread32Next },
     { 01, 0, "TlsAlloc", Kernel32_TlsAlloc },
     { 01, 0, "TlsFree", Kernel32_TlsFree },
     { 01, 0, "TlsGetValue", Kernel32_TlsGetValue },
     { 01, 0, "TlsSetValue", Kernel32_TlsSetValue },
+    { 01, 0, "TryEnterCriticalSection", Kernel32_TryEnterCriticalSection },
     { 01, 0, "UnhandledExceptionFilter", Kernel32_UnhandledExceptionFilter },
-    { 01, 0, "VirtualAlloc", Kernel32_VirtualAlloc },
-    { 01, 0, "VirtualFree", Kernel32_VirtualFree },
+    { 01, 0, "VirtualAlloc", Kernel32_VirtualAlloc, LX_WINAPI_EXECUTE },
+    { 01, 0, "VirtualFree", Kernel32_VirtualFree, LX_WINAPI_EXECUTE },
+    { 01, 0, "WaitForMultipleObjects", Kernel32_WaitForMultipleObjects },
 	{ 01, 0, "WaitForSingleObject", Kernel32_WaitForSingleObject },
+    { 01, 0, "WaitForSingleObjectEx", Kernel32_WaitForSingleObjectEx },
     { 01, 0, "WideCharToMultiByte", Kernel32_WideCharToMultiByte },
     { 01, 0, "WinExec", Kernel32_WinExec },
     { 01, 0, "WriteFile", Kernel32_WriteFile },
@@ -305,7 +325,7 @@ WinAPIInfo WinAPIInfoTable[] = {
 
     /* ntdll.dll */
     { 07, 0, "RtlGetNtVersionNumbers", Ntdll_RtlGetNtVersionNumbers },
-    { 07, 0, "RtlUnwind", Ntdll_RtlUnwind },
+    { 07, 0, "RtlUnwind", Ntdll_RtlUnwind, LX_WINAPI_EXECUTE },
 
     /* comctl32.dll */
     { 15, 0, "InitCommonControls", Comctl32_InitCommonControls },
@@ -328,9 +348,9 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 16, 0x03, "closesocket", Ws2_32_closesocket },
     { 16, 0x04, "connect", Ws2_32_connect },
     { 16, 0xA2, "freeaddrinfo", Ws2_32_freeaddrinfo },
-    { 16, 0xA3, "getaddrinfo", Ws2_32_getaddrinfo },
-    { 16, 0x33, "gethostbyaddr", Ws2_32_gethostbyaddr },
-    { 16, 0x34, "gethostbyname", Ws2_32_gethostbyname },
+    { 16, 0xA3, "getaddrinfo", Ws2_32_getaddrinfo, LX_WINAPI_ALLOCATES },
+    { 16, 0x33, "gethostbyaddr", Ws2_32_gethostbyaddr, LX_WINAPI_ALLOCATES },
+    { 16, 0x34, "gethostbyname", Ws2_32_gethostbyname, LX_WINAPI_ALLOCATES },
     { 16, 0x39, "gethostname", Ws2_32_gethostname },
     { 16, 0x05, "getpeername", Ws2_32_getpeername },
     { 16, 0x06, "getsockname", Ws2_32_getsockname },
@@ -349,7 +369,7 @@ WinAPIInfo WinAPIInfoTable[] = {
     { 16, 0x15, "setsockopt", Ws2_32_setsockopt },
     { 16, 0x16, "shutdown", Ws2_32_shutdown },
     { 16, 0x17, "socket", Ws2_32_socket },
-    { 16, 0x37, "getservbyname", Ws2_32_getservbyname },
+    { 16, 0x37, "getservbyname", Ws2_32_getservbyname, LX_WINAPI_ALLOCATES },
     { 16, 0x74, "WSACleanup", Ws2_32_WSACleanup },
     { 16, 0x6F, "WSAGetLastError", Ws2_32_WSAGetLastError },
     { 16, 0x70, "WSASetLastError", Ws2_32_WSASetLastError },
@@ -370,14 +390,14 @@ WinAPIInfo WinAPIInfoTable[] = {
 
     /* netapi32.dll */
     { 20, 0, "NetApiBufferFree", Netapi32_NetApiBufferFree },
-    { 20, 0, "NetStatisticsGet", Netapi32_NetStatisticsGet  },
+    { 20, 0, "NetStatisticsGet", Netapi32_NetStatisticsGet, LX_WINAPI_ALLOCATES },
 
     /* wsock32.dll */
     { 22, 0, "accept", Ws2_32_accept },
     { 22, 0, "bind", Ws2_32_bind },
     { 22, 0, "closesocket", Ws2_32_closesocket },
-    { 22, 0, "gethostbyaddr", Ws2_32_gethostbyaddr },
-    { 22, 0, "gethostbyname", Ws2_32_gethostbyname },
+    { 22, 0, "gethostbyaddr", Ws2_32_gethostbyaddr, LX_WINAPI_ALLOCATES },
+    { 22, 0, "gethostbyname", Ws2_32_gethostbyname, LX_WINAPI_ALLOCATES },
     { 22, 0, "htons", Ws2_32_htons },
     { 22, 0, "listen", Ws2_32_listen },
     { 22, 0, "recv", Ws2_32_recv },
@@ -424,6 +444,87 @@ LX_API uint QueryLibraryIndex( const char *dllName )
 }
 
 
+/*
+ * WinAPIInfoTable entries sorted by (DllIndex, FuncName) and by
+ * (DllIndex, Ordinal), so imports are resolved by binary search. Equal
+ * keys keep table order, so the first matching entry still wins
+ */
+struct WinAPIIndex {
+    std::vector<uint>   ByName;
+    std::vector<uint>   ByOrdinal;
+};
+
+struct NameKeyLess {
+    static int Compare(uint dllA, const char *nameA, uint dllB, const char *nameB) {
+        if (dllA != dllB) return dllA < dllB ? -1 : 1;
+        return strcmp(nameA, nameB);
+    }
+    bool operator()(uint a, uint b) const {
+        int r = Compare(WinAPIInfoTable[a].DllIndex, WinAPIInfoTable[a].FuncName,
+            WinAPIInfoTable[b].DllIndex, WinAPIInfoTable[b].FuncName);
+        return r != 0 ? r < 0 : a < b;
+    }
+    bool operator()(uint a, const std::pair<uint, const char *> &key) const {
+        return Compare(WinAPIInfoTable[a].DllIndex, WinAPIInfoTable[a].FuncName, key.first, key.second) < 0;
+    }
+    bool operator()(const std::pair<uint, const char *> &key, uint a) const {
+        return Compare(key.first, key.second, WinAPIInfoTable[a].DllIndex, WinAPIInfoTable[a].FuncName) < 0;
+    }
+};
+
+struct OrdinalKeyLess {
+    bool operator()(uint a, uint b) const {
+        const WinAPIInfo &x = WinAPIInfoTable[a], &y = WinAPIInfoTable[b];
+        if (x.DllIndex != y.DllIndex) return x.DllIndex < y.DllIndex;
+        if (x.Ordinal != y.Ordinal) return x.Ordinal < y.Ordinal;
+        return a < b;
+    }
+    bool operator()(uint a, const std::pair<uint, uint> &key) const {
+        const WinAPIInfo &x = WinAPIInfoTable[a];
+        if (x.DllIndex != key.first) return x.DllIndex < key.first;
+        return x.Ordinal < key.second;
+    }
+    bool operator()(const std::pair<uint, uint> &key, uint a) const {
+        const WinAPIInfo &x = WinAPIInfoTable[a];
+        if (key.first != x.DllIndex) return key.first < x.DllIndex;
+        return key.second < x.Ordinal;
+    }
+};
+
+static WinAPIIndex BuildWinAPIIndex()
+{
+    WinAPIIndex index;
+    uint N = LxGetTotalWinAPIs();
+    // entry 0 is the N/A placeholder and 0 means not found anyway
+    for (uint i = 1; i < N; i++) {
+        index.ByName.push_back(i);
+        index.ByOrdinal.push_back(i);
+    }
+    std::sort(index.ByName.begin(), index.ByName.end(), NameKeyLess());
+    std::sort(index.ByOrdinal.begin(), index.ByOrdinal.end(), OrdinalKeyLess());
+    return index;
+}
+
+static WinAPIIndex      s_winapiIndex;
+static MutexCS          s_winapiIndexLock;
+static volatile long    s_winapiIndexBuilt = 0;
+
+void InitWinAPIIndex()
+{
+    if (s_winapiIndexBuilt) return;
+    MutexCSLock lock(s_winapiIndexLock);
+    if (s_winapiIndexBuilt) return;
+    s_winapiIndex = BuildWinAPIIndex();
+    InterlockedExchange(&s_winapiIndexBuilt, 1);
+}
+
+static const WinAPIIndex &GetWinAPIIndex()
+{
+    // normally built by Emulator::Initialize, before any guest thread runs
+    InitWinAPIIndex();
+    return s_winapiIndex;
+}
+
 LX_API uint QueryWinAPIIndexByName( const char *dllName, const char *funcName )
 {
     HMODULE hModule = NULL;
@@ -440,16 +541,16 @@ LX_API uint QueryWinAPIIndexByName( const char *dllName, const char *funcName )
 
 LX_API uint QueryWinAPIIndexByName( HMODULE hModule, const char *funcName )
 {
-    static uint N = sizeof(WinAPIInfoTable) / sizeof(WinAPIInfo);
+    const WinAPIIndex &index = GetWinAPIIndex();
 
     uint dllIndex = LX_MODULE_NUM(hModule);
     if (dllIndex == 0) return 0; // dll not found
-    for (uint i = 0; i < N; i++) {
-        if (WinAPIInfoTable[i].DllIndex == dllIndex &&
-            !strcmp(WinAPIInfoTable[i].FuncName, funcName)) // Don't ignore case
-        {
-            return i;
-        }
+    auto iter = std::lower_bound(index.ByName.begin(), index.ByName.end(), 
+        std::make_pair(dllIndex, funcName), NameKeyLess());
+    if (iter != index.ByName.end() && WinAPIInfoTable[*iter].DllIndex == dllIndex &&
+        !strcmp(WinAPIInfoTable[*iter].FuncName, funcName)) // Don't ignore case
+    {
+        return *iter;
     }
     return 0; // Not found 
 }
@@ -466,15 +567,16 @@ LX_API uint QueryWinAPIIndexByOrdinal( const char *dllName, uint ordinal )
 
 LX_API uint QueryWinAPIIndexByOrdinal( HMODULE hModule, uint ordinal )
 {
-    static uint N = sizeof(WinAPIInfoTable) / sizeof(WinAPIInfo);
+    const WinAPIIndex &index = GetWinAPIIndex();
+
     uint dllIndex = LX_MODULE_NUM(hModule);
     if (dllIndex == 0) return 0;
-    for (uint i = 0; i < N; i++) {
-        if (WinAPIInfoTable[i].DllIndex == dllIndex && 
-            WinAPIInfoTable[i].Ordinal == ordinal)
-        {
-            return i;
-        }
+    auto iter = std::lower_bound(index.ByOrdinal.begin(), index.ByOrdinal.end(), 
+        std::make_pair(dllIndex, ordinal), OrdinalKeyLess());
+    if (iter != index.ByOrdinal.end() && WinAPIInfoTable[*iter].DllIndex == dllIndex &&
+        WinAPIInfoTable[*iter].Ordinal == ordinal)
+    {
+        return *iter;
     }
     return 0;
 }
@@ -505,17 +607,35 @@ void CallWindowsAPI( Processor *cpu, u32 val )
     Assert(LX_IS_WINAPI(val));
 
     uint apiIndex = LX_WINAPI_NUM(val);
+    Thread *t = cpu->Thr();
 
-    if (cpu->Thr()) {
-        cpu->Thr()->Plugins()->OnWinapiPreCall(cpu, apiIndex);
+    // plugins see one pre-call per call, however often it is retried
+    if (t) {
+        bool retried = t->RetryingApi == apiIndex;
+        t->RetryingApi = Thread::NoRetry;
+        if (!retried) t->Plugins()->OnWinapiPreCall(cpu, apiIndex);
     }
 
     WinAPIHandler apiFunc = WinAPIInfoTable[apiIndex].Handler;
 
-    uint r = apiFunc(cpu);
+    // a pooled worker runs many guest threads, each with its own last error
+    if (t) SetLastError(t->LastError);
+
+    ReplayLog *replay = cpu->Emu()->Replay();
+    uint r = (replay && t) ? replay->Call(cpu, apiIndex, apiFunc) : apiFunc(cpu);
+
+    if (r == WinAPIRetry) {
+        // back to the CALL/JMP that got here, as if it had not run yet
+        if (cpu->HasExecFlag(LX_EXEC_WINAPI_CALL)) cpu->ESP += 4;
+        cpu->EIP = cpu->GetPrevEip();
+        cpu->YieldSlice();
+        if (t) t->RetryingApi = apiIndex;
+        return;
+    }
 
-    if (cpu->Thr()) {
-        cpu->Thr()->Plugins()->OnWinapiPostCall(cpu, apiIndex);
+    if (t) {
+        t->LastError = GetLastError();
+        t->Plugins()->OnWinapiPostCall(cpu, apiIndex);
     }
 
     cpu->EIP = cpu->Pop32();
@@ -33,11 +33,22 @@ BEGIN_NAMESPACE_LOCHSEMU()
 // Return Value: number of parameters passed by stack
 typedef uint (*WinAPIHandler)(Processor *cpu);
 
+// Returned by a handler that cannot complete yet; the call is re-executed
+// on the thread's next time slice
+static const uint WinAPIRetry = (uint) -1;
+
+// How ReplayLog treats a handler; calls with no flags are not run on replay
+#define LX_WINAPI_EXECUTE       0x0001  // run on replay too, it changes emulator state
+#define LX_WINAPI_ALLOCATES     0x0002  // creates guest sections, recreated from the log
+#define LX_WINAPI_NEW_HANDLE    0x0004  // returns an emulator handle that may differ on replay
+#define LX_WINAPI_HANDLE_ARG    0x0008  // first parameter is such a handle
+
 struct WinAPIInfo {
     uint DllIndex;
     uint Ordinal;
     char FuncName[64];
     WinAPIHandler Handler;
+    uint Flags;
 };
 
 // Wrapped API table
@@ -59,6 +70,7 @@ LX_API const char * LxGetWinAPIModuleName(u32 index);
 LX_API const char * LxGetWinAPIName(u32 index);
 
 void CallWindowsAPI(Processor *cpu, u32 val);
+void InitWinAPIIndex();
 
 
 #define DECLARE_WINAPI_ENTRY(name)      uint name(Processor *cpu)
@@ -74,6 +86,7 @@ DECLARE_WINAPI_ENTRY(WinAPINotAvailable);
 /************************************************************************/
 DECLARE_WINAPI_ENTRY(Kernel32_AddAtomA);
 DECLARE_WINAPI_ENTRY(Kernel32_AreFileApisANSI);
+DECLARE_WINAPI_ENTRY(Kernel32_CancelWaitableTimer);
 DECLARE_WINAPI_ENTRY(Kernel32_CloseHandle);
 //DECLARE_WINAPI_ENTRY(Kernel32_CloseToolhelp32Snapshot);
 DECLARE_WINAPI_ENTRY(Kernel32_CompareStringW);
@@ -82,9 +95,14 @@ DECLARE_WINAPI_ENTRY(Kernel32_CreateEventW);
 DECLARE_WINAPI_ENTRY(Kernel32_CreateFileA);
 DECLARE_WINAPI_ENTRY(Kernel32_CreateFileW);
 DECLARE_WINAPI_ENTRY(kernel32_CreateProcessA);
+DECLARE_WINAPI_ENTRY(Kernel32_CreateMutexA);
+DECLARE_WINAPI_ENTRY(Kernel32_CreateMutexW);
 DECLARE_WINAPI_ENTRY(Kernel32_CreateSemaphoreA);
+DECLARE_WINAPI_ENTRY(Kernel32_CreateSemaphoreW);
 DECLARE_WINAPI_ENTRY(Kernel32_CreateThread);
 DECLARE_WINAPI_ENTRY(Kernel32_CreateToolhelp32Snapshot);
+DECLARE_WINAPI_ENTRY(Kernel32_CreateWaitableTimerA);
+DECLARE_WINAPI_ENTRY(Kernel32_CreateWaitableTimerW);
 DECLARE_WINAPI_ENTRY(Kernel32_DecodePointer);
 DECLARE_WINAPI_ENTRY(Kernel32_DeleteCriticalSection);
 DECLARE_WINAPI_ENTRY(Kernel32_DeleteFileA);
@@ -125,6 +143,7 @@ DECLARE_WINAPI_ENTRY(Kernel32_GetEnvironmentStrings);
 DECLARE_WINAPI_ENTRY(Kernel32_GetEnvironmentStringsW);
 DECLARE_WINAPI_ENTRY(Kernel32_GetEnvironmentVariableA);
 DECLARE_WINAPI_ENTRY(Kernel32_GetExitCodeProcess);
+DECLARE_WINAPI_ENTRY(Kernel32_GetExitCodeThread);
 DECLARE_WINAPI_ENTRY(Kernel32_GetFileAttributesA);
 DECLARE_WINAPI_ENTRY(Kernel32_GetFileType);
 DECLARE_WINAPI_ENTRY(Kernel32_GetLastError);
@@ -173,6 +192,7 @@ DECLARE_WINAPI_ENTRY(Kernel32_HeapReAlloc);
 DECLARE_WINAPI_ENTRY(Kernel32_HeapValidate);
 DECLARE_WINAPI_ENTRY(Kernel32_HeapSetInformation);
 DECLARE_WINAPI_ENTRY(Kernel32_HeapSize);
+DECLARE_WINAPI_ENTRY(Kernel32_HeapWalk);
 DECLARE_WINAPI_ENTRY(Kernel32_InitializeCriticalSection);
 DECLARE_WINAPI_ENTRY(Kernel32_InitializeCriticalSectionAndSpinCount);
 DECLARE_WINAPI_ENTRY(Kernel32_InitializeCriticalSectionEx);
@@ -206,9 +226,13 @@ DECLARE_WINAPI_ENTRY(Kernel32_PeekConsoleInputA);
 DECLARE_WINAPI_ENTRY(Kernel32_Process32First);
 DECLARE_WINAPI_ENTRY(Kernel32_Process32Next);
 DECLARE_WINAPI_ENTRY(Kernel32_QueryPerformanceCounter);
+DECLARE_WINAPI_ENTRY(Kernel32_QueryPerformanceFrequency);
 DECLARE_WINAPI_ENTRY(Kernel32_RaiseException);
 DECLARE_WINAPI_ENTRY(Kernel32_ReadConsoleInputA);
 DECLARE_WINAPI_ENTRY(Kernel32_ReadFile);
+DECLARE_WINAPI_ENTRY(Kernel32_ReleaseMutex);
+DECLARE_WINAPI_ENTRY(Kernel32_ReleaseSemaphore);
+DECLARE_WINAPI_ENTRY(Kernel32_ResetEvent);
 DECLARE_WINAPI_ENTRY(Kernel32_ResumeThread);
 DECLARE_WINAPI_ENTRY(Kernel32_RtlUnwind);
 DECLARE_WINAPI_ENTRY(Kernel32_SearchPathA);
@@ -223,8 +247,10 @@ DECLARE_WINAPI_ENTRY(Kernel32_SetFilePointer);
 DECLARE_WINAPI_ENTRY(Kernel32_SetHandleCount);
 DECLARE_WINAPI_ENTRY(Kernel32_SetLastError);
 DECLARE_WINAPI_ENTRY(Kernel32_SetUnhandledExceptionFilter);
+DECLARE_WINAPI_ENTRY(Kernel32_SetWaitableTimer);
 DECLARE_WINAPI_ENTRY(Kernel32_Sleep);
 DECLARE_WINAPI_ENTRY(Kernel32_SleepEx);
+DECLARE_WINAPI_ENTRY(Kernel32_SwitchToThread);
 DECLARE_WINAPI_ENTRY(Kernel32_TerminateProcess);
 DECLARE_WINAPI_ENTRY(Kernel32_Thread32First);
 DECLARE_WINAPI_ENTRY(Kernel32_Thread32Next);
@@ -232,10 +258,13 @@ DECLARE_WINAPI_ENTRY(Kernel32_TlsAlloc);
 DECLARE_WINAPI_ENTRY(Kernel32_TlsGetValue);
 DECLARE_WINAPI_ENTRY(Kernel32_TlsSetValue);
 DECLARE_WINAPI_ENTRY(Kernel32_TlsFree);
+DECLARE_WINAPI_ENTRY(Kernel32_TryEnterCriticalSection);
 DECLARE_WINAPI_ENTRY(Kernel32_UnhandledExceptionFilter);
 DECLARE_WINAPI_ENTRY(Kernel32_VirtualAlloc);
 DECLARE_WINAPI_ENTRY(Kernel32_VirtualFree);
+DECLARE_WINAPI_ENTRY(Kernel32_WaitForMultipleObjects);
 DECLARE_WINAPI_ENTRY(Kernel32_WaitForSingleObject);
+DECLARE_WINAPI_ENTRY(Kernel32_WaitForSingleObjectEx);
 DECLARE_WINAPI_ENTRY(Kernel32_WideCharToMultiByte);
 DECLARE_WINAPI_ENTRY(Kernel32_WinExec);
 DECLARE_WINAPI_ENTRY(Kernel32_WriteFile);
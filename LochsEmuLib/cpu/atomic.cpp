@@ -0,0 +1,303 @@
+#include "stdafx.h"
+#include "processor.h"
+#include "memory.h"
+#include "softtlb.h"
+#include <intrin.h>
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * LOCK-prefixed instructions run under the striped address locks of Memory
+ * covering their operand, so any two of them on one location exclude each
+ * other. Those with a host equivalent run as host atomics on the host
+ * address of the guest location, which also keeps them atomic against
+ * plain guest stores; anything else (other instructions, misaligned
+ * operands, pages without a host mapping) runs its normal handler.
+ */
+
+enum AtomicOp {
+    AtomicNone,
+    AtomicAdd,
+    AtomicSub,
+    AtomicOr,
+    AtomicAnd,
+    AtomicXor,
+    AtomicInc,
+    AtomicDec,
+    AtomicXadd,
+    AtomicXchg,
+    AtomicCmpxchg,
+    AtomicCmpxchg8b,
+};
+
+static AtomicOp DecodeAtomicOp( const Instruction *inst, u32 *size )
+{
+    static const AtomicOp GroupOps[8] = {
+        AtomicAdd, AtomicOr, AtomicNone, AtomicNone, AtomicAnd, AtomicSub, AtomicXor, AtomicNone,
+    };
+
+    const u32 opcode = inst->Main.Inst.Opcode;
+    const uint ext = MASK_MODRM_REG(inst->Aux.modrm);
+    *size = inst->Main.Prefix.OperandSize ? 2 : 4;
+    switch (opcode) {
+    case 0x00:  *size = 1;  // fall through
+    case 0x01:  return AtomicAdd;
+    case 0x08:  *size = 1;  // fall through
+    case 0x09:  return AtomicOr;
+    case 0x20:  *size = 1;  // fall through
+    case 0x21:  return AtomicAnd;
+    case 0x28:  *size = 1;  // fall through
+    case 0x29:  return AtomicSub;
+    case 0x30:  *size = 1;  // fall through
+    case 0x31:  return AtomicXor;
+    case 0x80:  *size = 1;  // fall through
+    case 0x81:
+    case 0x83:  return GroupOps[ext];
+    case 0x86:  *size = 1;  // fall through
+    case 0x87:  return AtomicXchg;
+    case 0xfe:  *size = 1;  // fall through
+    case 0xff:  return ext == 0 ? AtomicInc : ext == 1 ? AtomicDec : AtomicNone;
+    case 0x0fb0:*size = 1;  // fall through
+    case 0x0fb1:return AtomicCmpxchg;
+    case 0x0fc0:*size = 1;  // fall through
+    case 0x0fc1:return AtomicXadd;
+    case 0x0fc7:*size = 8;  return ext == 1 ? AtomicCmpxchg8b : AtomicNone;
+    default:    return AtomicNone;
+    }
+}
+
+static INLINE u32 HostLoad( pbyte p, u32 size )
+{
+    switch (size) {
+    case 1:     return *(volatile u8 *) p;
+    case 2:     return *(volatile u16 *) p;
+    default:    return *(volatile u32 *) p;
+    }
+}
+
+/* returns the previous value, like the Interlocked functions */
+static INLINE u32 HostCompareExchange( pbyte p, u32 size, u32 val, u32 comparand )
+{
+    switch (size) {
+    case 1:     return (u8) _InterlockedCompareExchange8((volatile char *) p, (char) val, (char) comparand);
+    case 2:     return (u16) _InterlockedCompareExchange16((volatile short *) p, (short) val, (short) comparand);
+    default:    return (u32) _InterlockedCompareExchange((volatile long *) p, (long) val, (long) comparand);
+    }
+}
+
+static INLINE u32 Truncate( u32 val, u32 size )
+{
+    return size == 4 ? val : val & ((1u << (size * 8)) - 1);
+}
+
+bool Processor::IsLocked( const Instruction *inst )
+{
+    if (inst->Main.Prefix.LockPrefix) return true;
+    // XCHG with a memory operand always asserts LOCK
+    const u32 opcode = inst->Main.Inst.Opcode;
+    return (opcode == 0x86 || opcode == 0x87) && IsMemoryArg(inst->Main.Argument1);
+}
+
+void Processor::ExecuteLocked( const Instruction *inst, InstHandler h )
+{
+    if (!IsMemoryArg(inst->Main.Argument1)) {
+        // nothing shared to lock
+        (this->*h)(inst);
+        return;
+    }
+
+    const Instruction::Operand *op = inst->OperandOf(inst->Main.Argument1);
+    u32 address = (op && op->Kind >= Instruction::Operand::KindMemDisp) ?
+        Offset32(*op) : Offset32(inst->Main.Argument1);
+    if (inst->Main.Prefix.FSPrefix) { address = GetFSOffset(address); }
+
+    // the access may straddle two lines; take both locks in a fixed order
+    u32 size = max(inst->Main.Argument1.ArgSize / 8, 1);
+    MutexCS &first = Mem->AddressLock(address);
+    MutexCS &last = Mem->AddressLock(address + size - 1);
+    MutexCSLock lock1(&first < &last ? first : last);
+    MutexCSLock lock2(&first < &last ? last : first);
+    if (ExecuteAtomic(inst, address)) return;
+    (this->*h)(inst);
+}
+
+pbyte Processor::AtomicHostPtr( u32 address, u32 size ) const
+{
+    // host interlocked operations need natural alignment, which also keeps
+    // the access within one page
+    if (address & (size - 1)) return NULL;
+
+    pbyte p = m_tlb ? m_tlb->LookupWrite(address, size) : Mem->MapWrite(address, size);
+    if (p) return p;
+
+    const Section *sec = Mem->GetSection(address);
+    if (sec == NULL || !sec->IsWritable(address)) return NULL;
+    return sec->GetRawData(address);
+}
+
+bool Processor::ExecuteAtomic( const Instruction *inst, u32 address )
+{
+    u32 size;
+    const AtomicOp op = DecodeAtomicOp(inst, &size);
+    if (op == AtomicNone) return false;
+
+    pbyte p = AtomicHostPtr(address, size);
+    if (p == NULL) return false;
+
+    if (op == AtomicCmpxchg8b) {
+        const u64 comparand = ((u64) EDX << 32) | EAX;
+        const u64 val = ((u64) ECX << 32) | EBX;
+        u64 old = (u64) _InterlockedCompareExchange64((volatile __int64 *) p, (__int64) val, (__int64) comparand);
+        NotifyMemRead(address, 8, (cpbyte) &old);
+        if (old == comparand) {
+            ZF = 1;
+            CheckCodeWrite(address, 8);
+            NotifyMemWrite(address, 8, (cpbyte) &val);
+        } else {
+            ZF = 0;
+            EDX = (u32) (old >> 32);
+            EAX = (u32) old;
+        }
+        return true;
+    }
+
+    // source operand
+    const u32 opcode = inst->Main.Inst.Opcode;
+    u32 src;
+    if (op == AtomicInc || op == AtomicDec) {
+        src = 1;
+    } else if (opcode == 0x83) {
+        src = SIGN_EXTEND(8, 32, inst->Main.Inst.Immediat);
+    } else if (opcode == 0x80 || opcode == 0x81) {
+        src = (u32) inst->Main.Inst.Immediat;
+    } else if (size == 1) {
+        src = ReadOperand8(inst, inst->Main.Argument2, NULL);
+    } else if (size == 2) {
+        src = ReadOperand16(inst, inst->Main.Argument2, NULL);
+    } else {
+        src = ReadOperand32(inst, inst->Main.Argument2, NULL);
+    }
+    src = Truncate(src, size);
+
+    u32 old, r;
+    bool written = true;
+    if (op == AtomicCmpxchg) {
+        const u32 comparand = Truncate(EAX, size);
+        old = HostCompareExchange(p, size, src, comparand);
+        r = src;
+        written = old == comparand;
+    } else if (size == 4 && op != AtomicOr && op != AtomicAnd && op != AtomicXor) {
+        // single host instruction for the common 32-bit forms
+        if (op == AtomicXchg) {
+            old = (u32) _InterlockedExchange((volatile long *) p, (long) src);
+            r = src;
+        } else {
+            u32 delta = (op == AtomicSub || op == AtomicDec) ? 0 - src : src;
+            old = (u32) _InterlockedExchangeAdd((volatile long *) p, (long) delta);
+            r = old + delta;
+        }
+    } else {
+        old = HostLoad(p, size);
+        for (;;) {
+            switch (op) {
+            case AtomicAdd:
+            case AtomicInc:
+            case AtomicXadd:    r = old + src; break;
+            case AtomicSub:
+            case AtomicDec:     r = old - src; break;
+            case AtomicOr:      r = old | src; break;
+            case AtomicAnd:     r = old & src; break;
+            case AtomicXor:     r = old ^ src; break;
+            default:            r = src; break;     // AtomicXchg
+            }
+            r = Truncate(r, size);
+            u32 prev = HostCompareExchange(p, size, r, old);
+            if (prev == old) break;
+            old = prev;
+        }
+    }
+
+    NotifyMemRead(address, size, (cpbyte) &old);
+    if (written) {
+        CheckCodeWrite(address, size);
+        NotifyMemWrite(address, size, (cpbyte) &r);
+    }
+
+    // flags and register results, as the plain handlers compute them
+    switch (op) {
+    case AtomicAdd:
+    case AtomicXadd:
+        if (size == 1) {
+            SetFlagsArith8((u8) r, PROMOTE_U16((u8) old) + PROMOTE_U16((u8) src),
+                PROMOTE_I16((u8) old) + PROMOTE_I16((u8) src));
+        } else if (size == 2) {
+            SetFlagsArith16((u16) r, PROMOTE_U32((u16) old) + PROMOTE_U32((u16) src),
+                PROMOTE_I32((u16) old) + PROMOTE_I32((u16) src));
+        } else {
+            SetFlagsArith32(r, PROMOTE_U64(old) + PROMOTE_U64(src), PROMOTE_I64(old) + PROMOTE_I64(src));
+        }
+        break;
+    case AtomicSub:
+        if (size == 1) {
+            SetFlagsArith8((u8) r, PROMOTE_U16((u8) old) - PROMOTE_U16((u8) src),
+                PROMOTE_I16((u8) old) - PROMOTE_I16((u8) src));
+        } else if (size == 2) {
+            SetFlagsArith16((u16) r, PROMOTE_U32((u16) old) - PROMOTE_U32((u16) src),
+                PROMOTE_I32((u16) old) - PROMOTE_I32((u16) src));
+        } else {
+            SetFlagsArith32(r, PROMOTE_U64(old) - PROMOTE_U64(src), PROMOTE_I64(old) - PROMOTE_I64(src));
+        }
+        break;
+    case AtomicOr:
+    case AtomicAnd:
+    case AtomicXor:
+        if (size == 1) {
+            SetFlagsLogic8((u8) r);
+        } else if (size == 2) {
+            SetFlagsLogic16((u16) r);
+        } else {
+            SetFlagsLogic32(r);
+        }
+        break;
+    case AtomicInc:
+    case AtomicDec:
+        // CF is left alone
+        if (size == 1) {
+            SetFlagsShift8((u8) r);
+            SetFlagOF8((u8) r, op == AtomicInc ? PROMOTE_I16((u8) old) + 1 : PROMOTE_I16((u8) old) - 1);
+        } else if (size == 2) {
+            SetFlagsShift16((u16) r);
+            SetFlagOF16((u16) r, op == AtomicInc ? PROMOTE_I32((u16) old) + 1 : PROMOTE_I32((u16) old) - 1);
+        } else {
+            SetFlagsShift32(r);
+            SetFlagOF32(r, op == AtomicInc ? PROMOTE_I64(old) + 1 : PROMOTE_I64(old) - 1);
+        }
+        break;
+    case AtomicCmpxchg:
+        ZF = written ? 1 : 0;
+        break;
+    default:
+        break;
+    }
+
+    if (op == AtomicXadd || op == AtomicXchg) {
+        if (size == 1) {
+            WriteOperand8(inst, inst->Main.Argument2, 0, (u8) old);
+        } else if (size == 2) {
+            WriteOperand16(inst, inst->Main.Argument2, 0, (u16) old);
+        } else {
+            WriteOperand32(inst, inst->Main.Argument2, 0, old);
+        }
+    } else if (op == AtomicCmpxchg && !written) {
+        if (size == 1) {
+            AL = (u8) old;
+        } else if (size == 2) {
+            AX = (u16) old;
+        } else {
+            EAX = old;
+        }
+    }
+    return true;
+}
+
+END_NAMESPACE_LOCHSEMU()
@@ -51,4 +51,22 @@ void Processor::Cmpxchg_0FB1(const Instruction *inst)
 }
 
 
+void Processor::Cmpxchg8b_0FC7_ext1(const Instruction *inst)
+{
+    /**
+     * CMPXCHG8B m64
+     */
+    u32 offset = 0;
+    u64 val1 = ReadOperand64(inst, inst->Main.Argument1, &offset);
+    u64 val2 = ((u64) EDX << 32) | EAX;
+    if (val1 == val2) {
+        ZF = 1;
+        WriteOperand64(inst, inst->Main.Argument1, offset, ((u64) ECX << 32) | EBX);
+    } else {
+        ZF = 0;
+        EDX = (u32) (val1 >> 32);
+        EAX = (u32) val1;
+    }
+}
+
 END_NAMESPACE_LOCHSEMU()
\ No newline at end of file
@@ -333,4 +333,19 @@ void Processor::Ext_0FBA(const Instruction *inst)
     return (this->*(handlers[MASK_MODRM_REG(inst->Aux.modrm)]))(inst);
 }
 
+void Processor::Ext_0FC7(const Instruction *inst)
+{
+    static InstHandler handlers[] = {
+        /* 0x0 */ &Processor::InstNotAvailable,
+        /* 0x1 */ &Processor::Cmpxchg8b_0FC7_ext1,
+        /* 0x2 */ &Processor::InstNotAvailable,
+        /* 0x3 */ &Processor::InstNotAvailable,
+        /* 0x4 */ &Processor::InstNotAvailable,
+        /* 0x5 */ &Processor::InstNotAvailable,
+        /* 0x6 */ &Processor::InstNotAvailable,
+        /* 0x7 */ &Processor::InstNotAvailable,
+    };
+    return (this->*(handlers[MASK_MODRM_REG(inst->Aux.modrm)]))(inst);
+}
+
 END_NAMESPACE_LOCHSEMU()
\ No newline at end of file
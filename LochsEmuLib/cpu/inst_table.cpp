@@ -140,7 +140,7 @@ Processor::InstHandler Processor::InstTableOneByte[] =
     /*0x83*/ &Processor::Ext_83,
     /*0x84*/ &Processor::Test_84,
     /*0x85*/ &Processor::Test_85,
-    /*0x86*/ &Processor::InstNotAvailable,
+    /*0x86*/ &Processor::Xchg_86,
     /*0x87*/ &Processor::Xchg_87,
     /*0x88*/ &Processor::Mov_88,
     /*0x89*/ &Processor::Mov_89,
@@ -459,14 +459,14 @@ Processor::InstHandler Processor::InstTableTwoBytes[] =
     /*0f bd*/ &Processor::Bsr_0FBD,
     /*0f be*/ &Processor::Movsx_0FBE,
     /*0f bf*/ &Processor::Movsx_0FBF,
-    /*0f c0*/ &Processor::InstNotAvailable,
+    /*0f c0*/ &Processor::Xadd_0FC0,
     /*0f c1*/ &Processor::Xadd_0FC1,
     /*0f c2*/ &Processor::InstNotAvailable,
     /*0f c3*/ &Processor::InstNotAvailable,
     /*0f c4*/ &Processor::InstNotAvailable,
     /*0f c5*/ &Processor::InstNotAvailable,
     /*0f c6*/ &Processor::InstNotAvailable,
-    /*0f c7*/ &Processor::InstNotAvailable,
+    /*0f c7*/ &Processor::Ext_0FC7,
     /*0f c8*/ &Processor::Bswap_0FC8,
     /*0f c9*/ &Processor::Bswap_0FC8,
     /*0f ca*/ &Processor::Bswap_0FC8,
@@ -0,0 +1,74 @@
+#include "stdafx.h"
+#include "processor.h"
+
+BEGIN_NAMESPACE_LOCHSEMU()
+
+/*
+ * One-byte opcodes which neither read EFLAGS nor write individual flags;
+ * pending lazy flags may stay pending across them.
+ * 0x80-0x83 are checked separately since ADC/SBB read CF
+ */
+static const bool LazyFlagsSafeOneByte[0x100] = {
+    /*       0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f */
+    /* 0 */  1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0,
+    /* 1 */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 2 */  1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0,
+    /* 3 */  1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0,
+    /* 4 */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 5 */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 6 */  0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0,
+    /* 7 */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 8 */  0, 0, 0, 0, 1, 1, 0, 0, 1, 1, 1, 1, 0, 1, 0, 0,
+    /* 9 */  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* a */  1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0,
+    /* b */  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* c */  0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* d */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* e */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* f */  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+bool Processor::IsLazyFlagsSafe( const Instruction *inst )
+{
+    const u32 opcode = inst->Main.Inst.Opcode;
+
+    // REP/REPNE iterations test ZF in Processor::Execute
+    if (inst->Main.Prefix.RepPrefix || inst->Main.Prefix.RepnePrefix) return false;
+
+    if (INST_ONEBYTE(opcode)) {
+        if (opcode >= 0x80 && opcode <= 0x83) {
+            uint ext = MASK_MODRM_REG(inst->Aux.modrm);
+            return ext != 2 && ext != 3;
+        }
+        return LazyFlagsSafeOneByte[opcode];
+    } else if (INST_TWOBYTE(opcode)) {
+        // MOVZX, MOVSX
+        return opcode == 0x0fb6 || opcode == 0x0fb7 || opcode == 0x0fbe || opcode == 0x0fbf;
+    }
+    return false;
+}
+
+void Processor::EvalLazyFlags( const LazyFlags &lf, u32 *cf, u32 *pf, u32 *zf, u32 *sf, u32 *of )
+{
+    Assert(lf.Size == 8 || lf.Size == 16 || lf.Size == 32);
+
+    i64 signedResult;
+    switch (lf.Size) {
+    case 8:     signedResult = PROMOTE_I64(PROMOTE_I32(PROMOTE_I16(lf.Result))); break;
+    case 16:    signedResult = PROMOTE_I64(PROMOTE_I32(lf.Result)); break;
+    default:    signedResult = PROMOTE_I64(lf.Result); break;
+    }
+
+    u8 low = (u8) lf.Result;
+    u8 parity = low ^ (low >> 4);
+    parity ^= parity >> 2;
+    parity ^= parity >> 1;
+
+    *cf = lf.UResult != (u64) lf.Result;
+    *of = lf.IResult != signedResult;
+    *zf = lf.Result == 0;
+    *sf = (lf.Result >> (lf.Size - 1)) & 1;
+    *pf = (parity & 1) == 0;
+}
+
+END_NAMESPACE_LOCHSEMU()
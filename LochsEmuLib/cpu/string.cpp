@@ -156,6 +156,115 @@ void Processor::Scasb_AE(const Instruction *inst)
     
 }
 
+bool Processor::IsBulkString( const Instruction *inst ) const
+{
+    if (!m_bulkStrings || DF != 0) return false;
+    if (inst->Main.Prefix.AddressSize) return false;
+    if (!inst->Main.Prefix.RepPrefix && !inst->Main.Prefix.RepnePrefix) return false;
+
+    switch (inst->Main.Inst.Opcode) {
+    case 0xa4: case 0xa5: case 0xaa: case 0xab:     // MOVS, STOS
+    case 0xa6: case 0xa7: case 0xae:                // CMPS, SCASB
+        return true;
+    default:
+        return false;
+    }
+}
+
+pbyte Processor::BulkStringPtr( u32 address, bool write ) const
+{
+    const Section *sec = Mem->GetSection(address);
+    if (sec == NULL) return NULL;
+    if (write ? !sec->IsWritable(address) : !sec->IsReadable(address)) return NULL;
+    return sec->GetRawData(address);
+}
+
+/*
+ * Elements of 'size' bytes starting at 'address' that fit in its page
+ */
+static INLINE u32 ElementsInPage(u32 address, u32 size)
+{
+    return (LX_PAGE_SIZE - PAGE_LOW(address)) / size;
+}
+
+/*
+ * Runs as many iterations of a REP string instruction as it can with host
+ * memcpy/memset/memcmp, one page-bounded chunk at a time. Whatever is left
+ * is stepped one iteration at a time by Execute: chunks stop short of any
+ * page the regular path would fault on or of an element straddling two
+ * pages, and CMPS/SCAS leave their terminating iteration (and the last
+ * one) to the real handler so ECX, ESI, EDI and the flags come out exactly
+ * as if every iteration had been stepped.
+ */
+void Processor::RepStringBulk( const Instruction *inst )
+{
+    const u32 opcode = inst->Main.Inst.Opcode;
+    const bool isByte = opcode == 0xa4 || opcode == 0xaa || opcode == 0xa6 || opcode == 0xae;
+    const u32 size = isByte ? 1 : (inst->Main.Prefix.OperandSize ? 2 : 4);
+    const bool isCompare = opcode == 0xa6 || opcode == 0xa7 || opcode == 0xae;
+    const bool usesSource = opcode == 0xa4 || opcode == 0xa5 || opcode == 0xa6 || opcode == 0xa7;
+    const bool whileEqual = inst->Main.Prefix.RepPrefix != 0;
+
+    while (ECX != 0) {
+        u32 n = min(ECX, ElementsInPage(EDI, size));
+        if (usesSource) n = min(n, ElementsInPage(ESI, size));
+        if (isCompare) n = min(n, ECX - 1);
+        if (n == 0) return;
+
+        const u32 nBytes = n * size;
+        pbyte dst = BulkStringPtr(EDI, !isCompare);
+        pbyte src = usesSource ? BulkStringPtr(ESI, false) : NULL;
+        if (dst == NULL || (usesSource && src == NULL)) return;
 
+        u32 done = n;
+        switch (opcode) {
+        case 0xa4: case 0xa5:
+            {
+                // forward copies onto themselves replicate a pattern
+                u32 dist = EDI - ESI;
+                if (dist != 0 && dist < nBytes) {
+                    done = dist / size;
+                    if (done == 0) return;
+                }
+                memmove(dst, src, done * size);
+                CheckCodeWrite(EDI, done * size);
+            } break;
+        case 0xaa:
+            memset(dst, AL, nBytes);
+            CheckCodeWrite(EDI, nBytes);
+            break;
+        case 0xab:
+            if (size == 2) {
+                for (u32 i = 0; i < n; i++) ((u16p) dst)[i] = AX;
+            } else {
+                for (u32 i = 0; i < n; i++) ((u32p) dst)[i] = EAX;
+            }
+            CheckCodeWrite(EDI, nBytes);
+            break;
+        case 0xa6: case 0xa7:
+            for (done = 0; done < n; done++) {
+                bool equal = memcmp(src + done * size, dst + done * size, size) == 0;
+                if (equal != whileEqual) break;
+            }
+            break;
+        case 0xae:
+            if (whileEqual) {
+                for (done = 0; done < n && dst[done] == AL; done++);
+            } else {
+                pbyte found = (pbyte) memchr(dst, AL, n);
+                done = found ? (u32) (found - dst) : n;
+            }
+            break;
+        default:
+            Assert(!"RepStringBulk() called on a non-string instruction");
+            return;
+        }
+
+        EDI += done * size;
+        if (usesSource) ESI += done * size;
+        ECX -= done;
+        if (isCompare && done < n) return;
+    }
+}
 
 END_NAMESPACE_LOCHSEMU()
\ No newline at end of file
@@ -3,6 +3,19 @@
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
+void Processor::Xadd_0FC0(const Instruction *inst)
+{
+    //XADD r/m8, r8
+    u32 offset = 0;
+    u8 val1 = ReadOperand8(inst, inst->Main.Argument1, &offset);
+    u8 val2 = ReadOperand8(inst, inst->Main.Argument2, NULL);
+    u8 r = val1 + val2;
+    SetFlagsArith8(r, PROMOTE_U16(val1) + PROMOTE_U16(val2), PROMOTE_I16(val1) + PROMOTE_I16(val2));
+
+    WriteOperand8(inst, inst->Main.Argument1, offset, r);
+    WriteOperand8(inst, inst->Main.Argument2, 0, val1);
+}
+
 void Processor::Xadd_0FC1(const Instruction *inst)
 {
 	//XADD r/m16/32, r16/32
@@ -3,6 +3,19 @@
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
+void Processor::Xchg_86(const Instruction *inst)
+{
+    /*
+     * XCHG r/m8, r8
+     * XCHG r8, r/m8
+     */
+    u32 offset1, offset2;
+    u8 val1 = ReadOperand8(inst, inst->Main.Argument1, &offset1);
+    u8 val2 = ReadOperand8(inst, inst->Main.Argument2, &offset2);
+    WriteOperand8(inst, inst->Main.Argument2, offset2, val1);
+    WriteOperand8(inst, inst->Main.Argument1, offset1, val2);
+}
+
 void Processor::Xchg_87(const Instruction *inst)
 {
     /*
@@ -8,6 +8,10 @@ void Processor::Fpu_Fadd32fp_D8_0(const Instruction *inst)
 {
 	// FADD m32fp
 	u32 val = ReadOperand32(inst, inst->Main.Argument2, NULL);
+	if (FPU()->IsSoftFloat()) {
+		FPU()->Soft()->ArithMem(SoftFpu::OpAdd, FPU()->Soft()->FromFloat32(val));
+		return;
+	}
 	FPU()->RestoreContext();
 	__asm fadd val;
 	FPU()->SaveContext();
@@ -18,6 +22,10 @@ void Processor::Fpu_Fadd_D8C0(const Instruction *inst)
 {
     // FADD ST(0), ST(i)
     int i = inst->Aux.opcode - 0xc0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpAdd, 0, i, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fadd st, st(0); 
@@ -46,6 +54,10 @@ void Processor::Fpu_Fadd_DC_0(const Instruction *inst)
 {
     // FADD m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpAdd, FPU()->Soft()->FromFloat64(val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fadd  val;
     FPU()->SaveContext();
@@ -56,6 +68,10 @@ void Processor::Fpu_Fadd_DCC0(const Instruction *inst)
 {
     // FADD ST(i), ST(0)
     int i = inst->Aux.opcode - 0xc0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpAdd, i, 0, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fadd st(0), st; 
@@ -85,6 +101,10 @@ void Processor::Fpu_Faddp_DEC0(const Instruction *inst)
 {
     // FADDP ST(i), ST(0)
     int i = inst->Aux.opcode - 0xc0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpAdd, i, 0, true);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm faddp st(0), st; 
@@ -8,6 +8,10 @@ void Processor::Fpu_Fcom_D8D0(const Instruction *inst)
 {
     // FCOM ST(0), ST(i)
     int i = inst->Aux.opcode - 0xd0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->CompareReg(i, false, 0);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
     case 0: __asm fcom st(0); 
@@ -35,6 +39,10 @@ void Processor::Fpu_Fcom_D8D0(const Instruction *inst)
 void Processor::Fpu_Fucompp_DAE9(const Instruction *inst)
 {
 	// FUCOMPP
+	if (FPU()->IsSoftFloat()) {
+		FPU()->Soft()->CompareReg(1, true, 2);
+		return;
+	}
 	FPU()->RestoreContext();
 	__asm fucompp;
 	FPU()->SaveContext();
@@ -44,6 +52,10 @@ void Processor::Fpu_Fucompp_DAE9(const Instruction *inst)
 void Processor::Fpu_Fucomi_DBE8(const Instruction *inst)
 {
     int i = inst->Aux.opcode - 0xe8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->CompareFlags(i, &ZF, &PF, &CF);
+        return;
+    }
     FPU()->RestoreContext();
 
     switch (i) {
@@ -73,6 +85,10 @@ void Processor::Fpu_Fcom_DC_2(const Instruction *inst)
 {
     // FCOM m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->CompareMem(FPU()->Soft()->FromFloat64(val), false, 0);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fcom      val;
     FPU()->SaveContext();
@@ -83,6 +99,10 @@ void Processor::Fpu_Fcomp_DC_3(const Instruction *inst)
 {
     // FCOMP m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->CompareMem(FPU()->Soft()->FromFloat64(val), false, 1);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fcomp     val;
     FPU()->SaveContext();
@@ -8,6 +8,10 @@ void Processor::Fpu_Fdiv32fp_D8_6(const Instruction *inst)
 {
     // FDIV m32fp
     u32 val = ReadOperand32(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpDiv, FPU()->Soft()->FromFloat32(val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fdiv  val;
     FPU()->SaveContext();
@@ -18,6 +22,10 @@ void Processor::Fpu_Fdiv_D8F0(const Instruction *inst)
 {
     // FDIV st(0), st(i)
     int i = inst->Aux.opcode - 0xf0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpDiv, 0, i, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fdiv st, st(0); 
@@ -47,6 +55,10 @@ void Processor::Fpu_Fidiv_DA_6(const Instruction *inst)
 {
     // FIDIV m32int
     u32 val = ReadOperand32(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpDiv, FPU()->Soft()->FromInt64((i32) val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fidiv     val;
     FPU()->SaveContext();
@@ -57,6 +69,10 @@ void Processor::Fpu_Fidiv_DE_6(const Instruction *inst)
 {
     // FIDIV m64int
     u16 val = ReadOperand16(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpDiv, FPU()->Soft()->FromInt64((i16) val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fidiv     val;
     FPU()->SaveContext();
@@ -67,6 +83,10 @@ void Processor::Fpu_Fdiv_DC_6(const Instruction *inst)
 {
     // FDIV m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpDiv, FPU()->Soft()->FromFloat64(val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fdiv  val;
     FPU()->SaveContext();
@@ -77,6 +97,10 @@ void Processor::Fpu_Fdivr_DC_7(const Instruction *inst)
 {
     // FDIVR m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpDivR, FPU()->Soft()->FromFloat64(val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fdivr     val;
     FPU()->SaveContext();
@@ -88,6 +112,10 @@ void Processor::Fpu_Fdivr_DCF0(const Instruction *inst)
 {
     // FDIVR st(i), st(0)
     int i = inst->Aux.opcode - 0xF0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpDivR, i, 0, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fdivr st(0), st; 
@@ -116,6 +144,10 @@ void Processor::Fpu_Fdiv_DCF8(const Instruction *inst)
 {
     // FDIV st(i), st(0)
     int i = inst->Aux.opcode - 0xF8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpDiv, i, 0, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fdiv st(0), st; 
@@ -145,6 +177,10 @@ void Processor::Fpu_Fdivp_DEF8(const Instruction *inst)
 {
     // FDIVP st(i), st(0)
     int i = inst->Aux.opcode - 0xF8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpDiv, i, 0, true);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fdivp st(0), st; 
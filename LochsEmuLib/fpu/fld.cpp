@@ -8,6 +8,10 @@ void Processor::Fpu_Fldcw_D9_5(const Instruction *inst)
 {
     // FLDCW
     u16 val = ReadOperand16(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->SetControlWord(val);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fldcw   val;
     FPU()->SaveContext();
@@ -18,6 +22,10 @@ void Processor::Fpu_Fld_D9C0(const Instruction *inst)
 {
     // FLD ST(i)
     int i = inst->Aux.opcode - 0xC0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadReg(i);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fld st(0); 
@@ -45,6 +53,10 @@ void Processor::Fpu_Fld_D9C0(const Instruction *inst)
 void Processor::Fpu_Fld1_D9E8(const Instruction *inst)
 {
     // FLD1
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadConst(SoftFpu::ConstOne);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fld1;
     FPU()->SaveContext();
@@ -54,6 +66,10 @@ void Processor::Fpu_Fld1_D9E8(const Instruction *inst)
 void Processor::Fpu_Fldl2t_D9E9(const Instruction *inst)
 {
     // FLDL2T
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadConst(SoftFpu::ConstL2T);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fldl2t;
     FPU()->SaveContext();
@@ -63,6 +79,10 @@ void Processor::Fpu_Fldl2t_D9E9(const Instruction *inst)
 void Processor::Fpu_Fldl2e_D9EA(const Instruction *inst)
 {
     // FLDL2E
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadConst(SoftFpu::ConstL2E);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fldl2e;
     FPU()->SaveContext();
@@ -72,6 +92,10 @@ void Processor::Fpu_Fldl2e_D9EA(const Instruction *inst)
 void Processor::Fpu_Fldpi_D9EB(const Instruction *inst)
 {
     // FLDPI
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadConst(SoftFpu::ConstPi);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fldpi;
     FPU()->SaveContext();
@@ -81,6 +105,10 @@ void Processor::Fpu_Fldpi_D9EB(const Instruction *inst)
 void Processor::Fpu_Fldlg2_D9EC(const Instruction *inst)
 {
     // FLDLG2
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadConst(SoftFpu::ConstLG2);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fldlg2;
     FPU()->SaveContext();
@@ -90,6 +118,10 @@ void Processor::Fpu_Fldlg2_D9EC(const Instruction *inst)
 void Processor::Fpu_Fldln2_D9ED(const Instruction *inst)
 {
     // FLDLN2
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadConst(SoftFpu::ConstLN2);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fldln2;
     FPU()->SaveContext();
@@ -99,6 +131,10 @@ void Processor::Fpu_Fldln2_D9ED(const Instruction *inst)
 void Processor::Fpu_Fldz_D9EE(const Instruction *inst)
 {
     // FLDZ
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadConst(SoftFpu::ConstZero);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fldz;
     FPU()->SaveContext();
@@ -109,6 +145,10 @@ void Processor::Fpu_Fild16_DF_0(const Instruction *inst)
 {
 	// FILD m16int
 	u16 val = ReadOperand16(inst, inst->Main.Argument2, NULL);
+	if (FPU()->IsSoftFloat()) {
+		FPU()->Soft()->LoadInt16((i16) val);
+		return;
+	}
 	FPU()->RestoreContext();
 	__asm fild val;
 	FPU()->SaveContext();
@@ -119,6 +159,10 @@ void Processor::Fpu_Fild32_DB_0(const Instruction *inst)
 {
     // FILD m32int
     u32 val = ReadOperand32(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadInt32((i32) val);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fild  val;
     FPU()->SaveContext();
@@ -129,6 +173,10 @@ void Processor::Fpu_Fild64_DF_5(const Instruction *inst)
 {
 	// FILD m64int
 	u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+	if (FPU()->IsSoftFloat()) {
+		FPU()->Soft()->LoadInt64((i64) val);
+		return;
+	}
 	FPU()->RestoreContext();
 	__asm fild val;
 	FPU()->SaveContext();
@@ -140,6 +188,10 @@ void Processor::Fpu_Fld80_DB_5(const Instruction *inst)
     // FLD m80fp
     u32 offset = Offset32(inst->Main.Argument2);
     pbyte dataPtr = Mem->GetRawData(offset);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadFloat80(dataPtr);
+        return;
+    }
     FPU()->RestoreContext();
     __asm {
         mov     eax, dataPtr
@@ -153,6 +205,10 @@ void Processor::Fpu_Fld64fp_DD_0(const Instruction *inst)
 {
     // FLD m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->LoadFloat64(val);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fld   val;
     FPU()->SaveContext();
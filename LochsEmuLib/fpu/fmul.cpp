@@ -8,6 +8,10 @@ void Processor::Fpu_Fmul_D8C8(const Instruction *inst)
 {
     // FMUL ST(0), ST(i)
     int i = inst->Aux.opcode - 0xc8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpMul, 0, i, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fmul st, st(0); 
@@ -37,6 +41,10 @@ void Processor::Fpu_Fmul_DC_1(const Instruction *inst)
 {
     // FMUL m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpMul, FPU()->Soft()->FromFloat64(val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fmul  val;
     FPU()->SaveContext();
@@ -47,6 +55,10 @@ void Processor::Fpu_Fmul_DCC8(const Instruction *inst)
 {
     // FMUL ST(i), ST(0)
     int i = inst->Aux.opcode - 0xc8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpMul, i, 0, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fmul st(0), st; 
@@ -75,6 +87,10 @@ void Processor::Fpu_Fmulp_DEC8(const Instruction *inst)
 {
     // FMUL st(i), st(0)
     int i = inst->Aux.opcode - 0xC8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpMul, i, 0, true);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fmulp st(0), st; 
@@ -7,6 +7,10 @@ BEGIN_NAMESPACE_LOCHSEMU()
 void Processor::Fpu_Fchs_D9E0(const Instruction *inst)
 {
     // FCHS
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->Chs();
+        return;
+    }
     FPU()->RestoreContext();
     __asm fchs;
     FPU()->SaveContext();
@@ -16,6 +20,10 @@ void Processor::Fpu_Fchs_D9E0(const Instruction *inst)
 void Processor::Fpu_Fabs_D9E1(const Instruction *inst)
 {
     // FABS
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->Abs();
+        return;
+    }
     FPU()->RestoreContext();
     __asm fabs;
     FPU()->SaveContext();
@@ -61,6 +69,10 @@ void Processor::Fpu_Fprem_D9F8(const Instruction *inst)
 void Processor::Fpu_Fsqrt_D9FA(const Instruction *inst)
 {
     // FSQRT
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->Sqrt();
+        return;
+    }
     FPU()->RestoreContext();
     __asm fsqrt;
     FPU()->SaveContext();
@@ -70,6 +82,10 @@ void Processor::Fpu_Fsqrt_D9FA(const Instruction *inst)
 void Processor::Fpu_Frndint_D9FC(const Instruction *inst)
 {
     // FRNDINT
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->RoundInt();
+        return;
+    }
     FPU()->RestoreContext();
     __asm frndint;
     FPU()->SaveContext();
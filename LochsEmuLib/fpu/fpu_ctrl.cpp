@@ -7,6 +7,10 @@ BEGIN_NAMESPACE_LOCHSEMU()
 void Processor::Fpu_Fxam_D9E5(const Instruction *inst)
 {
     // FXAM
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->Xam();
+        return;
+    }
     FPU()->RestoreContext();
     __asm fxam;
     FPU()->SaveContext();
@@ -36,6 +40,10 @@ void Processor::Fpu_Wait_9B(const Instruction *inst)
 
 void Processor::Emms_0F77(const Instruction *inst)
 {
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Context()->TagWord = 0xffff;
+        return;
+    }
     FPU()->RestoreContext();
     __asm emms;
     FPU()->SaveContext();
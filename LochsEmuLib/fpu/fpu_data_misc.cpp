@@ -8,6 +8,10 @@ void Processor::Fpu_Fxch_D9C8(const Instruction *inst)
 {
     // FXCH ST(i)
     int i = inst->Aux.opcode - 0xC8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->Xch(i);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fxch st(0); 
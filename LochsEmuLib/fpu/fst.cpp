@@ -9,6 +9,10 @@ void Processor::Fpu_Fstcw_D9_7(const Instruction *inst)
     // FSTCW m2byte
     u32 offset = Offset32(inst->Main.Argument1);
     u16 ctrl;
+    if (FPU()->IsSoftFloat()) {
+        MemWrite16(offset, FPU()->Soft()->ControlWord(), LX_REG_DS);
+        return;
+    }
     FPU()->RestoreContext();
     __asm fstcw     ctrl;
     FPU()->SaveContext();
@@ -19,6 +23,10 @@ void Processor::Fpu_Fstsw_DFE0(const Instruction *inst)
 {
     // FSTSW AX
     u16 status;
+    if (FPU()->IsSoftFloat()) {
+        AX = FPU()->Soft()->StatusWord();
+        return;
+    }
     FPU()->RestoreContext();
     __asm {
         fstsw ax
@@ -33,6 +41,10 @@ void Processor::Fpu_Fst64fp_DD_2(const Instruction *inst)
     // FST m64fp
     u32 offset = Offset32(inst->Main.Argument1);
     u64 val;
+    if (FPU()->IsSoftFloat()) {
+        WriteOperand64(inst, inst->Main.Argument1, offset, FPU()->Soft()->StoreFloat64(false));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fst   val;
     FPU()->SaveContext();
@@ -44,6 +56,10 @@ void Processor::Fpu_Fstp64fp_DD_3(const Instruction *inst)
     // FSTP m64fp
     u32 offset = Offset32(inst->Main.Argument1);
     u64 val;
+    if (FPU()->IsSoftFloat()) {
+        WriteOperand64(inst, inst->Main.Argument1, offset, FPU()->Soft()->StoreFloat64(true));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fstp  val;
     FPU()->SaveContext();
@@ -55,6 +71,10 @@ void Processor::Fpu_Fstsw_DD_7(const Instruction *inst)
     // FSTSW m2byte
     u32 offset = Offset32(inst->Main.Argument1);
     u16 status;
+    if (FPU()->IsSoftFloat()) {
+        MemWrite16(offset, FPU()->Soft()->StatusWord());
+        return;
+    }
     FPU()->RestoreContext();
     __asm fstsw     status;
     FPU()->SaveContext();
@@ -65,6 +85,10 @@ void Processor::Fpu_Fstp_DDD8(const Instruction *inst)
 {
     // FSTP ST(i)
     int i = inst->Aux.opcode - 0xd8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->StoreReg(i, true);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fstp st(0); 
@@ -93,6 +117,10 @@ void Processor::Fpu_Fistp32_DB_3(const Instruction *inst)
 	// FISTP m32int
 	u32 offset = Offset32(inst->Main.Argument1);
 	u32 val;
+	if (FPU()->IsSoftFloat()) {
+		WriteOperand32(inst, inst->Main.Argument1, offset, FPU()->Soft()->StoreInt32(true));
+		return;
+	}
 	FPU()->RestoreContext();
 	__asm fistp val;
 	FPU()->SaveContext();
@@ -104,6 +132,10 @@ void Processor::Fpu_Fistp64int_DF_7(const Instruction *inst)
     // FISTP m64int
     u32 offset = Offset32(inst->Main.Argument1);
     u64 val;
+    if (FPU()->IsSoftFloat()) {
+        WriteOperand64(inst, inst->Main.Argument1, offset, FPU()->Soft()->StoreInt64(true));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fistp val;
     FPU()->SaveContext();
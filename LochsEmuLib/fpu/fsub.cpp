@@ -8,6 +8,10 @@ void Processor::Fpu_Fsub_D8E0(const Instruction *inst)
 {
     // FSUB ST(0), ST(i)
     int i = inst->Aux.opcode - 0xe0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpSub, 0, i, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fsub st, st(0); 
@@ -36,6 +40,10 @@ void Processor::Fpu_Fsubr_D8E8(const Instruction *inst)
 {
     // FSUBR ST(0), ST(i)
     int i = inst->Aux.opcode - 0xe8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpSubR, 0, i, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fsubr st, st(0); 
@@ -64,6 +72,10 @@ void Processor::Fpu_Fsub_DC_4(const Instruction *inst)
 {
     // FSUB m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpSub, FPU()->Soft()->FromFloat64(val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fsub      val;
     FPU()->SaveContext();
@@ -74,6 +86,10 @@ void Processor::Fpu_Fsubr_DC_5(const Instruction *inst)
 {
     // FSUBR m64fp
     u64 val = ReadOperand64(inst, inst->Main.Argument2, NULL);
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithMem(SoftFpu::OpSubR, FPU()->Soft()->FromFloat64(val));
+        return;
+    }
     FPU()->RestoreContext();
     __asm fsubr     val;
     FPU()->SaveContext();
@@ -84,6 +100,10 @@ void Processor::Fpu_Fsubr_DCE0(const Instruction *inst)
 {
     // FSUBR ST(i), ST(0)
     int i = inst->Aux.opcode - 0xe0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpSubR, i, 0, false);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fsubr st(0), st; 
@@ -112,6 +132,10 @@ void Processor::Fpu_Fsubrp_DEE0(const Instruction *inst)
 {
     // FSUBRP ST(i), ST(0)
     int i = inst->Aux.opcode - 0xe0;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpSubR, i, 0, true);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fsubrp st(0), st; 
@@ -140,6 +164,10 @@ void Processor::Fpu_Fsubp_DEE8(const Instruction *inst)
 {
     // FSUBP ST(i), ST(0)
     int i = inst->Aux.opcode - 0xe8;
+    if (FPU()->IsSoftFloat()) {
+        FPU()->Soft()->ArithReg(SoftFpu::OpSub, i, 0, true);
+        return;
+    }
     FPU()->RestoreContext();
     switch (i) {
         case 0: __asm fsubp st(0), st; 
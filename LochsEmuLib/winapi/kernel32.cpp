@@ -5,9 +5,103 @@
 #include "heap.h"
 #include "process.h"
 #include "config.h"
+#include "syncmgr.h"
+#include "scheduler.h"
 
 BEGIN_NAMESPACE_LOCHSEMU()
 
+/* names of emulated objects are kept as ANSI strings */
+static LPCSTR NarrowName( LPCWSTR name, char *buf, int size )
+{
+    if (name == NULL) return NULL;
+    if (!LxWideToByte(name, buf, size - 1)) {
+        LxWarning("Object name too long, creating an unnamed object instead\n");
+        return NULL;
+    }
+    return buf;
+}
+
+/* result of a SyncManager wait, retried later when a pooled thread blocks */
+static uint WaitResult( Processor *cpu, u32 r, uint nParams )
+{
+    if (r == SyncManager::WaitPending) return WinAPIRetry;
+    RET_VALUE = r;
+    RET_PARAMS(nParams);
+}
+
+/*
+ * Host I/O cannot signal an emulated event, so OVERLAPPED.hEvent is swapped
+ * for a host event during the call and a thread pool wait passes its signal
+ * on once the I/O completes
+ */
+struct OverlappedRelay {
+    SyncManager *   Sync;
+    HANDLE          Emulated;
+    HANDLE          Host;
+    HANDLE          Wait;
+};
+
+static VOID CALLBACK RelayOverlapped( PVOID lpParam, BOOLEAN timedOut )
+{
+    OverlappedRelay *r = (OverlappedRelay *) lpParam;
+    r->Sync->SetEvent(r->Emulated);
+    r->Sync->Close(r->Emulated);
+    UnregisterWait(r->Wait);
+    CloseHandle(r->Host);
+    delete r;
+}
+
+static OverlappedRelay * BeginOverlapped( Processor *cpu, LPOVERLAPPED lpOverlapped )
+{
+    if (lpOverlapped == NULL || !SyncManager::IsEmulatedHandle(lpOverlapped->hEvent)) return NULL;
+
+    // like the kernel, hold on to the event until the I/O completes
+    SyncManager *sync = cpu->Proc()->Sync();
+    if (!sync->Retain(lpOverlapped->hEvent)) return NULL;
+    sync->ResetEvent(lpOverlapped->hEvent);
+
+    OverlappedRelay *r = new OverlappedRelay;
+    r->Sync     = sync;
+    r->Emulated = lpOverlapped->hEvent;
+    r->Host     = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (r->Host == NULL || !RegisterWaitForSingleObject(&r->Wait, r->Host, RelayOverlapped, r,
+        INFINITE, WT_EXECUTEONLYONCE)) 
+    {
+        LxWarning("Cannot relay overlapped I/O to emulated event %x\n", r->Emulated);
+        if (r->Host) CloseHandle(r->Host);
+        sync->Close(r->Emulated);
+        delete r;
+        return NULL;
+    }
+    lpOverlapped->hEvent = r->Host;
+    return r;
+}
+
+static void EndOverlapped( LPOVERLAPPED lpOverlapped, OverlappedRelay *r, BOOL result )
+{
+    if (r == NULL) return;
+    DWORD lastError = GetLastError();
+    lpOverlapped->hEvent = r->Emulated;
+    if (!result && lastError != ERROR_IO_PENDING) {
+        // nothing is going to signal the host event
+        UnregisterWaitEx(r->Wait, INVALID_HANDLE_VALUE);
+        CloseHandle(r->Host);
+        r->Sync->Close(r->Emulated);
+        delete r;
+    }
+    SetLastError(lastError);
+}
+
+/* give up the rest of the time slice */
+static void YieldThread( Processor *cpu )
+{
+    if (Scheduler::Current() == cpu->Thr()) {
+        cpu->YieldSlice();
+    } else {
+        SwitchToThread();
+    }
+}
+
 
 
 
@@ -35,9 +129,21 @@ uint Kernel32_AddAtomA(Processor *cpu)
 	RET_PARAMS(1);
 }
 
+uint Kernel32_CancelWaitableTimer(Processor *cpu)
+{
+    RET_VALUE = (u32) cpu->Proc()->Sync()->CancelTimer(
+        (HANDLE)    PARAM(0)
+        );
+    RET_PARAMS(1);
+}
+
 uint Kernel32_CloseHandle(Processor *cpu)
 {
     HANDLE h = (HANDLE) cpu->GetStackParam32(0);
+    if (SyncManager::IsEmulatedHandle(h)) {
+        cpu->EAX = (u32) cpu->Proc()->Sync()->Close(h);
+        return 1;
+    }
     cpu->EAX = (u32) CloseHandle(h);
 
     LxWarning("CloseHandle() is called\n");
@@ -65,13 +171,9 @@ uint Kernel32_CompareStringW(Processor *cpu)
 
 uint Kernel32_CreateEventA(Processor *cpu)
 {
-    if (PARAM_PTR(0) != 0) {
-        LxFatal("SecurityAttributes in CreateEventA() is not NULL\n");
-    }
-    RET_VALUE = (u32) CreateEventA(
-        NULL,
-        (BOOL)      PARAM(1),
-        (BOOL)      PARAM(2),
+    RET_VALUE = (u32) cpu->Proc()->Sync()->NewEvent(
+        PARAM(1) != 0,
+        PARAM(2) != 0,
         (LPCSTR)    PARAM_PTR(3)
         );
     RET_PARAMS(4);
@@ -79,14 +181,11 @@ uint Kernel32_CreateEventA(Processor *cpu)
 
 uint Kernel32_CreateEventW(Processor *cpu)
 {
-    if (PARAM_PTR(0) != 0) {
-        LxFatal("SecurityAttributes in CreateEventW() is not NULL\n");
-    }
-    RET_VALUE = (u32) CreateEventW(
-        NULL,
-        (BOOL)      PARAM(1),
-        (BOOL)      PARAM(2),
-        (LPCWSTR)    PARAM_PTR(3)
+    char name[MAX_PATH];
+    RET_VALUE = (u32) cpu->Proc()->Sync()->NewEvent(
+        PARAM(1) != 0,
+        PARAM(2) != 0,
+        NarrowName((LPCWSTR) PARAM_PTR(3), name, MAX_PATH)
         );
     RET_PARAMS(4);
 }
@@ -130,6 +229,27 @@ uint Kernel32_CreateFileW(Processor *cpu)
     RET_PARAMS(7);
 }
 
+uint Kernel32_CreateMutexA(Processor *cpu)
+{
+    RET_VALUE = (u32) cpu->Proc()->Sync()->NewMutex(
+        cpu->Thr(),
+        PARAM(1) != 0,
+        (LPCSTR)    PARAM_PTR(2)
+        );
+    RET_PARAMS(3);
+}
+
+uint Kernel32_CreateMutexW(Processor *cpu)
+{
+    char name[MAX_PATH];
+    RET_VALUE = (u32) cpu->Proc()->Sync()->NewMutex(
+        cpu->Thr(),
+        PARAM(1) != 0,
+        NarrowName((LPCWSTR) PARAM_PTR(2), name, MAX_PATH)
+        );
+    RET_PARAMS(3);
+}
+
 uint kernel32_CreateProcessA(Processor *cpu)
 {
 	LPSTARTUPINFOA si = (LPSTARTUPINFOA) PARAM_PTR(8);
@@ -158,13 +278,23 @@ uint kernel32_CreateProcessA(Processor *cpu)
 
 uint Kernel32_CreateSemaphoreA(Processor *cpu)
 {
-	RET_VALUE = (u32) CreateSemaphoreA(
-		(LPSECURITY_ATTRIBUTES) PARAM(0),
-		(LONG) PARAM(1),
-		(LONG) PARAM(2),
-		(LPCSTR) PARAM_PTR(3)
-		);
-	RET_PARAMS(4);
+    RET_VALUE = (u32) cpu->Proc()->Sync()->NewSemaphore(
+        (i32)       PARAM(1),
+        (i32)       PARAM(2),
+        (LPCSTR)    PARAM_PTR(3)
+        );
+    RET_PARAMS(4);
+}
+
+uint Kernel32_CreateSemaphoreW(Processor *cpu)
+{
+    char name[MAX_PATH];
+    RET_VALUE = (u32) cpu->Proc()->Sync()->NewSemaphore(
+        (i32)       PARAM(1),
+        (i32)       PARAM(2),
+        NarrowName((LPCWSTR) PARAM_PTR(3), name, MAX_PATH)
+        );
+    RET_PARAMS(4);
 }
 
 uint Kernel32_CreateToolhelp32Snapshot(Processor *cpu)
@@ -197,6 +327,25 @@ uint Kernel32_CreateThread(Processor *cpu)
     RET_PARAMS(6);
 }
 
+uint Kernel32_CreateWaitableTimerA(Processor *cpu)
+{
+    RET_VALUE = (u32) cpu->Proc()->Sync()->NewTimer(
+        PARAM(1) != 0,
+        (LPCSTR)    PARAM_PTR(2)
+        );
+    RET_PARAMS(3);
+}
+
+uint Kernel32_CreateWaitableTimerW(Processor *cpu)
+{
+    char name[MAX_PATH];
+    RET_VALUE = (u32) cpu->Proc()->Sync()->NewTimer(
+        PARAM(1) != 0,
+        NarrowName((LPCWSTR) PARAM_PTR(2), name, MAX_PATH)
+        );
+    RET_PARAMS(3);
+}
+
 uint Kernel32_DecodePointer(Processor *cpu)
 {
     RET_VALUE = (u32) DecodePointer(
@@ -207,10 +356,7 @@ uint Kernel32_DecodePointer(Processor *cpu)
 
 uint Kernel32_DeleteCriticalSection(Processor *cpu)
 {
-    LPCRITICAL_SECTION x = (LPCRITICAL_SECTION) PARAM_PTR(0);
-    DeleteCriticalSection(
-        (LPCRITICAL_SECTION)    PARAM_PTR(0)
-        );
+    cpu->Proc()->Sync()->DeleteCriticalSection(PARAM(0));
     RET_PARAMS(1);
 }
 
@@ -239,10 +385,8 @@ uint Kernel32_EncodePointer(Processor *cpu)
 
 uint Kernel32_EnterCriticalSection(Processor *cpu)
 {
-    LPCRITICAL_SECTION x = (LPCRITICAL_SECTION) PARAM_PTR(0);
-    EnterCriticalSection(
-        (LPCRITICAL_SECTION)    PARAM_PTR(0)
-        );
+    u32 r = cpu->Proc()->Sync()->EnterCriticalSection(cpu->Thr(), PARAM(0));
+    if (r == SyncManager::WaitPending) return WinAPIRetry;
     RET_PARAMS(1);
 }
 
@@ -254,7 +398,7 @@ uint Kernel32_ExitProcess( Processor *cpu )
 
 uint Kernel32_ExitThread(Processor *cpu)
 {
-    ThreadID id = GetCurrentThreadId();
+    ThreadID id = cpu->Thr()->ExtID;
 
     u32 exitCode = (u32) PARAM(0);
 
@@ -576,6 +720,23 @@ uint Kernel32_GetExitCodeProcess(Processor *cpu)
 	RET_PARAMS(2);
 }
 
+uint Kernel32_GetExitCodeThread(Processor *cpu)
+{
+    // threads run by the Scheduler have emulated handles
+    if (SyncManager::IsEmulatedHandle((HANDLE) PARAM(0))) {
+        RET_VALUE = (u32) cpu->Proc()->Sync()->GetExitCode(
+            (HANDLE)    PARAM(0),
+            (u32 *)     PARAM_PTR(1)
+            );
+        RET_PARAMS(2);
+    }
+    RET_VALUE = (u32) GetExitCodeThread(
+        (HANDLE)    PARAM(0),
+        (LPDWORD)   PARAM_PTR(1)
+        );
+    RET_PARAMS(2);
+}
+
 uint Kernel32_GetFileAttributesA(Processor *cpu)
 {
 	RET_VALUE = (u32) GetFileAttributesA((LPCSTR) PARAM_PTR(0));
@@ -783,9 +944,13 @@ uint Kernel32_GetStringTypeW(Processor *cpu)
 
 uint Kernel32_GetSystemTimeAsFileTime(Processor *cpu)
 {
-    GetSystemTimeAsFileTime(
-        (LPFILETIME)    PARAM_PTR(0)
-        );
+    LPFILETIME lpTime = (LPFILETIME) PARAM_PTR(0);
+    GetSystemTimeAsFileTime(lpTime);
+    // virtual time runs ahead of the host clock by the skipped waits
+    u64 t = ((u64) lpTime->dwHighDateTime << 32) | lpTime->dwLowDateTime;
+    t += cpu->Proc()->Sync()->Skew() * 10000;
+    lpTime->dwHighDateTime  = (DWORD) (t >> 32);
+    lpTime->dwLowDateTime   = (DWORD) t;
     RET_PARAMS(1);
 }
 
@@ -801,6 +966,19 @@ uint Kernel32_GetTempPathA(Processor *cpu)
 
 uint Kernel32_GetThreadTimes(Processor *cpu)
 {
+    if (SyncManager::IsEmulatedHandle((HANDLE) PARAM(0))) {
+        // a pooled thread has no host thread of its own to account to
+        u32 exitCode;
+        if (!cpu->Proc()->Sync()->GetExitCode((HANDLE) PARAM(0), &exitCode)) {
+            RET_VALUE = FALSE;
+            RET_PARAMS(5);
+        }
+        for (int i = 1; i <= 4; i++) {
+            ZeroMemory(PARAM_PTR(i), sizeof(FILETIME));
+        }
+        RET_VALUE = TRUE;
+        RET_PARAMS(5);
+    }
     RET_VALUE = (u32) GetThreadTimes(
         (HANDLE)        PARAM(0),
         (LPFILETIME)    PARAM_PTR(1),
@@ -813,13 +991,15 @@ uint Kernel32_GetThreadTimes(Processor *cpu)
 
 uint Kernel32_GetTickCount(Processor *cpu)
 {
-    RET_VALUE = (u32) GetTickCount();
+    RET_VALUE = (u32) cpu->Proc()->Sync()->Now();
     RET_PARAMS(0);
 }
 
 uint Kernel32_GetTickCount64(Processor *cpu)
 {
-    RET_VALUE = (u32) GetTickCount64();
+    u64 t = cpu->Proc()->Sync()->Now();
+    RET_VALUE = (u32) t;
+    cpu->EDX = (u32) (t >> 32);
     RET_PARAMS(0);
 }
 
@@ -1044,31 +1224,47 @@ uint Kernel32_HeapSize(Processor *cpu)
     RET_PARAMS(3);
 }
 
+uint Kernel32_HeapWalk(Processor *cpu)
+{
+    HANDLE hHeap = (HANDLE) PARAM(0);
+    LPPROCESS_HEAP_ENTRY lpEntry = (LPPROCESS_HEAP_ENTRY) PARAM_PTR(1);
+
+    SyncObjectLock lock(*cpu->Mem);
+
+    Heap *h = LxEmulator.Proc()->GetHeap((u32) hHeap);
+    Assert(h);
+    u32 addr, size;
+    if (h->HeapWalk((u32) lpEntry->lpData, &addr, &size)) {
+        // only busy blocks are reported; overhead lives on the host side
+        ZeroMemory(lpEntry, sizeof(PROCESS_HEAP_ENTRY));
+        lpEntry->lpData     = (PVOID) addr;
+        lpEntry->cbData     = size;
+        lpEntry->wFlags     = PROCESS_HEAP_ENTRY_BUSY;
+        RET_VALUE = TRUE;
+    } else {
+        SetLastError(ERROR_NO_MORE_ITEMS);
+        RET_VALUE = FALSE;
+    }
+    RET_PARAMS(2);
+}
+
 uint Kernel32_InitializeCriticalSection(Processor *cpu)
 {
-	InitializeCriticalSection(
-		(LPCRITICAL_SECTION)	PARAM_PTR(0)
-		);
-	RET_PARAMS(1);
+    cpu->Proc()->Sync()->InitCriticalSection(PARAM(0), 0);
+    RET_PARAMS(1);
 }
 
 uint Kernel32_InitializeCriticalSectionAndSpinCount( Processor *cpu )
 {
-    LPCRITICAL_SECTION x = (LPCRITICAL_SECTION) PARAM_PTR(0);
-    RET_VALUE = (u32) InitializeCriticalSectionAndSpinCount(
-        (LPCRITICAL_SECTION)    PARAM_PTR(0),
-        (DWORD)                 PARAM(1)
-        );
+    cpu->Proc()->Sync()->InitCriticalSection(PARAM(0), PARAM(1));
+    RET_VALUE = TRUE;
     RET_PARAMS(2);
 }
 
 uint Kernel32_InitializeCriticalSectionEx(Processor *cpu)
 {
-    RET_VALUE = (u32) InitializeCriticalSectionEx(
-        (LPCRITICAL_SECTION)    PARAM_PTR(0),
-        (DWORD)                 PARAM(1),
-        (DWORD)                 PARAM(2)
-        );
+    cpu->Proc()->Sync()->InitCriticalSection(PARAM(0), PARAM(1));
+    RET_VALUE = TRUE;
     RET_PARAMS(3);
 }
 
@@ -1230,9 +1426,7 @@ uint Kernel32_LCMapStringW(Processor *cpu)
 
 uint Kernel32_LeaveCriticalSection(Processor *cpu)
 {
-    LeaveCriticalSection(
-        (LPCRITICAL_SECTION)    PARAM_PTR(0)
-        );
+    cpu->Proc()->Sync()->LeaveCriticalSection(cpu->Thr(), PARAM(0));
     RET_PARAMS(1);
 }
 
@@ -1362,7 +1556,19 @@ uint Kernel32_Process32Next(Processor *cpu)
 
 uint Kernel32_QueryPerformanceCounter(Processor *cpu)
 {
-    RET_VALUE = (u32) QueryPerformanceCounter(
+    LARGE_INTEGER *lpCount = (LARGE_INTEGER *) PARAM_PTR(0);
+    RET_VALUE = (u32) QueryPerformanceCounter(lpCount);
+    if (RET_VALUE) {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        lpCount->QuadPart += (LONGLONG) cpu->Proc()->Sync()->Skew() * freq.QuadPart / 1000;
+    }
+    RET_PARAMS(1);
+}
+
+uint Kernel32_QueryPerformanceFrequency(Processor *cpu)
+{
+    RET_VALUE = (u32) QueryPerformanceFrequency(
         (LARGE_INTEGER *)   PARAM_PTR(0)
         );
     RET_PARAMS(1);
@@ -1392,12 +1598,61 @@ uint Kernel32_ReadFile(Processor *cpu)
     DWORD nNumToRead = (DWORD) cpu->GetStackParam32(2);
     LPDWORD nNumRead = (LPDWORD) cpu->GetStackParamPtr32(3);
     LPOVERLAPPED lpOverlapped = (LPOVERLAPPED) cpu->GetStackParamPtr32(4);
+    OverlappedRelay *relay = BeginOverlapped(cpu, lpOverlapped);
     cpu->EAX = (u32) ReadFile(hFile, lpBuffer, nNumToRead, nNumRead, lpOverlapped);
+    EndOverlapped(lpOverlapped, relay, (BOOL) cpu->EAX);
     return 5;
 }
 
+uint Kernel32_ReleaseMutex(Processor *cpu)
+{
+    if (!SyncManager::IsEmulatedHandle((HANDLE) PARAM(0))) {
+        RET_VALUE = (u32) ReleaseMutex((HANDLE) PARAM(0));
+        RET_PARAMS(1);
+    }
+    RET_VALUE = (u32) cpu->Proc()->Sync()->ReleaseMutex(
+        cpu->Thr(),
+        (HANDLE)    PARAM(0)
+        );
+    RET_PARAMS(1);
+}
+
+uint Kernel32_ReleaseSemaphore(Processor *cpu)
+{
+    if (!SyncManager::IsEmulatedHandle((HANDLE) PARAM(0))) {
+        RET_VALUE = (u32) ReleaseSemaphore(
+            (HANDLE)    PARAM(0),
+            (LONG)      PARAM(1),
+            (LPLONG)    PARAM_PTR(2)
+            );
+        RET_PARAMS(3);
+    }
+    RET_VALUE = (u32) cpu->Proc()->Sync()->ReleaseSemaphore(
+        (HANDLE)    PARAM(0),
+        (i32)       PARAM(1),
+        (i32 *)     PARAM_PTR(2)
+        );
+    RET_PARAMS(3);
+}
+
+uint Kernel32_ResetEvent(Processor *cpu)
+{
+    if (!SyncManager::IsEmulatedHandle((HANDLE) PARAM(0))) {
+        RET_VALUE = (u32) ResetEvent((HANDLE) PARAM(0));
+        RET_PARAMS(1);
+    }
+    RET_VALUE = (u32) cpu->Proc()->Sync()->ResetEvent(
+        (HANDLE)    PARAM(0)
+        );
+    RET_PARAMS(1);
+}
+
 uint Kernel32_ResumeThread(Processor *cpu)
 {
+    if (cpu->Proc()->ThreadResume((HANDLE) PARAM(0))) {
+        RET_VALUE = 1;      // previous suspend count
+        RET_PARAMS(1);
+    }
     RET_VALUE = (u32) ResumeThread(
         (HANDLE)        PARAM(0)
         );
@@ -1484,7 +1739,11 @@ uint Kernel32_SetErrorMode(Processor *cpu)
 
 uint Kernel32_SetEvent(Processor *cpu)
 {
-    RET_VALUE = (u32) SetEvent(
+    if (!SyncManager::IsEmulatedHandle((HANDLE) PARAM(0))) {
+        RET_VALUE = (u32) SetEvent((HANDLE) PARAM(0));
+        RET_PARAMS(1);
+    }
+    RET_VALUE = (u32) cpu->Proc()->Sync()->SetEvent(
         (HANDLE)    PARAM(0)
         );
     RET_PARAMS(1);
@@ -1533,23 +1792,50 @@ uint Kernel32_SetUnhandledExceptionFilter(Processor *cpu)
     RET_PARAMS(1);
 }
 
-uint Kernel32_Sleep(Processor *cpu)
+uint Kernel32_SetWaitableTimer(Processor *cpu)
 {
-    Sleep(
-        (DWORD) PARAM(0)
+    const LARGE_INTEGER *lpDueTime = (const LARGE_INTEGER *) PARAM_PTR(1);
+    if (PARAM(3) != 0) {
+        LxWarning("Completion routine of SetWaitableTimer() is ignored\n");
+    }
+    RET_VALUE = (u32) cpu->Proc()->Sync()->SetTimer(
+        (HANDLE)    PARAM(0),
+        (i64)       lpDueTime->QuadPart,
+        (u32)       PARAM(2)
         );
+    RET_PARAMS(6);
+}
+
+uint Kernel32_Sleep(Processor *cpu)
+{
+    u32 ms = PARAM(0);
+    if (ms == 0) {
+        YieldThread(cpu);
+    } else if (cpu->Proc()->Sync()->Sleep(cpu->Thr(), ms) == SyncManager::WaitPending) {
+        return WinAPIRetry;
+    }
     RET_PARAMS(1);
 }
 
 uint Kernel32_SleepEx(Processor *cpu)
 {
-    RET_VALUE = (u32) SleepEx(
-        (DWORD)     PARAM(0),
-        (BOOL)      PARAM(1)
-        );
+    u32 ms = PARAM(0);
+    if (ms == 0) {
+        YieldThread(cpu);
+    } else if (cpu->Proc()->Sync()->Sleep(cpu->Thr(), ms) == SyncManager::WaitPending) {
+        return WinAPIRetry;
+    }
+    RET_VALUE = 0;
     RET_PARAMS(2);
 }
 
+uint Kernel32_SwitchToThread(Processor *cpu)
+{
+    YieldThread(cpu);
+    RET_VALUE = TRUE;
+    RET_PARAMS(0);
+}
+
 uint Kernel32_TerminateProcess(Processor *cpu)
 {
     HANDLE hCurrProc = GetCurrentProcess();
@@ -1614,6 +1900,12 @@ uint Kernel32_TlsSetValue(Processor *cpu)
     RET_PARAMS(2);
 }
 
+uint Kernel32_TryEnterCriticalSection(Processor *cpu)
+{
+    RET_VALUE = (u32) cpu->Proc()->Sync()->TryEnterCriticalSection(cpu->Thr(), PARAM(0));
+    RET_PARAMS(1);
+}
+
 uint Kernel32_UnhandledExceptionFilter(Processor *cpu)
 {
 //     struct _EXCEPTION_POINTERS *p = (struct _EXCEPTION_POINTERS *)PARAM_PTR(0);
@@ -1703,9 +1995,36 @@ uint Kernel32_VirtualFree(Processor *cpu)
     return 3;
 }
 
+uint Kernel32_WaitForMultipleObjects(Processor *cpu)
+{
+    u32 count = PARAM(0);
+    const HANDLE *handles = (const HANDLE *) PARAM_PTR(1);
+    bool waitAll = PARAM(2) != 0;
+    u32 timeout = PARAM(3);
+
+    u32 emulated = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (SyncManager::IsEmulatedHandle(handles[i])) emulated++;
+    }
+    if (emulated == 0) {
+        RET_VALUE = (u32) WaitForMultipleObjects(count, handles, waitAll, timeout);
+        RET_PARAMS(4);
+    }
+    if (emulated != count) {
+        LxWarning("WaitForMultipleObjects() on both host and emulated objects\n");
+        SetLastError(ERROR_INVALID_HANDLE);
+        RET_VALUE = WAIT_FAILED;
+        RET_PARAMS(4);
+    }
+    return WaitResult(cpu, cpu->Proc()->Sync()->Wait(cpu->Thr(), handles, count, waitAll, timeout), 4);
+}
+
 uint Kernel32_WaitForSingleObject(Processor *cpu)
 {
     HANDLE hObj = (HANDLE) PARAM(0);
+    if (SyncManager::IsEmulatedHandle(hObj)) {
+        return WaitResult(cpu, cpu->Proc()->Sync()->Wait(cpu->Thr(), &hObj, 1, false, PARAM(1)), 2);
+    }
 
 	RET_VALUE = (u32) WaitForSingleObject(
 		hObj,
@@ -1714,6 +2033,21 @@ uint Kernel32_WaitForSingleObject(Processor *cpu)
 	RET_PARAMS(2);
 }
 
+uint Kernel32_WaitForSingleObjectEx(Processor *cpu)
+{
+    HANDLE hObj = (HANDLE) PARAM(0);
+    if (SyncManager::IsEmulatedHandle(hObj)) {
+        return WaitResult(cpu, cpu->Proc()->Sync()->Wait(cpu->Thr(), &hObj, 1, false, PARAM(1)), 3);
+    }
+
+    RET_VALUE = (u32) WaitForSingleObjectEx(
+        hObj,
+        (DWORD)     PARAM(1),
+        (BOOL)      PARAM(2)
+        );
+    RET_PARAMS(3);
+}
+
 uint Kernel32_WideCharToMultiByte(Processor *cpu)
 {
     RET_VALUE = (u32) WideCharToMultiByte(
@@ -1744,7 +2078,9 @@ uint Kernel32_WriteFile(Processor *cpu)
     DWORD nNumToWrite = (DWORD) cpu->GetStackParam32(2);
     LPDWORD nNumWritten = (LPDWORD) cpu->GetStackParamPtr32(3);
     LPOVERLAPPED lpOverlapped = (LPOVERLAPPED) cpu->GetStackParamPtr32(4);
+    OverlappedRelay *relay = BeginOverlapped(cpu, lpOverlapped);
     cpu->EAX = (u32) WriteFile(hFile, lpBuffer, nNumToWrite, nNumWritten, lpOverlapped);
+    EndOverlapped(lpOverlapped, relay, (BOOL) cpu->EAX);
     return 5;
 }
 
@@ -36,6 +36,7 @@ PROPHET_API void LochsEmu_Thread_Exit               (Thread *thrd);
 // dbg
 class ProDebugger;
 struct TraceContext;
+struct TraceRecord;
 class ProTracer;
 struct Breakpoint;
 class CallStack;
@@ -77,10 +78,12 @@ class WinapiPostCallEvent;
 class Protocol;
 class Message;
 class MessageManager;
+class AnalysisJob;
 struct TContext;
 class RunTrace;
 class ProtocolAnalyzer;
 class TraceAnalyzer;
+class AnalyzerProfile;
 class ProcScope;
 class CallStack;
 class MessageFieldFormat;
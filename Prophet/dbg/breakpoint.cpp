@@ -28,3 +28,21 @@ void Breakpoint::Deserialize( Json::Value &root )
     Desc          = root.get("desc", "invalid").asString();
     Enabled       = root.get("enabled", true).asBool();
 }
+
+void Watchpoint::Serialize( Json::Value &root ) const
+{
+    root["address"]     = Address;
+    root["length"]      = Length;
+    root["on_read"]     = OnRead;
+    root["on_write"]    = OnWrite;
+    root["desc"]        = Desc;
+}
+
+void Watchpoint::Deserialize( Json::Value &root )
+{
+    Address     = root.get("address", 0).asUInt();
+    Length      = root.get("length", 0).asUInt();
+    OnRead      = root.get("on_read", false).asBool();
+    OnWrite     = root.get("on_write", true).asBool();
+    Desc        = root.get("desc", "invalid").asString();
+}
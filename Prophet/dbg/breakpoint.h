@@ -26,6 +26,50 @@ struct Breakpoint : public ISerializable {
     std::string ModuleName;
 };
 
+struct Watchpoint : public ISerializable {
+    u32         Address;
+    u32         Length;
+    bool        OnRead;
+    bool        OnWrite;
+    std::string Desc;
+
+    Watchpoint() : Address(0), Length(0), OnRead(false), OnWrite(true), Desc("invalid") {}
+    Watchpoint(u32 addr, u32 len, bool onRead, bool onWrite, const std::string &desc)
+        : Address(addr), Length(len), OnRead(onRead), OnWrite(onWrite), Desc(desc) {}
+
+    void        Serialize(Json::Value &root) const override;
+    void        Deserialize(Json::Value &root) override;
+
+    bool        Overlaps(u32 addr, u32 len) const {
+        return addr < Address + Length && Address < addr + len;
+    }
+};
+
+/*
+ * One bit per 4K page of the guest address space, so the debugger can
+ * skip its breakpoint lookups for the vast majority of addresses.
+ */
+class PageBitmap {
+public:
+    PageBitmap() : m_bits(PageCount / 32) {}
+
+    void        Clear() { std::fill(m_bits.begin(), m_bits.end(), 0); }
+    void        Set(u32 addr, u32 len) {
+        for (u32 page = addr >> 12; page <= (addr + len - 1) >> 12; page++)
+            m_bits[page / 32] |= 1u << (page % 32);
+    }
+    bool        Test(u32 addr) const {
+        u32 page = addr >> 12;
+        return (m_bits[page / 32] & (1u << (page % 32))) != 0;
+    }
+    bool        Test(u32 addr, u32 len) const {
+        return Test(addr) || Test(addr + len - 1);
+    }
+private:
+    static const u32 PageCount = 0x100000;
+    std::vector<u32>    m_bits;
+};
+
 
  
 #endif // __PROPHET_DBG_BREAKPOINT_H__
\ No newline at end of file
@@ -17,6 +17,7 @@ ProDebugger::ProDebugger(ProEngine *engine) : m_engine(engine)
     m_archive = m_engine->GetArchive();
     m_currTid = 0;  // Main thread
     m_switchThreadOnBreak = true;
+    m_maxWatchLength = 0;
 
     ZeroMemory(m_threads, sizeof(m_threads));
 
@@ -161,6 +162,9 @@ void ProDebugger::AddBreakpoint( u32 eip, const std::string &desc )
     {
         SyncObjectLock lock(*m_archive);
         m_breakpoints.push_back(bp);
+        if (m_bpIndex.find(eip) == m_bpIndex.end())
+            m_bpIndex[eip] = (int) m_breakpoints.size() - 1;
+        m_bpPages.Set(eip, 1);
     }
 }
 
@@ -168,11 +172,11 @@ void ProDebugger::ToggleBreakpoint(u32 eip)
 {
     SyncObjectLock lock(*m_archive);
 
-    for (auto &bp : m_breakpoints) {
-        if (bp.Address == eip) {
-            bp.Enabled = !bp.Enabled;       // toggle existing breakpoint
-            return;
-        }
+    auto iter = m_bpIndex.find(eip);
+    if (iter != m_bpIndex.end()) {
+        Breakpoint &bp = m_breakpoints[iter->second];
+        bp.Enabled = !bp.Enabled;       // toggle existing breakpoint
+        return;
     }
 
     AddBreakpoint(eip, "user");
@@ -181,35 +185,98 @@ void ProDebugger::ToggleBreakpoint(u32 eip)
 void ProDebugger::RemoveBreakpoint(u32 eip)
 {
     SyncObjectLock lock(*m_archive);
-    auto iter = m_breakpoints.begin();
-    for (; iter != m_breakpoints.end(); iter++) {
-        if (iter->Address == eip) {
-            m_breakpoints.erase(iter);
-            break;
-        }
-    }
+    auto iter = m_bpIndex.find(eip);
+    if (iter == m_bpIndex.end()) return;
+    m_breakpoints.erase(m_breakpoints.begin() + iter->second);
+    RebuildBreakpointIndex();
 }
 
 const Breakpoint * ProDebugger::GetBreakpoint( u32 eip ) const
 {
-    for (auto &bp : m_breakpoints) {
-        if (bp.Address == eip) 
-            return &bp;
+    if (!m_bpPages.Test(eip)) return NULL;
+    SyncObjectLock lock(*m_archive);
+    auto iter = m_bpIndex.find(eip);
+    return iter == m_bpIndex.end() ? NULL : &m_breakpoints[iter->second];
+}
+
+void ProDebugger::RebuildBreakpointIndex()
+{
+    m_bpIndex.clear();
+    m_bpPages.Clear();
+    for (int i = (int) m_breakpoints.size() - 1; i >= 0; i--) {
+        m_bpIndex[m_breakpoints[i].Address] = i;    // the first one of an address wins
+        m_bpPages.Set(m_breakpoints[i].Address, 1);
     }
-    return NULL;
 }
 
 void ProDebugger::CheckBreakpoints( const Processor *cpu, const Instruction *inst )
 {
-    for (auto &bp : m_breakpoints) {
-        if (cpu->EIP == bp.Address && bp.Enabled) {
-            m_state[cpu->IntID] = STATE_SINGLESTEP;
-            if (m_switchThreadOnBreak) {
-                SetCurrentThread(cpu->IntID);
-            }
+    // most pages hold no breakpoint at all, no need to lock for them
+    if (!m_bpPages.Test(cpu->EIP)) return;
+
+    bool hit = false;
+    {
+        SyncObjectLock lock(*m_archive);
+        auto iter = m_bpIndex.find(cpu->EIP);
+        hit = iter != m_bpIndex.end() && m_breakpoints[iter->second].Enabled;
+    }
+    if (hit) BreakOn(cpu);
+}
+
+void ProDebugger::BreakOn( const Processor *cpu )
+{
+    m_state[cpu->IntID] = STATE_SINGLESTEP;
+    if (m_switchThreadOnBreak) {
+        SetCurrentThread(cpu->IntID);
+    }
+}
+
+void ProDebugger::AddWatchpoint( u32 addr, u32 len, bool onRead, bool onWrite, const std::string &desc )
+{
+    Assert(len > 0);
+    SyncObjectLock lock(*m_archive);
+    m_watchpoints.insert(std::make_pair(addr, Watchpoint(addr, len, onRead, onWrite, desc)));
+    m_maxWatchLength = max(m_maxWatchLength, len);
+    m_watchPages.Set(addr, len);
+}
+
+void ProDebugger::RemoveWatchpoint( u32 addr )
+{
+    SyncObjectLock lock(*m_archive);
+    m_watchpoints.erase(addr);
+    RebuildWatchpointIndex();
+}
+
+void ProDebugger::RebuildWatchpointIndex()
+{
+    m_maxWatchLength = 0;
+    m_watchPages.Clear();
+    for (auto &w : m_watchpoints) {
+        m_maxWatchLength = max(m_maxWatchLength, w.second.Length);
+        m_watchPages.Set(w.second.Address, w.second.Length);
+    }
+}
+
+void ProDebugger::CheckWatchpoints( const Processor *cpu, u32 addr, u32 len, bool isWrite )
+{
+    if (m_state[cpu->IntID] == STATE_RUNNING_NOBP) return;
+
+    bool hit = false;
+    {
+        SyncObjectLock lock(*m_archive);
+        // only watchpoints starting within m_maxWatchLength before addr can overlap it
+        u32 lowest  = addr >= m_maxWatchLength ? addr - m_maxWatchLength + 1 : 0;
+        auto end    = m_watchpoints.upper_bound(addr + len - 1);
+        for (auto iter = m_watchpoints.lower_bound(lowest); iter != end; ++iter) {
+            const Watchpoint &w = iter->second;
+            if (!w.Overlaps(addr, len) || !(isWrite ? w.OnWrite : w.OnRead)) continue;
+            LxInfo("Watchpoint %s: %s %08x at %08x\n", w.Desc.c_str(), 
+                isWrite ? "write to" : "read from", addr, cpu->GetPrevEip());
+            hit = true;
             break;
         }
     }
+    if (hit) BreakOn(cpu);
 }
 
 void ProDebugger::DoPreExecSingleStep( const Processor *cpu, const Instruction *inst )
@@ -238,6 +305,7 @@ void ProDebugger::OnProcessPostLoad( ProcessPostLoadEvent &event )
             bp.ModuleName = minfo->Name;
             bp.Address = minfo->ImageBase + bp.Offset;
         }
+        RebuildBreakpointIndex();
     }
 }
 
@@ -286,33 +354,27 @@ void ProDebugger::UpdateInstContext( const Processor *cpu, InstContext *ctx ) co
     ctx->ExternalTid = cpu->Thr()->ExtID;
 }
 
-void ProDebugger::UpdateTraceContext( const Processor *cpu, TraceContext *ctx, u32 eip ) const
+void ProDebugger::UpdateTraceRecord( const Processor *cpu, TraceRecord *rec, u32 eip ) const
 {
     Assert(m_cpu[cpu->IntID] != NULL);
     for (int i = 0; i < InstContext::RegCount; i++) {
-        ctx->Regs[i]        = m_cpu[cpu->IntID]->GP_Regs[i].X32;
+        rec->Regs[i]        = m_cpu[cpu->IntID]->GP_Regs[i].X32;
     }
-    ctx->Eip                = eip;
-
-    ctx->Flags[InstContext::OF]         = m_cpu[cpu->IntID]->OF;
-    ctx->Flags[InstContext::SF]         = m_cpu[cpu->IntID]->SF;
-    ctx->Flags[InstContext::ZF]         = m_cpu[cpu->IntID]->ZF;
-    ctx->Flags[InstContext::AF]         = m_cpu[cpu->IntID]->AF;
-    ctx->Flags[InstContext::PF]         = m_cpu[cpu->IntID]->PF;
-    ctx->Flags[InstContext::CF]         = m_cpu[cpu->IntID]->CF;
-
-    uint module             = m_cpu[cpu->IntID]->GetModule(eip);
-    const ModuleInfo *minfo = m_cpu[cpu->IntID]->Proc()->GetModuleInfo(module);
-    ctx->ModuleName         = minfo->Name;
-    ctx->ModuleImageBase    = minfo->ImageBase;
+    rec->Eip                = eip;
 
-    ctx->MRs = m_mrs[cpu->IntID];
-    ctx->MWs = m_mws[cpu->IntID];
+    u32 flags               = 0;
+    flags                  |= m_cpu[cpu->IntID]->OF << InstContext::OF;
+    flags                  |= m_cpu[cpu->IntID]->SF << InstContext::SF;
+    flags                  |= m_cpu[cpu->IntID]->ZF << InstContext::ZF;
+    flags                  |= m_cpu[cpu->IntID]->AF << InstContext::AF;
+    flags                  |= m_cpu[cpu->IntID]->PF << InstContext::PF;
+    flags                  |= m_cpu[cpu->IntID]->CF << InstContext::CF;
+    rec->Flags              = (u8) flags;
 
-    ctx->Tid = cpu->IntID;
-    ctx->ExternalTid = cpu->Thr()->ExtID;
-    ctx->JumpTaken = Instruction::IsConditionalJump(ctx->Inst) ? 
-        m_cpu[cpu->IntID]->IsJumpTaken(ctx->Inst) : false;
+    rec->Tid = cpu->IntID;
+    rec->ExternalTid = cpu->Thr()->ExtID;
+    rec->JumpTaken = Instruction::IsConditionalJump(rec->Inst) ? 
+        m_cpu[cpu->IntID]->IsJumpTaken(rec->Inst) : false;
 }
 
 
@@ -334,16 +396,15 @@ void ProDebugger::UpdateTContext( const Processor *cpu, TContext *ctx ) const
     ctx->Eflags |= GET_FLAG(CF);
     ctx->Eflags |= GET_FLAG(DF);
 
-    if (m_mrs[cpu->IntID].size() > 0) {
-        //if (m_mrs[cpu->IntID].size() > 1) 
-        //    LxWarning("len(MRs) > 1 at %08x, %s\n", cpu->EIP, ctx->Inst->Main.CompleteInstr);
-        ctx->Mr = m_mrs[cpu->IntID][0];
-    }
-    if (m_mws[cpu->IntID].size() > 0) {
-        //if (m_mws[cpu->IntID].size() > 1) 
-        //    LxWarning("len(MWs) > 1 at %08x, %s\n", cpu->EIP, ctx->Inst->Main.CompleteInstr);
-        ctx->Mw = m_mws[cpu->IntID][0];
-    }
+    const std::vector<MemAccess> &mrs = m_mrs[cpu->IntID];
+    const std::vector<MemAccess> &mws = m_mws[cpu->IntID];
+    // valid until the thread's next instruction, RunTrace copies what it keeps
+    ctx->ReadCount = (int) mrs.size();
+    ctx->Reads = mrs.empty() ? NULL : &mrs[0];
+    ctx->WriteCount = (int) mws.size();
+    ctx->Writes = mws.empty() ? NULL : &mws[0];
+    ctx->Mr = ctx->ReadCount > 0 ? ctx->Reads[0] : MemAccess();
+    ctx->Mw = ctx->WriteCount > 0 ? ctx->Writes[0] : MemAccess();
     ctx->Tid = cpu->IntID;
     ctx->ExtTid = cpu->Thr()->ExtID;
     ctx->ExecFlag = cpu->GetExecFlag();
@@ -363,7 +424,15 @@ void ProDebugger::Serialize( Json::Value &root ) const
         bps.append(b);
     }
 
+    Json::Value wps;
+    for (auto &w : m_watchpoints) {
+        Json::Value v;
+        w.second.Serialize(v);
+        wps.append(v);
+    }
+
     root["breakpoints"]     = bps;
+    root["watchpoints"]     = wps;
     root["switch_thread_on_break"] = m_switchThreadOnBreak;
 }
 
@@ -378,6 +447,14 @@ void ProDebugger::Deserialize( Json::Value &root )
         }
     }
 
+    Json::Value wps = root["watchpoints"];
+    for (uint i = 0; i < wps.size(); i++) {
+        Watchpoint w;
+        w.Deserialize(wps[i]);
+        if (w.Length == 0) continue;
+        AddWatchpoint(w.Address, w.Length, w.OnRead, w.OnWrite, w.Desc);
+    }
+
     m_switchThreadOnBreak = root.get("switch_thread_on_break", 
         m_switchThreadOnBreak).asBool();
 }
@@ -390,6 +467,9 @@ void ProDebugger::SetState( int tid, State s )
 
 void ProDebugger::OnMemRead( MemReadEvent &event )
 {
+    if (m_watchPages.Test(event.Addr, event.NBytes))
+        CheckWatchpoints(event.Cpu, event.Addr, event.NBytes, false);
+
     if (event.NBytes == 4) {
         m_mrs[event.Cpu->IntID].emplace_back(event.Addr, 4, *((u32p) event.Data));
     } else if (event.NBytes == 1) {
@@ -411,6 +491,9 @@ void ProDebugger::OnMemRead( MemReadEvent &event )
 
 void ProDebugger::OnMemWrite( MemWriteEvent &event )
 {
+    if (m_watchPages.Test(event.Addr, event.NBytes))
+        CheckWatchpoints(event.Cpu, event.Addr, event.NBytes, true);
+
     if (event.NBytes == 4) {
         m_mws[event.Cpu->IntID].emplace_back(event.Addr, 4, *((u32p) event.Data));
     } else if (event.NBytes == 1) {
@@ -58,17 +58,25 @@ public:
     const Breakpoint * GetBreakpoint(u32 eip) const;
     const Breakpoint & GetBreakpointIndex(int index) const { return m_breakpoints[index]; }
     int         GetNumBreakpoints() const { return (int) m_breakpoints.size(); }
+    void        AddWatchpoint(u32 addr, u32 len, bool onRead, bool onWrite, const std::string &desc);
+    void        RemoveWatchpoint(u32 addr);
     void        OnTerminate();
 
     void        UpdateInstContext(const Processor *cpu, InstContext *ctx) const;
-    void        UpdateTraceContext(const Processor *cpu, TraceContext *ctx, u32 eip) const;
+    void        UpdateTraceRecord(const Processor *cpu, TraceRecord *rec, u32 eip) const;
     void        UpdateTContext(const Processor *cpu, TContext *ctx) const;
+    const std::vector<MemAccess> &  GetMemReads(const Processor *cpu) const { return m_mrs[cpu->IntID]; }
+    const std::vector<MemAccess> &  GetMemWrites(const Processor *cpu) const { return m_mws[cpu->IntID]; }
 
     void        Serialize(Json::Value &root) const override;
     void        Deserialize(Json::Value &root) override;
 private:
     void        DoPreExecSingleStep(const Processor *cpu, const Instruction *inst);
     void        CheckBreakpoints(const Processor *cpu, const Instruction *inst);
+    void        CheckWatchpoints(const Processor *cpu, u32 addr, u32 len, bool isWrite);
+    void        BreakOn(const Processor *cpu);
+    void        RebuildBreakpointIndex();
+    void        RebuildWatchpointIndex();
 private:
     ProEngine *         m_engine;
     Archive *           m_archive;
@@ -82,6 +90,11 @@ private:
     const Instruction * m_currInst[MaxThreads];
 
     std::vector<Breakpoint>     m_breakpoints;
+    std::unordered_map<u32, int>    m_bpIndex;      // address -> index in m_breakpoints
+    PageBitmap                  m_bpPages;
+    std::multimap<u32, Watchpoint>  m_watchpoints;  // by start address
+    u32                         m_maxWatchLength;
+    PageBitmap                  m_watchPages;
     std::vector<MemAccess>      m_mrs[MaxThreads];
     std::vector<MemAccess>      m_mws[MaxThreads];
 
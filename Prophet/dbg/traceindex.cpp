@@ -0,0 +1,134 @@
+#include "stdafx.h"
+#include "traceindex.h"
+#include "tracer.h"
+
+TraceIndex::TraceIndex()
+{
+    m_window    = 0;
+    m_oldest    = 0;
+    m_nextSweep = 0;
+}
+
+void TraceIndex::Reset( int window )
+{
+    m_window    = window;
+    m_oldest    = 0;
+    m_nextSweep = window;
+    m_reads.clear();
+    m_writes.clear();
+    m_eips.clear();
+    m_values.clear();
+    m_threads.clear();
+}
+
+void TraceIndex::Add( i64 pos, const TraceRecord &rec, const MemAccess *mrs, int nmr,
+                      const MemAccess *mws, int nmw )
+{
+    m_oldest = max(m_oldest, pos - m_window + 1);
+
+    Insert(m_eips, rec.Eip, pos);
+    for (int i = 0; i < nmr; i++) {
+        Insert(m_reads, mrs[i].Addr, pos);
+        if (mrs[i].Len == 4) Insert(m_values, mrs[i].Val, pos);
+    }
+    for (int i = 0; i < nmw; i++) {
+        Insert(m_writes, mws[i].Addr, pos);
+        if (mws[i].Len == 4) Insert(m_values, mws[i].Val, pos);
+    }
+
+    // registers are only indexed when they change, which is rarely more than one per instruction
+    auto iter = m_threads.find(rec.Tid);
+    bool isNew = iter == m_threads.end();
+    if (isNew) iter = m_threads.insert(std::make_pair(rec.Tid, ThreadState())).first;
+    ThreadState &t = iter->second;
+    for (int r = 0; r < InstContext::RegCount; r++) {
+        if (!isNew && t.Regs[r] == rec.Regs[r]) continue;
+        t.Regs[r] = rec.Regs[r];
+        Insert(t.RegWrites[r], pos);
+        Insert(m_values, rec.Regs[r], pos);
+    }
+    Insert(t.Positions, pos);
+
+    if (pos >= m_nextSweep) {
+        Sweep();
+        m_nextSweep = pos + m_window;
+    }
+}
+
+void TraceIndex::Insert( PosList &list, i64 pos )
+{
+    // positions come in order, the same one once per access of an instruction
+    Prune(list);
+    if (list.empty() || list.back() < pos) list.push_back(pos);
+}
+
+void TraceIndex::Prune( PosList &list ) const
+{
+    while (!list.empty() && list.front() < m_oldest) list.pop_front();
+}
+
+i64 TraceIndex::FindPrev( const PosList &list, i64 before ) const
+{
+    auto iter = std::lower_bound(list.begin(), list.end(), before);
+    if (iter == list.begin()) return -1;
+    --iter;
+    return *iter >= m_oldest ? *iter : -1;
+}
+
+i64 TraceIndex::FindNext( const PosList &list, i64 after ) const
+{
+    auto iter = std::upper_bound(list.begin(), list.end(), max(after, m_oldest - 1));
+    return iter == list.end() ? -1 : *iter;
+}
+
+i64 TraceIndex::FindPrev( const PosMap &map, u32 key, i64 before ) const
+{
+    auto iter = map.find(key);
+    return iter == map.end() ? -1 : FindPrev(iter->second, before);
+}
+
+i64 TraceIndex::FindNext( const PosMap &map, u32 key, i64 after ) const
+{
+    auto iter = map.find(key);
+    return iter == map.end() ? -1 : FindNext(iter->second, after);
+}
+
+i64 TraceIndex::FindPrevRegWrite( int tid, int reg, i64 before ) const
+{
+    Assert(reg >= 0 && reg < InstContext::RegCount);
+    auto iter = m_threads.find(tid);
+    return iter == m_threads.end() ? -1 : FindPrev(iter->second.RegWrites[reg], before);
+}
+
+void TraceIndex::GetThreadStarts( std::vector<i64> &starts ) const
+{
+    starts.clear();
+    for (auto &t : m_threads) {
+        i64 pos = FindNext(t.second.Positions, m_oldest - 1);
+        if (pos != -1) starts.push_back(pos);
+    }
+}
+
+void TraceIndex::Sweep( PosMap &map ) const
+{
+    for (auto iter = map.begin(); iter != map.end(); ) {
+        if (iter->second.empty() || iter->second.back() < m_oldest) {
+            iter = map.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void TraceIndex::Sweep()
+{
+    Sweep(m_reads);
+    Sweep(m_writes);
+    Sweep(m_eips);
+    Sweep(m_values);
+    for (auto &t : m_threads) {
+        for (int r = 0; r < InstContext::RegCount; r++)
+            Prune(t.second.RegWrites[r]);
+        Prune(t.second.Positions);
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef __PROPHET_TRACEINDEX_H__
+#define __PROPHET_TRACEINDEX_H__
+
+#include "prophet.h"
+#include "instcontext.h"
+
+struct TraceRecord;
+
+/*
+ * Lookup tables over the trace ring, fed in ring order by the tracer.
+ * Everything is addressed by ring position and each list is sorted, so
+ * queries are binary searches. Positions that fell out of the ring are
+ * dropped lazily, and the tables are swept once per ring's worth of traces.
+ */
+class TraceIndex {
+public:
+    TraceIndex();
+
+    void        Reset(int window);
+    void        Add(i64 pos, const TraceRecord &rec, const MemAccess *mrs, int nmr,
+                    const MemAccess *mws, int nmw);
+
+    /* all return a position, -1 if there is none */
+    i64         FindPrevRead(u32 addr, i64 before) const { return FindPrev(m_reads, addr, before); }
+    i64         FindNextRead(u32 addr, i64 after) const { return FindNext(m_reads, addr, after); }
+    i64         FindPrevWrite(u32 addr, i64 before) const { return FindPrev(m_writes, addr, before); }
+    i64         FindNextWrite(u32 addr, i64 after) const { return FindNext(m_writes, addr, after); }
+    i64         FindPrevEip(u32 eip, i64 before) const { return FindPrev(m_eips, eip, before); }
+    i64         FindNextEip(u32 eip, i64 after) const { return FindNext(m_eips, eip, after); }
+    i64         FindPrevRegWrite(int tid, int reg, i64 before) const;
+    /* first position a value was loaded into a register or moved by a 4-byte access */
+    i64         FindFirstValue(u32 val) const { return FindNext(m_values, val, m_oldest - 1); }
+    /* first position of each thread, whose registers may hold values loaded before it */
+    void        GetThreadStarts(std::vector<i64> &starts) const;
+
+private:
+    typedef std::deque<i64>                     PosList;
+    typedef std::unordered_map<u32, PosList>    PosMap;
+
+    struct ThreadState {
+        u32         Regs[InstContext::RegCount];
+        PosList     RegWrites[InstContext::RegCount];
+        PosList     Positions;
+    };
+
+    void        Insert(PosList &list, i64 pos);
+    void        Insert(PosMap &map, u32 key, i64 pos) { Insert(map[key], pos); }
+    i64         FindPrev(const PosList &list, i64 before) const;
+    i64         FindNext(const PosList &list, i64 after) const;
+    i64         FindPrev(const PosMap &map, u32 key, i64 before) const;
+    i64         FindNext(const PosMap &map, u32 key, i64 after) const;
+    void        Prune(PosList &list) const;
+    void        Sweep(PosMap &map) const;
+    void        Sweep();
+
+private:
+    int         m_window;
+    i64         m_oldest;       // oldest position still in the ring
+    i64         m_nextSweep;
+    PosMap      m_reads;
+    PosMap      m_writes;
+    PosMap      m_eips;
+    PosMap      m_values;
+    std::map<int, ThreadState>  m_threads;
+};
+
+#endif // __PROPHET_TRACEINDEX_H__
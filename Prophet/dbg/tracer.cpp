@@ -11,57 +11,194 @@ ProTracer::ProTracer( ProEngine *engine )
     m_mainModuleOnly = false;
     m_traces    = NULL;
     m_maxTraces = 100000;
-    m_ptr       = 0;
-    m_count     = 0;
+    m_head      = 0;
+    m_accesses  = NULL;
+    m_maxAccesses   = 0;
+    m_accessHead    = 0;
+    m_indexed       = 0;
+    m_indexing      = 0;
+    for (int i = 0; i < MaxThreads; i++) {
+        m_lastImageBase[i]  = 0;
+        m_lastModuleId[i]   = 0;
+    }
 }
 
 ProTracer::~ProTracer()
 {
     SAFE_DELETE_ARRAY(m_traces);
+    SAFE_DELETE_ARRAY(m_accesses);
 }
 
 void ProTracer::OnProcessPostLoad( ProcessPostLoadEvent &event )
 {
-    LxDebug("Allocating spaces for %d traces\n", m_maxTraces);
-    m_traces = new TraceContext[m_maxTraces];
+    // most instructions touch memory at most once or twice
+    m_maxAccesses   = max(m_maxTraces * 2, 0x20000);
+    LxDebug("Allocating spaces for %d traces and %d memory accesses\n", m_maxTraces, m_maxAccesses);
+    m_traces    = new TraceRecord[m_maxTraces];
+    m_accesses  = new MemAccess[m_maxAccesses];
+    ZeroMemory(m_traces, sizeof(TraceRecord) * m_maxTraces);
+    m_index.Reset(m_maxTraces);
+    m_indexed   = 0;
 }
 
 void ProTracer::OnPreExecute( PreExecuteEvent &event )
 {
     //m_currEip   = event.Cpu->EIP;
-    if (!IsEnabled()) return;
-    m_currTrace.Reset();
 }
 
 void ProTracer::OnPostExecute( PostExecuteEvent &event )
 {
-    ++m_seq;
+    i64 seq = InterlockedIncrement64(&m_seq);
 
     if (!IsEnabled()) return;
     if (m_mainModuleOnly && event.Cpu->GetCurrentModule() != 0)
         return; // skip DLLs
 
-    m_engine->GetTraceContext(event.Cpu, &m_currTrace, event.Cpu->GetPrevEip());
-    m_currTrace.Seq     = m_seq;
-    AddTrace(m_currTrace);
+    const std::vector<MemAccess> &mrs = m_engine->GetDebugger()->GetMemReads(event.Cpu);
+    const std::vector<MemAccess> &mws = m_engine->GetDebugger()->GetMemWrites(event.Cpu);
+    int nmr = min((int) mrs.size(), 0xffff);
+    int nmw = min((int) mws.size(), 0xffff);
+    if (nmr + nmw > m_maxAccesses) {
+        LxWarning("Too many memory accesses at %08x, only %d are traced\n", 
+            event.Cpu->GetPrevEip(), m_maxAccesses);
+        nmr = min(nmr, m_maxAccesses);
+        nmw = m_maxAccesses - nmr;
+    }
+
+    i64 pos         = InterlockedIncrement64(&m_head) - 1;
+    i64 memStart    = InterlockedExchangeAdd64(&m_accessHead, nmr + nmw);
+    TraceRecord &rec = m_traces[pos % m_maxTraces];
+    InterlockedExchange(&rec.Version, (long) (pos * 2 + 1));
+
+    m_engine->GetTraceRecord(event.Cpu, &rec, event.Cpu->GetPrevEip());
+    rec.Seq         = seq;
+    InternModule(event.Cpu, rec);
+    rec.MemStart    = memStart;
+    rec.MrCount     = (u16) nmr;
+    rec.MwCount     = (u16) nmw;
+    for (int i = 0; i < nmr; i++)
+        m_accesses[(memStart + i) % m_maxAccesses] = mrs[i];
+    for (int i = 0; i < nmw; i++)
+        m_accesses[(memStart + nmr + i) % m_maxAccesses] = mws[i];
+
+    InterlockedExchange(&rec.Version, (long) (pos * 2 + 2));
+
+    // the index trails the ring by about a batch; one thread at a time catches it up
+    if ((pos + 1) % IndexBatch == 0 && InterlockedCompareExchange(&m_indexing, 1, 0) == 0) {
+        {
+            MutexCSLock lock(m_indexLock);
+            UpdateIndex();
+        }
+        InterlockedExchange(&m_indexing, 0);
+    }
+}
+
+void ProTracer::UpdateIndex() const
+{
+    // called with m_indexLock held, every IndexBatch traces and before every search
+    i64 head = GetHead();
+    i64 pos = max(m_indexed, head - m_maxTraces);
+    TraceRecord rec;
+    std::vector<MemAccess> mrs, mws;
+    for (; pos < head; pos++) {
+        if (!ReadRecord(pos, rec)) {
+            // overwritten meanwhile, or still being written and indexed next time
+            if (GetHead() - pos > m_maxTraces) continue;
+            break;
+        }
+        if (!ReadAccesses(rec, mrs, mws)) {
+            mrs.clear();
+            mws.clear();
+        }
+        m_index.Add(pos, rec, mrs.empty() ? NULL : &mrs[0], (int) mrs.size(), 
+            mws.empty() ? NULL : &mws[0], (int) mws.size());
+    }
+    m_indexed = pos;
+}
+
+int ProTracer::GetIndex( i64 pos ) const
+{
+    if (pos < 0) return -1;
+    i64 n = pos - (GetHead() - GetCount());
+    return n >= 0 && n < GetCount() ? (int) n : -1;
 }
 
-void ProTracer::AddTrace( const TraceContext &t )
+void ProTracer::InternModule( const Processor *cpu, TraceRecord &rec )
+{
+    const int tid = cpu->IntID;
+    const ModuleInfo *minfo = cpu->Proc()->GetModuleInfo(cpu->GetModule(rec.Eip));
+    rec.ModuleImageBase = minfo->ImageBase;
+
+    // a thread mostly stays in one module, so the table is rarely consulted
+    if (minfo->ImageBase != m_lastImageBase[tid] || m_lastImageBase[tid] == 0) {
+        SyncObjectLock lock(*this);
+        auto iter = m_moduleIds.find(minfo->Name);
+        if (iter == m_moduleIds.end()) {
+            iter = m_moduleIds.insert(std::make_pair(std::string(minfo->Name), (u16) m_modules.size())).first;
+            m_modules.push_back(minfo->Name);
+        }
+        m_lastImageBase[tid]    = minfo->ImageBase;
+        m_lastModuleId[tid]     = iter->second;
+    }
+    rec.ModuleId    = m_lastModuleId[tid];
+}
+
+std::string ProTracer::GetModuleName( u16 id ) const
 {
     SyncObjectLock lock(*this);
-    m_traces[m_ptr++] = t;
-    if (m_ptr >= m_maxTraces)
-        m_ptr = 0;
-    if (m_count < m_maxTraces)
-        m_count++;
+    return id < m_modules.size() ? m_modules[id] : "n/a";
 }
 
-const TraceContext & ProTracer::GetTrace( int n ) const
+bool ProTracer::ReadRecord( i64 pos, TraceRecord &rec ) const
 {
-    Assert(n >= 0 && n < m_count);
-    int p = m_ptr + n - m_count;
-    if (p < 0) p += m_maxTraces;
-    return m_traces[p];
+    i64 head = GetHead();
+    if (pos < 0 || pos >= head || head - pos > m_maxTraces) return false;
+    const TraceRecord &slot = m_traces[pos % m_maxTraces];
+    long version = slot.Version;
+    if (version != (long) (pos * 2 + 2)) return false;
+    MemoryBarrier();
+    rec = slot;
+    MemoryBarrier();
+    return slot.Version == version;
+}
+
+bool ProTracer::ReadAccesses( const TraceRecord &rec, std::vector<MemAccess> &mrs, 
+                              std::vector<MemAccess> &mws ) const
+{
+    mrs.clear();
+    mws.clear();
+    for (int i = 0; i < rec.MrCount; i++)
+        mrs.push_back(m_accesses[(rec.MemStart + i) % m_maxAccesses]);
+    for (int i = 0; i < rec.MwCount; i++)
+        mws.push_back(m_accesses[(rec.MemStart + rec.MrCount + i) % m_maxAccesses]);
+    MemoryBarrier();
+    // the access ring wraps faster than the trace ring under heavy memory traffic
+    return AtomicRead(m_accessHead) - rec.MemStart <= m_maxAccesses;
+}
+
+bool ProTracer::GetTrace( int n, TraceContext &ctx ) const
+{
+    Assert(n >= 0 && n < GetCount());
+    TraceRecord rec;
+    if (!ReadRecord(GetPosition(n), rec)) return false;
+
+    ctx.Seq     = rec.Seq;
+    for (int i = 0; i < InstContext::RegCount; i++)
+        ctx.Regs[i] = rec.Regs[i];
+    ctx.Eip     = rec.Eip;
+    for (int i = 0; i < InstContext::FlagCount; i++)
+        ctx.Flags[i] = (rec.Flags >> i) & 1;
+    ctx.ModuleName      = GetModuleName(rec.ModuleId);
+    ctx.ModuleImageBase = rec.ModuleImageBase;
+    ctx.Inst            = rec.Inst;
+    ctx.JumpTaken       = rec.JumpTaken;
+    ctx.Tid             = rec.Tid;
+    ctx.ExternalTid     = rec.ExternalTid;
+    if (!ReadAccesses(rec, ctx.MRs, ctx.MWs)) {
+        ctx.MRs.clear();
+        ctx.MWs.clear();
+    }
+    return true;
 }
 
 void ProTracer::Serialize( Json::Value &root ) const 
@@ -86,41 +223,73 @@ void ProTracer::Enable( bool isEnabled )
 
 int ProTracer::FindFirstReg( u32 val ) const
 {
-    for (int i = 0; i < m_count; i++) {
-        const TraceContext &t = GetTrace(i);
-        for (int r = 0; r < t.RegCount; r++) {
-            if (t.Regs[r] == val) return i;
+    MutexCSLock lock(m_indexLock);
+    UpdateIndex();
+    i64 first = m_index.FindFirstValue(val);
+
+    // values a thread already held when its oldest trace was taken were never indexed
+    std::vector<i64> starts;
+    m_index.GetThreadStarts(starts);
+    TraceRecord rec;
+    for (i64 pos : starts) {
+        if (first != -1 && pos >= first) continue;
+        if (!ReadRecord(pos, rec)) continue;
+        for (int r = 0; r < InstContext::RegCount; r++) {
+            if (rec.Regs[r] == val) {
+                first = pos;
+                break;
+            }
         }
-        for (auto &mr : t.MRs)
-            if (mr.Len == 4 && mr.Val == val) return i;
-        for (auto &mw : t.MWs)
-            if (mw.Len == 4 && mw.Val == val) return i;
     }
-    return -1;
+    return GetIndex(first);
 }
 
 int ProTracer::FindMostRecentMrAddr( u32 addr, int idxFrom ) const
 {
-    int index = idxFrom - 1;
-    while (index >= 0) {
-        for (auto &mr : GetTrace(index).MRs) {
-            if (mr.Addr == addr) return index;
-        }
-        index--;
-    }
-    return -1;
+    MutexCSLock lock(m_indexLock);
+    UpdateIndex();
+    return GetIndex(m_index.FindPrevRead(addr, GetPosition(idxFrom)));
 }
 
 int ProTracer::FindMostRecentMwAddr( u32 addr, int idxFrom ) const
 {
-    int index = idxFrom - 1;
-    while (index >= 0) {
-        for (auto &mw : GetTrace(index).MWs) {
-            if (mw.Addr == addr) return index;
-        }
-        index--;
-    }
-    return -1;
+    MutexCSLock lock(m_indexLock);
+    UpdateIndex();
+    return GetIndex(m_index.FindPrevWrite(addr, GetPosition(idxFrom)));
 }
 
+int ProTracer::FindNextMrAddr( u32 addr, int idxFrom ) const
+{
+    MutexCSLock lock(m_indexLock);
+    UpdateIndex();
+    return GetIndex(m_index.FindNextRead(addr, GetPosition(idxFrom)));
+}
+
+int ProTracer::FindNextMwAddr( u32 addr, int idxFrom ) const
+{
+    MutexCSLock lock(m_indexLock);
+    UpdateIndex();
+    return GetIndex(m_index.FindNextWrite(addr, GetPosition(idxFrom)));
+}
+
+int ProTracer::FindPrevEip( u32 eip, int idxFrom ) const
+{
+    MutexCSLock lock(m_indexLock);
+    UpdateIndex();
+    return GetIndex(m_index.FindPrevEip(eip, GetPosition(idxFrom)));
+}
+
+int ProTracer::FindNextEip( u32 eip, int idxFrom ) const
+{
+    MutexCSLock lock(m_indexLock);
+    UpdateIndex();
+    return GetIndex(m_index.FindNextEip(eip, GetPosition(idxFrom)));
+}
+
+int ProTracer::FindPrevRegWrite( int tid, int reg, int idxFrom ) const
+{
+    MutexCSLock lock(m_indexLock);
+    UpdateIndex();
+    return GetIndex(m_index.FindPrevRegWrite(tid, reg, GetPosition(idxFrom)));
+}
 
@@ -8,6 +8,8 @@
 #include "static/disassembler.h"
 #include "instcontext.h"
 #include "utilities.h"
+#include "process.h"
+#include "traceindex.h"
 
 struct TraceContext : public InstContext {
     i64     Seq;
@@ -22,7 +24,37 @@ struct TraceContext : public InstContext {
     }
 };
 
+/*
+ * What the ring keeps per traced instruction. Plain data, so storing one
+ * never allocates: the module name is an id into the tracer's module table
+ * and the memory accesses live in a separate ring of MemAccess.
+ */
+struct TraceRecord {
+    volatile long   Version;        // 2*pos+1 while being written, 2*pos+2 when done
+    i64     Seq;
+    i64     MemStart;               // position of the first access in the access ring
+    u32     Regs[InstContext::RegCount];
+    u32     Eip;
+    u32     ModuleImageBase;
+    InstPtr Inst;
+    int     Tid;
+    ThreadID    ExternalTid;
+    u16     ModuleId;
+    u16     MrCount;
+    u16     MwCount;
+    u8      Flags;                  // bit n is InstContext::Flags[n]
+    bool    JumpTaken;
+};
 
+/*
+ * Instructions are appended without locking: a writer reserves a slot (and
+ * room in the access ring) with an interlocked add and publishes it by
+ * setting its version. Readers copy a record out and check the version
+ * again, so a record overwritten meanwhile is reported instead of torn.
+ * The search index is fed from the ring in batches of IndexBatch traces
+ * by whichever tracing thread completes a batch, so searches only have
+ * the last few traces left to index.
+ */
 class ProTracer : public MutexSyncObject, public ISerializable {
 public:
     ProTracer(ProEngine *engine);
@@ -32,12 +64,19 @@ public:
     void            OnPreExecute(PreExecuteEvent &event);
     void            OnPostExecute(PostExecuteEvent &event);
 
-    int             GetCount() const { return m_count; }
-    const TraceContext &    GetTrace(int n) const;
+    int             GetCount() const { return (int) min(GetHead(), (i64) m_maxTraces); }
+    /* n counts from the oldest trace kept; false if it has been overwritten */
+    bool            GetTrace(int n, TraceContext &ctx) const;
 
+    /* searches return a trace index like GetTrace takes, -1 if nothing matches */
     int             FindFirstReg(u32 val) const;
     int             FindMostRecentMrAddr(u32 addr, int idxFrom) const;
     int             FindMostRecentMwAddr(u32 addr, int idxFrom) const;
+    int             FindNextMrAddr(u32 addr, int idxFrom) const;
+    int             FindNextMwAddr(u32 addr, int idxFrom) const;
+    int             FindPrevEip(u32 eip, int idxFrom) const;
+    int             FindNextEip(u32 eip, int idxFrom) const;
+    int             FindPrevRegWrite(int tid, int reg, int idxFrom) const;
 
     void            Enable(bool isEnabled);
     bool            IsEnabled() const { return m_enabled; }
@@ -45,18 +84,42 @@ public:
     void            Serialize(Json::Value &root) const override;
     void            Deserialize(Json::Value &root) override;
 private:
-    void            AddTrace(const TraceContext &t);
+    static const int MaxThreads = Process::MaximumThreads;
+    static const int IndexBatch = 256;
+
+    static i64      AtomicRead(const volatile i64 &v) { 
+        return InterlockedCompareExchange64((volatile LONG64 *) &v, 0, 0); 
+    }
+    i64             GetHead() const { return AtomicRead(m_head); }
+    i64             GetPosition(int n) const { return GetHead() - GetCount() + n; }
+    int             GetIndex(i64 pos) const;
+    void            InternModule(const Processor *cpu, TraceRecord &rec);
+    std::string     GetModuleName(u16 id) const;
+    bool            ReadRecord(i64 pos, TraceRecord &rec) const;
+    void            UpdateIndex() const;
+    bool            ReadAccesses(const TraceRecord &rec, std::vector<MemAccess> &mrs, 
+                                 std::vector<MemAccess> &mws) const;
 private:
-    TraceContext    m_currTrace;
     //u32             m_currEip;
-    i64             m_seq;
+    volatile i64    m_seq;
     bool            m_enabled;
     bool            m_mainModuleOnly;
     ProEngine *     m_engine;
     int             m_maxTraces;
-    TraceContext *  m_traces;
-    int             m_ptr;
-    int             m_count;
+    TraceRecord *   m_traces;
+    volatile i64    m_head;         // traces ever added
+    int             m_maxAccesses;
+    MemAccess *     m_accesses;
+    volatile i64    m_accessHead;   // accesses ever added
+    mutable TraceIndex  m_index;
+    mutable i64     m_indexed;      // traces before this position are in m_index
+    volatile long   m_indexing;     // a tracing thread is feeding the index
+    mutable MutexCS m_indexLock;
+
+    std::vector<std::string>    m_modules;
+    std::map<std::string, u16>  m_moduleIds;
+    u32             m_lastImageBase[MaxThreads];    // per thread, module of its last trace
+    u16             m_lastModuleId[MaxThreads];
 };
 
 #endif // __PROPHET_TRACER_H__
@@ -260,10 +260,10 @@ void ProEngine::GetInstContext(const Processor *cpu, InstContext *ctx) const
     m_debugger.UpdateInstContext(cpu, ctx);
 }
 
-void ProEngine::GetTraceContext( const Processor *cpu, TraceContext *ctx, u32 eip ) const
+void ProEngine::GetTraceRecord( const Processor *cpu, TraceRecord *rec, u32 eip ) const
 {
-    m_disassembler.UpdateInstContext(ctx, eip);
-    m_debugger.UpdateTraceContext(cpu, ctx, eip);
+    m_disassembler.UpdateTraceRecord(rec, eip);
+    m_debugger.UpdateTraceRecord(cpu, rec, eip);
 }
 
 void ProEngine::ReportBusy( bool isBusy )
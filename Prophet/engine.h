@@ -62,7 +62,7 @@ public:
     const Statistics *  GetStatistics() const { return &m_statistics; }
 
     void            GetInstContext(const Processor *cpu, InstContext *ctx) const;
-    void            GetTraceContext(const Processor *cpu, TraceContext *ctx, u32 eip) const;
+    void            GetTraceRecord(const Processor *cpu, TraceRecord *rec, u32 eip) const;
 
     void            BreakOnNextInst(const char *desc);
 
@@ -38,6 +38,8 @@ enum {
     ID_RunNoBp,
     ID_ToggleBreakpoint,
     ID_RemoveBreakpoint,
+    ID_AddWatchpoint,
+    ID_RemoveWatchpoint,
     ID_ShowMemory,
     ID_ShowCode,
 
@@ -174,6 +174,8 @@ void ProphetFrame::InitMenu()
     m_menuDebug->AppendSeparator();
     m_menuDebug->Append(ID_ToggleBreakpoint, "Toggle Breakpoint\tF2");
     m_menuDebug->Append(ID_RemoveBreakpoint, "Remove Breakpoint\tF3");
+    m_menuDebug->Append(ID_AddWatchpoint, "Add Watchpoint...\tCtrl-W");
+    m_menuDebug->Append(ID_RemoveWatchpoint, "Remove Watchpoint...");
     m_menuDebug->AppendSeparator();
     m_menuDebug->Append(ID_ShowMemory, "Show memory by address...\tCtrl-M");
     m_menuDebug->Append(ID_ShowCode, "Show code by address...\tCtrl-G");
@@ -208,6 +210,8 @@ void ProphetFrame::InitMenu()
     Bind(wxEVT_COMMAND_MENU_SELECTED, &ProphetFrame::OnRunNoBp,         this,   ID_RunNoBp);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &ProphetFrame::OnToggleBreakpoint,this,   ID_ToggleBreakpoint);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &ProphetFrame::OnRemoveBreakpoint,this,   ID_RemoveBreakpoint);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, &ProphetFrame::OnAddWatchpoint,   this,   ID_AddWatchpoint);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, &ProphetFrame::OnRemoveWatchpoint,this,   ID_RemoveWatchpoint);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &ProphetFrame::OnShowMemory,      this,   ID_ShowMemory);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &ProphetFrame::OnShowCode,        this,   ID_ShowCode);
 }
@@ -412,6 +416,37 @@ void ProphetFrame::OnRemoveBreakpoint( wxCommandEvent &event )
     m_cpuPanel->Refresh();
 }
 
+void ProphetFrame::OnAddWatchpoint( wxCommandEvent &event )
+{
+    if (m_isbusy) return;
+    wxString str = wxGetTextFromUser("Address, length and r/w/rw (hex, e.g. 403000 4 w):");
+    if (str.IsEmpty()) return;
+
+    u32 addr = 0, len = 0;
+    char access[4] = "w";
+    if (sscanf(str.c_str(), "%x %x %3s", &addr, &len, access) < 2 || len == 0) {
+        wxMessageBox("Invalid watchpoint: " + str);
+        return;
+    }
+    bool onRead     = strchr(access, 'r') != NULL;
+    bool onWrite    = strchr(access, 'w') != NULL;
+    if (!onRead && !onWrite) {
+        wxMessageBox("Invalid watchpoint: " + str);
+        return;
+    }
+    m_engine->GetDebugger()->AddWatchpoint(addr, len, onRead, onWrite, "user");
+    m_engine->SaveArchive();
+}
+
+void ProphetFrame::OnRemoveWatchpoint( wxCommandEvent &event )
+{
+    if (m_isbusy) return;
+    u32 addr = 0;
+    if (!GetU32FromUser("Watchpoint address:", &addr)) return;
+    m_engine->GetDebugger()->RemoveWatchpoint(addr);
+    m_engine->SaveArchive();
+}
+
 void ProphetFrame::OnPreExecSingleStep( const Processor *cpu )
 {
     InstContext ctx;
@@ -50,6 +50,8 @@ private:
     void    OnStepOut(wxCommandEvent &event);
     void    OnToggleBreakpoint(wxCommandEvent &event);
     void    OnRemoveBreakpoint(wxCommandEvent &event);
+    void    OnAddWatchpoint(wxCommandEvent &event);
+    void    OnRemoveWatchpoint(wxCommandEvent &event);
     void    OnToggleTraceClicked(wxCommandEvent &event);
 //     void    OnToggleCRTEntryClicked(wxCommandEvent &event);
 //     void    OnToggleSkipDllEntryClicked(wxCommandEvent &event);
@@ -43,8 +43,6 @@ void TracePanel::Draw( wxBufferedPaintDC &dc )
         return;
     }
 
-    SyncObjectLock lock(*m_parent->m_tracer);
-
     //const ProTracer::TraceVec &vec = m_parent->m_tracer->GetData();
     const int N = m_parent->m_tracer->GetCount();
     SetVirtualSize(m_width, m_lineHeight * N);
@@ -57,8 +55,10 @@ void TracePanel::Draw( wxBufferedPaintDC &dc )
 
     // draw traces
     dc.SetBrush(m_bgBrush);
+    TraceContext trace;
     for (int i = istart; i <= min(N-1, iend); i++) {
-        DrawTrace(dc, m_parent->m_tracer->GetTrace(i), i);
+        if (m_parent->m_tracer->GetTrace(i, trace))
+            DrawTrace(dc, trace, i);
     }
 
     // draw vertical lines
@@ -140,7 +140,8 @@ void TracePanel::OnSelectionChange()
     //const ProTracer::TraceVec &vec = m_parent->m_tracer->GetData();
 
     if (m_currSelIndex >= m_parent->m_tracer->GetCount() || m_currSelIndex < 0) return;
-    const TraceContext &ctx = m_parent->m_tracer->GetTrace(m_currSelIndex);
+    TraceContext ctx;
+    if (!m_parent->m_tracer->GetTrace(m_currSelIndex, ctx)) return;
 
     wxString desc = wxString::Format("Traced #%I64d", ctx.Seq);
     m_parent->m_contextPanel->UpdateData(&ctx, desc.ToAscii());
@@ -152,7 +153,8 @@ void TracePanel::SelectIndex( int index )
     m_currSelIndex = index;
 
     if (m_currSelIndex >= m_parent->m_tracer->GetCount() || m_currSelIndex < 0) return;
-    const TraceContext &ctx = m_parent->m_tracer->GetTrace(m_currSelIndex);
+    TraceContext ctx;
+    if (!m_parent->m_tracer->GetTrace(m_currSelIndex, ctx)) return;
 
     wxString desc = wxString::Format("Traced #%I64d", ctx.Seq);
     m_parent->m_contextPanel->UpdateData(&ctx, desc.ToAscii());
@@ -355,8 +357,10 @@ void CompositeTracePanel::OnSelectionChange( int index )
     if (index < 0) return;
     //const ProTracer::TraceVec & v = m_tracer->GetData();
     if (index >= m_tracer->GetCount()) return;
-    m_infoPanel->UpdateData(m_tracer->GetTrace(index));
-    m_cpuPanel->ShowCode(m_tracer->GetTrace(index).Eip);
+    TraceContext trace;
+    if (!m_tracer->GetTrace(index, trace)) return;
+    m_infoPanel->UpdateData(trace);
+    m_cpuPanel->ShowCode(trace.Eip);
 }
 
 
@@ -8,8 +8,8 @@
 #include "generic_analyzer.h"
 #include "base64_analyzer.h"
 
-AdvAlgEngine::AdvAlgEngine( MessageManager *msgmgr, Message *msg, int minProcSize )
-    : m_msgmgr(msgmgr), m_message(msg)
+AdvAlgEngine::AdvAlgEngine( AnalysisJob *job, Message *msg, int minProcSize )
+    : m_job(job), m_message(msg)
 {
     m_minProcSize = minProcSize;
     m_taint.TaintRule_LoadMemory();
@@ -95,7 +95,7 @@ void AdvAlgEngine::EnqueueNewMessage( const MemRegion &mr, pbyte pout, const Tai
 {
     Message *parent = this->GetMessage();
     Message *newMsg = new Message(mr, pout, parent, parent->GetRegion().SubRegion(tr), tag, clear);
-    GetMessageManager()->EnqueueMessage(newMsg, 
+    GetJob()->EnqueueMessage(newMsg, 
         ctx.Level == 0 ? ctx.EndSeq + 1 : ctx.BeginSeq, parent->GetTraceEnd());
 }
 
@@ -12,7 +12,7 @@ class AlgorithmAnalyzer;
 
 class AdvAlgEngine : public ProcAnalyzer {
 public:
-    AdvAlgEngine(MessageManager *msgmgr, Message *msg, int minProcSize = 32);
+    AdvAlgEngine(AnalysisJob *job, Message *msg, int minProcSize = 32);
     virtual ~AdvAlgEngine();
     virtual void OnProcedure(ExecuteTraceEvent &event, const ProcContext &ctx) override;
     virtual void OnComplete() override;
@@ -20,7 +20,7 @@ public:
     TaintEngine *   GetTaint() { return &m_taint; }
     const TaintEngine *GetTaint() const { return &m_taint; }
     Message * GetMessage() { return m_message; }
-    MessageManager *    GetMessageManager() { return m_msgmgr; }
+    AnalysisJob *   GetJob() { return m_job; }
     void EnqueueNewMessage(const MemRegion &mr, pbyte pout, const TaintRegion &tr,
         AlgTag *tag, const ProcContext &ctx, bool clear);
 
@@ -28,7 +28,7 @@ private:
     void RegisterAnalyzers();
     void RegisterAnalyzer(AlgorithmAnalyzer *a);
 private:
-    MessageManager *m_msgmgr;
+    AnalysisJob *m_job;
     Message *m_message;
     TaintEngine m_taint;
     int m_minProcSize;
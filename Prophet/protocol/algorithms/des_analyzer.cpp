@@ -267,7 +267,7 @@ void DESAnalyzer::OnComplete()
             parent->GetRegion().SubRegion(crypt->MsgRegion), tag, true);
         LxInfo("DES sub-message: [%08x-%08x]\n", msg->GetRegion().Addr,
             msg->GetRegion().Addr + msg->GetRegion().Len - 1);
-        m_algEngine->GetMessageManager()->EnqueueMessage(msg, crypt->BeginSeq, crypt->EndSeq);
+        m_algEngine->GetJob()->EnqueueMessage(msg, crypt->BeginSeq, crypt->EndSeq);
     }
 }
 
@@ -92,7 +92,7 @@ void GenericSymmetricAnalyzer::OnComplete()
         Message *parent = m_algEngine->GetMessage();
         Message *msg = new Message(crypto->OutputRegion,
             crypto->Output.Get(), parent, parent->GetRegion().SubRegion(crypto->MsgRegion), tag, true);
-        m_algEngine->GetMessageManager()->EnqueueMessage(msg, crypto->BeginSeq, crypto->EndSeq);
+        m_algEngine->GetJob()->EnqueueMessage(msg, crypto->BeginSeq, crypto->EndSeq);
     }
 }
 
@@ -240,7 +240,7 @@ bool GenericChecksumAnalyzer::CheckRegisterChecksum(
         Message *parent = m_algEngine->GetMessage();
         Message *newMsg = new Message(MemRegion(0, len), (cpbyte) &event.Context->EAX,
             parent, parent->GetRegion().SubRegion(tr), tag, false);
-        m_algEngine->GetMessageManager()->EnqueueMessage(newMsg, 0, 0);
+        m_algEngine->GetJob()->EnqueueMessage(newMsg, 0, 0);
 
         SAFE_DELETE_ARRAY(pin);
         return true;
@@ -131,7 +131,7 @@ bool RC4Analyzer::TestRC4Crypt(const ProcContext &ctx, const MemRegion &input,
 //             Message *parent = m_algEngine->GetMessage();
 //             Message *submsg = new Message(output, ct, parent,
 //                 parent->GetRegion().SubRegion(tin), tag, true);
-//             m_algEngine->GetMessageManager()->EnqueueMessage(
+//             m_algEngine->GetJob()->EnqueueMessage(
 //                 submsg, ctx.EndSeq+1, parent->GetTraceEnd());
         }
         SAFE_DELETE_ARRAY(pt);
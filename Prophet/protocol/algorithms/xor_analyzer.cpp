@@ -63,7 +63,7 @@ bool ChainedXorAnalyzer::TestCrypt( const ProcContext &ctx, const MemRegion &inp
 //         Message *msg = new Message(output, pt, parent,
 //             parent->GetRegion().SubRegion(tr), tag, true);
 // 
-//         m_algEngine->GetMessageManager()->EnqueueMessage(msg, 
+//         m_algEngine->GetJob()->EnqueueMessage(msg, 
 //             ctx.Level == 0?ctx.EndSeq+1:ctx.BeginSeq, parent->GetTraceEnd());
         found = true;
     }
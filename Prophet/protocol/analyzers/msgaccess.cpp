@@ -62,7 +62,8 @@ void MessageAccessLog::OnMemRead( const TContext *t, u32 addr, byte data )
     }
     MessageAccess *acc = new MessageAccess;
     acc->CallStack = m_callstack->Get();
-    acc->Context = t;
+    acc->Eip = t->Eip;      // records are only valid while the trace reader holds them
+    acc->Inst = t->Inst;
     acc->Offset = offset;
     m_accesses.push_back(acc);
 }
@@ -72,8 +73,8 @@ void MessageAccessLog::Dump( File &f ) const
     for (auto &m : m_accesses) {
         byte c = m_currmsg->Get(m->Offset);
         fprintf(f.Ptr(), "%3d '%c' %08x %-50s  stack_hash=%08x", 
-            m->Offset, isprint(c) ? c : '.', m->Context->Eip, 
-            m->Context->Inst->Main.CompleteInstr, GetProcStackHash(m->CallStack));
+            m->Offset, isprint(c) ? c : '.', m->Eip, 
+            m->Inst->Main.CompleteInstr, GetProcStackHash(m->CallStack));
         fprintf(f.Ptr(), "  %08x", m->CallStack[0]->Entry());
         for (uint i = 1; i < m->CallStack.size(); i++)
             fprintf(f.Ptr(), "->%08x", m->CallStack[i]->Entry());
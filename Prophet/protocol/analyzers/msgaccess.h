@@ -9,7 +9,8 @@
 
 struct MessageAccess {
     int Offset;
-    const TContext *Context;
+    u32     Eip;
+    InstPtr Inst;
     ProcStack CallStack;
 };
 
@@ -2,13 +2,37 @@
 #include "traceexec.h"
 #include "processor.h"
 #include "protocol/message.h"
+#include <intrin.h>
+#include <typeinfo>
+
+void AnalyzerProfile::Add( const TraceAnalyzer *analyzer, u64 cycles )
+{
+    m_cycles[typeid(*analyzer).name()] += cycles;
+}
+
+void AnalyzerProfile::Report( const std::string &title ) const
+{
+    LxInfo("%s: %I64d traces replayed\n", title.c_str(), m_replayed);
+    for (auto &c : m_cycles) {
+        LxInfo("    %-32s %10.1f Mcycles\n", c.first.c_str(), c.second / 1e6);
+    }
+}
 
 TraceExec::TraceExec(const RunTrace &t)
-    : m_trace(t)
+    : m_trace(t), m_reader(t), m_profile(NULL)
 {
     Reset();
 }
 
+#define TIMED_CALL(i, call)                                     \
+    if (m_profile) {                                            \
+        u64 t0 = __rdtsc();                                     \
+        m_workers[i]->call;                                     \
+        m_cycles[i] += __rdtsc() - t0;                          \
+    } else {                                                    \
+        m_workers[i]->call;                                     \
+    }
+
 bool TraceExec::IsSpecialCallPop( ExecuteTraceEvent &event ) const
 {
     if (m_prev == NULL) return false;
@@ -34,15 +58,15 @@ void TraceExec::OnExecuteTrace( ExecuteTraceEvent &event )
         !m_prev->HasExecFlag(LX_EXEC_WINAPI_JMP)) && !IsSpecialCallPop(event))
     {
         for (int i = 0; i < m_count; i++)
-            m_workers[i]->OnProcBegin(event);
+            TIMED_CALL(i, OnProcBegin(event));
     }
     
     for (int i = 0; i < m_count; i++)
-        m_workers[i]->OnExecuteTrace(event);
+        TIMED_CALL(i, OnExecuteTrace(event));
 
     if (Instruction::IsRet(event.Context->Inst) || IsSpecialXchgJmp(event)) {
         for (int i = m_count - 1; i >= 0; i--)
-            m_workers[i]->OnProcEnd(event);
+            TIMED_CALL(i, OnProcEnd(event));
     }
 
     m_prev = event.Context;
@@ -50,15 +74,20 @@ void TraceExec::OnExecuteTrace( ExecuteTraceEvent &event )
 
 void TraceExec::OnComplete()
 {
-    for (int i = 0; i < m_count; i++)
-        m_workers[i]->OnComplete();
+    for (int i = 0; i < m_count; i++) {
+        TIMED_CALL(i, OnComplete());
+        if (m_profile) m_profile->Add(m_workers[i], m_cycles[i]);
+    }
     Reset();
 }
 
+#undef TIMED_CALL
+
 void TraceExec::Reset()
 {
     m_count = 0;
     ZeroMemory(m_workers, sizeof(m_workers));
+    ZeroMemory(m_cycles, sizeof(m_cycles));
     m_prev = NULL;
 }
 
@@ -85,9 +114,10 @@ void TraceExec::RunPartial( int firstIncl, int lastIncl )
     Assert(firstIncl >= 0 && firstIncl < m_trace.Count());
     Assert(lastIncl >= firstIncl && lastIncl < m_trace.Count());
     for (int i = firstIncl; i <= lastIncl; i++) {
-        ExecuteTraceEvent e(this, m_trace.Get(i), i, m_trace);
+        ExecuteTraceEvent e(this, m_reader.Get(i), i, m_trace);
         OnExecuteTrace(e);
     }
+    if (m_profile) m_profile->AddReplayed(lastIncl - firstIncl + 1);
     OnComplete();
 }
 
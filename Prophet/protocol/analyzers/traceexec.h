@@ -10,6 +10,22 @@
  * TraceAnalyzer
  */
 
+/*
+ * Time spent in each kind of TraceAnalyzer, in TSC cycles, summed over
+ * every replay that reports to it.
+ */
+class AnalyzerProfile {
+public:
+    AnalyzerProfile() : m_replayed(0) {}
+
+    void    Add(const TraceAnalyzer *analyzer, u64 cycles);
+    void    AddReplayed(int count) { m_replayed += count; }
+    void    Report(const std::string &title) const;
+private:
+    std::map<std::string, u64>  m_cycles;
+    i64     m_replayed;     // trace records walked
+};
+
 class TraceExec : public TraceAnalyzer {
 public:
     TraceExec(const RunTrace &t);
@@ -21,16 +37,20 @@ public:
     void Add(TraceAnalyzer *t0, TraceAnalyzer *t1, TraceAnalyzer *t2);
     void RunPartial(int firstIncl, int lastIncl);
     void RunMessage(const Message *msg);
+    void SetProfile(AnalyzerProfile *profile) { m_profile = profile; }
 
 private:
     bool IsSpecialCallPop(ExecuteTraceEvent &event) const;
     bool IsSpecialXchgJmp(ExecuteTraceEvent &event) const;
 private:
     const RunTrace &m_trace;
+    TraceReader     m_reader;
     static const int MaxAnalyzers = 16;
     TraceAnalyzer * m_workers[MaxAnalyzers];
     int m_count;
     const TContext *    m_prev;
+    AnalyzerProfile *   m_profile;
+    u64 m_cycles[MaxAnalyzers];
 };
 
 #endif // __PROPHET_PROTOCOL_ANALYZERS_TRACEEXEC_H__
\ No newline at end of file
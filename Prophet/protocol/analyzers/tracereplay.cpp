@@ -0,0 +1,64 @@
+#include "stdafx.h"
+#include "tracereplay.h"
+#include "traceexec.h"
+
+TraceReplay::TraceReplay( const RunTrace &t )
+    : m_trace(t), m_reader(t)
+{
+}
+
+void TraceReplay::Add( TraceExec *exec, int firstIncl, int lastIncl )
+{
+    Assert(firstIncl >= 0 && firstIncl < m_trace.Count());
+    Assert(lastIncl >= firstIncl && lastIncl < m_trace.Count());
+    Range r = { exec, NULL, firstIncl, lastIncl };
+    m_ranges.push_back(r);
+}
+
+void TraceReplay::Add( TraceExecFactory *factory, int firstIncl, int lastIncl )
+{
+    Assert(firstIncl >= 0 && firstIncl < m_trace.Count());
+    Assert(lastIncl >= firstIncl && lastIncl < m_trace.Count());
+    Range r = { NULL, factory, firstIncl, lastIncl };
+    m_ranges.push_back(r);
+}
+
+void TraceReplay::Run( AnalyzerProfile *profile )
+{
+    std::stable_sort(m_ranges.begin(), m_ranges.end(), 
+        [](const Range &lhs, const Range &rhs) { return lhs.First < rhs.First; });
+
+    std::vector<Range> active;
+    uint next = 0;
+    int walked = 0;
+    while (next < m_ranges.size()) {
+        // skip the gaps no range covers
+        int i = m_ranges[next].First;
+        while (true) {
+            while (next < m_ranges.size() && m_ranges[next].First == i) {
+                Range &r = m_ranges[next++];
+                if (r.Factory) r.Exec = r.Factory->Open();
+                active.push_back(r);
+            }
+            if (active.empty()) break;
+
+            const TContext *ctx = m_reader.Get(i);
+            walked++;
+            for (auto &r : active) {
+                ExecuteTraceEvent e(r.Exec, ctx, i, m_trace);
+                r.Exec->OnExecuteTrace(e);
+            }
+            for (auto iter = active.begin(); iter != active.end(); ) {
+                if (iter->Last == i) {
+                    iter->Exec->OnComplete();
+                    if (iter->Factory) iter->Factory->Close(iter->Exec);
+                    iter = active.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+            i++;
+        }
+    }
+    if (profile) profile->AddReplayed(walked);
+}
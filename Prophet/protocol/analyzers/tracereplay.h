@@ -0,0 +1,46 @@
+#pragma once
+ 
+#ifndef __PROPHET_PROTOCOL_ANALYZERS_TRACEREPLAY_H__
+#define __PROPHET_PROTOCOL_ANALYZERS_TRACEREPLAY_H__
+ 
+#include "protocol/analyzer.h"
+#include "protocol/runtrace.h"
+
+/*
+ * Creates the TraceExec of a range when the walk reaches its first trace
+ * and frees it after OnComplete, so only the ranges being walked hold state
+ */
+class TraceExecFactory {
+public:
+    virtual ~TraceExecFactory() {}
+    virtual TraceExec * Open() = 0;
+    virtual void        Close(TraceExec *exec) = 0;
+};
+
+/*
+ * Replays one run-trace to several TraceExecs in a single walk, each
+ * seeing only its own range, as if it had been run with RunPartial.
+ * Overlapping ranges share the decoding of every record.
+ */
+class TraceReplay {
+public:
+    TraceReplay(const RunTrace &t);
+
+    void Add(TraceExec *exec, int firstIncl, int lastIncl);
+    void Add(TraceExecFactory *factory, int firstIncl, int lastIncl);
+    void Run(AnalyzerProfile *profile);
+
+private:
+    struct Range {
+        TraceExec * Exec;
+        TraceExecFactory *  Factory;
+        int         First;
+        int         Last;
+    };
+
+    const RunTrace &    m_trace;
+    TraceReader         m_reader;
+    std::vector<Range>  m_ranges;
+};
+
+#endif // __PROPHET_PROTOCOL_ANALYZERS_TRACEREPLAY_H__
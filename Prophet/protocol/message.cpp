@@ -14,6 +14,7 @@
 #include "analyzers/parallel_detector.h"
 #include "analyzers/sanitize_refiner.h"
 #include "analyzers/direction_field.h"
+#include "analyzers/tracereplay.h"
 
 const char *FieldFormatName[] = {
     "unknown", "separator", "keyword", "length", "fixed_length", "var_length", NULL
@@ -56,11 +57,12 @@ Message::~Message()
     m_children.clear();
 }
 
-bool Message::Analyze( MessageManager *msgmgr, const RunTrace &trace )
+bool Message::Analyze( AnalysisJob *job )
 {
     std::string name = GetName();
     LxInfo("Analyzing message %s ...\n", name.c_str());
-    TraceExec traceExe(trace);
+    TraceExec traceExe(job->GetRunTrace());
+    traceExe.SetProfile(job->GetProfile());
     ProcScope procScope;
 
     std::string dir = g_engine.GetArchiveDir() + g_engine.GetArchiveFileName() + "\\";
@@ -97,11 +99,11 @@ bool Message::Analyze( MessageManager *msgmgr, const RunTrace &trace )
         TokenizeRefiner(this, m_type, 1).RefineTree(*m_fieldTree);
         ParallelFieldDetector(3).RefineTree(*m_fieldTree);
 
-        TaintEngine *taint = msgmgr->GetTaint();
+        TaintEngine *taint = job->GetTaint();
         taint->Reset();
         taint->TaintRule_LoadMemory();
         taint->TaintMemRegion(m_region);
-        AdvAlgEngine alg(msgmgr, this, 32);
+        AdvAlgEngine alg(job, this, 32);
         ProcExec procExe(&callStack, taint);
         procExe.Add(&alg);
         traceExe.Add(taint, &callStack, &procExe);
@@ -124,21 +126,68 @@ bool Message::Analyze( MessageManager *msgmgr, const RunTrace &trace )
     return true;
 }
 
-void Message::AnalyzeAll( MessageManager *msgmgr, const RunTrace &trace )
+/*
+ * Direction analysis of one message, with its own taint state so that
+ * the passes of a whole message tree can share one replay. A pass only
+ * exists while the replay is inside the message's trace range.
+ */
+struct DirectionPass {
+    TaintEngine     Taint;
+    DirectionField  Field;
+    TraceExec       Exec;
+
+    DirectionPass(AnalysisJob *job, Message *msg)
+        : Field(msg, &Taint), Exec(job->GetRunTrace())
+    {
+        Taint.Reset();
+        Taint.TaintRule_LoadDefault();
+        Taint.TaintMemRegion(msg->GetRegion());
+        Exec.SetProfile(job->GetProfile());
+        Exec.Add(&Taint, &Field);
+    }
+};
+
+class DirectionPassFactory : public TraceExecFactory {
+public:
+    DirectionPassFactory(AnalysisJob *job, Message *msg)
+        : m_job(job), m_msg(msg), m_pass(NULL) {}
+    ~DirectionPassFactory() { SAFE_DELETE(m_pass); }
+
+    TraceExec * Open() override {
+        Assert(m_pass == NULL);
+        m_pass = new DirectionPass(m_job, m_msg);
+        return &m_pass->Exec;
+    }
+    void        Close(TraceExec *exec) override { SAFE_DELETE(m_pass); }
+private:
+    AnalysisJob *   m_job;
+    Message *       m_msg;
+    DirectionPass * m_pass;
+};
+
+void Message::AnalyzeAll( AnalysisJob *job )
 {
-    TraceExec traceExe(trace);
-    TaintEngine *taint = msgmgr->GetTaint();
-
-    taint->Reset();
-    taint->TaintRule_LoadDefault();
-    taint->TaintMemRegion(m_region);
-    DirectionField df(this, taint);
-    traceExe.Add(taint, &df);
-    traceExe.RunMessage(this);
+    // sub-messages mostly lie within the trace of their parent, 
+    // so walking the trace once for all of them saves decoding it again
+    TraceReplay replay(job->GetRunTrace());
+    std::vector<DirectionPassFactory *> passes;
+    AddDirectionPasses(job, replay, passes);
+    replay.Run(job->GetProfile());
+
+    for (auto &pass : passes) {
+        SAFE_DELETE(pass);
+    }
     LxInfo("Post-analyzing Message %s complate\n", GetName().c_str());
+}
+
+void Message::AddDirectionPasses( AnalysisJob *job, TraceReplay &replay, std::vector<DirectionPassFactory *> &passes )
+{
+    DirectionPassFactory *pass = new DirectionPassFactory(job, this);
+    passes.push_back(pass);
+    replay.Add(pass, m_traceBegin, m_traceEnd);
 
     for (auto &msg : m_children) {
-        msg->AnalyzeAll(msgmgr, trace);
+        msg->AddDirectionPasses(job, replay, passes);
     }
 }
 
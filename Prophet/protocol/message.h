@@ -58,6 +58,9 @@ struct AlgTag {
     ~AlgTag();
 };
 
+class DirectionPassFactory;
+class TraceReplay;
+
 class Message {
 public:
     //Message(u32 addr, int len);
@@ -85,13 +88,14 @@ public:
     void        DumpTree(File &f) const;
     bool        SearchData(cpbyte p, int len, MemRegion &r);
 
-    bool        Analyze(MessageManager *msgmgr, const RunTrace &trace);
-    void        AnalyzeAll(MessageManager *msgmgr, const RunTrace &trace);
+    bool        Analyze(AnalysisJob *job);
+    void        AnalyzeAll(AnalysisJob *job);
     void        Insert(Message *msg);
     MessageType GetType() const { return m_type; }
     std::string GetTypeString() const;
 private:
     void        ResolveType();
+    void        AddDirectionPasses(AnalysisJob *job, TraceReplay &replay, std::vector<DirectionPassFactory *> &passes);
 private:
     int     m_id;
     int     m_traceBegin, m_traceEnd;
@@ -5,9 +5,54 @@
 #include "protocol.h"
 #include "analyzers/msgtree.h"
 #include "taint/taintengine.h"
+#include "analyzers/traceexec.h"
+
+AnalysisJob::AnalysisJob( Message *root, RunTrace *trace )
+    : m_root(root), m_trace(trace)
+{
+    m_accepted = false;
+    m_taint = new TaintEngine();
+    m_profile = new AnalyzerProfile();
+    m_msgQueue.push_back(root);
+}
+
+AnalysisJob::~AnalysisJob()
+{
+    Assert(m_msgQueue.empty());
+    SAFE_DELETE(m_taint);
+    SAFE_DELETE(m_profile);
+    SAFE_DELETE(m_trace);
+}
+
+void AnalysisJob::EnqueueMessage( Message *msg, int beginIncl, int endIncl )
+{
+    Assert(msg->GetParent() != NULL);
+    msg->SetTraceRange(beginIncl, endIncl);
+    msg->SetID(msg->GetParent()->GetID());
+    m_msgQueue.push_back(msg);
+}
+
+void AnalysisJob::Run()
+{
+    while (!m_msgQueue.empty()) {
+        Message *msg = m_msgQueue.front();
+        m_msgQueue.pop_front();
+
+        if (msg->Analyze(this)) {
+            if (msg->GetParent() != NULL) {
+                msg->GetParent()->Insert(msg);
+            } else {
+                m_accepted = true;
+            }
+        }
+    }
+
+    m_root->AnalyzeAll(this);
+    m_profile->Report(m_root->GetName());
+}
 
 MessageManager::MessageManager( Protocol *protocol )
-    : m_protocol(protocol), m_tracer(protocol)
+    : m_protocol(protocol)
 {
     m_currRootMsg = NULL;
     m_breakOnMsgBegin   = false;
@@ -15,21 +60,25 @@ MessageManager::MessageManager( Protocol *protocol )
     m_autoShowMemory    = true;
     m_tracing           = false;
     m_currId = 0;
-    m_taint = new TaintEngine();
+    m_tracer = new RunTrace(protocol);
     m_clearSubNodes = true;
+    m_numWorkers    = 2;
+    m_maxQueuedJobs = 4;
+    m_runningJobs   = 0;
+    m_stopWorkers   = false;
 }
 
 MessageManager::~MessageManager()
 {
     //SAFE_DELETE(m_currRootMsg);
     Assert(m_currRootMsg == NULL);
-    //Analyze();
-    Assert(m_msgQueue.empty());
+    WaitForAnalysis();
+    StopWorkers();
     for (auto &msg : m_messages) {
         SAFE_DELETE(msg);
     }
     m_messages.clear();
-    SAFE_DELETE(m_taint);
+    SAFE_DELETE(m_tracer);
 }
 
 void MessageManager::Initialize()
@@ -48,7 +97,7 @@ void MessageManager::OnMessageBegin( MessageBeginEvent &event )
     m_currRootMsg = new Message(MemRegion(event.MessageAddr, event.MessageLen), event.MessageData);
     //m_format.OnMessageBegin(event);
 
-    m_tracer.Begin();
+    m_tracer->Begin();
     m_tracing = true;
 
 //     if (m_breakOnMsgBegin) {
@@ -67,13 +116,19 @@ void MessageManager::OnMessageEnd( MessageEndEvent &event )
 {
     //m_format.OnMessageEnd(event);
 
-    int nTraces = m_tracer.Count();
-    EnqueueMessage(m_currRootMsg, 0, nTraces-1);
+    int nTraces = m_tracer->Count();
+    m_currRootMsg->SetTraceRange(0, nTraces-1);
+    m_currRootMsg->SetID(m_currId++);
 
-    Analyze();
+    // the job takes the trace along, the next message gets a fresh one
+    RunTrace *next = new RunTrace(m_protocol);
+    Json::Value runtrace;
+    m_tracer->Serialize(runtrace);
+    next->Deserialize(runtrace);
+    SubmitJob(new AnalysisJob(m_currRootMsg, m_tracer));
 
+    m_tracer = next;
     m_currRootMsg = NULL;
-    m_tracer.End();
     m_tracing = false;
     LxInfo("Finished %d run-traces\n", nTraces);
 
@@ -91,13 +146,15 @@ void MessageManager::Serialize( Json::Value &root ) const
     root["break_on_message_end"]    = m_breakOnMsgEnd;
     root["auto_show_memory"]        = m_autoShowMemory;
     root["clear_sub_nodes"]         = m_clearSubNodes;
+    root["analysis_workers"]        = m_numWorkers;
+    root["max_queued_analyses"]     = m_maxQueuedJobs;
 
 //     Json::Value formatsyn;
 //     m_format.Serialize(formatsyn);
 //     root["format_synthesizer"] = formatsyn;
 
     Json::Value runtrace;
-    m_tracer.Serialize(runtrace);
+    m_tracer->Serialize(runtrace);
     root["run_trace"] = runtrace;
 }
 
@@ -107,6 +164,8 @@ void MessageManager::Deserialize( Json::Value &root )
     m_breakOnMsgEnd     = root.get("break_on_message_end", m_breakOnMsgEnd).asBool();
     m_autoShowMemory    = root.get("auto_show_memory", m_autoShowMemory).asBool();
     m_clearSubNodes = root.get("clear_sub_nodes", m_clearSubNodes).asBool();
+    m_numWorkers    = min(MAXIMUM_WAIT_OBJECTS, root.get("analysis_workers", m_numWorkers).asInt());
+    m_maxQueuedJobs = max(1, root.get("max_queued_analyses", m_maxQueuedJobs).asInt());
 
 //     Json::Value formatsyn = root["format_synthesizer"];
 //     if (!formatsyn.isNull())
@@ -114,48 +173,119 @@ void MessageManager::Deserialize( Json::Value &root )
 
     Json::Value runtrace = root["run_trace"];
     if (!runtrace.isNull())
-        m_tracer.Deserialize(runtrace);
+        m_tracer->Deserialize(runtrace);
 }
 
 void MessageManager::OnPostExecute( PostExecuteEvent &event )
 {
     if (m_tracing)
-        m_tracer.Trace(event.Cpu);
+        m_tracer->Trace(event.Cpu);
 }
 
-void MessageManager::EnqueueMessage( Message *msg, int beginIncl, int endIncl )
+void MessageManager::SubmitJob( AnalysisJob *job )
 {
-    msg->SetTraceRange(beginIncl, endIncl);
-    msg->SetID(msg->GetParent() ? msg->GetParent()->GetID() : m_currId++);
-    m_msgQueue.push_back(msg);
+    if (m_numWorkers <= 0) {
+        job->Run();
+        FinishJob(job);
+        return;
+    }
+    if (m_workers.empty()) StartWorkers();
+
+    MutexCSLock lock(m_jobLock);
+    // capture waits for the workers rather than piling up traces
+    while ((int) m_jobs.size() >= m_maxQueuedJobs) {
+        m_jobChanged.Wait(m_jobLock);
+    }
+    m_jobs.push_back(job);
+    m_jobChanged.WakeAll();
 }
 
-void MessageManager::Analyze()
+void MessageManager::FinishJob( AnalysisJob *job )
 {
-    while (!m_msgQueue.empty()) {
-        Message *msg = m_msgQueue.front();
-        m_msgQueue.pop_front();
+    Message *root = job->GetRoot();
+    if (job->IsAccepted()) {
+        MutexCSLock lock(m_jobLock);
+        // jobs finish in any order, keep the messages in capture order
+        auto iter = m_messages.begin();
+        while (iter != m_messages.end() && (*iter)->GetID() < root->GetID()) ++iter;
+        m_messages.insert(iter, root);
+    } else {
+        SAFE_DELETE(root);
+    }
+    SAFE_DELETE(job);
+}
 
-        if (msg->Analyze(this, m_tracer)) {
-            if (msg->GetParent() != NULL) {
-                msg->GetParent()->Insert(msg);
-            } else {
-                m_messages.push_back(msg);
+void MessageManager::StartWorkers()
+{
+    m_stopWorkers = false;
+    for (int i = 0; i < m_numWorkers; i++) {
+        HANDLE hThread = CreateThread(NULL, 0, WorkerRoutine, (LPVOID) this, 0, NULL);
+        if (hThread == NULL) {
+            LxFatal("Cannot create message analysis thread\n");
+        }
+        m_workers.push_back(hThread);
+    }
+    LxInfo("Analyzing messages with %d workers\n", m_numWorkers);
+}
+
+void MessageManager::StopWorkers()
+{
+    if (m_workers.empty()) return;
+    {
+        MutexCSLock lock(m_jobLock);
+        m_stopWorkers = true;
+        m_jobChanged.WakeAll();
+    }
+    WaitForMultipleObjects(m_workers.size(), &m_workers[0], TRUE, INFINITE);
+    for (auto &h : m_workers) {
+        CloseHandle(h);
+    }
+    m_workers.clear();
+}
+
+DWORD WINAPI MessageManager::WorkerRoutine( LPVOID lpParams )
+{
+    MessageManager *msgmgr = (MessageManager *) lpParams;
+    msgmgr->WorkerLoop();
+    return 0;
+}
+
+void MessageManager::WorkerLoop()
+{
+    while (true) {
+        AnalysisJob *job = NULL;
+        {
+            MutexCSLock lock(m_jobLock);
+            while (m_jobs.empty() && !m_stopWorkers) {
+                m_jobChanged.Wait(m_jobLock);
             }
+            if (m_jobs.empty()) break;
+            job = m_jobs.front();
+            m_jobs.pop_front();
+            m_runningJobs++;
+            m_jobChanged.WakeAll();
         }
+
+        job->Run();
+        FinishJob(job);
+
+        MutexCSLock lock(m_jobLock);
+        m_runningJobs--;
+        m_jobChanged.WakeAll();
     }
+}
 
-    if (m_currRootMsg) {
-        m_currRootMsg->AnalyzeAll(this, m_tracer);
+void MessageManager::WaitForAnalysis()
+{
+    MutexCSLock lock(m_jobLock);
+    while (!m_jobs.empty() || m_runningJobs > 0) {
+        m_jobChanged.Wait(m_jobLock);
     }
-//     for (auto &msg : m_messages) {
-//         msg->AnalyzeAll(this, m_tracer);
-//     }
 }
 
 void MessageManager::GenerateOutput()
 {
-    //Analyze();
+    WaitForAnalysis();
 
     std::string dir = g_engine.GetArchiveDir() + g_engine.GetArchiveFileName() + "\\";
     LxCreateDirectory(dir.c_str());
@@ -7,6 +7,35 @@
 #include "event.h"
 #include "taint/taint.h"
 #include "runtrace.h"
+#include "parallel.h"
+
+/*
+ * Analysis of one captured message: the root message, the run-trace
+ * recorded for it, and the sub-messages found while analyzing it. Jobs
+ * share no state, so MessageManager can run several of them at once.
+ */
+class AnalysisJob {
+public:
+    AnalysisJob(Message *root, RunTrace *trace);
+    ~AnalysisJob();
+
+    void            Run();
+    void            EnqueueMessage(Message *msg, int beginIncl, int endIncl);
+
+    Message *       GetRoot() { return m_root; }
+    bool            IsAccepted() const { return m_accepted; }
+    const RunTrace &GetRunTrace() const { return *m_trace; }
+    TaintEngine *   GetTaint() { return m_taint; }
+    AnalyzerProfile *GetProfile() { return m_profile; }
+
+private:
+    Message *       m_root;
+    bool            m_accepted;
+    RunTrace *      m_trace;
+    TaintEngine *   m_taint;
+    AnalyzerProfile *m_profile;
+    std::deque<Message *>   m_msgQueue;
+};
 
 class MessageManager : ISerializable {
 public:
@@ -18,33 +47,43 @@ public:
     void            OnMessageBegin(MessageBeginEvent &event);
     void            OnMessageEnd(MessageEndEvent &event);
 
-    void            EnqueueMessage(Message *msg, int beginIncl, int endIncl);
-    void            Analyze();
+    void            WaitForAnalysis();
     void            GenerateOutput();
 
 //     Message *       GetCurrentMessage() { return m_currRootMsg; }
 //     const Message * GetCurrentMessage() const { return m_currRootMsg; }
-    RunTrace &      GetRunTrace() { return m_tracer; }
-    const RunTrace &GetRunTrace() const { return m_tracer; }
     Protocol *      GetProtocol() { return m_protocol; }
     const Protocol *GetProtocol() const { return m_protocol; }
-    TaintEngine *   GetTaint() { return m_taint; }
-    const TaintEngine *GetTaint() const { return m_taint; }
 
     void            Serialize(Json::Value &root) const override;
     void            Deserialize(Json::Value &root) override;
 
 private:
-    TaintEngine *   m_taint;
+    void            SubmitJob(AnalysisJob *job);
+    void            FinishJob(AnalysisJob *job);
+    void            StartWorkers();
+    void            StopWorkers();
+    static DWORD WINAPI WorkerRoutine(LPVOID lpParams);
+    void            WorkerLoop();
+
+private:
     Protocol *      m_protocol;
     Message *       m_currRootMsg;
-    RunTrace        m_tracer;
+    RunTrace *      m_tracer;       // trace of the message being captured
     bool            m_tracing;
     bool            m_clearSubNodes;
 
     int             m_currId;
-    std::vector<Message *>  m_messages;
-    std::deque<Message *>   m_msgQueue;
+    std::vector<Message *>  m_messages;     // analyzed root messages, ordered by id
+
+    int             m_numWorkers;   // 0 analyzes on the emulation thread
+    int             m_maxQueuedJobs;
+    std::vector<HANDLE>     m_workers;
+    MutexCS         m_jobLock;
+    ConditionVariable       m_jobChanged;
+    std::deque<AnalysisJob *>   m_jobs;
+    int             m_runningJobs;
+    bool            m_stopWorkers;
 
     bool            m_breakOnMsgBegin;
     bool            m_breakOnMsgEnd;
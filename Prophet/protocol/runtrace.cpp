@@ -3,89 +3,390 @@
 #include "protocol.h"
 #include "processor.h"
 #include "message.h"
+#include "engine.h"
 
-RunTrace::RunTrace(Protocol *engine) : m_engine(engine)
+/*
+ * Record layout, every field relative to the previous record:
+ *   byte     mask of registers that changed
+ *   byte     RecordFlag bits
+ *   varint   zigzag Eip delta
+ *   varint   zigzag delta of each changed register
+ *   varint   Eflags                      (RecordEflags)
+ *   varint   Tid, ExtTid                 (RecordThread)
+ *   varint   ExecFlag                    (RecordExecFlag)
+ *   varint   ReadCount, WriteCount       (RecordAccess)
+ *   each read, then each write:
+ *   varint   zigzag address delta, Len, Val
+ */
+enum RecordFlag {
+    RecordEflags    = 1 << 0,
+    RecordThread    = 1 << 1,
+    RecordExecFlag  = 1 << 2,
+    RecordJumpTaken = 1 << 3,
+    RecordAccess    = 1 << 4,
+};
+
+static INLINE void PutVarint(std::vector<byte> &out, u32 val)
+{
+    while (val >= 0x80) {
+        out.push_back((byte) (val | 0x80));
+        val >>= 7;
+    }
+    out.push_back((byte) val);
+}
+
+static INLINE u32 GetVarint(cpbyte &p)
+{
+    u32 val = 0;
+    for (int shift = 0; ; shift += 7) {
+        byte b = *p++;
+        val |= (u32) (b & 0x7f) << shift;
+        if ((b & 0x80) == 0) break;
+    }
+    return val;
+}
+
+static INLINE u32 ZigZag(u32 delta)
+{
+    return (delta << 1) ^ (u32) ((i32) delta >> 31);
+}
+
+static INLINE u32 UnZigZag(u32 val)
+{
+    return (val >> 1) ^ (u32) -(i32) (val & 1);
+}
+
+/* accesses are encoded against the first access of the same kind in the previous record */
+static void PutAccesses(std::vector<byte> &out, const MemAccess *acc, int count, u32 base)
+{
+    for (int i = 0; i < count; i++) {
+        PutVarint(out, ZigZag(acc[i].Addr - base));
+        PutVarint(out, acc[i].Len);
+        PutVarint(out, acc[i].Val);
+        base = acc[i].Addr;
+    }
+}
+
+static void GetAccesses(cpbyte &p, std::vector<MemAccess> &acc, int count, u32 base)
+{
+    for (int i = 0; i < count; i++) {
+        MemAccess a;
+        a.Addr  = base + UnZigZag(GetVarint(p));
+        a.Len   = GetVarint(p);
+        a.Val   = GetVarint(p);
+        acc.push_back(a);
+        base = a.Addr;
+    }
+}
+
+static INLINE u32 ReadBase(const TContext &prev, const TContext &ctx)
+{
+    return prev.ReadCount > 0 ? prev.Mr.Addr : ctx.ESP;
+}
+
+static INLINE u32 WriteBase(const TContext &prev, const TContext &ctx)
+{
+    return prev.WriteCount > 0 ? prev.Mw.Addr : ctx.ESP;
+}
+
+RunTrace::RunTrace(Protocol *engine) : m_engine(engine), m_reader(*this)
 {
     m_count = 0;
-    m_maxTraces = 100000;
-    m_traces = NULL;
     m_mergeCallJmp = true;
+    m_fp = NULL;
+    m_chunkCount = 0;
+    m_lastStart = 0;
+    m_merges = 0;
+    ZeroMemory(&m_last, sizeof(TContext));
+    ZeroMemory(&m_beforeLast, sizeof(TContext));
 }
 
 RunTrace::~RunTrace()
 {
-    SAFE_DELETE_ARRAY(m_traces);
+    if (m_fp) End();
 }
 
 void RunTrace::Trace( const Processor *cpu )
 {
-    m_engine->UpdateTContext(cpu, m_traces + m_count);
+    TContext ctx;
+    ZeroMemory(&ctx, sizeof(TContext));
+    m_engine->UpdateTContext(cpu, &ctx);
 
+    MutexCSLock lock(m_chunkLock);
     if (m_mergeCallJmp && m_count > 0 &&
-        Instruction::IsIndirectJump(m_traces[m_count].Inst) &&
-        Instruction::IsCall(m_traces[m_count-1].Inst)
-        ) 
+        Instruction::IsIndirectJump(ctx.Inst) &&
+        Instruction::IsCall(m_last.Inst)
+        )
     {
-        LxDebug("CALL-JMP ignored, [%08x] %s\n", 
-            m_traces[m_count].Eip, m_traces[m_count].Inst->Main.CompleteInstr);
-        m_traces[m_count-1].ExecFlag |= m_traces[m_count].ExecFlag; // merge exec flag
+        LxDebug("CALL-JMP ignored, [%08x] %s\n",
+            ctx.Eip, ctx.Inst->Main.CompleteInstr);
+        m_last.ExecFlag |= ctx.ExecFlag; // merge exec flag
+        m_chunk.resize(m_lastStart);
+        Encode(m_beforeLast, m_last);
+        InterlockedIncrement(&m_merges);
         return;
     }
 
+    Append(ctx);
     m_count++;
 }
 
-void RunTrace::Begin()
+void RunTrace::Append( const TContext &ctx )
+{
+    if (m_chunkCount == ChunkSize)
+        FlushChunk();
+
+    if (m_chunkCount == 0) {
+        ZeroMemory(&m_beforeLast, sizeof(TContext));    // every chunk starts from a zero record
+    } else {
+        m_beforeLast = m_last;
+        m_beforeLast.Reads = m_beforeLast.Writes = NULL;
+    }
+
+    // ctx's accesses belong to the debugger and change with the next instruction
+    m_last = ctx;
+    m_lastAccesses.assign(ctx.Reads, ctx.Reads + ctx.ReadCount);
+    m_lastAccesses.insert(m_lastAccesses.end(), ctx.Writes, ctx.Writes + ctx.WriteCount);
+    const MemAccess *acc = m_lastAccesses.empty() ? NULL : &m_lastAccesses[0];
+    m_last.Reads    = acc;
+    m_last.Writes   = acc ? acc + ctx.ReadCount : NULL;
+    m_lastStart = m_chunk.size();
+    Encode(m_beforeLast, m_last);
+    m_chunkCount++;
+}
+
+void RunTrace::Encode( const TContext &prev, const TContext &ctx )
+{
+    byte regMask = 0;
+    for (int i = 0; i < TContext::RegCount; i++) {
+        if (ctx.Regs[i] != prev.Regs[i]) regMask |= 1 << i;
+    }
+    byte flags = 0;
+    if (ctx.Eflags != prev.Eflags)          flags |= RecordEflags;
+    if (ctx.Tid != prev.Tid || ctx.ExtTid != prev.ExtTid)
+                                            flags |= RecordThread;
+    if (ctx.ExecFlag != prev.ExecFlag)      flags |= RecordExecFlag;
+    if (ctx.JumpTaken)                      flags |= RecordJumpTaken;
+    if (ctx.ReadCount + ctx.WriteCount > 0) flags |= RecordAccess;
+
+    m_chunk.push_back(regMask);
+    m_chunk.push_back(flags);
+    PutVarint(m_chunk, ZigZag(ctx.Eip - prev.Eip));
+    for (int i = 0; i < TContext::RegCount; i++) {
+        if (regMask & (1 << i)) PutVarint(m_chunk, ZigZag(ctx.Regs[i] - prev.Regs[i]));
+    }
+    if (flags & RecordEflags) PutVarint(m_chunk, ctx.Eflags);
+    if (flags & RecordThread) {
+        PutVarint(m_chunk, ctx.Tid);
+        PutVarint(m_chunk, ctx.ExtTid);
+    }
+    if (flags & RecordExecFlag) PutVarint(m_chunk, ctx.ExecFlag);
+    if (flags & RecordAccess) {
+        PutVarint(m_chunk, ctx.ReadCount);
+        PutVarint(m_chunk, ctx.WriteCount);
+        PutAccesses(m_chunk, ctx.Reads, ctx.ReadCount, ReadBase(prev, ctx));
+        PutAccesses(m_chunk, ctx.Writes, ctx.WriteCount, WriteBase(prev, ctx));
+    }
+}
+
+void RunTrace::FlushChunk()
+{
+    if (m_fp == NULL) {
+        char path[MAX_PATH], filename[MAX_PATH];
+        if (GetTempPathA(MAX_PATH, path) == 0 ||
+            GetTempFileNameA(path, "lxt", 0, filename) == 0) {
+            LxFatal("Error creating temp file for RunTracer\n");
+        }
+        m_filename = filename;
+        m_fp = fopen(filename, "w+b");
+        if (m_fp == NULL) {
+            LxFatal("Error opening trace file %s\n", filename);
+        }
+        LxInfo("RunTracer streaming to %s\n", filename);
+    }
+
+    ChunkEntry entry;
+    _fseeki64(m_fp, 0, SEEK_END);
+    entry.Offset    = _ftelli64(m_fp);
+    entry.Size      = m_chunk.size();
+    if (fwrite(&m_chunk[0], 1, m_chunk.size(), m_fp) != m_chunk.size()) {
+        LxFatal("Error writing trace file %s\n", m_filename.c_str());
+    }
+    m_index.push_back(entry);
+    m_chunk.clear();
+    m_chunkCount = 0;
+}
+
+int RunTrace::ReadChunk( int chunk, std::vector<byte> &data, bool *open, long *merges ) const
 {
-    LxInfo("Allocating %d traces for RunTracer, Memory used = %d KB\n", 
-        m_maxTraces, m_maxTraces * sizeof(TContext) / 1024);
-    Assert(m_traces == NULL);
-    m_traces = new TContext[m_maxTraces];
-    if (m_traces == NULL) {
-        LxFatal("Error allocating traces for RunTracer\n");
+    MutexCSLock lock(m_chunkLock);
+    Assert(chunk >= 0 && chunk <= (int) m_index.size());
+    if (open) *open = chunk == (int) m_index.size();
+    if (merges) *merges = m_merges;
+    if (chunk == (int) m_index.size()) {
+        data = m_chunk;
+        return m_chunkCount;
     }
-    ZeroMemory(m_traces, sizeof(TContext) * m_maxTraces);
+    const ChunkEntry &entry = m_index[chunk];
+    data.resize(entry.Size);
+    _fseeki64(m_fp, entry.Offset, SEEK_SET);
+    if (fread(&data[0], 1, entry.Size, m_fp) != entry.Size) {
+        LxFatal("Error reading trace file %s\n", m_filename.c_str());
+    }
+    return ChunkSize;
+}
+
+void RunTrace::DecodeChunk( const std::vector<byte> &data, int count, TContext *records,
+                            std::vector<MemAccess> &accesses ) const
+{
+    const Disassembler *disasm = m_engine->GetEngine()->GetDisassembler();
+
+    TContext prev;
+    ZeroMemory(&prev, sizeof(TContext));
+    accesses.clear();
+    cpbyte p = data.empty() ? NULL : &data[0];
+    for (int n = 0; n < count; n++) {
+        TContext &ctx = records[n];
+        ctx = prev;
+
+        byte regMask = *p++;
+        byte flags = *p++;
+        ctx.Eip = prev.Eip + UnZigZag(GetVarint(p));
+        for (int i = 0; i < TContext::RegCount; i++) {
+            if (regMask & (1 << i)) ctx.Regs[i] = prev.Regs[i] + UnZigZag(GetVarint(p));
+        }
+        if (flags & RecordEflags) ctx.Eflags = GetVarint(p);
+        if (flags & RecordThread) {
+            ctx.Tid     = GetVarint(p);
+            ctx.ExtTid  = GetVarint(p);
+        }
+        if (flags & RecordExecFlag) ctx.ExecFlag = GetVarint(p);
+        ctx.JumpTaken = (flags & RecordJumpTaken) != 0;
+        ctx.ReadCount = ctx.WriteCount = 0;
+        const size_t first = accesses.size();
+        if (flags & RecordAccess) {
+            ctx.ReadCount   = GetVarint(p);
+            ctx.WriteCount  = GetVarint(p);
+            GetAccesses(p, accesses, ctx.ReadCount, ReadBase(prev, ctx));
+            GetAccesses(p, accesses, ctx.WriteCount, WriteBase(prev, ctx));
+        }
+        ctx.Mr = ctx.ReadCount > 0 ? accesses[first] : MemAccess();
+        ctx.Mw = ctx.WriteCount > 0 ? accesses[first + ctx.ReadCount] : MemAccess();
+        disasm->UpdateTContext(&ctx, ctx.Eip);
+        prev = ctx;
+    }
+    Assert(p == (data.empty() ? NULL : &data[0] + data.size()));
+
+    // accesses may have moved while growing, so records point into them only now
+    const MemAccess *acc = accesses.empty() ? NULL : &accesses[0];
+    for (int n = 0; n < count; n++) {
+        records[n].Reads    = acc;
+        acc += records[n].ReadCount;
+        records[n].Writes   = acc;
+        acc += records[n].WriteCount;
+    }
+}
+
+const TContext * RunTrace::Get( int n ) const
+{
+    return m_reader.Get(n);
+}
+
+void RunTrace::Begin()
+{
+    Assert(m_fp == NULL && m_index.empty());
+    m_chunk.clear();
+    m_chunk.reserve(ChunkSize * 16);
+    m_chunkCount = 0;
     m_count = 0;
+    m_reader.Reset();
 }
 
 void RunTrace::End()
 {
-    Assert(m_traces != NULL);
-    SAFE_DELETE_ARRAY(m_traces);
+    if (m_fp) {
+        fclose(m_fp);
+        m_fp = NULL;
+        DeleteFileA(m_filename.c_str());
+    }
+    m_index.clear();
+    m_chunk.clear();
+    m_chunkCount = 0;
     m_count = 0;
 }
 
-void RunTrace::Serialize( Json::Value &root ) const 
+void RunTrace::Serialize( Json::Value &root ) const
 {
-    root["max_traces"] = m_maxTraces;
     root["merge_calljmp"] = m_mergeCallJmp;
 }
 
 void RunTrace::Deserialize( Json::Value &root )
 {
-    m_maxTraces = root.get("max_traces", m_maxTraces).asInt();
     m_mergeCallJmp = root.get("merge_calljmp", m_mergeCallJmp).asBool();
 }
 
 void RunTrace::Dump( File &f ) const
 {
     for (int i = 0; i < m_count; i++)
-        m_traces[i].Dump(f);
+        Get(i)->Dump(f);
 }
 
 void RunTrace::DumpMsg( Message *msg, File &f ) const
 {
     Assert(msg->GetTraceEnd() < m_count);
     for (int i = msg->GetTraceBegin(); i <= msg->GetTraceEnd(); i++)
-        m_traces[i].Dump(f);
+        Get(i)->Dump(f);
+}
+
+TraceReader::TraceReader( const RunTrace &trace ) : m_trace(trace)
+{
+    Reset();
+}
+
+void TraceReader::Reset()
+{
+    for (int i = 0; i < 2; i++) {
+        m_cache[i].Chunk = -1;
+        m_cache[i].Count = 0;
+        m_cache[i].Open  = false;
+        m_cache[i].Merges = 0;
+    }
+    m_recent = 0;
+}
+
+const TContext * TraceReader::Get( int n )
+{
+    Assert(n >= 0 && n < m_trace.Count());
+    int chunk = n / RunTrace::ChunkSize;
+    int index = n % RunTrace::ChunkSize;
+
+    for (int i = 0; i < 2; i++) {
+        // the open chunk may have grown or had its last record rewritten since it was cached
+        const CachedChunk &c = m_cache[i];
+        if (c.Chunk == chunk && index < c.Count && (!c.Open || c.Merges == m_trace.MergeCount())) {
+            m_recent = i;
+            return &m_cache[i].Records[index];
+        }
+    }
+
+    CachedChunk &c = m_cache[1 - m_recent];
+    c.Count = m_trace.ReadChunk(chunk, m_buffer, &c.Open, &c.Merges);
+    c.Chunk = chunk;
+    c.Records.resize(RunTrace::ChunkSize);
+    m_trace.DecodeChunk(m_buffer, c.Count, &c.Records[0], c.Accesses);
+    m_recent = 1 - m_recent;
+    Assert(index < c.Count);
+    return &c.Records[index];
 }
 
 void TContext::Dump( File &f ) const
 {
     fprintf(f.Ptr(), "%08x  %-40s \tEsp=%08x  EF=%x",
         Eip, Inst->Main.CompleteInstr, Regs[LX_REG_ESP], ExecFlag);
-    if (Mr.Addr) fprintf(f.Ptr(), "  R[%x:%d]%08x", Mr.Addr, Mr.Len, Mr.Val);
-    if (Mw.Addr) fprintf(f.Ptr(), "  W[%x:%d]%08x", Mw.Addr, Mw.Len, Mw.Val);
+    for (int i = 0; i < ReadCount; i++)
+        fprintf(f.Ptr(), "  R[%x:%d]%08x", Reads[i].Addr, Reads[i].Len, Reads[i].Val);
+    for (int i = 0; i < WriteCount; i++)
+        fprintf(f.Ptr(), "  W[%x:%d]%08x", Writes[i].Addr, Writes[i].Len, Writes[i].Val);
     if (JumpTaken) fprintf(f.Ptr(), "  JUMP");
     fprintf(f.Ptr(), "\n");
 }
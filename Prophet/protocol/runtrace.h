@@ -1,14 +1,55 @@
 #pragma once
- 
+
 #ifndef __PROPHET_TAINT_TTRACE_H__
 #define __PROPHET_TAINT_TTRACE_H__
- 
+
 #include "prophet.h"
 #include "parallel.h"
 #include "utilities.h"
 #include "tcontext.h"
 
+class RunTrace;
+
+/*
+ * Decodes records of a RunTrace on demand, keeping the last two chunks
+ * so that a record (and its accesses) stays valid while the one after it
+ * is fetched. A cached open chunk is read again once a CALL-JMP merge has
+ * rewritten its last record.
+ * Each replay should own its reader; RunTrace::Get uses a shared one.
+ */
+class TraceReader {
+public:
+    TraceReader(const RunTrace &trace);
+
+    const TContext *Get(int n);
+    void            Reset();
+
+private:
+    struct CachedChunk {
+        int                     Chunk;
+        int                     Count;
+        bool                    Open;       // still being filled when read
+        long                    Merges;     // RunTrace::MergeCount() when read
+        std::vector<TContext>   Records;
+        std::vector<MemAccess>  Accesses;   // what Records' Reads and Writes point to
+    };
+
+    const RunTrace &    m_trace;
+    CachedChunk         m_cache[2];
+    int                 m_recent;       // slot used last, the other one is evicted
+    std::vector<byte>   m_buffer;
+};
+
+/*
+ * Records are delta-encoded with varints against the previous record of
+ * the same chunk, so every chunk decodes on its own. Full chunks are
+ * streamed to a temporary file and m_index maps them to file offsets;
+ * only the chunk being filled is kept in memory.
+ */
 class RunTrace : public MutexSyncObject, public ISerializable {
+public:
+    static const int    ChunkSize   = 256;
+
 public:
     RunTrace(Protocol *engine);
     ~RunTrace();
@@ -17,21 +58,49 @@ public:
     void        Trace(const Processor *cpu);
     void        End();
     int         Count() const { return m_count; }
-    TContext *  Get(int n) { Assert(n >= 0 && n < m_count); return m_traces + n; }
-    const TContext * Get(int n) const { Assert(n >= 0 && n < m_count); return m_traces + n; }
+    const TContext * Get(int n) const;
+
+    /* copy the encoded chunk into data and return the number of records in it */
+    int         ReadChunk(int chunk, std::vector<byte> &data, bool *open = NULL, long *merges = NULL) const;
+    void        DecodeChunk(const std::vector<byte> &data, int count, TContext *records, 
+                            std::vector<MemAccess> &accesses) const;
+    /* bumped whenever a CALL-JMP merge rewrites the last record of the open chunk */
+    long        MergeCount() const { return m_merges; }
 
     void        Serialize(Json::Value &root) const override;
     void        Deserialize(Json::Value &root) override;
-    
+
     void        Dump(File &f) const;
     void        DumpMsg(Message *msg, File &f) const;
 
+private:
+    struct ChunkEntry {
+        i64     Offset;
+        u32     Size;
+    };
+
+    void        Append(const TContext &ctx);
+    void        Encode(const TContext &prev, const TContext &ctx);
+    void        FlushChunk();
+
 private:
     int         m_count;
-    int         m_maxTraces;
     Protocol *  m_engine;
-    TContext *  m_traces;
     bool        m_mergeCallJmp;
+
+    mutable MutexCS         m_chunkLock;
+    std::string             m_filename;
+    FILE *                  m_fp;
+    std::vector<ChunkEntry> m_index;
+    std::vector<byte>       m_chunk;        // chunk being filled
+    int                     m_chunkCount;   // records in m_chunk
+    TContext                m_last;         // last record, re-encoded when a CALL-JMP is merged
+    std::vector<MemAccess>  m_lastAccesses; // its reads then writes
+    TContext                m_beforeLast;   // record m_last is encoded against, only Mr and Mw of its accesses
+    volatile long           m_merges;
+    u32                     m_lastStart;    // offset of m_last in m_chunk
+
+    mutable TraceReader     m_reader;
 };
- 
-#endif // __PROPHET_TAINT_TTRACE_H__
\ No newline at end of file
+
+#endif // __PROPHET_TAINT_TTRACE_H__
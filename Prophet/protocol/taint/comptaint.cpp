@@ -2,118 +2,125 @@
 #include "comptaint.h"
 #include "utilities.h"
 
-MemoryTaint::MemoryTaint()
+TaintSetTable::TaintSetTable()
 {
-    //ZeroMemory(m_pagetable, sizeof(m_pagetable));
-    m_pagetable = new PageTaint *[Pages];
-    ZeroMemory(m_pagetable, sizeof(PageTaint *) * Pages);
+    m_sets.push_back(Taint());
 }
 
-MemoryTaint::~MemoryTaint()
+u32 TaintSetTable::Intern( const Taint &t )
 {
-    for (int i = 0; i < Pages; i++) {
-        SAFE_DELETE(m_pagetable[i]);
+    if (!t.IsAnyTainted()) return Untainted;
+
+    const u32 h = t.Hash();
+    auto range = m_index.equal_range(h);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (m_sets[iter->second] == t) return iter->second;
     }
-    SAFE_DELETE_ARRAY(m_pagetable);
+    const u32 id = (u32) m_sets.size();
+    m_sets.push_back(t);
+    m_index.insert(std::make_pair(h, id));
+    return id;
 }
 
-MemoryTaint::PageTaint * MemoryTaint::GetPage( u32 addr )
+u32 TaintSetTable::Union( u32 a, u32 b )
 {
-    const u32 pageNum = PAGE_NUM(addr);
-    if (m_pagetable[pageNum] == NULL) {
-        m_pagetable[pageNum] = new PageTaint;
-    }
-    return m_pagetable[pageNum];
+    if (a == Untainted || a == b) return b;
+    if (b == Untainted) return a;
+
+    const u64 key = a < b ? ((u64) a << 32) | b : ((u64) b << 32) | a;
+    auto iter = m_unions.find(key);
+    if (iter != m_unions.end()) return iter->second;
+
+    const u32 id = Intern(m_sets[a] | m_sets[b]);
+    m_unions[key] = id;
+    return id;
 }
 
-void MemoryTaint::Reset()
+MemoryTaint::MemoryTaint()
 {
-    for (int i = 0; i < Pages; i++) {
-        if (m_pagetable[i] != NULL)
-            m_pagetable[i]->Reset();
-    }
+    m_pagetable = new u32 *[Pages];
+    ZeroMemory(m_pagetable, sizeof(u32 *) * Pages);
+    m_sets.reset(new TaintSetTable);
 }
 
-MemoryTaint * MemoryTaint::Clone() const
+MemoryTaint::~MemoryTaint()
 {
-    MemoryTaint *t = new MemoryTaint;
-    for (int i = 0; i < Pages; i++) {
-        if (m_pagetable[i]) t->m_pagetable[i] = m_pagetable[i]->Clone();
-    }
-    return t;
+    FreePages();
+    SAFE_DELETE_ARRAY(m_pagetable);
 }
 
-void MemoryTaint::CopyFrom( const MemoryTaint *t )
+u32 * MemoryTaint::GetPage( u32 addr )
 {
-    for (int i = 0; i < Pages; i++) {
-        if (t->m_pagetable[i]) {
-            if (m_pagetable[i]) 
-                m_pagetable[i]->CopyFrom(t->m_pagetable[i]);
-            else
-                m_pagetable[i] = t->m_pagetable[i]->Clone();
-        } else {
-            SAFE_DELETE(m_pagetable[i]);
-        }
+    const u32 pageNum = PAGE_NUM(addr);
+    if (m_pagetable[pageNum] == NULL) {
+        m_pagetable[pageNum] = new u32[LX_PAGE_SIZE];
+        ZeroMemory(m_pagetable[pageNum], sizeof(u32) * LX_PAGE_SIZE);
+        m_usedPages.push_back(pageNum);
     }
+    return m_pagetable[pageNum];
 }
 
-
-Taint MemoryTaint::PageTaint::Get( u32 offset )
+u32 MemoryTaint::GetId( u32 addr ) const
 {
-    Assert(offset < LX_PAGE_SIZE);
-
-    if (m_data[offset] == NULL)
-        m_data[offset] = new Taint;
-
-    return *m_data[offset];
+    Assert((addr & 0x80000000) == 0);
+    const u32 *page = m_pagetable[PAGE_NUM(addr)];
+    return page ? page[PAGE_LOW(addr)] : TaintSetTable::Untainted;
 }
 
-void MemoryTaint::PageTaint::Set( u32 offset, const Taint &t )
+void MemoryTaint::FreePages()
 {
-    Assert(offset < LX_PAGE_SIZE);
+    for (auto pageNum : m_usedPages) {
+        SAFE_DELETE_ARRAY(m_pagetable[pageNum]);
+    }
+    m_usedPages.clear();
+}
 
-    if (m_data[offset] == 0)
-        m_data[offset] = new Taint(t);
-    else
-        *(m_data[offset]) = t;
+void MemoryTaint::Reset()
+{
+    // only the pages ever written are visited
+    FreePages();
+    m_sets.reset(new TaintSetTable);
 }
 
-void MemoryTaint::PageTaint::Reset()
+MemoryTaint * MemoryTaint::Clone() const
 {
-    for (int i = 0; i < LX_PAGE_SIZE; i++)
-        if (m_data[i]) SAFE_DELETE(m_data[i]);
+    MemoryTaint *t = new MemoryTaint;
+    t->CopyFrom(this);
+    return t;
 }
 
-MemoryTaint::PageTaint::PageTaint()
+void MemoryTaint::CopyFrom( const MemoryTaint *t )
 {
-    uint x = sizeof(m_data);
-    ZeroMemory(m_data, sizeof(m_data));
+    if (t == this) return;
+    FreePages();
+    for (auto pageNum : t->m_usedPages) {
+        m_pagetable[pageNum] = new u32[LX_PAGE_SIZE];
+        memcpy(m_pagetable[pageNum], t->m_pagetable[pageNum], sizeof(u32) * LX_PAGE_SIZE);
+    }
+    m_usedPages = t->m_usedPages;
+    m_sets = t->m_sets;
 }
 
-MemoryTaint::PageTaint::~PageTaint()
+Taint MemoryTaint::GetByte( u32 addr )
 {
-    Reset();
+    return m_sets->Lookup(GetId(addr));
 }
 
-MemoryTaint::PageTaint * MemoryTaint::PageTaint::Clone() const
+void MemoryTaint::SetByte( u32 addr, const Taint &t )
 {
-    PageTaint *t = new PageTaint;
-    for (int i = 0; i < LX_PAGE_SIZE; i++) {
-        if (m_data[i]) t->m_data[i] = new Taint(*m_data[i]);
-    }
-    return t;
+    Assert((addr & 0x80000000) == 0);
+    const u32 id = m_sets->Intern(t);
+    if (id == TaintSetTable::Untainted && m_pagetable[PAGE_NUM(addr)] == NULL) return;
+    GetPage(addr)[PAGE_LOW(addr)] = id;
 }
 
-void MemoryTaint::PageTaint::CopyFrom( const PageTaint *t )
+Taint MemoryTaint::GetUnion( u32 addr, int len )
 {
-    for (int i = 0; i < LX_PAGE_SIZE; i++) {
-        if (t->m_data[i]) {
-            if (m_data[i]) *(m_data[i]) = *(t->m_data[i]);
-            else m_data[i] = new Taint(*t->m_data[i]);
-        } else {
-            SAFE_DELETE(m_data[i]);
-        }
+    u32 id = TaintSetTable::Untainted;
+    for (int i = 0; i < len; i++) {
+        id = m_sets->Union(id, GetId(addr + i));
     }
+    return m_sets->Lookup(id);
 }
 
 void ProcessorTaint::Reset()
@@ -171,30 +178,14 @@ void ProcessorTaint::Dump( File &f ) const
 void MemoryTaint::Dump( File &f ) const
 {
     fprintf(f.Ptr(), "Memory Taint:\n");
-    for (u32 i = 0; i < LX_PAGE_COUNT/2; i++) {
-        if (m_pagetable[i]) {
-            m_pagetable[i]->Dump(f, i * LX_PAGE_SIZE);
+    std::vector<u32> pages = m_usedPages;
+    std::sort(pages.begin(), pages.end());
+    for (auto pageNum : pages) {
+        const u32 *page = m_pagetable[pageNum];
+        for (u32 i = 0; i < LX_PAGE_SIZE; i++) {
+            if (page[i] == TaintSetTable::Untainted) continue;
+            fprintf(f.Ptr(), "%08x: ", pageNum * LX_PAGE_SIZE + i);
+            m_sets->Lookup(page[i]).Dump(f);
         }
     }
 }
-
-Taint MemoryTaint::GetByte( u32 addr )
-{
-    return GetPage(addr)->Get(PAGE_LOW(addr));
-}
-
-void MemoryTaint::SetByte( u32 addr, const Taint &t )
-{
-    GetPage(addr)->Set(PAGE_LOW(addr), t);
-}
-
-
-void MemoryTaint::PageTaint::Dump( File &f, u32 base ) const
-{
-    for (u32 i = 0; i < LX_PAGE_SIZE; i++) {
-        if (!m_data[i]) continue;
-        if (!m_data[i]->IsAnyTainted()) continue;
-        fprintf(f.Ptr(), "%08x: ", base + i);
-        m_data[i]->Dump(f);
-    }
-}
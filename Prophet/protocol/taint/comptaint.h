@@ -20,25 +20,28 @@ struct ProcessorTaint {
     void        Dump(File &f) const;
 };
 
-class MemoryTaint {
-
-    struct PageTaint { 
-        Taint   Get(u32 offset);
-        void    Set(u32 offset, const Taint &t);
-        void    Reset();
-
-        PageTaint * Clone() const;
-        void        CopyFrom(const PageTaint *t);
-        void        Dump(File &f, u32 base) const;
+/*
+ * Hash-consed table of the distinct taint sets seen so far; memory taint
+ * stores an id into it per byte. Id 0 is always the empty set
+ */
+class TaintSetTable {
+public:
+    static const u32 Untainted = 0;
 
-        PageTaint();
-        ~PageTaint();
+    TaintSetTable();
 
-    private:
-        Taint *     m_data[LX_PAGE_SIZE];
-    };
+    u32             Intern(const Taint &t);
+    const Taint &   Lookup(u32 id) const { Assert(id < m_sets.size()); return m_sets[id]; }
+    u32             Union(u32 a, u32 b);
+    u32             Count() const { return (u32) m_sets.size(); }
 
+private:
+    std::deque<Taint>                   m_sets;     // deque keeps Lookup() references valid
+    std::unordered_multimap<u32, u32>   m_index;    // hash -> id
+    std::unordered_map<u64, u32>        m_unions;   // (smaller id, larger id) -> id
+};
 
+class MemoryTaint {
 public:
     MemoryTaint();
     ~MemoryTaint();
@@ -52,6 +55,9 @@ public:
     Taint       GetByte(u32 addr);
     void        SetByte(u32 addr, const Taint &t);
 
+    /* union of the taint of [addr, addr+len) */
+    Taint       GetUnion(u32 addr, int len);
+
     void        Reset();
 
     MemoryTaint *   Clone() const;
@@ -59,11 +65,15 @@ public:
 
     void            Dump(File &f) const;
 private:
-    PageTaint *  GetPage(u32 addr);
+    u32 *       GetPage(u32 addr);
+    u32         GetId(u32 addr) const;
+    void        FreePages();
 
 private:
     static const u32 Pages = LX_PAGE_COUNT/2;   // No address above 0x7fffffff
-    PageTaint ** m_pagetable;
+    u32 **      m_pagetable;                    // per-byte set ids, NULL if all untainted
+    std::vector<u32>    m_usedPages;
+    std::shared_ptr<TaintSetTable>  m_sets;     // shared with clones so ids stay valid
 };
 
 template <int N>
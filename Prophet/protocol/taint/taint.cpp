@@ -82,6 +82,17 @@ bool Taint::operator==(const Taint &rhs) const
     return true;
 }
 
+u32 Taint::Hash() const
+{
+    // FNV-1a over the words
+    u32 h = 2166136261u;
+    for (int i = 0; i < Count; i++) {
+        h ^= m_data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
 bool Taint::operator!=(const Taint &rhs) const
 {
     return !(*this == rhs);
@@ -101,6 +101,7 @@ public:
     Taint&      operator^=(const Taint &rhs);
     bool        operator==(const Taint &rhs) const;
     bool        operator!=(const Taint &rhs) const;
+    u32         Hash() const;
 
     std::vector<TaintRegion> GenerateRegions() const;
 
@@ -201,6 +201,14 @@ Taint1 TaintEngine::GetTestedFlagTaint( const TContext *ctx, const Instruction *
 
 Taint TaintEngine::GetTaintShrink( const TContext *ctx, const ARGTYPE &oper )
 {
+    if (IsMemoryArg(oper)) {
+        // same as shrinking TaintRule_Load(), without copying each byte's taint
+        Taint t = MemTaint.GetUnion(ctx->Mr.Addr, oper.ArgSize / 8);
+        if (TaintRuleEnabled(TAINT_LOADADDRREG)) {
+            t |= GetTaintAddressingReg(ctx, oper)[0];
+        }
+        return t;
+    }
     switch (oper.ArgSize) {
     case 32:
         return Shrink<4>(GetTaint<4>(ctx, oper))[0];
@@ -26,13 +26,17 @@ struct TContext {
 
     u32         Eip;
     u32         Eflags;
-    MemAccess   Mr;
-    MemAccess   Mw;
+    MemAccess   Mr;         // first read, same as Reads[0]
+    MemAccess   Mw;         // first write, same as Writes[0]
     InstPtr     Inst;
     int         Tid;
     ThreadID    ExtTid;
     bool        JumpTaken;
     u32         ExecFlag;
+    int         ReadCount;
+    int         WriteCount;
+    const MemAccess *   Reads;  // all accesses of the instruction, owned by
+    const MemAccess *   Writes; // whoever filled the record (debugger, TraceReader)
 
     u32         Flag(InstContext::Flag f) const {
         return (Eflags >> f) & 1;
@@ -284,6 +284,11 @@ void Disassembler::UpdateTContext( TContext *ctx, u32 eip ) const
     ctx->Inst = m_instMem.GetInst(eip);
 }
 
+void Disassembler::UpdateTraceRecord( TraceRecord *rec, u32 eip ) const
+{
+    rec->Inst = m_instMem.GetInst(eip);
+}
+
 InstPtr Disassembler::GetInst( u32 eip )
 {
     InstPtr pinst = m_instMem.GetInst(eip);
@@ -112,6 +112,7 @@ public:
     InstPtr     Disassemble(const Processor *cpu, u32 eip);
     void        UpdateInstContext(InstContext *ctx, u32 eip) const;
     void        UpdateTContext(TContext *ctx, u32 eip) const;
+    void        UpdateTraceRecord(TraceRecord *rec, u32 eip) const;
     InstPtr     GetInst(u32 eip);
     InstPtr     GetInst(const Processor *cpu, u32 eip);
     const InstSection * GetInstSection(u32 addr);
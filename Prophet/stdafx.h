@@ -12,6 +12,7 @@
 #include <Windows.h>
 #include <vector>
 #include <stack>
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
@@ -21,6 +21,7 @@
 #include <Tlhelp32.h>
 #include <stack>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <string>
 #include <sstream>